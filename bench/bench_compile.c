@@ -0,0 +1,326 @@
+// bench_compile.c
+// End-to-end compiler benchmark: generates a program of each requested size
+// with gen_hiasm, compiles it with hiasc a few times and reports the best
+// wall time, lines/sec, tokens/sec and peak RSS, then the time of each phase
+// and codegen pass from one --trace run. Results go to stdout as a table and
+// to --output as one JSON object per size, for comparing builds.
+//
+// Usage: bench_compile [--seed=N] [--shape=name] [--runs=N] [--flags="hiasc flags"]
+//                      [--output=results.jsonl] hiasc gen_hiasm lines...
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "arena.h"
+#include "intern.h"
+#include "lexer.h"
+
+#define MAX_ARGS 64
+#define MAX_SPANS 32
+
+// One run of a child process
+typedef struct {
+    int status;             // Wait status
+    double wall;            // Seconds
+    double cpu;             // User and system seconds
+    long max_rss;           // Kilobytes
+} RunResult;
+
+// A phase or pass from the trace, summed over workers
+typedef struct {
+    char name[32];
+    char category[16];
+    double wall;            // Milliseconds
+    double cpu;
+} Span;
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Helper function to run a program with stdout sent to 'stdout_path' (or
+// /dev/null) and stderr discarded, measuring it with wait4()
+static RunResult run(char** argv, const char* stdout_path) {
+    RunResult result = {-1, 0, 0, 0};
+    double start = now_seconds();
+    pid_t pid = fork();
+    if (pid < 0) {
+        fprintf(stderr, "Error: Cannot fork: %s\n", strerror(errno));
+        exit(1);
+    }
+    if (pid == 0) {
+        int out = open(stdout_path ? stdout_path : "/dev/null", O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        int null = open("/dev/null", O_WRONLY);
+        if (out < 0 || null < 0) _exit(127);
+        dup2(out, STDOUT_FILENO);
+        dup2(null, STDERR_FILENO);
+        execv(argv[0], argv);
+        _exit(127);
+    }
+    struct rusage usage;
+    while (wait4(pid, &result.status, 0, &usage) < 0) {
+        if (errno != EINTR) {
+            fprintf(stderr, "Error: Cannot wait for %s\n", argv[0]);
+            exit(1);
+        }
+    }
+    result.wall = now_seconds() - start;
+    result.cpu = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec * 1e-6 +
+                 usage.ru_stime.tv_sec + usage.ru_stime.tv_usec * 1e-6;
+    result.max_rss = usage.ru_maxrss;
+    return result;
+}
+
+static int succeeded(const RunResult* result) {
+    return WIFEXITED(result->status) && WEXITSTATUS(result->status) == 0;
+}
+
+// Helper function to describe how a run failed
+static void describe_failure(const RunResult* result, char* text, size_t size) {
+    if (WIFSIGNALED(result->status)) snprintf(text, size, "killed by signal %d", WTERMSIG(result->status));
+    else snprintf(text, size, "exit status %d", WEXITSTATUS(result->status));
+}
+
+static char* load_file(const char* path, size_t* length) {
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        fprintf(stderr, "Error: Cannot open %s\n", path);
+        exit(1);
+    }
+    struct stat st;
+    fstat(fileno(file), &st);
+    char* data = malloc(st.st_size + 1);
+    if (!data) {
+        fprintf(stderr, "Error: Out of memory\n");
+        exit(1);
+    }
+    *length = fread(data, 1, st.st_size, file);
+    data[*length] = '\0';
+    fclose(file);
+    return data;
+}
+
+// Lines and tokens of the generated program, counted with the compiler's own lexer
+static void count_input(const char* path, size_t* bytes, long* lines, long* tokens) {
+    char* source = load_file(path, bytes);
+    *lines = 0;
+    for (size_t i = 0; i < *bytes; i++) *lines += source[i] == '\n';
+
+    Arena arena;
+    InternTable names;
+    TokenStream stream;
+    arena_init(&arena, ARENA_BLOCK_SIZE);
+    intern_init(&names, &arena);
+    tokenize(&stream, source, *bytes, &names);
+    *tokens = stream.count - 1;     // Not the end marker
+    token_stream_free(&stream);
+    intern_free(&names);
+    arena_free(&arena);
+    free(source);
+}
+
+// Sum the phase and pass events of a trace by name; each event is on a line
+// of its own
+static int read_spans(const char* path, Span* spans) {
+    FILE* file = fopen(path, "r");
+    if (!file) return 0;
+    int num_spans = 0;
+    char line[1024];
+    while (fgets(line, sizeof(line), file)) {
+        char name[32], category[16];
+        double start, dur, cpu;
+        if (sscanf(line, "{\"name\": \"%31[^\"]\", \"cat\": \"%15[^\"]\", \"ph\": \"X\", \"ts\": %lf, "
+                   "\"dur\": %lf, \"pid\": 1, \"tid\": %*d, \"args\": {\"cpu_us\": %lf",
+                   name, category, &start, &dur, &cpu) != 5 ||
+            strcmp(category, "function") == 0) {
+            continue;
+        }
+        int s = 0;
+        while (s < num_spans && strcmp(spans[s].name, name) != 0) s++;
+        if (s == MAX_SPANS) continue;
+        if (s == num_spans) {
+            memset(&spans[s], 0, sizeof(Span));
+            strcpy(spans[s].name, name);
+            strcpy(spans[s].category, category);
+            num_spans++;
+        }
+        spans[s].wall += dur / 1e3;
+        spans[s].cpu += cpu / 1e3;
+    }
+    fclose(file);
+    return num_spans;
+}
+
+// Helper function to build hiasc's argument list: flags, input, output and extras
+static void compile_args(char** argv, int* argc, char* hiasc, char** flags, int num_flags,
+                         char* input, char* output, char* extra) {
+    *argc = 0;
+    argv[(*argc)++] = hiasc;
+    for (int i = 0; i < num_flags; i++) argv[(*argc)++] = flags[i];
+    if (extra) argv[(*argc)++] = extra;
+    argv[(*argc)++] = input;
+    argv[(*argc)++] = "-o";
+    argv[(*argc)++] = output;
+    argv[*argc] = NULL;
+}
+
+// Helper function to read a numeric option; exits on a bad value
+static long long number_option(const char* arg, const char* value, long long min) {
+    char* end;
+    long long n = strtoll(value, &end, 10);
+    if (*value == '\0' || *end != '\0' || n < min) {
+        fprintf(stderr, "Error: Bad value in %s\n", arg);
+        exit(1);
+    }
+    return n;
+}
+
+int main(int argc, char** argv) {
+    long long seed = 1;
+    const char* shape = "mixed";
+    int runs = 3;
+    const char* flags_arg = "";
+    const char* output_path = NULL;
+    char* programs[2];
+    int num_programs = 0;
+    long long sizes[MAX_ARGS];
+    int num_sizes = 0;
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        if (strncmp(arg, "--seed=", 7) == 0) {
+            seed = number_option(arg, arg + 7, 0);
+        } else if (strncmp(arg, "--shape=", 8) == 0) {
+            shape = arg + 8;
+        } else if (strncmp(arg, "--runs=", 7) == 0) {
+            runs = (int)number_option(arg, arg + 7, 1);
+        } else if (strncmp(arg, "--flags=", 8) == 0) {
+            flags_arg = arg + 8;
+        } else if (strncmp(arg, "--output=", 9) == 0) {
+            output_path = arg + 9;
+        } else if (num_programs < 2) {
+            programs[num_programs++] = argv[i];
+        } else if (num_sizes < MAX_ARGS) {
+            sizes[num_sizes++] = number_option(arg, arg, 1);
+        }
+    }
+    if (num_programs < 2 || num_sizes == 0) {
+        fprintf(stderr, "Usage: bench_compile [--seed=N] [--shape=name] [--runs=N] [--flags=\"hiasc flags\"] "
+                        "[--output=results.jsonl] hiasc gen_hiasm lines...\n");
+        return 1;
+    }
+    char* flags_text = strdup(flags_arg);
+    char* flags[MAX_ARGS];
+    int num_flags = 0;
+    for (char* flag = strtok(flags_text, " "); flag && num_flags < MAX_ARGS - 8; flag = strtok(NULL, " ")) {
+        flags[num_flags++] = flag;
+    }
+
+    FILE* output = output_path ? fopen(output_path, "w") : NULL;
+    if (output_path && !output) {
+        fprintf(stderr, "Error: Cannot write %s\n", output_path);
+        return 1;
+    }
+    char dir[] = "/tmp/bench_compile.XXXXXX";
+    if (!mkdtemp(dir)) {
+        fprintf(stderr, "Error: Cannot create a temporary directory\n");
+        return 1;
+    }
+    char input[64], compiled[64], trace[64], trace_flag[80];
+    snprintf(input, sizeof(input), "%s/input.hiasm", dir);
+    snprintf(compiled, sizeof(compiled), "%s/output", dir);
+    snprintf(trace, sizeof(trace), "%s/trace.json", dir);
+    snprintf(trace_flag, sizeof(trace_flag), "--trace=%s", trace);
+
+    printf("%10s %10s %10s %10s %14s %14s %10s\n",
+           "lines", "tokens", "bytes", "ms", "lines/sec", "tokens/sec", "peak KB");
+    int failed = 0;
+    for (int s = 0; s < num_sizes; s++) {
+        // Generate the program
+        char seed_arg[32], lines_arg[32], shape_arg[64];
+        snprintf(seed_arg, sizeof(seed_arg), "--seed=%lld", seed);
+        snprintf(lines_arg, sizeof(lines_arg), "--lines=%lld", sizes[s]);
+        snprintf(shape_arg, sizeof(shape_arg), "--shape=%s", shape);
+        char* gen_argv[] = {programs[1], seed_arg, lines_arg, shape_arg, NULL};
+        RunResult generated = run(gen_argv, input);
+        if (!succeeded(&generated)) {
+            fprintf(stderr, "Error: %s failed\n", programs[1]);
+            return 1;
+        }
+        size_t bytes;
+        long lines, tokens;
+        count_input(input, &bytes, &lines, &tokens);
+
+        // End to end: the best wall time of the runs, the largest RSS
+        char* hiasc_argv[MAX_ARGS];
+        int hiasc_argc;
+        compile_args(hiasc_argv, &hiasc_argc, programs[0], flags, num_flags, input, compiled, NULL);
+        RunResult best = {0, 1e30, 0, 0};
+        long max_rss = 0;
+        char failure[64] = "";
+        for (int r = 0; r < runs && !failure[0]; r++) {
+            RunResult result = run(hiasc_argv, NULL);
+            if (!succeeded(&result)) describe_failure(&result, failure, sizeof(failure));
+            if (result.wall < best.wall) best = result;
+            if (result.max_rss > max_rss) max_rss = result.max_rss;
+        }
+
+        // Phases and passes from one traced run
+        Span spans[MAX_SPANS];
+        int num_spans = 0;
+        if (!failure[0]) {
+            compile_args(hiasc_argv, &hiasc_argc, programs[0], flags, num_flags, input, compiled, trace_flag);
+            RunResult traced = run(hiasc_argv, NULL);
+            if (succeeded(&traced)) num_spans = read_spans(trace, spans);
+        }
+
+        if (failure[0]) {
+            failed = 1;
+            printf("%10ld %10ld %10zu  hiasc failed: %s\n", lines, tokens, bytes, failure);
+        } else {
+            printf("%10ld %10ld %10zu %10.1f %14.0f %14.0f %10ld\n", lines, tokens, bytes, best.wall * 1e3,
+                   lines / best.wall, tokens / best.wall, max_rss);
+            for (int i = 0; i < num_spans; i++) {
+                printf("%10s %-10s %8.1f ms %14.0f lines/sec\n", "", spans[i].name, spans[i].wall,
+                       spans[i].wall > 0 ? lines / (spans[i].wall / 1e3) : 0.0);
+            }
+        }
+        fflush(stdout);
+        if (!output) continue;
+
+        fprintf(output, "{\"benchmark\": \"compile\", \"seed\": %lld, \"shape\": \"%s\", \"flags\": \"%s\", "
+                "\"lines\": %ld, \"tokens\": %ld, \"bytes\": %zu, ", seed, shape, flags_arg,
+                lines, tokens, bytes);
+        if (failure[0]) {
+            fprintf(output, "\"status\": \"failed\", \"error\": \"%s\"}\n", failure);
+            continue;
+        }
+        fprintf(output, "\"status\": \"ok\", \"runs\": %d, \"wall_ms\": %.3f, \"cpu_ms\": %.3f, "
+                "\"lines_per_sec\": %.0f, \"tokens_per_sec\": %.0f, \"peak_rss_kb\": %ld, \"phases\": {",
+                runs, best.wall * 1e3, best.cpu * 1e3, lines / best.wall, tokens / best.wall, max_rss);
+        for (int i = 0; i < num_spans; i++) {
+            fprintf(output, "%s\"%s\": {\"kind\": \"%s\", \"wall_ms\": %.3f, \"cpu_ms\": %.3f, "
+                    "\"lines_per_sec\": %.0f, \"tokens_per_sec\": %.0f}", i > 0 ? ", " : "", spans[i].name,
+                    spans[i].category, spans[i].wall, spans[i].cpu,
+                    spans[i].wall > 0 ? lines / (spans[i].wall / 1e3) : 0.0,
+                    spans[i].wall > 0 ? tokens / (spans[i].wall / 1e3) : 0.0);
+        }
+        fprintf(output, "}}\n");
+        fflush(output);
+    }
+
+    unlink(input);
+    unlink(compiled);
+    unlink(trace);
+    rmdir(dir);
+    if (output) fclose(output);
+    free(flags_text);
+    return failed;
+}
@@ -0,0 +1,234 @@
+// bench_lexer.c
+// Lexer microbenchmark: compares tokenize() with each available bulk scanner
+// (scalar, SSE2, AVX2) against the previous strcmp-chain and <ctype.h> scanner
+// on the same input, checks they agree token for token, and reports tokens/sec.
+//
+// Usage: bench_lexer [input.hiasm]   (a synthetic corpus is used without input)
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include "arena.h"
+#include "intern.h"
+#include "lexer.h"
+
+#define CORPUS_BYTES (8 * 1024 * 1024)
+#define RUNS 5
+
+static const char* snippet =
+    "// Fold a seed into a running checksum\n"
+    "func int compute_checksum(int seed, byte mask) {\n"
+    "    reg int total = seed;      // Accumulator lives in a register\n"
+    "    ptr buffer = alloc(64);\n"
+    "    while (total) {\n"
+    "        total = total - mask * 3 + seed / 7;\n"
+    "        counter_value = counter_value + 1;\n"
+    "    }\n"
+    "    if (total) { return total; } else { return 0; }\n"
+    "}\n\n";
+
+// --- Reference implementation (keyword strcmp chain, locale-aware ctype) ---
+
+static TokenType reference_keyword(const char* start, int length) {
+    static const struct { const char* name; TokenType type; } words[] = {
+        {"reg", TOKEN_REG}, {"func", TOKEN_FUNC}, {"int", TOKEN_INT},
+        {"byte", TOKEN_BYTE}, {"ptr", TOKEN_PTR}, {"void", TOKEN_VOID},
+        {"if", TOKEN_IF}, {"else", TOKEN_ELSE}, {"while", TOKEN_WHILE},
+        {"for", TOKEN_FOR}, {"return", TOKEN_RETURN}, {"asm", TOKEN_ASM},
+        {"at", TOKEN_AT}, {"cdecl", TOKEN_CDECL}, {"fastcall", TOKEN_FASTCALL},
+    };
+    char word[64];
+    if (length >= (int)sizeof(word)) return TOKEN_IDENT;
+    memcpy(word, start, length);
+    word[length] = '\0';
+    for (size_t i = 0; i < sizeof(words) / sizeof(words[0]); i++) {
+        if (strcmp(word, words[i].name) == 0) return words[i].type;
+    }
+    return TOKEN_IDENT;
+}
+
+static void reference_push(TokenStream* stream, Token token) {
+    if (stream->count == stream->capacity) {
+        stream->capacity *= 2;
+        stream->tokens = realloc(stream->tokens, stream->capacity * sizeof(Token));
+    }
+    stream->tokens[stream->count++] = token;
+}
+
+static int reference_tokenize(TokenStream* stream, const char* input, size_t length,
+                              InternTable* names) {
+    stream->capacity = length / 4 + 64;
+    stream->tokens = malloc(stream->capacity * sizeof(Token));
+    stream->count = 0;
+    stream->source = input;
+    stream->names = names;
+
+    int line = 1;
+    const char* line_start = input;
+    const char* src = input;
+    const char* end = input + length;
+
+    while (src < end) {
+        if (*src == '\n') {
+            line++;
+            line_start = src + 1;
+        }
+        if (isspace(*src)) {
+            src++;
+            continue;
+        }
+        if (*src == '/' && src + 1 < end && src[1] == '/') {
+            while (src < end && *src != '\n') src++;
+            continue;
+        }
+        const char* start = src;
+        Token token = {TOKEN_EOF, start - input, 0, line, start - line_start + 1, -1};
+        if (isalpha(*src) || *src == '_') {
+            while (src < end && (isalnum(*src) || *src == '_')) src++;
+            token.length = src - start;
+            token.type = reference_keyword(start, token.length);
+            if (token.type == TOKEN_IDENT) token.id = intern(names, start, token.length);
+        } else if (isdigit(*src)) {
+            while (src < end && (isalnum(*src) || *src == '_')) src++;
+            token.type = TOKEN_NUMBER;
+            token.length = src - start;
+        } else {
+            // Only positions are compared, so every operator is one kind
+            token.type = TOKEN_SEMICOLON;
+            token.length = src + 1 < end && src[1] == '=' && strchr("<>=!+-*", *src) ? 2 : 1;
+            src += token.length;
+        }
+        reference_push(stream, token);
+    }
+    reference_push(stream, (Token){TOKEN_EOF, length, 0, line, end - line_start + 1, -1});
+    return 0;
+}
+
+// --- Harness ---
+
+typedef int (*TokenizeFn)(TokenStream*, const char*, size_t, InternTable*);
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Best-of-RUNS time for one implementation; keeps the last token stream
+static void run(TokenizeFn fn, const char* input, size_t length, double* best,
+                TokenStream* result, Arena* result_arena, InternTable* result_names) {
+    *best = 1e30;
+    for (int i = 0; i < RUNS; i++) {
+        Arena arena;
+        InternTable names;
+        TokenStream stream;
+        arena_init(&arena, ARENA_BLOCK_SIZE);
+        intern_init(&names, &arena);
+
+        double start = now_seconds();
+        fn(&stream, input, length, &names);
+        double elapsed = now_seconds() - start;
+
+        if (elapsed < *best) *best = elapsed;
+        if (i < RUNS - 1) {
+            token_stream_free(&stream);
+            intern_free(&names);
+            arena_free(&arena);
+        } else {
+            *result = stream;
+            *result_arena = arena;
+            *result_names = names;
+        }
+    }
+}
+
+// Token positions must agree exactly, which also checks line counting
+static int same_tokens(TokenStream* a, TokenStream* b) {
+    if (a->count != b->count) return 0;
+    for (int i = 0; i < a->count; i++) {
+        Token* x = &a->tokens[i];
+        Token* y = &b->tokens[i];
+        if (x->offset != y->offset || x->length != y->length ||
+            x->line != y->line || x->column != y->column) {
+            fprintf(stderr, "token %d differs: %d:%d vs %d:%d\n",
+                    i, x->line, x->column, y->line, y->column);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static char* load_input(const char* path, size_t* length) {
+    if (path) {
+        FILE* file = fopen(path, "rb");
+        if (!file) {
+            fprintf(stderr, "Cannot open %s\n", path);
+            exit(1);
+        }
+        fseek(file, 0, SEEK_END);
+        *length = ftell(file);
+        rewind(file);
+        char* data = malloc(*length + 1);
+        *length = fread(data, 1, *length, file);
+        fclose(file);
+        return data;
+    }
+
+    size_t snippet_length = strlen(snippet);
+    size_t copies = CORPUS_BYTES / snippet_length;
+    char* data = malloc(copies * snippet_length + 1);
+    for (size_t i = 0; i < copies; i++) {
+        memcpy(data + i * snippet_length, snippet, snippet_length);
+    }
+    *length = copies * snippet_length;
+    return data;
+}
+
+int main(int argc, char** argv) {
+    size_t length;
+    char* input = load_input(argc > 1 ? argv[1] : NULL, &length);
+
+    double reference_time;
+    TokenStream reference;
+    Arena reference_arena;
+    InternTable reference_names;
+    run(reference_tokenize, input, length, &reference_time,
+        &reference, &reference_arena, &reference_names);
+
+    printf("input: %zu bytes, %d tokens\n", length, reference.count);
+    printf("%-16s %10s %14s %10s %8s\n", "lexer", "ms", "tokens/sec", "MB/sec", "speedup");
+    printf("%-16s %10.2f %14.0f %10.1f %7.2fx\n", "reference", reference_time * 1e3,
+           reference.count / reference_time, length / reference_time / 1e6, 1.0);
+
+    const char* scanners[] = {"scalar", "sse2", "avx2"};
+    for (int i = 0; i < 3; i++) {
+        const Scanner* scanner = scanner_by_name(scanners[i]);
+        if (!scanner) continue;
+        lexer_set_scanner(scanner);
+
+        double time;
+        TokenStream stream;
+        Arena arena;
+        InternTable names;
+        run(tokenize, input, length, &time, &stream, &arena, &names);
+        if (!same_tokens(&reference, &stream)) {
+            fprintf(stderr, "tokenize/%s disagrees with the reference lexer\n", scanners[i]);
+            return 1;
+        }
+
+        char label[32];
+        snprintf(label, sizeof(label), "tokenize/%s", scanners[i]);
+        printf("%-16s %10.2f %14.0f %10.1f %7.2fx\n", label, time * 1e3,
+               stream.count / time, length / time / 1e6, reference_time / time);
+        token_stream_free(&stream);
+        intern_free(&names);
+        arena_free(&arena);
+    }
+
+    token_stream_free(&reference);
+    intern_free(&reference_names);
+    arena_free(&reference_arena);
+    free(input);
+    return 0;
+}
@@ -0,0 +1,141 @@
+// bench_symtab.c
+// Symbol table stress benchmark: declares 100k globals, then opens and closes
+// a function scope per 100 locals while resolving a mix of local and global
+// names. The same workload on the previous linked-list table (one list,
+// strcmp per probe) is timed on a reduced lookup count and scaled.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "arena.h"
+#include "intern.h"
+#include "symbol_table.h"
+
+#define NUM_GLOBALS 100000
+#define NUM_FUNCTIONS 1000
+#define LOCALS_PER_FUNCTION 100
+#define LOOKUPS_PER_FUNCTION 1000
+#define REFERENCE_FUNCTIONS 10
+
+// --- Reference implementation: singly linked list searched with strcmp ---
+
+typedef struct ListSymbol {
+    char* name;
+    struct ListSymbol* next;
+} ListSymbol;
+
+static ListSymbol* list_add(ListSymbol* head, char* name, Arena* arena) {
+    ListSymbol* sym = arena_alloc(arena, sizeof(ListSymbol));
+    sym->name = name;
+    sym->next = head;
+    return sym;
+}
+
+static ListSymbol* list_find(ListSymbol* head, const char* name) {
+    for (ListSymbol* sym = head; sym; sym = sym->next) {
+        if (strcmp(sym->name, name) == 0) return sym;
+    }
+    return NULL;
+}
+
+// --- Harness ---
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(void) {
+    Arena arena;
+    InternTable names;
+    arena_init(&arena, ARENA_BLOCK_SIZE);
+    intern_init(&names, &arena);
+
+    // Global names g0..g99999 and local names l0..l99 (reused by every function)
+    int* global_ids = malloc(NUM_GLOBALS * sizeof(int));
+    int local_ids[LOCALS_PER_FUNCTION];
+    char buffer[32];
+    for (int i = 0; i < NUM_GLOBALS; i++) {
+        int length = snprintf(buffer, sizeof(buffer), "g%d", i);
+        global_ids[i] = intern(&names, buffer, length);
+    }
+    for (int i = 0; i < LOCALS_PER_FUNCTION; i++) {
+        int length = snprintf(buffer, sizeof(buffer), "l%d", i);
+        local_ids[i] = intern(&names, buffer, length);
+    }
+
+    // Pseudo-random probe sequence shared by both implementations
+    int num_probes = NUM_FUNCTIONS * LOOKUPS_PER_FUNCTION;
+    int* probes = malloc(num_probes * sizeof(int));
+    unsigned int seed = 12345;
+    for (int i = 0; i < num_probes; i++) {
+        seed = seed * 1103515245u + 12345u;
+        int index = (seed >> 8) % (NUM_GLOBALS + LOCALS_PER_FUNCTION);
+        probes[i] = index < NUM_GLOBALS ? global_ids[index] : local_ids[index - NUM_GLOBALS];
+    }
+
+    // Scoped hash table
+    SymbolTable table;
+    symtab_init(&table, &arena);
+    double start = now_seconds();
+    for (int i = 0; i < NUM_GLOBALS; i++) {
+        symtab_add(&table, (char*)intern_name(&names, global_ids[i]), global_ids[i]);
+    }
+    double declared = now_seconds();
+
+    long found = 0;
+    for (int f = 0; f < NUM_FUNCTIONS; f++) {
+        symtab_push_scope(&table);
+        for (int i = 0; i < LOCALS_PER_FUNCTION; i++) {
+            symtab_add(&table, (char*)intern_name(&names, local_ids[i]), local_ids[i]);
+        }
+        int* batch = probes + f * LOOKUPS_PER_FUNCTION;
+        for (int i = 0; i < LOOKUPS_PER_FUNCTION; i++) {
+            if (symtab_find(&table, batch[i])) found++;
+        }
+        symtab_pop_scope(&table);
+    }
+    double finished = now_seconds();
+    symtab_free(&table);
+
+    if (found != num_probes) {
+        fprintf(stderr, "symbol table lost symbols: %ld of %d found\n", found, num_probes);
+        return 1;
+    }
+
+    // Linked list, scopes emulated by truncating the list on function exit
+    ListSymbol* list = NULL;
+    for (int i = 0; i < NUM_GLOBALS; i++) {
+        list = list_add(list, (char*)intern_name(&names, global_ids[i]), &arena);
+    }
+    double list_start = now_seconds();
+    long list_found = 0;
+    for (int f = 0; f < REFERENCE_FUNCTIONS; f++) {
+        ListSymbol* globals = list;
+        for (int i = 0; i < LOCALS_PER_FUNCTION; i++) {
+            list = list_add(list, (char*)intern_name(&names, local_ids[i]), &arena);
+        }
+        int* batch = probes + f * LOOKUPS_PER_FUNCTION;
+        for (int i = 0; i < LOOKUPS_PER_FUNCTION; i++) {
+            if (list_find(list, intern_name(&names, batch[i]))) list_found++;
+        }
+        list = globals;
+    }
+    double list_finished = now_seconds();
+
+    double lookup_ns = (finished - declared) * 1e9 / num_probes;
+    double list_ns = (list_finished - list_start) * 1e9 / (REFERENCE_FUNCTIONS * LOOKUPS_PER_FUNCTION);
+    printf("symbols: %d globals, %d scopes x %d locals, %d lookups\n",
+           NUM_GLOBALS, NUM_FUNCTIONS, LOCALS_PER_FUNCTION, num_probes);
+    printf("%-12s %14s %14s\n", "table", "declare ns", "lookup ns");
+    printf("%-12s %14.1f %14.1f\n", "hash", (declared - start) * 1e9 / NUM_GLOBALS, lookup_ns);
+    printf("%-12s %14s %14.1f\n", "linked list", "-", list_ns);
+    printf("speedup: %.0fx per lookup\n", list_ns / lookup_ns);
+
+    free(probes);
+    free(global_ids);
+    intern_free(&names);
+    arena_free(&arena);
+    return list_found == REFERENCE_FUNCTIONS * LOOKUPS_PER_FUNCTION ? 0 : 1;
+}
@@ -0,0 +1,256 @@
+// bench_writer.c
+// Assembly output benchmark: formats a few million generated instructions,
+// split into functions like codegen splits them, and writes them to a file.
+// The buffered writer (insn_list_format into one buffer per function, then
+// text_write) is timed against the previous path: fprintf per operand into
+// a memory stream per function, copied to the output with fwrite. Both must
+// produce the same bytes.
+//
+// Usage: bench_writer [instructions]
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "insn.h"
+#include "writer.h"
+
+#define DEFAULT_INSNS 2000000
+#define INSNS_PER_FUNCTION 200
+#define NUM_NAMES 512
+#define RUNS 3
+
+// --- Reference implementation: the fprintf printer codegen used before ---
+
+static const char* ref_regs[] = {"eax", "ebx", "ecx", "edx", "esi", "edi", "esp", "ebp"};
+static const char* ref_regs8[] = {"al", "bl", "cl", "dl"};
+
+static void ref_operand(FILE* output, const Operand* operand) {
+    switch (operand->kind) {
+        case OPND_REG:
+            fputs(operand->size == 1 ? ref_regs8[operand->reg] : ref_regs[operand->reg], output);
+            break;
+        case OPND_IMM:
+            fprintf(output, "%d", operand->value);
+            break;
+        case OPND_MEM:
+            if (operand->size == 1) fputs("byte ", output);
+            else if (operand->size == 4) fputs("dword ", output);
+            if (operand->reg >= 0 || operand->name) {
+                fprintf(output, "[%s", operand->name ? operand->name : ref_regs[operand->reg]);
+                if (operand->scale) fprintf(output, " + %s*%d", ref_regs[operand->index], operand->scale);
+                if (operand->value > 0) fprintf(output, " + %d", operand->value);
+                else if (operand->value < 0) fprintf(output, " - %d", -operand->value);
+                fputc(']', output);
+            } else {
+                fprintf(output, "[0x%X]", (unsigned int)operand->value);
+            }
+            break;
+        case OPND_LABEL:
+            if (operand->name) fputs(operand->name, output);
+            else fprintf(output, ".L%d", operand->value);
+            break;
+        default:
+            break;
+    }
+}
+
+static void ref_print(FILE* output, const Insn* insn) {
+    switch (insn->op) {
+        case OP_NOP:
+            return;
+        case OP_LABEL:
+            ref_operand(output, &insn->dst);
+            fputs(":\n", output);
+            return;
+        case OP_ASM:
+            fprintf(output, "%s\n", insn->dst.name);
+            return;
+        default:
+            break;
+    }
+    fprintf(output, "  %s", insn_mnemonic(insn->op));
+    if (insn->dst.kind != OPND_NONE) {
+        fputc(' ', output);
+        ref_operand(output, &insn->dst);
+    }
+    if (insn->op == OP_IMUL && insn->src.kind == OPND_IMM) {
+        fputs(", ", output);
+        ref_operand(output, &insn->dst);
+    }
+    if (insn->src.kind != OPND_NONE) {
+        fputs(", ", output);
+        ref_operand(output, &insn->src);
+    }
+    fputc('\n', output);
+}
+
+// --- Workload ---
+
+static unsigned int seed = 12345;
+
+static unsigned int random_below(unsigned int n) {
+    seed = seed * 1103515245u + 12345u;
+    return (seed >> 8) % n;
+}
+
+// Helper function to pick an operand of the kinds codegen emits
+static Operand random_operand(char** names, int label_base) {
+    switch (random_below(8)) {
+        case 0: return op_imm((int)random_below(2000) - 1000);
+        case 1: return op_imm((int)(random_below(1u << 24) * 97u));
+        case 2: return op_mem(4, REG_ESP, 4 * (int)random_below(64));
+        case 3: return op_mem(random_below(2) ? 1 : 4, REG_EBP, -4 * (int)random_below(16) - 4);
+        case 4: return op_global(4, names[random_below(NUM_NAMES)]);
+        case 5: return op_abs(1, 0x40000000u + 4 * random_below(64));
+        case 6: return op_label(label_base + (int)random_below(20));
+        default: return op_reg((int)random_below(NUM_REGS));
+    }
+}
+
+static void generate(InsnList* functions, int num_functions, char** names) {
+    static const Opcode arith[] = {OP_MOV, OP_ADD, OP_SUB, OP_AND, OP_XOR, OP_CMP, OP_IMUL, OP_MOVZX};
+    for (int f = 0; f < num_functions; f++) {
+        InsnList* code = &functions[f];
+        insn_list_init(code);
+        int label_base = 20 * f;
+        insn_emit(code, OP_LABEL, op_name(names[f % NUM_NAMES]), op_none());
+        insn_emit(code, OP_PUSH, op_reg(REG_EBX), op_none());
+        while (code->count < INSNS_PER_FUNCTION - 2) {
+            unsigned int kind = random_below(16);
+            if (kind == 0) {
+                insn_emit(code, OP_LABEL, op_label(label_base + (int)random_below(20)), op_none());
+            } else if (kind == 1) {
+                insn_emit(code, OP_JE + random_below(6), op_label(label_base + (int)random_below(20)), op_none());
+            } else if (kind == 2) {
+                insn_emit(code, OP_CALL, op_name(names[random_below(NUM_NAMES)]), op_none());
+            } else if (kind == 3) {
+                insn_emit(code, OP_LEA, op_reg((int)random_below(NUM_REGS)),
+                          op_scaled(REG_EAX, REG_ECX, 4));
+            } else {
+                Operand src = random_operand(names, label_base);
+                if (src.kind == OPND_LABEL) src = op_reg((int)random_below(NUM_REGS));
+                insn_emit(code, arith[random_below(8)], op_reg((int)random_below(NUM_REGS)), src);
+            }
+        }
+        insn_emit(code, OP_POP, op_reg(REG_EBX), op_none());
+        insn_emit(code, OP_RET, op_none(), op_none());
+    }
+}
+
+// --- Harness ---
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Helper function to read a file back to compare outputs
+static char* read_back(FILE* file, long* size) {
+    fflush(file);
+    fseek(file, 0, SEEK_END);
+    *size = ftell(file);
+    rewind(file);
+    char* data = malloc(*size + 1);
+    if (!data || fread(data, 1, *size, file) != (size_t)*size) {
+        fprintf(stderr, "cannot read the output back\n");
+        exit(1);
+    }
+    return data;
+}
+
+// The previous path: a memory stream per function, then fwrite
+static double run_reference(const InsnList* functions, int num_functions, FILE* output) {
+    double start = now_seconds();
+    char** texts = malloc(num_functions * sizeof(char*));
+    size_t* sizes = malloc(num_functions * sizeof(size_t));
+    for (int f = 0; f < num_functions; f++) {
+        FILE* text = open_memstream(&texts[f], &sizes[f]);
+        for (int i = 0; i < functions[f].count; i++) ref_print(text, &functions[f].insns[i]);
+        fprintf(text, "\n");
+        fclose(text);
+    }
+    for (int f = 0; f < num_functions; f++) {
+        fwrite(texts[f], 1, sizes[f], output);
+        free(texts[f]);
+    }
+    fflush(output);
+    double seconds = now_seconds() - start;
+    free(texts);
+    free(sizes);
+    return seconds;
+}
+
+// The buffered writer: a text buffer per function, then one writev per batch
+static double run_writer(const InsnList* functions, int num_functions, FILE* output) {
+    double start = now_seconds();
+    TextBuffer* texts = malloc(num_functions * sizeof(TextBuffer));
+    for (int f = 0; f < num_functions; f++) {
+        text_init(&texts[f], (size_t)functions[f].count * 24);
+        insn_list_format(&texts[f], &functions[f]);
+        text_append(&texts[f], "\n", 1);
+    }
+    if (text_write(output, texts, num_functions) != 0) {
+        fprintf(stderr, "write failed\n");
+        exit(1);
+    }
+    double seconds = now_seconds() - start;
+    for (int f = 0; f < num_functions; f++) text_free(&texts[f]);
+    free(texts);
+    return seconds;
+}
+
+int main(int argc, char** argv) {
+    long num_insns = argc > 1 ? atol(argv[1]) : DEFAULT_INSNS;
+    int num_functions = (int)((num_insns + INSNS_PER_FUNCTION - 1) / INSNS_PER_FUNCTION);
+    if (num_functions < 1) num_functions = 1;
+
+    char* names[NUM_NAMES];
+    for (int i = 0; i < NUM_NAMES; i++) {
+        names[i] = malloc(32);
+        snprintf(names[i], 32, "%s%d", i % 2 ? "function_" : "g", i);
+    }
+    InsnList* functions = malloc(num_functions * sizeof(InsnList));
+    generate(functions, num_functions, names);
+
+    double best_reference = 1e30, best_writer = 1e30;
+    long reference_size = 0, writer_size = 0;
+    int same = 1;
+    for (int run = 0; run < RUNS; run++) {
+        FILE* reference = tmpfile();
+        FILE* written = tmpfile();
+        if (!reference || !written) {
+            perror("tmpfile");
+            return 1;
+        }
+        double seconds = run_reference(functions, num_functions, reference);
+        if (seconds < best_reference) best_reference = seconds;
+        seconds = run_writer(functions, num_functions, written);
+        if (seconds < best_writer) best_writer = seconds;
+
+        char* expected = read_back(reference, &reference_size);
+        char* actual = read_back(written, &writer_size);
+        if (reference_size != writer_size || memcmp(expected, actual, reference_size) != 0) same = 0;
+        free(expected);
+        free(actual);
+        fclose(reference);
+        fclose(written);
+    }
+    if (!same) {
+        fprintf(stderr, "the writer's output differs from fprintf's\n");
+        return 1;
+    }
+
+    double megabytes = writer_size / 1e6;
+    printf("output: %d functions, %ld instructions, %.1f MB of assembly\n",
+           num_functions, (long)num_functions * INSNS_PER_FUNCTION, megabytes);
+    printf("%-16s %12s %12s\n", "path", "seconds", "MB/s");
+    printf("%-16s %12.3f %12.1f\n", "fprintf", best_reference, megabytes / best_reference);
+    printf("%-16s %12.3f %12.1f\n", "buffered writer", best_writer, megabytes / best_writer);
+    printf("speedup: %.1fx\n", best_reference / best_writer);
+
+    for (int f = 0; f < num_functions; f++) insn_list_free(&functions[f]);
+    free(functions);
+    for (int i = 0; i < NUM_NAMES; i++) free(names[i]);
+    return 0;
+}
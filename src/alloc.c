@@ -0,0 +1,12 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "alloc.h"
+
+void* checked_calloc(size_t count, size_t size) {
+    void* memory = calloc(count ? count : 1, size);
+    if (!memory) {
+        fprintf(stderr, "Error: Out of memory\n");
+        exit(1);
+    }
+    return memory;
+}
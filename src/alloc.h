@@ -0,0 +1,11 @@
+// alloc.h
+#ifndef ALLOC_H
+#define ALLOC_H
+
+#include <stddef.h>
+
+// Allocate zeroed scratch memory, or exit reporting that memory ran out.
+// A count of zero still returns a block that can be freed.
+void* checked_calloc(size_t count, size_t size);
+
+#endif
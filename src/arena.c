@@ -0,0 +1,145 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "arena.h"
+
+#define ARENA_ALIGN 8
+
+// Initialize an empty arena; blocks are only allocated on first use
+void arena_init(Arena* arena, size_t block_size) {
+    arena->head = NULL;
+    arena->spare = NULL;
+    arena->block_size = block_size ? block_size : ARENA_BLOCK_SIZE;
+    arena->bytes_allocated = 0;
+    arena->num_allocations = 0;
+    arena->bytes_reserved = 0;
+    arena->num_blocks = 0;
+}
+
+// Helper function to chain a new block big enough for 'size' bytes, taking a
+// spare one when it fits
+static ArenaBlock* arena_new_block(Arena* arena, size_t size) {
+    ArenaBlock* spare = arena->spare;
+    if (spare && spare->size >= size) {
+        arena->spare = spare->next;
+        spare->next = arena->head;
+        spare->used = 0;
+        arena->head = spare;
+        return spare;
+    }
+
+    size_t block_size = arena->block_size;
+    if (size > block_size) block_size = size;
+
+    ArenaBlock* block = malloc(sizeof(ArenaBlock) + block_size);
+    if (!block) {
+        fprintf(stderr, "Error: Out of memory\n");
+        exit(1);
+    }
+    block->next = arena->head;
+    block->size = block_size;
+    block->used = 0;
+    arena->head = block;
+    arena->bytes_reserved += block_size;
+    arena->num_blocks++;
+    return block;
+}
+
+// Bump-allocate 'size' bytes, aligned for any scalar type
+void* arena_alloc(Arena* arena, size_t size) {
+    size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+
+    ArenaBlock* block = arena->head;
+    if (!block || block->size - block->used < size) {
+        block = arena_new_block(arena, size);
+    }
+
+    void* ptr = block->data + block->used;
+    block->used += size;
+    arena->bytes_allocated += size;
+    arena->num_allocations++;
+    return ptr;
+}
+
+// Copy 'length' bytes of a string into the arena and terminate it
+char* arena_strndup(Arena* arena, const char* str, size_t length) {
+    char* copy = arena_alloc(arena, length + 1);
+    memcpy(copy, str, length);
+    copy[length] = '\0';
+    return copy;
+}
+
+// Copy a NUL-terminated string into the arena
+char* arena_strdup(Arena* arena, const char* str) {
+    return arena_strndup(arena, str, strlen(str));
+}
+
+// Move every block of 'other' into 'arena', which keeps allocating from its
+// own current block; 'other' is left empty
+void arena_adopt(Arena* arena, Arena* other) {
+    if (other->head) {
+        ArenaBlock* tail = other->head;
+        while (tail->next) tail = tail->next;
+        if (arena->head) {
+            tail->next = arena->head->next;
+            arena->head->next = other->head;
+        } else {
+            arena->head = other->head;
+        }
+    }
+    while (other->spare) {
+        ArenaBlock* spare = other->spare;
+        other->spare = spare->next;
+        spare->next = arena->spare;
+        arena->spare = spare;
+    }
+    arena->bytes_allocated += other->bytes_allocated;
+    arena->num_allocations += other->num_allocations;
+    arena->bytes_reserved += other->bytes_reserved;
+    arena->num_blocks += other->num_blocks;
+    arena_init(other, other->block_size);
+}
+
+// Move one spare block to 'other', typically an arena about to be used on
+// another thread and adopted back afterwards
+void arena_lend_spare(Arena* arena, Arena* other) {
+    ArenaBlock* spare = arena->spare;
+    if (!spare) return;
+    arena->spare = spare->next;
+    spare->next = other->spare;
+    other->spare = spare;
+    arena->bytes_reserved -= spare->size;
+    arena->num_blocks--;
+    other->bytes_reserved += spare->size;
+    other->num_blocks++;
+}
+
+// Empty the arena but keep its blocks for the next compilation; the
+// allocation counters restart, the reserved ones still count the blocks
+void arena_reset(Arena* arena) {
+    while (arena->head) {
+        ArenaBlock* block = arena->head;
+        arena->head = block->next;
+        block->next = arena->spare;
+        arena->spare = block;
+    }
+    arena->bytes_allocated = 0;
+    arena->num_allocations = 0;
+}
+
+// Helper function to free a chain of blocks
+static void free_blocks(ArenaBlock* block) {
+    while (block) {
+        ArenaBlock* next = block->next;
+        free(block);
+        block = next;
+    }
+}
+
+// Release every block at once
+void arena_free(Arena* arena) {
+    free_blocks(arena->head);
+    free_blocks(arena->spare);
+    arena->head = NULL;
+    arena->spare = NULL;
+}
@@ -0,0 +1,37 @@
+// arena.h
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+#define ARENA_BLOCK_SIZE (64 * 1024)
+
+// A block of memory owned by an arena; blocks are chained newest-first
+typedef struct ArenaBlock {
+    struct ArenaBlock* next;
+    size_t size;
+    size_t used;
+    char data[];
+} ArenaBlock;
+
+// Compilation-scoped bump allocator, everything is released at once
+typedef struct {
+    ArenaBlock* head;
+    ArenaBlock* spare;        // Blocks emptied by arena_reset(), reused before malloc()
+    size_t block_size;
+    size_t bytes_allocated;   // Bytes handed out to callers
+    size_t num_allocations;   // Number of arena_alloc() calls
+    size_t bytes_reserved;    // Bytes obtained from malloc()
+    size_t num_blocks;
+} Arena;
+
+void arena_init(Arena* arena, size_t block_size);
+void* arena_alloc(Arena* arena, size_t size);
+char* arena_strndup(Arena* arena, const char* str, size_t length);
+char* arena_strdup(Arena* arena, const char* str);
+void arena_adopt(Arena* arena, Arena* other);
+void arena_lend_spare(Arena* arena, Arena* other);
+void arena_reset(Arena* arena);
+void arena_free(Arena* arena);
+
+#endif
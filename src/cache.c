@@ -0,0 +1,249 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "cache.h"
+
+static const char cache_magic[4] = {'H', 'C', 'F', 'N'};
+
+// Helper function to hash a key (FNV-1a, 64 bits)
+static unsigned long long hash_key(const CacheKey* key) {
+    unsigned long long hash = 14695981039346656037ull;
+    for (size_t i = 0; i < key->length; i++) {
+        hash ^= key->data[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+// Helper function to build the path of a key's entry
+static void entry_path(const Cache* cache, const CacheKey* key, char* path, size_t size) {
+    snprintf(path, size, "%s/%016llx", cache->dir, hash_key(key));
+}
+
+int cache_open(Cache* cache, const char* dir) {
+    cache->dir = dir;
+    if (mkdir(dir, 0777) != 0 && errno != EEXIST) return -1;
+
+    // A rebuilt compiler may generate different code for the same key
+    struct stat st;
+    cache->compiler_id = 0;
+    if (stat("/proc/self/exe", &st) == 0) {
+        cache->compiler_id = (unsigned long long)st.st_size * 1000003u ^ (unsigned long long)st.st_mtime;
+    }
+    return 0;
+}
+
+// --- Keys ---
+
+void cache_key_init(CacheKey* key, const Cache* cache) {
+    key->data = NULL;
+    key->length = 0;
+    key->capacity = 0;
+    cache_key_add_int(key, CACHE_VERSION);
+    cache_key_add_int(key, (long long)cache->compiler_id);
+}
+
+void cache_key_add(CacheKey* key, const void* data, size_t length) {
+    if (key->length + length > key->capacity) {
+        while (key->length + length > key->capacity) key->capacity = key->capacity ? key->capacity * 2 : 256;
+        key->data = realloc(key->data, key->capacity);
+        if (!key->data) {
+            fprintf(stderr, "Error: Out of memory\n");
+            exit(1);
+        }
+    }
+    memcpy(key->data + key->length, data, length);
+    key->length += length;
+}
+
+void cache_key_add_int(CacheKey* key, long long value) {
+    cache_key_add(key, &value, sizeof(value));
+}
+
+// Strings are length-prefixed, so consecutive ones cannot run together
+void cache_key_add_string(CacheKey* key, const char* str) {
+    long long length = str ? (long long)strlen(str) : -1;
+    cache_key_add_int(key, length);
+    if (str) cache_key_add(key, str, length);
+}
+
+void cache_key_free(CacheKey* key) {
+    free(key->data);
+    key->data = NULL;
+    key->length = key->capacity = 0;
+}
+
+// --- Entries ---
+
+// An entry is the magic, the key, then each instruction: the opcode and two
+// operands. Names are stored inline; numbered labels relative to the
+// function's first.
+
+static void write_operand(CacheKey* buffer, const Operand* operand, int label_base) {
+    unsigned char fields[4] = {operand->kind, operand->size, (unsigned char)operand->reg,
+                               (unsigned char)operand->index};
+    cache_key_add(buffer, fields, 4);
+    cache_key_add(buffer, &operand->scale, 1);
+    int value = operand->value;
+    if (operand->kind == OPND_LABEL && !operand->name) value -= label_base;
+    cache_key_add(buffer, &value, sizeof(int));
+    cache_key_add_string(buffer, operand->name);
+}
+
+// Reads past the end of an entry fail instead of running off the buffer
+typedef struct {
+    const unsigned char* data;
+    size_t length;
+    size_t pos;
+    int failed;
+} Reader;
+
+static const void* read_bytes(Reader* reader, size_t length) {
+    if (reader->failed || reader->length - reader->pos < length) {
+        reader->failed = 1;
+        return NULL;
+    }
+    const void* bytes = reader->data + reader->pos;
+    reader->pos += length;
+    return bytes;
+}
+
+static long long read_int(Reader* reader) {
+    long long value = 0;
+    const void* bytes = read_bytes(reader, sizeof(value));
+    if (bytes) memcpy(&value, bytes, sizeof(value));
+    return value;
+}
+
+static int read_operand(Reader* reader, Operand* operand, int label_base, Arena* arena) {
+    const unsigned char* fields = read_bytes(reader, 5);
+    const void* value_bytes = read_bytes(reader, sizeof(int));
+    long long name_length = read_int(reader);
+    const char* name = name_length >= 0 ? read_bytes(reader, (size_t)name_length) : NULL;
+    if (reader->failed || fields[0] > OPND_LABEL) return 0;
+
+    operand->kind = fields[0];
+    operand->size = fields[1];
+    operand->reg = (signed char)fields[2];
+    operand->index = (signed char)fields[3];
+    operand->scale = fields[4];
+    memcpy(&operand->value, value_bytes, sizeof(int));
+    operand->name = name ? arena_strndup(arena, name, (size_t)name_length) : NULL;
+    if (operand->kind == OPND_LABEL && !operand->name) operand->value += label_base;
+    return 1;
+}
+
+// Helper function to read a whole entry file; NULL if there is none
+static unsigned char* read_entry(const char* path, size_t* length) {
+    FILE* file = fopen(path, "rb");
+    if (!file) return NULL;
+    struct stat st;
+    unsigned char* data = NULL;
+    if (fstat(fileno(file), &st) == 0 && (data = malloc(st.st_size + 1)) != NULL) {
+        *length = fread(data, 1, st.st_size, file);
+        if (*length != (size_t)st.st_size) {
+            free(data);
+            data = NULL;
+        }
+    }
+    fclose(file);
+    return data;
+}
+
+int cache_load(const Cache* cache, const CacheKey* key, InsnList* code, int label_base,
+               Arena* arena, CacheStats* stats) {
+    char path[4096];
+    entry_path(cache, key, path, sizeof(path));
+    size_t length;
+    unsigned char* data = read_entry(path, &length);
+    if (!data) {
+        stats->misses++;
+        return 0;
+    }
+
+    // The whole key must match, and the entry must parse to its end
+    Reader reader = {data, length, 0, 0};
+    const void* magic = read_bytes(&reader, sizeof(cache_magic));
+    long long key_length = read_int(&reader);
+    const void* stored_key = key_length == (long long)key->length ? read_bytes(&reader, key->length) : NULL;
+    int hit = magic && stored_key && memcmp(magic, cache_magic, sizeof(cache_magic)) == 0 &&
+              memcmp(stored_key, key->data, key->length) == 0;
+    int first = code->count;
+    long long count = hit ? read_int(&reader) : 0;
+    for (long long i = 0; hit && i < count; i++) {
+        const unsigned char* op = read_bytes(&reader, 1);
+        Operand dst, src;
+        if (!op || *op > OP_INT || !read_operand(&reader, &dst, label_base, arena) ||
+            !read_operand(&reader, &src, label_base, arena)) {
+            hit = 0;
+            break;
+        }
+        insn_emit(code, *op, dst, src);
+    }
+    if (reader.failed || reader.pos != reader.length) hit = 0;
+    free(data);
+
+    if (!hit) {
+        code->count = first;
+        stats->misses++;
+        return 0;
+    }
+    stats->hits++;
+    stats->bytes_read += length;
+    return 1;
+}
+
+void cache_store(const Cache* cache, const CacheKey* key, const InsnList* code, int label_base,
+                 CacheStats* stats) {
+    CacheKey entry = {NULL, 0, 0};
+    cache_key_add(&entry, cache_magic, sizeof(cache_magic));
+    cache_key_add_int(&entry, (long long)key->length);
+    cache_key_add(&entry, key->data, key->length);
+    long long count = 0;
+    for (int i = 0; i < code->count; i++) count += code->insns[i].op != OP_NOP;
+    cache_key_add_int(&entry, count);
+    for (int i = 0; i < code->count; i++) {
+        const Insn* insn = &code->insns[i];
+        if (insn->op == OP_NOP) continue;
+        unsigned char op = insn->op;
+        cache_key_add(&entry, &op, 1);
+        write_operand(&entry, &insn->dst, label_base);
+        write_operand(&entry, &insn->src, label_base);
+    }
+
+    // Readers only ever see complete entries: write elsewhere, then rename.
+    // A failed store only costs a later miss.
+    char path[4096], temp_path[4096];
+    entry_path(cache, key, path, sizeof(path));
+    snprintf(temp_path, sizeof(temp_path), "%s/tmp.XXXXXX", cache->dir);
+    int fd = mkstemp(temp_path);
+    if (fd >= 0) {
+        fchmod(fd, 0644);
+        size_t written = 0;
+        while (written < entry.length) {
+            ssize_t n = write(fd, entry.data + written, entry.length - written);
+            if (n <= 0) break;
+            written += n;
+        }
+        close(fd);
+        if (written == entry.length && rename(temp_path, path) == 0) {
+            stats->stores++;
+            stats->bytes_written += entry.length;
+        } else {
+            unlink(temp_path);
+        }
+    }
+    cache_key_free(&entry);
+}
+
+void cache_report(const CacheStats* stats, FILE* output) {
+    long lookups = stats->hits + stats->misses;
+    fprintf(output, "Cache report:\n");
+    fprintf(output, "  %ld functions reused, %ld generated (%.1f%% hits)\n", stats->hits, stats->misses,
+            lookups ? 100.0 * stats->hits / lookups : 0.0);
+    fprintf(output, "  %ld entries stored, %ld bytes read, %ld bytes written\n",
+            stats->stores, stats->bytes_read, stats->bytes_written);
+}
@@ -0,0 +1,54 @@
+// cache.h
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include "arena.h"
+#include "insn.h"
+
+#define CACHE_VERSION 1
+
+// On-disk cache of generated functions. Each entry is a file named after the
+// hash of its key and holds the whole key, so a hash collision is a miss.
+// Entries are written to a temporary file and renamed into place, so any
+// number of compilers can share a directory.
+typedef struct {
+    const char* dir;
+    unsigned long long compiler_id;     // Size and time of the running binary
+} Cache;
+
+// Everything a function's code depends on, serialized by the code generator
+typedef struct {
+    unsigned char* data;
+    size_t length;
+    size_t capacity;
+} CacheKey;
+
+typedef struct {
+    long hits;
+    long misses;
+    long stores;            // Entries written after a miss
+    long bytes_read;
+    long bytes_written;
+} CacheStats;
+
+// Create the directory if needed; returns 0 on success
+int cache_open(Cache* cache, const char* dir);
+
+void cache_key_init(CacheKey* key, const Cache* cache);
+void cache_key_add(CacheKey* key, const void* data, size_t length);
+void cache_key_add_int(CacheKey* key, long long value);
+void cache_key_add_string(CacheKey* key, const char* str);
+void cache_key_free(CacheKey* key);
+
+// Look a function up, appending its code to 'code' with labels numbered from
+// 'label_base' and names copied into 'arena'. Returns 1 on a hit.
+int cache_load(const Cache* cache, const CacheKey* key, InsnList* code, int label_base,
+               Arena* arena, CacheStats* stats);
+// Store a function's code; labels are saved relative to 'label_base'
+void cache_store(const Cache* cache, const CacheKey* key, const InsnList* code, int label_base,
+                 CacheStats* stats);
+void cache_report(const CacheStats* stats, FILE* output);
+
+#endif
@@ -2,342 +2,769 @@
 #include <stdlib.h>
 #include <string.h>
 #include "codegen.h"
-#include "parser.h"
-#include "lexer.h"
-
-// Symbol table for variables and registers
-typedef struct Symbol {
-    char* name;
-    enum { SYM_REG, SYM_MEM, SYM_PTR } type;
-    int reg;        // Register ID (eax=0, ebx=1, etc.)
-    int address;    // Memory address or offset
-    struct Symbol* next;
-} Symbol;
-
-static Symbol* symbol_table = NULL;
-static int stack_offset = 0;    // For local variables
-static int label_counter = 0;    // For control flow labels
-static char* current_func = "";  // Track current function
-
-// Available registers: eax, ebx, ecx, edx
-static const char* reg_names[] = {"eax", "ebx", "ecx", "edx"};
-static int reg_used[] = {0, 0, 0, 0};
-
-static int has_error = 0;
-
-void error(const char* msg, const char* context) {
-    fprintf(stderr, "Error: %s (%s)\n", msg, context);
-    has_error = 1;
-}
+#include "arena.h"
+#include "regalloc.h"
+#include "insn.h"
+#include "peephole.h"
+#include "muldiv.h"
+#include "object.h"
+#include "threadpool.h"
+#include "cache.h"
+#include "profile.h"
+#include "stack.h"
+
+// Output of one function, kept until every function is done so the program
+// comes out in the same order however many workers there are
+typedef struct {
+    InsnList code;      // Instructions after the peephole pass, for object output
+    TextBuffer text;    // NASM text, for assembly output
+    int failed;         // Set when register allocation reported an error
+} FuncOutput;
+
+// Program-wide state, read-only while functions are being generated
+typedef struct {
+    IrProgram* program;
+    OutputFormat format;
+    int* global_reg;                // Register of each global, -1 if in memory
+    unsigned int global_reserved;   // Registers holding 'reg' globals
+    int* order;                     // Functions in output order, the entry point first
+    int* label_base;                // Label number of block 0 of each function in output order
+    FuncOutput* outputs;            // In output order
+    Arena* arenas;                  // One per worker
+    PeepholeStats* stats;           // One per worker, NULL to skip the peephole pass
+    const Cache* cache;             // NULL to generate every function
+    CacheStats* cache_stats;        // One per worker
+    Tracer* tracer;                 // NULL when not tracing
+    StackUsage* stack_usage;        // Per function in program order, NULL to skip measuring
+    StackFunction* callees;         // Functions sorted by name, for measuring
+} CodeGen;
+
+// State of the function one worker is generating
+typedef struct {
+    const CodeGen* cg;
+    IrFunction* func;
+    Allocation* alloc;              // Its register assignment
+    InsnList code;                  // Its instructions
+    int label_base;                 // Label number of its block 0
+    unsigned int saved_regs;        // Callee-saved registers it spills
+    int saved_bytes;                // Frame bytes holding saved registers
+    int frame_pointer;              // Whether ebp addresses the frame, else esp does
+    int push_depth;                 // Bytes of arguments pushed for the next call
+    Operand reg_args[NUM_ARG_REGS]; // Register arguments waiting for their call
+    int num_reg_args;
+    int worker;                     // Thread generating it, for tracing
+} FuncGen;
+
+// Room made for the text of each instruction up front; lines are shorter
+// on average, so function text rarely has to grow
+#define TEXT_BYTES_PER_INSN 24
+
+// Callee-saved registers that may hold 'reg' globals for the whole program
+static const int global_regs[] = {REG_ESI, REG_EDI};
+#define NUM_GLOBAL_REGS 2
+
+// Conditional jumps and sets for each IrCond; flipping the low bit of a
+// condition flips its test in both
+static const Opcode jump_ops[] = {OP_JE, OP_JNE, OP_JL, OP_JGE, OP_JLE, OP_JG};
+static const Opcode set_ops[] = {OP_SETE, OP_SETNE, OP_SETL, OP_SETGE, OP_SETLE, OP_SETG};
 
 // --- Helper Functions ---
 
-// Check if a symbol exists in the current scope
-Symbol* check_symbol_exists(char* name) {
-    Symbol* sym = find_symbol(name);
-    if (!sym) {
-        error("Undeclared variable", name);
-        return NULL;
-    }
-    return sym;
+// Append an instruction to the function
+static void emit(FuncGen* gen, Opcode op, Operand dst, Operand src) {
+    insn_emit(&gen->code, op, dst, src);
+}
+
+// Helper function to place a numbered label
+static void emit_label(FuncGen* gen, int label) {
+    emit(gen, OP_LABEL, op_label(label), op_none());
+}
+
+// Register assigned to a vreg
+static int reg_of(const FuncGen* gen, int v) {
+    return gen->alloc->ranges[v].reg;
+}
+
+// Operand 'a' or 'b' of an instruction as an immediate or a register
+static Operand operand_a(const FuncGen* gen, const IrInsn* insn) {
+    return (insn->flags & IR_A_IMM) ? op_imm(insn->a) : op_reg(reg_of(gen, insn->a));
+}
+
+static Operand operand_b(const FuncGen* gen, const IrInsn* insn) {
+    return (insn->flags & IR_B_IMM) ? op_imm(insn->b) : op_reg(reg_of(gen, insn->b));
+}
+
+// Helper function to check whether an operand is a given register
+static int is_reg(Operand operand, int reg) {
+    return operand.kind == OPND_REG && operand.reg == reg;
+}
+
+// Helper function to move into a register unless the value is already there
+static void emit_move(FuncGen* gen, int reg, Operand source) {
+    if (!is_reg(source, reg)) emit(gen, OP_MOV, op_reg(reg), source);
+}
+
+// The memory operand of a global in the data section or at its MMIO address
+static Operand global_operand(const FuncGen* gen, int index, int size) {
+    IrGlobal* global = &gen->cg->program->globals[index];
+    if (global->is_mmio) return op_abs(size, global->address);
+    return op_global(size, global->name);
+}
+
+// Bytes of stack arguments a function removes on return; fastcall callees
+// pop their own, cdecl callers do
+static int popped_by_callee(const IrFunction* callee) {
+    return callee->num_reg_params > 0 ? 4 * (callee->num_params - callee->num_reg_params) : 0;
 }
 
-// Check type compatibility
-void check_type(DataType expected, DataType actual, const char* context) {
-    if (expected != actual) {
-        fprintf(stderr, "Type error: Expected %d, got %d (%s)\n",
-                expected, actual, context);
-        has_error = 1;
+// The frame location of a stack slot: spill slots below the saved registers,
+// stack parameters above the return address. Without a frame pointer, esp
+// sits on the spill slots, moved down by arguments pushed so far.
+static Operand slot_operand(const FuncGen* gen, int slot, int size) {
+    int frame_bytes = gen->alloc->frame_bytes;
+    if (slot < 0) {
+        int offset = 4 * (-slot - 1 - gen->func->num_reg_params);
+        if (gen->frame_pointer) return op_mem(4, REG_EBP, 8 + offset);
+        return op_mem(4, REG_ESP, gen->push_depth + frame_bytes + gen->saved_bytes + 4 + offset);
     }
+    if (gen->frame_pointer) return op_mem(size, REG_EBP, slot - (gen->saved_bytes + frame_bytes));
+    return op_mem(size, REG_ESP, gen->push_depth + slot);
 }
 
-// Allocate a register for 'reg' variables
-int allocate_register() {
-    for (int i = 0; i < 4; i++) {
-        if (!reg_used[i]) {
-            reg_used[i] = 1;
-            return i;
+// Restore the callee-saved registers and return to the caller
+static void emit_epilogue(FuncGen* gen) {
+    if (gen->frame_pointer) {
+        int slot = 0;
+        for (int r = 0; r < NUM_REGS; r++) {
+            if (gen->saved_regs & REG_BIT(r)) {
+                slot += 4;
+                emit(gen, OP_MOV, op_reg(r), op_mem(0, REG_EBP, -slot));
+            }
+        }
+        emit(gen, OP_MOV, op_reg(REG_ESP), op_reg(REG_EBP));
+        emit(gen, OP_POP, op_reg(REG_EBP), op_none());
+    } else {
+        if (gen->alloc->frame_bytes > 0) emit(gen, OP_ADD, op_reg(REG_ESP), op_imm(gen->alloc->frame_bytes));
+        for (int r = NUM_REGS - 1; r >= 0; r--) {
+            if (gen->saved_regs & REG_BIT(r)) emit(gen, OP_POP, op_reg(r), op_none());
         }
     }
-    fprintf(stderr, "Error: No registers available\n");
-    exit(1);
+    int popped = popped_by_callee(gen->func);
+    emit(gen, OP_RET, popped > 0 ? op_imm(popped) : op_none(), op_none());
 }
 
-// Find a symbol in the symbol table
-Symbol* find_symbol(char* name) {
-    Symbol* sym = symbol_table;
-    while (sym) {
-        if (strcmp(sym->name, name) == 0) return sym;
-        sym = sym->next;
+// --- Instruction selection ---
+
+// Two-address arithmetic: d = a op b. When d already holds b, commutative
+// operations swap and subtraction negates first.
+static void emit_arith(FuncGen* gen, Opcode op, int d, Operand a, Operand b) {
+    if (is_reg(a, d)) {
+        emit(gen, op, op_reg(d), b);
+    } else if (is_reg(b, d)) {
+        if (op == OP_SUB) {
+            emit(gen, OP_NEG, op_reg(d), op_none());
+            emit(gen, OP_ADD, op_reg(d), a);
+        } else {
+            emit(gen, op, op_reg(d), a);
+        }
+    } else {
+        emit(gen, OP_MOV, op_reg(d), a);
+        emit(gen, op, op_reg(d), b);
     }
-    return NULL;
 }
 
-// Determine the type of an expression node
-DataType get_expression_type(ASTNode* node) {
-    switch (node->type) {
-        case NODE_IDENT: {
-            Symbol* sym = find_symbol(node->value);
-            return sym ? sym->data_type : DT_INT; // Default to int on error
-        }
-        case NODE_NUMBER: return DT_INT;
-        case NODE_BINOP: {
-            DataType left = get_expression_type(node->children[0]);
-            DataType right = get_expression_type(node->children[1]);
-            return (left == DT_PTR || right == DT_PTR) ? DT_PTR : left;
-        }
-        default: return DT_INT;
+// Store to a global of 'size' bytes, keeping byte globals within 8 bits
+static void emit_store_global(FuncGen* gen, const IrInsn* insn) {
+    int reg = gen->cg->global_reg[insn->b];
+    Operand value = operand_a(gen, insn);
+    if (insn->size == 1 && value.kind == OPND_IMM) value = op_imm(value.value & 0xFF);
+
+    if (reg < 0) {
+        if (insn->size == 1 && value.kind == OPND_REG) value = op_reg8(value.reg);
+        emit(gen, OP_MOV, global_operand(gen, insn->b, insn->size), value);
+    } else if (insn->size == 1 && value.kind == OPND_REG) {
+        emit(gen, OP_MOVZX, op_reg(reg), op_reg8(value.reg));
+    } else {
+        emit_move(gen, reg, value);
     }
 }
 
-// Add a symbol to the table
-void add_symbol(char* name, int type, int reg, int address) {
-    Symbol* sym = malloc(sizeof(Symbol));
-    sym->name = strdup(name);
-    sym->type = type;
-    sym->reg = reg;
-    sym->address = address;
-    sym->next = symbol_table;
-    symbol_table = sym;
+// Grow the heap with brk: query the break, then move it by the requested size
+static void emit_alloc(FuncGen* gen, const IrInsn* insn) {
+    emit_move(gen, REG_ECX, operand_a(gen, insn));
+    emit(gen, OP_MOV, op_reg(REG_EAX), op_imm(45));  // SYS_BRK
+    emit(gen, OP_XOR, op_reg(REG_EBX), op_reg(REG_EBX));
+    emit(gen, OP_INT, op_imm(0x80), op_none());
+    emit(gen, OP_ADD, op_reg(REG_EAX), op_reg(REG_ECX));
+    emit(gen, OP_MOV, op_reg(REG_EBX), op_reg(REG_EAX));
+    emit(gen, OP_MOV, op_reg(REG_EAX), op_imm(45));
+    emit(gen, OP_INT, op_imm(0x80), op_none());
+    emit(gen, OP_SUB, op_reg(REG_EAX), op_reg(REG_ECX));  // Start of the new block
+    emit_move(gen, reg_of(gen, insn->dst), op_reg(REG_EAX));
 }
 
-// --- Code Generation ---
+// Helper function to jump to a block; unconditional jumps to the block that
+// directly follows are left out
+static void emit_jump(FuncGen* gen, Opcode op, int from, int to) {
+    if (op != OP_JMP || to != from + 1) emit(gen, op, op_label(gen->label_base + to), op_none());
+}
 
-void codegen(ASTNode* node, FILE* output) {
-    if (!node) return;
+// Load the register arguments of a call as one parallel move: each goes
+// first unless it would overwrite the other's source, and a swap goes
+// through eax, which the call clobbers anyway
+static void emit_reg_args(FuncGen* gen) {
+    if (gen->num_reg_args == 2 && is_reg(gen->reg_args[1], arg_regs[0])) {
+        if (is_reg(gen->reg_args[0], arg_regs[1])) {
+            emit(gen, OP_MOV, op_reg(REG_EAX), gen->reg_args[1]);
+            gen->reg_args[1] = op_reg(REG_EAX);
+        } else {
+            emit_move(gen, arg_regs[1], gen->reg_args[1]);
+            emit_move(gen, arg_regs[0], gen->reg_args[0]);
+            return;
+        }
+    }
+    for (int i = 0; i < gen->num_reg_args; i++) emit_move(gen, arg_regs[i], gen->reg_args[i]);
+}
 
-    switch (node->type) {
-        // Inside codegen() for NODE_ASSIGN:
-        case NODE_ASSIGN: {
-            char* var_name = node->children[0]->value;
-            ASTNode* expr = node->children[1];
+// Call a function, then drop the pushed arguments unless the callee did
+static void emit_call(FuncGen* gen, const IrInsn* insn, int d) {
+    IrFunction* callee = &gen->cg->program->funcs[insn->b];
+    Operand target = op_name(callee->name);
+    emit_reg_args(gen);
+    for (int i = 0; i < gen->num_reg_args; i++) target.value |= REG_BIT(arg_regs[i]);
+    emit(gen, OP_CALL, target, op_none());
+
+    int pushed = 4 * (insn->a - gen->num_reg_args);
+    if (pushed > 0 && popped_by_callee(callee) == 0) emit(gen, OP_ADD, op_reg(REG_ESP), op_imm(pushed));
+    gen->push_depth -= pushed;
+    gen->num_reg_args = 0;
+    if (d >= 0) emit_move(gen, d, op_reg(REG_EAX));
+}
 
-            Symbol* sym = check_symbol_exists(var_name);
-            codegen(expr, output);
-            DataType expr_type = get_expression_type(expr);
+// Helper function to check whether an instruction has an 'a' operand
+static int has_a(const IrInsn* insn) {
+    return insn->a >= 0 || (insn->flags & IR_A_IMM);
+}
 
-            if (sym) {
-                check_type(sym->data_type, expr_type, "assignment");
-                if (sym->storage_type == SYM_REG) {
-                    fprintf(output, "  mov %s, eax\n", reg_names[sym->reg]);
-                } else {
-                    fprintf(output, "  mov [ebp - %d], eax\n", sym->address);
-                }
+static void emit_insn(FuncGen* gen, const IrInsn* insn, int b) {
+    IrBlock* block = &gen->func->blocks[b];
+    int d = insn->dst >= 0 ? reg_of(gen, insn->dst) : -1;
+
+    switch (insn->op) {
+        case IR_PARAM:
+            if (insn->a < gen->func->num_reg_params) {
+                emit_move(gen, d, op_reg(arg_regs[insn->a]));
+            } else {
+                emit(gen, OP_MOV, op_reg(d), slot_operand(gen, PARAM_SLOT(insn->a), 4));
             }
             break;
-        }
-
-        // --- Functions ---
-        case NODE_FUNC: {
-            current_func = node->value;
-            fprintf(output, "%s:\n", node->value);
-            fprintf(output, "  push ebp\n");
-            fprintf(output, "  mov ebp, esp\n");
-            
-            // Allocate space for local variables
-            if (stack_offset > 0) {
-                fprintf(output, "  sub esp, %d\n", stack_offset);
+        case IR_CONST:
+        case IR_COPY:
+            emit_move(gen, d, operand_a(gen, insn));
+            break;
+        case IR_ADD: emit_arith(gen, OP_ADD, d, operand_a(gen, insn), operand_b(gen, insn)); break;
+        case IR_SUB: emit_arith(gen, OP_SUB, d, operand_a(gen, insn), operand_b(gen, insn)); break;
+        case IR_MUL:
+            if ((insn->flags & (IR_A_IMM | IR_B_IMM)) == IR_B_IMM) {
+                emit_mul_const(&gen->code, d, reg_of(gen, insn->a), insn->b);
+            } else {
+                emit_arith(gen, OP_IMUL, d, operand_a(gen, insn), operand_b(gen, insn));
             }
-
-            // Generate code for function body
-            for (int i = 0; i < node->num_children; i++) {
-                codegen(node->children[i], output);
+            break;
+        case IR_AND: emit_arith(gen, OP_AND, d, operand_a(gen, insn), operand_b(gen, insn)); break;
+        case IR_SET:
+            // Clearing first avoids a movzx, but only while no operand is in d
+            if (!is_reg(operand_a(gen, insn), d) && !is_reg(operand_b(gen, insn), d)) {
+                emit(gen, OP_XOR, op_reg(d), op_reg(d));
+                emit(gen, OP_CMP, operand_a(gen, insn), operand_b(gen, insn));
+                emit(gen, set_ops[insn->cond], op_reg8(d), op_none());
+            } else {
+                emit(gen, OP_CMP, operand_a(gen, insn), operand_b(gen, insn));
+                emit(gen, set_ops[insn->cond], op_reg8(d), op_none());
+                emit(gen, OP_MOVZX, op_reg(d), op_reg8(d));
             }
-
-            // Function epilogue
-            fprintf(output, "  mov esp, ebp\n");
-            fprintf(output, "  pop ebp\n");
-            fprintf(output, "  ret\n\n");
-            stack_offset = 0;  // Reset for next function
             break;
-        }
-
-        // Inside codegen() for NODE_CALL:
-        case NODE_CALL: {
-            char* func_name = node->value;
-            Symbol* func_sym = check_symbol_exists(func_name);
-
-            // Check if symbol is a function
-            if (func_sym && func_sym->storage_type != SYM_FUNC) {
-                error("Not a function", func_name);
+        case IR_DIV:
+        case IR_MOD:
+            if (insn->flags & IR_B_IMM) {
+                emit_div_const(&gen->code, d, reg_of(gen, insn->a), insn->b, insn->op == IR_MOD);
+                break;
             }
-
-            // Check argument count and types (simplified)
-            int expected_args = func_sym->num_children;
-            if (node->num_children != expected_args) {
-                error("Argument count mismatch", func_name);
+            // Dividend in edx:eax, quotient in eax and remainder in edx; the
+            // divisor avoids both
+            emit_move(gen, REG_EAX, operand_a(gen, insn));
+            emit(gen, OP_CDQ, op_none(), op_none());
+            emit(gen, OP_IDIV, operand_b(gen, insn), op_none());
+            emit_move(gen, d, op_reg(insn->op == IR_MOD ? REG_EDX : REG_EAX));
+            break;
+        case IR_LOAD:
+            if (gen->cg->global_reg[insn->b] >= 0) {
+                emit_move(gen, d, op_reg(gen->cg->global_reg[insn->b]));
+            } else {
+                emit(gen, insn->size == 1 ? OP_MOVZX : OP_MOV, op_reg(d),
+                     global_operand(gen, insn->b, insn->size));
             }
-
-            for (int i = 0; i < node->num_children; i++) {
-                codegen(node->children[i], output);
-                check_type(func_sym->children[i]->data_type, 
-                        get_expression_type(node->children[i]), 
-                        func_name);
-                fprintf(output, "  push eax\n");
+            break;
+        case IR_STORE:
+            emit_store_global(gen, insn);
+            break;
+        case IR_LOAD_PTR:
+            emit(gen, OP_MOV, op_reg(d), op_mem(4, reg_of(gen, insn->a), 0));
+            break;
+        case IR_STORE_PTR:
+            emit(gen, OP_MOV, op_mem(4, reg_of(gen, insn->a), 0), operand_b(gen, insn));
+            break;
+        case IR_ARG:
+            if (insn->flags & IR_B_IMM) {
+                gen->reg_args[gen->num_reg_args++] = operand_a(gen, insn);
+            } else {
+                emit(gen, OP_PUSH, operand_a(gen, insn), op_none());
+                gen->push_depth += 4;
             }
-
-            fprintf(output, "  call %s\n", func_name);
-            fprintf(output, "  add esp, %d\n", node->num_children * 4);
+            break;
+        case IR_CALL:
+            emit_call(gen, insn, d);
+            break;
+        case IR_ALLOC:
+            emit_alloc(gen, insn);
+            break;
+        case IR_ASM:
+            emit(gen, OP_ASM, op_name(gen->cg->program->asm_texts[insn->b]), op_none());
+            break;
+        case IR_SPILL: {
+            int reg = reg_of(gen, insn->a);
+            emit(gen, OP_MOV, slot_operand(gen, insn->b, insn->size), insn->size == 1 ? op_reg8(reg) : op_reg(reg));
             break;
         }
-
-        // Inside codegen() for NODE_REG and NODE_VAR:
-        case NODE_REG: {
-            char* type_str = node->children[0]->value; // "int" or "byte"
-            char* var_name = node->children[1]->value;
-            DataType data_type = DT_INT;
-
-            if (strcmp(type_str, "byte") == 0) data_type = DT_BYTE;
-            else if (strcmp(type_str, "ptr") == 0) data_type = DT_PTR;
-
-            if (find_symbol(var_name)) {
-                error("Redeclared variable", var_name);
-                break;
+        case IR_RELOAD:
+            emit(gen, insn->size == 1 ? OP_MOVZX : OP_MOV, op_reg(d), slot_operand(gen, insn->b, insn->size));
+            break;
+        case IR_COUNT: {
+            Operand counter = op_global(4, PROFILE_COUNTERS);
+            counter.value = 4 * insn->b;
+            emit(gen, OP_INC, counter, op_none());
+            break;
+        }
+        case IR_JUMP:
+            emit_jump(gen, OP_JMP, b, block->succ[0]);
+            break;
+        case IR_BRANCH:
+            // Compare and jump on the flags; the taken side is whichever
+            // successor does not follow in the layout
+            emit(gen, OP_CMP, operand_a(gen, insn), operand_b(gen, insn));
+            if (block->succ[0] == b + 1) {
+                emit_jump(gen, jump_ops[insn->cond ^ 1], b, block->succ[1]);
+            } else {
+                emit_jump(gen, jump_ops[insn->cond], b, block->succ[0]);
+                emit_jump(gen, OP_JMP, b, block->succ[1]);
             }
-
-            int reg = allocate_register();
-            add_symbol(var_name, SYM_REG, data_type, reg, -1);
-
-            // Handle initialization (if any)
-            if (node->num_children > 2) {
-                ASTNode* init_expr = node->children[2];
-                codegen(init_expr, output);
-                check_type(data_type, get_expression_type(init_expr), var_name);
-                fprintf(output, "  mov %s, eax\n", reg_names[reg]);
+            break;
+        case IR_RET:
+            if (gen->func->is_entry) {
+                // Exit with the value as status
+                if (has_a(insn)) emit_move(gen, REG_EBX, operand_a(gen, insn));
+                emit(gen, OP_MOV, op_reg(REG_EAX), op_imm(1));  // SYS_EXIT
+                emit(gen, OP_INT, op_imm(0x80), op_none());
+            } else {
+                if (has_a(insn)) emit_move(gen, REG_EAX, operand_a(gen, insn));
+                emit_epilogue(gen);
             }
             break;
-        }
+        default:
+            break;
+    }
+}
 
-        case NODE_VAR: {
-            stack_offset += 4;  // Assume 4 bytes for int/ptr
-            add_symbol(node->value, SYM_MEM, -1, stack_offset);
-            if (node->num_children > 0) {  // Initial value
-                fprintf(output, "  mov [ebp - %d], %s\n", stack_offset, node->children[0]->value);
+// --- Functions ---
+
+// Emit one function: prologue, blocks in layout order with labels only where
+// something jumps, epilogue at every return
+static void emit_function(FuncGen* gen) {
+    IrFunction* func = gen->func;
+    Allocation* alloc = gen->alloc;
+
+    // Frame: saved callee-saved registers, then spill slots. Inline assembly
+    // may address the frame through ebp, so only functions with it set up a
+    // frame pointer; the rest address the frame from esp, and leaves that
+    // save nothing and spill nothing get no prologue at all.
+    gen->saved_regs = func->is_entry ? 0 : alloc->used_regs & CALLEE_SAVED & ~gen->cg->global_reserved;
+    gen->saved_bytes = 0;
+    for (int r = 0; r < NUM_REGS; r++) {
+        if (gen->saved_regs & REG_BIT(r)) gen->saved_bytes += 4;
+    }
+    int frame_size = gen->saved_bytes + alloc->frame_bytes;
+    gen->frame_pointer = 0;
+    for (int i = 0; i < func->num_insns; i++) {
+        if (func->insns[i].op == IR_ASM) gen->frame_pointer = 1;
+    }
+    gen->push_depth = 0;
+    gen->num_reg_args = 0;
+
+    emit(gen, OP_LABEL, op_name(func->name), op_none());
+    if (gen->frame_pointer) {
+        if (!func->is_entry) emit(gen, OP_PUSH, op_reg(REG_EBP), op_none());
+        emit(gen, OP_MOV, op_reg(REG_EBP), op_reg(REG_ESP));
+        if (frame_size > 0) emit(gen, OP_SUB, op_reg(REG_ESP), op_imm(frame_size));
+        int slot = 0;
+        for (int r = 0; r < NUM_REGS; r++) {
+            if (gen->saved_regs & REG_BIT(r)) {
+                slot += 4;
+                emit(gen, OP_MOV, op_mem(0, REG_EBP, -slot), op_reg(r));
             }
-            break;
         }
-
-        // --- Inline Assembly ---
-        case NODE_ASM: {
-            fprintf(output, "%s\n", node->value);
-            break;
+    } else {
+        for (int r = 0; r < NUM_REGS; r++) {
+            if (gen->saved_regs & REG_BIT(r)) emit(gen, OP_PUSH, op_reg(r), op_none());
         }
+        if (alloc->frame_bytes > 0) emit(gen, OP_SUB, op_reg(REG_ESP), op_imm(alloc->frame_bytes));
+    }
 
-        // --- Control Flow ---
-        case NODE_IF: {
-            int label_else = label_counter++;
-            int label_end = label_counter++;
+    // A block needs a label when it is reached other than by falling through
+    unsigned char* needs_label = calloc(func->num_blocks + 1, 1);
+    for (int b = 0; b < func->num_blocks; b++) {
+        for (int s = 0; s < 2; s++) {
+            int succ = func->blocks[b].succ[s];
+            if (succ >= 0 && succ != b + 1) needs_label[succ] = 1;
+        }
+    }
 
-            // Generate condition
-            codegen(node->children[0], output);
-            fprintf(output, "  cmp eax, 0\n");
-            fprintf(output, "  je .L%d\n", label_else);
+    for (int b = 0; b < func->num_blocks; b++) {
+        IrBlock* block = &func->blocks[b];
+        if (needs_label[b]) emit_label(gen, gen->label_base + b);
+        for (int i = block->first; i < block->first + block->count; i++) {
+            Tracer* tracer = gen->cg->tracer;
+            if (!tracer) {
+                emit_insn(gen, &func->insns[i], b);
+                continue;
+            }
+            TraceKind* kind = &tracer->workers[gen->worker].ops[func->insns[i].op];
+            TraceKindMark mark;
+            trace_kind_begin(tracer, gen->worker, kind, &mark);
+            emit_insn(gen, &func->insns[i], b);
+            trace_kind_end(tracer, gen->worker, kind, &mark);
+        }
+    }
 
-            // Then block
-            codegen(node->children[1], output);
-            fprintf(output, "  jmp .L%d\n", label_end);
-            fprintf(output, ".L%d:\n", label_else);
+    free(needs_label);
+}
 
-            // Else block (if present)
-            if (node->num_children > 2) {
-                codegen(node->children[2], output);
+// Give the most used 'reg' globals the program-wide registers; the rest
+// (and any global only ever initialized) stay in memory. Code inlined into
+// the entry point counts like any other, but its stores outside loops are
+// mostly the global initializers and do not.
+static void assign_global_registers(CodeGen* cg) {
+    IrProgram* program = cg->program;
+    int* uses = calloc(program->num_globals + 1, sizeof(int));
+    for (int f = 0; f < program->num_funcs; f++) {
+        IrFunction* ir = &program->funcs[f];
+        for (int b = 0; b < ir->num_blocks; b++) {
+            IrBlock* block = &ir->blocks[b];
+            for (int i = block->first; i < block->first + block->count; i++) {
+                IrInsn* insn = &ir->insns[i];
+                if (ir->is_entry && insn->op == IR_STORE && block->loop_depth == 0) continue;
+                if (insn->op == IR_LOAD || insn->op == IR_STORE) {
+                    uses[insn->b] += loop_weight(block->loop_depth);
+                }
             }
+        }
+    }
 
-            fprintf(output, ".L%d:\n", label_end);
-            break;
+    cg->global_reserved = 0;
+    for (int g = 0; g < program->num_globals; g++) cg->global_reg[g] = -1;
+    for (int n = 0; n < NUM_GLOBAL_REGS; n++) {
+        int best = -1;
+        for (int g = 0; g < program->num_globals; g++) {
+            IrGlobal* global = &program->globals[g];
+            if (!global->is_reg || global->is_mmio || cg->global_reg[g] >= 0 || uses[g] == 0) continue;
+            if (best < 0 || uses[g] > uses[best]) best = g;
         }
+        if (best < 0) break;
+        cg->global_reg[best] = global_regs[n];
+        cg->global_reserved |= REG_BIT(global_regs[n]);
+    }
+    free(uses);
+}
 
-        case NODE_WHILE: {
-            int label_start = label_counter++;
-            int label_end = label_counter++;
-
-            fprintf(output, ".L%d:\n", label_start);
-            codegen(node->children[0], output);  // Condition
-            fprintf(output, "  cmp eax, 0\n");
-            fprintf(output, "  je .L%d\n", label_end);
-            codegen(node->children[1], output);  // Body
-            fprintf(output, "  jmp .L%d\n", label_start);
-            fprintf(output, ".L%d:\n", label_end);
-            break;
+// Everything a function's code depends on: its IR, what it knows of the
+// globals and functions it names, and the program-wide register choices
+static void function_key(const CodeGen* cg, const IrFunction* func, CacheKey* key) {
+    cache_key_init(key, cg->cache);
+    cache_key_add_int(key, cg->stats != NULL);
+    cache_key_add_int(key, cg->global_reserved);
+    cache_key_add_string(key, func->name);
+    cache_key_add_int(key, func->is_entry);
+    cache_key_add_int(key, func->num_params);
+    cache_key_add_int(key, func->num_reg_params);
+    cache_key_add_int(key, func->num_vregs);
+    cache_key_add(key, func->vreg_flags, func->num_vregs);
+    cache_key_add_int(key, func->num_blocks);
+    cache_key_add(key, func->blocks, func->num_blocks * sizeof(IrBlock));
+    int num_preds = 0;
+    for (int b = 0; b < func->num_blocks; b++) num_preds += func->blocks[b].num_preds;
+    cache_key_add(key, func->preds, num_preds * sizeof(int));
+
+    // Globals, callees and inline assembly by what they are, not their number
+    const IrProgram* program = cg->program;
+    cache_key_add_int(key, func->num_insns);
+    for (int i = 0; i < func->num_insns; i++) {
+        IrInsn insn = func->insns[i];
+        int b = insn.b;
+        if (insn.op == IR_LOAD || insn.op == IR_STORE || insn.op == IR_CALL || insn.op == IR_ASM) insn.b = -1;
+        cache_key_add(key, &insn, sizeof(insn));
+        if (insn.op == IR_LOAD || insn.op == IR_STORE) {
+            const IrGlobal* global = &program->globals[b];
+            cache_key_add_string(key, global->name);
+            cache_key_add_int(key, global->is_mmio);
+            cache_key_add_int(key, global->address);
+            cache_key_add_int(key, cg->global_reg[b]);
+        } else if (insn.op == IR_CALL) {
+            const IrFunction* callee = &program->funcs[b];
+            cache_key_add_string(key, callee->name);
+            cache_key_add_int(key, callee->num_params);
+            cache_key_add_int(key, callee->num_reg_params);
+        } else if (insn.op == IR_ASM) {
+            cache_key_add_string(key, program->asm_texts[b]);
         }
+    }
+}
 
-        // --- Pointers and Memory ---
-        case NODE_PTR: {
-            if (strcmp(node->value, "alloc") == 0) {
-                // Simple alloc: increment heap pointer (using brk)
-                fprintf(output, "  mov eax, 45\n");  // SYS_BRK
-                fprintf(output, "  xor ebx, ebx\n");
-                fprintf(output, "  int 0x80\n");
-                fprintf(output, "  add eax, %s\n", node->children[0]->value);
-                fprintf(output, "  mov ebx, eax\n");
-                fprintf(output, "  mov eax, 45\n");
-                fprintf(output, "  int 0x80\n");
-            } else if (strcmp(node->value, "free") == 0) {
-                // No-op for this simple implementation
-            } else {
-                // Pointer assignment
-                Symbol* sym = find_symbol(node->value);
-                if (sym && sym->type == SYM_PTR) {
-                    fprintf(output, "  mov eax, [ebp - %d]\n", sym->address);
-                    fprintf(output, "  mov [eax], %s\n", node->children[0]->value);
-                }
-            }
-            break;
+// Allocate registers for one function and generate it into its own output,
+// with the worker's arena and counters; a function found in the cache skips
+// all of that
+static void generate_function(void* context, int task, int worker) {
+    CodeGen* cg = context;
+    IrFunction* func = &cg->program->funcs[cg->order[task]];
+    Arena* arena = &cg->arenas[worker];
+    FuncGen gen;
+    memset(&gen, 0, sizeof(gen));
+    gen.cg = cg;
+    gen.func = func;
+    gen.label_base = cg->label_base[task];
+    gen.worker = worker;
+    insn_list_init(&gen.code);
+    TraceMark function_mark, mark;
+    trace_begin(cg->tracer, &function_mark, arena);
+
+    CacheKey key;
+    int cached = 0;
+    if (cg->cache) {
+        trace_begin(cg->tracer, &mark, arena);
+        function_key(cg, func, &key);
+        cached = cache_load(cg->cache, &key, &gen.code, gen.label_base, arena, &cg->cache_stats[worker]);
+        trace_end(cg->tracer, &mark, "cache", "pass", worker, arena);
+    }
+    if (!cached) {
+        Allocation alloc;
+        trace_begin(cg->tracer, &mark, arena);
+        int failed = allocate_registers(func, ALL_REGS & ~cg->global_reserved, &alloc, arena);
+        trace_end(cg->tracer, &mark, "regalloc", "pass", worker, arena);
+        if (failed) {
+            cg->outputs[task].failed = 1;
+            if (cg->cache) cache_key_free(&key);
+            insn_list_free(&gen.code);
+            trace_end(cg->tracer, &function_mark, func->name, "function", worker, arena);
+            return;
         }
+        gen.alloc = &alloc;
+        trace_begin(cg->tracer, &mark, arena);
+        emit_function(&gen);
+        trace_end(cg->tracer, &mark, "select", "pass", worker, arena);
+        if (cg->stats) {
+            trace_begin(cg->tracer, &mark, arena);
+            peephole(&gen.code, &cg->stats[worker]);
+            trace_end(cg->tracer, &mark, "peephole", "pass", worker, arena);
+        }
+        if (cg->cache) {
+            trace_begin(cg->tracer, &mark, arena);
+            cache_store(cg->cache, &key, &gen.code, gen.label_base, &cg->cache_stats[worker]);
+            trace_end(cg->tracer, &mark, "cache", "pass", worker, arena);
+        }
+    }
+    if (cg->cache) cache_key_free(&key);
+    if (cg->stack_usage) {
+        StackUsage* usage = &cg->stack_usage[cg->order[task]];
+        usage->name = func->name;
+        usage->is_entry = func->is_entry;
+        stack_measure(&gen.code, cg->callees, cg->program->num_funcs, usage, arena);
+    }
 
-        // Inside codegen() for NODE_PTR:
-        /*
-        case NODE_PTR: {
-            Symbol* ptr_sym = check_symbol_exists(node->value);
-            if (ptr_sym && ptr_sym->data_type != DT_PTR) {
-                error("Expected pointer type", node->value);
-            }
+    FuncOutput* output = &cg->outputs[task];
+    if (cg->format != FORMAT_ASM) {
+        output->code = gen.code;
+        trace_end(cg->tracer, &function_mark, func->name, "function", worker, arena);
+        return;
+    }
+    text_init(&output->text, (size_t)gen.code.count * TEXT_BYTES_PER_INSN);
+    insn_list_format(&output->text, &gen.code);
+    text_append(&output->text, "\n", 1);
+    insn_list_free(&gen.code);
+    trace_end(cg->tracer, &function_mark, func->name, "function", worker, arena);
+}
 
-            // Handle dereference (*ptr = ...)
-            if (node->num_children > 0) {
-                codegen(node->children[0], output); // Value to assign
-                fprintf(output, "  mov [%s], eax\n", reg_names[ptr_sym->reg]);
-            }
-            break;
+// Generate NASM assembly, an ELF object or a flat image for the whole program.
+// Functions are independent once the global registers are chosen, so they
+// are generated on 'num_workers' threads and written out in program order.
+int codegen(IrProgram* program, FILE* output, OutputFormat format, int num_workers, const Cache* cache,
+            Arena* arena, PeepholeStats* stats, CacheStats* cache_stats, Tracer* tracer,
+            StackUsage* stack_usage) {
+    if (num_workers < 1) num_workers = 1;
+    if (num_workers > MAX_WORKERS) num_workers = MAX_WORKERS;
+    CodeGen cg;
+    memset(&cg, 0, sizeof(cg));
+    cg.program = program;
+    cg.format = format;
+    cg.cache = cache;
+    cg.tracer = tracer;
+    cg.stack_usage = stack_usage;
+    cg.global_reg = arena_alloc(arena, (program->num_globals + 1) * sizeof(int));
+    assign_global_registers(&cg);
+
+    // Entry point first: run global initializers, call main, exit with its result
+    int num_funcs = program->num_funcs;
+    int entry = num_funcs > 0 && program->funcs[num_funcs - 1].is_entry ? num_funcs - 1 : -1;
+    cg.order = arena_alloc(arena, (num_funcs + 1) * sizeof(int));
+    cg.label_base = arena_alloc(arena, (num_funcs + 1) * sizeof(int));
+    int count = 0;
+    if (entry >= 0) cg.order[count++] = entry;
+    for (int f = 0; f < num_funcs; f++) {
+        if (f != entry) cg.order[count++] = f;
+    }
+    int label = 0;
+    for (int i = 0; i < num_funcs; i++) {
+        cg.label_base[i] = label;
+        label += program->funcs[cg.order[i]].num_blocks;
+    }
+
+    // Measuring the stack needs what each callee pops on return
+    if (stack_usage) {
+        cg.callees = arena_alloc(arena, (num_funcs + 1) * sizeof(StackFunction));
+        for (int f = 0; f < num_funcs; f++) {
+            cg.callees[f].name = program->funcs[f].name;
+            cg.callees[f].index = f;
+            cg.callees[f].popped = popped_by_callee(&program->funcs[f]);
         }
-        */
-
-        // --- Binary Operations ---
-        // Inside codegen() for NODE_BINOP:
-        case NODE_BINOP: {
-            DataType left_type = get_expression_type(node->children[0]);
-            DataType right_type = get_expression_type(node->children[1]);
-
-            // Allow int + byte (promote byte to int)
-            if (left_type == DT_BYTE && right_type == DT_INT) {
-                left_type = DT_INT;
-            } else if (right_type == DT_BYTE && left_type == DT_INT) {
-                right_type = DT_INT;
-            }
+        stack_sort(cg.callees, num_funcs);
+    }
 
-            check_type(left_type, right_type, "binary operation");
-            codegen(node->children[0], output);
-            fprintf(output, "  push eax\n");
-            codegen(node->children[1], output);
-            fprintf(output, "  pop ebx\n");
+    cg.outputs = calloc(num_funcs + 1, sizeof(FuncOutput));
+    cg.arenas = malloc(num_workers * sizeof(Arena));
+    cg.stats = stats ? calloc(num_workers, sizeof(PeepholeStats)) : NULL;
+    cg.cache_stats = calloc(num_workers, sizeof(CacheStats));
+    if (!cg.outputs || !cg.arenas || (stats && !cg.stats) || !cg.cache_stats) {
+        fprintf(stderr, "Error: Out of memory\n");
+        exit(1);
+    }
+    for (int w = 0; w < num_workers; w++) {
+        arena_init(&cg.arenas[w], arena->block_size);
+        arena_lend_spare(arena, &cg.arenas[w]);
+    }
 
-            // Handle operation based on type
-            if (left_type == DT_PTR || right_type == DT_PTR) {
-                error("Invalid operation for pointer type", node->value);
-            }
+    run_tasks(num_funcs, num_workers, generate_function, &cg);
+
+    // Worker memory lives as long as the compilation, like everything else
+    for (int w = 0; w < num_workers; w++) {
+        arena_adopt(arena, &cg.arenas[w]);
+        if (cache_stats) {
+            cache_stats->hits += cg.cache_stats[w].hits;
+            cache_stats->misses += cg.cache_stats[w].misses;
+            cache_stats->stores += cg.cache_stats[w].stores;
+            cache_stats->bytes_read += cg.cache_stats[w].bytes_read;
+            cache_stats->bytes_written += cg.cache_stats[w].bytes_written;
+        }
+        if (!stats) continue;
+        for (int r = 0; r < MAX_PEEPHOLE_RULES; r++) stats->fired[r] += cg.stats[w].fired[r];
+        stats->insns_in += cg.stats[w].insns_in;
+        stats->insns_out += cg.stats[w].insns_out;
+        stats->passes += cg.stats[w].passes;
+    }
 
-            switch (node->value[0]) {
-                case '+': fprintf(output, "  add eax, ebx\n"); break;
-                case '-': fprintf(output, "  sub eax, ebx\n"); break;
-                case '*': fprintf(output, "  imul eax, ebx\n"); break;
-                case '/': fprintf(output, "  idiv ebx\n"); break;
-            }
-            break;
+    // A function that failed was reported by its worker; nothing is written
+    int failed = 0;
+    for (int i = 0; i < num_funcs; i++) {
+        if (cg.outputs[i].failed) failed = 1;
+    }
+
+    TraceMark mark;
+    ObjectFile object;
+    if (format != FORMAT_ASM) {
+        trace_begin(tracer, &mark, arena);
+        object_init(&object);
+        for (int i = 0; i < num_funcs; i++) {
+            if (!failed && object_assemble(&object, &cg.outputs[i].code) != 0) failed = 1;
+            insn_list_free(&cg.outputs[i].code);
+        }
+        trace_end(tracer, &mark, "assemble", "pass", 0, arena);
+    }
+    trace_begin(tracer, &mark, arena);
+
+    // Assembly text goes out in one write of every piece: the header, each
+    // function and the data
+    TextBuffer header, data;
+    text_init(&header, 64);
+    text_init(&data, 0);
+    text_string(&header, "bits 32\nsection .text\n");
+    if (entry >= 0) text_string(&header, "global _start\n");
+
+    // Storage for memory globals; MMIO globals live at their fixed address
+    for (int g = 0; g < program->num_globals; g++) {
+        IrGlobal* global = &program->globals[g];
+        int size = global->data_type == DT_BYTE ? 1 : 4;
+        if (format != FORMAT_ASM) {
+            if (global->is_mmio) object_add_device(&object, global->name, global->address, size);
+            else if (cg.global_reg[g] < 0) object_add_data(&object, global->name, size);
+            continue;
         }
+        if (global->is_mmio || cg.global_reg[g] >= 0) continue;
+        if (data.size == 0) text_string(&data, "section .data\n");
+        text_string(&data, global->name);
+        text_string(&data, size == 1 ? ": db 0\n" : ": dd 0\n");
+    }
 
-        // --- Default: Error ---
-        default:
-            fprintf(stderr, "Error: Unknown node type %d\n", node->type);
+    // Profile counters go last, so they end where the data does
+    if (program->num_counters > 0) {
+        if (format != FORMAT_ASM) {
+            object_add_data(&object, PROFILE_COUNTERS, 4 * program->num_counters);
+        } else {
+            if (data.size == 0) text_string(&data, "section .data\n");
+            text_string(&data, PROFILE_COUNTERS ": times ");
+            text_int(&data, program->num_counters);
+            text_string(&data, " dd 0\n");
+        }
+    }
+
+    if (failed) {
+        for (int i = 0; i < num_funcs; i++) text_free(&cg.outputs[i].text);
+        if (format != FORMAT_ASM) object_free(&object);
+    } else if (format == FORMAT_ASM) {
+        TextBuffer* parts = malloc((num_funcs + 2) * sizeof(TextBuffer));
+        if (!parts) {
+            fprintf(stderr, "Error: Out of memory\n");
             exit(1);
+        }
+        parts[0] = header;
+        for (int i = 0; i < num_funcs; i++) parts[i + 1] = cg.outputs[i].text;
+        parts[num_funcs + 1] = data;
+        if (text_write(output, parts, num_funcs + 2) != 0) {
+            fprintf(stderr, "Error: Cannot write the output\n");
+            failed = 1;
+        }
+        for (int i = 0; i < num_funcs; i++) text_free(&cg.outputs[i].text);
+        free(parts);
+    } else {
+        if (object_write(&object, format, output) != 0) {
+            failed = 1;
+        } else if (ferror(output)) {
+            fprintf(stderr, "Error: Cannot write the output\n");
+            failed = 1;
+        }
+        object_free(&object);
     }
-}
\ No newline at end of file
+    text_free(&header);
+    text_free(&data);
+    trace_end(tracer, &mark, "write", "pass", 0, arena);
+    free(cg.outputs);
+    free(cg.arenas);
+    free(cg.stats);
+    free(cg.cache_stats);
+    return failed;
+}
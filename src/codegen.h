@@ -1,17 +1,27 @@
 // codegen.h
-void codegen(ASTNode* root, FILE* output);
+#ifndef CODEGEN_H
+#define CODEGEN_H
 
-typedef enum {
-    DT_INT,     // Integer type (32-bit)
-    DT_BYTE,    // Byte type (8-bit)
-    DT_PTR      // Pointer type (32-bit address)
-} DataType;
+#include <stdio.h>
+#include "arena.h"
+#include "ir.h"
+#include "object.h"
+#include "peephole.h"
+#include "cache.h"
+#include "trace.h"
+#include "stack.h"
 
-typedef struct Symbol {
-    char* name;
-    enum { SYM_REG, SYM_MEM, SYM_PTR } storage_type;
-    DataType data_type;       // Data type (int, byte, ptr)
-    int reg;                  // Register ID (eax=0, ebx=1, etc.)
-    int address;              // Memory address or offset
-    struct Symbol* next;
-} Symbol;
\ No newline at end of file
+// Allocate registers and emit NASM assembly, an ELF32 object or a flat image
+// from the IR, generating functions on 'num_workers' threads; the output is
+// the same for any number. 'peephole_stats' NULL skips the peephole pass.
+// With a 'cache', functions whose code is already stored there are reused
+// and new ones are added; 'cache_stats' counts both. A 'tracer' gets a span
+// per function and pass and the time of each IR op selected. A non-NULL
+// 'stack_usage' gets the stack use of each function, in program order.
+// Returns nonzero after reporting an error, such as code that cannot be
+// encoded or output that could not be written.
+int codegen(IrProgram* program, FILE* output, OutputFormat format, int num_workers, const Cache* cache,
+            Arena* arena, PeepholeStats* peephole_stats, CacheStats* cache_stats, Tracer* tracer,
+            StackUsage* stack_usage);
+
+#endif
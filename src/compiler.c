@@ -0,0 +1,333 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "compiler.h"
+#include "lexer.h"
+#include "parser.h"
+#include "fold.h"
+#include "ir.h"
+#include "lower.h"
+#include "inline.h"
+#include "loop.h"
+#include "codegen.h"
+#include "threadpool.h"
+#include "cache.h"
+#include "sim.h"
+#include "profile.h"
+
+#define NUM_PHASES 6
+
+// Arena counters captured at the end of each phase
+typedef struct {
+    const char* name;
+    size_t allocations;
+    size_t bytes;
+} PhaseMemory;
+
+// Helper function to record how much a phase took from the arena
+static void record_phase(PhaseMemory* phase, const char* name, Arena* arena,
+                         size_t* last_allocations, size_t* last_bytes) {
+    phase->name = name;
+    phase->allocations = arena->num_allocations - *last_allocations;
+    phase->bytes = arena->bytes_allocated - *last_bytes;
+    *last_allocations = arena->num_allocations;
+    *last_bytes = arena->bytes_allocated;
+}
+
+// Print bytes and allocation counts per phase
+static void print_mem_report(PhaseMemory* phases, int num_phases, Arena* arena) {
+    fprintf(stderr, "Memory report:\n");
+    fprintf(stderr, "  %-10s %12s %14s\n", "phase", "allocations", "bytes");
+    for (int i = 0; i < num_phases; i++) {
+        fprintf(stderr, "  %-10s %12zu %14zu\n",
+                phases[i].name, phases[i].allocations, phases[i].bytes);
+    }
+    fprintf(stderr, "  %-10s %12zu %14zu\n",
+            "total", arena->num_allocations, arena->bytes_allocated);
+    fprintf(stderr, "  reserved %zu bytes in %zu arena blocks\n",
+            arena->bytes_reserved, arena->num_blocks);
+}
+
+void compile_options_init(CompileOptions* options) {
+    memset(options, 0, sizeof(*options));
+    options->opt_level = 1;
+    options->callconv = CALLCONV_CDECL;
+    options->format = FORMAT_ASM;
+    options->num_workers = 1;
+    options->run_limit = SIM_DEFAULT_LIMIT;
+}
+
+int compile_option(CompileOptions* options, const char* arg) {
+    if (strcmp(arg, "--mem-report") == 0) {
+        options->mem_report = 1;
+    } else if (strcmp(arg, "--peephole-report") == 0) {
+        options->peephole_report = 1;
+    } else if (strcmp(arg, "--inline-report") == 0) {
+        options->inline_report = 1;
+    } else if (strcmp(arg, "--dump-ir") == 0) {
+        options->dump_ir = 1;
+    } else if (strcmp(arg, "--cache-report") == 0) {
+        options->cache_report = 1;
+    } else if (strcmp(arg, "--time-report") == 0) {
+        options->time_report = 1;
+    } else if (strcmp(arg, "--stack-usage") == 0) {
+        options->stack_usage = 1;
+    } else if (strncmp(arg, "--trace=", 8) == 0 && arg[8] != '\0') {
+        options->trace_path = arg + 8;
+    } else if (strcmp(arg, "--run") == 0) {
+        options->run = 1;
+    } else if (strncmp(arg, "--run-limit=", 12) == 0) {
+        char* end;
+        long n = strtol(arg + 12, &end, 10);
+        if (arg[12] == '\0' || *end != '\0' || n < 1) {
+            fprintf(stderr, "Error: --run-limit needs a positive instruction count\n");
+            return -1;
+        }
+        options->run_limit = n;
+    } else if (strcmp(arg, "-fprofile-generate") == 0) {
+        options->profile_generate = PROFILE_DEFAULT_PATH;
+    } else if (strncmp(arg, "-fprofile-generate=", 19) == 0 && arg[19] != '\0') {
+        options->profile_generate = arg + 19;
+    } else if (strcmp(arg, "-fprofile-use") == 0) {
+        options->profile_use = PROFILE_DEFAULT_PATH;
+    } else if (strncmp(arg, "-fprofile-use=", 14) == 0 && arg[14] != '\0') {
+        options->profile_use = arg + 14;
+    } else if (strncmp(arg, "--cache-dir=", 12) == 0 && arg[12] != '\0') {
+        options->cache_dir = arg + 12;
+    } else if (strcmp(arg, "--callconv=cdecl") == 0) {
+        options->callconv = CALLCONV_CDECL;
+    } else if (strcmp(arg, "--callconv=fastcall") == 0) {
+        options->callconv = CALLCONV_FASTCALL;
+    } else if (strncmp(arg, "--callconv=", 11) == 0) {
+        fprintf(stderr, "Error: Unknown calling convention %s\n", arg + 11);
+        return -1;
+    } else if (strcmp(arg, "--format=asm") == 0) {
+        options->format = FORMAT_ASM;
+    } else if (strcmp(arg, "--format=elf") == 0) {
+        options->format = FORMAT_ELF;
+    } else if (strcmp(arg, "--format=bin") == 0) {
+        options->format = FORMAT_BIN;
+    } else if (strncmp(arg, "--format=", 9) == 0) {
+        fprintf(stderr, "Error: Unknown output format %s\n", arg + 9);
+        return -1;
+    } else if (strcmp(arg, "-O0") == 0) {
+        options->opt_level = 0;
+    } else if (strcmp(arg, "-O1") == 0) {
+        options->opt_level = 1;
+    } else if (strncmp(arg, "-j", 2) == 0) {
+        // Threads generating function bodies
+        char* end;
+        long n = strtol(arg + 2, &end, 10);
+        if (arg[2] == '\0' || *end != '\0' || n < 1 || n > MAX_WORKERS) {
+            fprintf(stderr, "Error: -j needs a thread count from 1 to %d\n", MAX_WORKERS);
+            return -1;
+        }
+        options->num_workers = (int)n;
+    } else {
+        return 0;
+    }
+    return 1;
+}
+
+// Helper function to simulate a program's flat image and report the run;
+// an instrumented program's counters are written to 'profile_path'
+static int run_program(const IrProgram* program, const char* image, size_t size, long limit,
+                       const Profile* profile, const char* profile_path, FILE* output) {
+    if (program->num_funcs == 0 || !program->funcs[program->num_funcs - 1].is_entry) {
+        fprintf(stderr, "Error: --run needs a main function\n");
+        return 1;
+    }
+    SimDevice* devices = malloc((program->num_globals + 1) * sizeof(SimDevice));
+    if (!devices) {
+        fprintf(stderr, "Error: Out of memory\n");
+        exit(1);
+    }
+    int num_devices = 0;
+    for (int g = 0; g < program->num_globals; g++) {
+        const IrGlobal* global = &program->globals[g];
+        if (!global->is_mmio) continue;
+        devices[num_devices].name = global->name;
+        devices[num_devices].address = global->address;
+        devices[num_devices].size = global->data_type == DT_BYTE ? 1 : 4;
+        num_devices++;
+    }
+
+    SimResult result;
+    int failed = simulate((const unsigned char*)image, size, devices, num_devices, limit, &result);
+    sim_report(&result, limit, output);
+    if (failed) {
+        fprintf(stderr, "Error: Run stopped: %s\n", result.fault);
+    } else if (profile_path) {
+        // The counters end the data, which ends the image
+        const unsigned char* counters = result.memory + result.image_size - 4 * program->num_counters;
+        if (profile_write(profile, counters, profile_path) != 0) {
+            fprintf(stderr, "Error: Cannot write %s\n", profile_path);
+            failed = 1;
+        }
+    }
+    sim_result_free(&result);
+    free(devices);
+    return failed;
+}
+
+void compiler_init(Compiler* compiler) {
+    arena_init(&compiler->arena, ARENA_BLOCK_SIZE);
+    intern_init(&compiler->names, &compiler->arena);
+    tracer_init(&compiler->tracer);
+}
+
+int compile_source(Compiler* compiler, const CompileOptions* options,
+                   const char* source, size_t length, FILE* output) {
+    // Only the simulator writes the counters out; a program built to run
+    // elsewhere would count and then lose the counts
+    if (options->profile_generate && !options->run) {
+        fprintf(stderr, "Error: -fprofile-generate needs --run\n");
+        return 1;
+    }
+    Cache cache;
+    if (options->cache_dir && cache_open(&cache, options->cache_dir) != 0) {
+        fprintf(stderr, "Error: Cannot create cache directory %s\n", options->cache_dir);
+        return 1;
+    }
+
+    // Every phase allocates from one arena that lives as long as the compilation
+    Arena* arena = &compiler->arena;
+    PhaseMemory phases[NUM_PHASES];
+    size_t last_allocations = 0, last_bytes = 0;
+
+    // Spans are only recorded when asked for; the report covers this
+    // compilation's events alone
+    Tracer* tracer = options->time_report || options->trace_path ? &compiler->tracer : NULL;
+    int first_event[MAX_WORKERS];
+    for (int w = 0; w < MAX_WORKERS; w++) first_event[w] = compiler->tracer.workers[w].num_events;
+    if (tracer) trace_reset_kinds(tracer);
+    TraceMark mark;
+
+    // Lex, parse, fold, lower to IR, inline, optimize loops, generate code
+    TokenStream tokens;
+    trace_begin(tracer, &mark, arena);
+    int failed = tokenize(&tokens, source, length, &compiler->names);
+    trace_end(tracer, &mark, "lex", "phase", 0, arena);
+    record_phase(&phases[0], "lex", arena, &last_allocations, &last_bytes);
+    ASTNode* ast = NULL;
+    if (!failed) {
+        trace_begin(tracer, &mark, arena);
+        ast = parse(&tokens, arena);
+        failed = !ast;
+        trace_end(tracer, &mark, "parse", "phase", 0, arena);
+    }
+    record_phase(&phases[1], "parse", arena, &last_allocations, &last_bytes);
+    if (options->opt_level >= 1 && !failed) {
+        trace_begin(tracer, &mark, arena);
+        fold_constants(ast, arena);
+        trace_end(tracer, &mark, "fold", "phase", 0, arena);
+    }
+    record_phase(&phases[2], "fold", arena, &last_allocations, &last_bytes);
+    IrProgram program;
+    memset(&program, 0, sizeof(program));
+    if (!failed) {
+        trace_begin(tracer, &mark, arena);
+        failed = lower_program(ast, &program, options->callconv, arena, tracer);
+        trace_end(tracer, &mark, "lower", "phase", 0, arena);
+    }
+    record_phase(&phases[3], "lower", arena, &last_allocations, &last_bytes);
+    if (options->opt_level >= 1 && !failed) {
+        trace_begin(tracer, &mark, arena);
+        inline_functions(&program, options->inline_report ? stderr : NULL, arena);
+        trace_end(tracer, &mark, "inline", "phase", 0, arena);
+        trace_begin(tracer, &mark, arena);
+        optimize_loops(&program, arena);
+        trace_end(tracer, &mark, "loops", "phase", 0, arena);
+    }
+
+    // Profiles work on the optimized IR: counters go in, then the layout
+    // follows the counts, which ignore them
+    Profile profile, counts;
+    if ((options->profile_generate || options->profile_use) && !failed) {
+        trace_begin(tracer, &mark, arena);
+        if (options->profile_generate) profile_instrument(&program, &profile, arena);
+        if (options->profile_use) {
+            if (profile_read(&counts, options->profile_use, arena) != 0) {
+                fprintf(stderr, "Error: Cannot read profile %s\n", options->profile_use);
+                failed = 1;
+            } else {
+                profile_layout(&program, &counts, arena);
+            }
+        }
+        trace_end(tracer, &mark, "profile", "phase", 0, arena);
+    }
+    record_phase(&phases[4], "optimize", arena, &last_allocations, &last_bytes);
+    if (options->dump_ir && !failed) {
+        ir_dump(stdout, &program);
+        fflush(stdout);
+    }
+    PeepholeStats stats;
+    memset(&stats, 0, sizeof(stats));
+    CacheStats cache_stats;
+    memset(&cache_stats, 0, sizeof(cache_stats));
+    // A run simulates the flat image, built in memory
+    char* image = NULL;
+    size_t image_size = 0;
+    FILE* code = output;
+    if (options->run && !failed) {
+        code = open_memstream(&image, &image_size);
+        if (!code) {
+            fprintf(stderr, "Error: Out of memory\n");
+            exit(1);
+        }
+    }
+    StackUsage* stack_usage = NULL;
+    if (options->stack_usage && !failed) {
+        stack_usage = arena_alloc(arena, (program.num_funcs + 1) * sizeof(StackUsage));
+    }
+    if (!failed) {
+        trace_begin(tracer, &mark, arena);
+        if (codegen(&program, code, options->run ? FORMAT_BIN : options->format, options->num_workers,
+                    options->cache_dir ? &cache : NULL, arena, options->opt_level >= 1 ? &stats : NULL,
+                    &cache_stats, tracer, stack_usage) != 0) {
+            failed = 1;
+        }
+        trace_end(tracer, &mark, "codegen", "phase", 0, arena);
+    }
+    record_phase(&phases[5], "codegen", arena, &last_allocations, &last_bytes);
+    if (code != output) {
+        fclose(code);
+        if (!failed) {
+            trace_begin(tracer, &mark, arena);
+            failed = run_program(&program, image, image_size, options->run_limit, &profile,
+                                 options->profile_generate, output);
+            trace_end(tracer, &mark, "run", "phase", 0, arena);
+        }
+        free(image);
+    }
+
+    if (options->mem_report) {
+        print_mem_report(phases, NUM_PHASES, arena);
+        fprintf(stderr, "  %d tokens (%zu bytes), %d distinct identifiers\n",
+                tokens.count, tokens.capacity * sizeof(Token), compiler->names.count);
+    }
+    if (options->peephole_report && options->opt_level >= 1) {
+        peephole_report(&stats, stderr);
+    }
+    if (options->cache_report && options->cache_dir) {
+        cache_report(&cache_stats, stderr);
+    }
+    if (stack_usage && !failed) {
+        stack_report(stack_usage, program.num_funcs, stderr);
+    }
+    if (options->time_report) {
+        trace_report(&compiler->tracer, first_event, stderr);
+    }
+
+    // Ready for the next source: names and arena blocks stay allocated
+    token_stream_free(&tokens);
+    intern_reset(&compiler->names);
+    arena_reset(arena);
+    return failed;
+}
+
+void compiler_free(Compiler* compiler) {
+    tracer_free(&compiler->tracer);
+    intern_free(&compiler->names);
+    arena_free(&compiler->arena);
+}
@@ -0,0 +1,58 @@
+// compiler.h
+#ifndef COMPILER_H
+#define COMPILER_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include "arena.h"
+#include "intern.h"
+#include "parser.h"
+#include "object.h"
+#include "trace.h"
+
+// How to compile; the reports go to stderr
+typedef struct {
+    int opt_level;
+    CallConv callconv;
+    OutputFormat format;
+    int num_workers;
+    int mem_report;
+    int peephole_report;
+    int inline_report;
+    int dump_ir;            // Printed to stdout before code generation
+    const char* cache_dir;  // Function cache shared between runs, NULL for none
+    int cache_report;
+    int time_report;        // Time and memory per phase, pass, node kind and IR op
+    int stack_usage;        // Stack depth per function and along the deepest call chain
+    const char* trace_path; // Chrome trace of every compilation, NULL for none
+    int run;                // Simulate the flat image and write a run report instead
+    long run_limit;         // Instructions a run may retire
+    const char* profile_generate;   // Count blocks; only with --run, which writes the counts here
+    const char* profile_use;        // Block counts to lay functions out by
+} CompileOptions;
+
+// State that outlives one compilation: the arena keeps its blocks and the
+// intern table its arrays, so later sources start with warm allocators. The
+// tracer collects the spans of every compilation for one trace file.
+typedef struct {
+    Arena arena;
+    InternTable names;
+    Tracer tracer;
+} Compiler;
+
+void compile_options_init(CompileOptions* options);
+// Apply one command-line flag such as -O0, --format=elf, -j4,
+// --cache-dir=dir, --trace=file, --run or -fprofile-use=file. Returns 1 if
+// it was applied, 0 if it is not a compile option, -1 after reporting a bad
+// value.
+int compile_option(CompileOptions* options, const char* arg);
+
+void compiler_init(Compiler* compiler);
+// Compile one source buffer into 'output', or with 'run' set simulate it and
+// write the run report there. Returns nonzero if errors were reported or the
+// run faulted.
+int compile_source(Compiler* compiler, const CompileOptions* options,
+                   const char* source, size_t length, FILE* output);
+void compiler_free(Compiler* compiler);
+
+#endif
@@ -0,0 +1,372 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "encode.h"
+
+// Hardware numbers of the register IDs: eax ebx ecx edx esi edi esp ebp
+static const unsigned char hw_reg[] = {0, 3, 1, 2, 6, 7, 4, 5};
+
+// Condition codes of je, jne, jl, jge, jle, jg and the matching setcc
+static const unsigned char condition_codes[] = {0x4, 0x5, 0xC, 0xD, 0xE, 0xF};
+
+// Opcode extensions of the two-operand arithmetic group
+enum { ALU_ADD = 0, ALU_AND = 4, ALU_SUB = 5, ALU_XOR = 6, ALU_CMP = 7 };
+
+// The instruction being encoded
+typedef struct {
+    unsigned char* out;
+    int length;
+    int patch;              // Offset of the field to resolve, -1 if none
+    int failed;             // Set once an error is reported
+} Encoder;
+
+// --- Helper Functions ---
+
+static void byte(Encoder* e, int value) {
+    e->out[e->length++] = (unsigned char)value;
+}
+
+static void word(Encoder* e, int value) {
+    byte(e, value);
+    byte(e, value >> 8);
+}
+
+static void dword(Encoder* e, int value) {
+    word(e, value);
+    word(e, value >> 16);
+}
+
+static int fits_byte(int value) {
+    return value >= -128 && value <= 127;
+}
+
+static int is_byte(const Operand* operand) {
+    return operand->size == 1;
+}
+
+static int is_reg(const Operand* operand, int reg) {
+    return operand->kind == OPND_REG && operand->reg == reg;
+}
+
+// Helper function to check for an absolute address, with no base or index
+static int is_absolute(const Operand* operand) {
+    return operand->kind == OPND_MEM && operand->reg < 0 && !operand->scale;
+}
+
+// Helper function to give up on an instruction
+static void cannot_encode(Encoder* e, const Insn* insn) {
+    fprintf(stderr, "Error: Cannot encode instruction: ");
+    insn_print(stderr, insn);
+    e->failed = 1;
+}
+
+// A 32-bit address field: global references are resolved later
+static void address(Encoder* e, const Operand* operand) {
+    if (operand->name) e->patch = e->length;
+    dword(e, operand->value);
+}
+
+// ModRM byte with 'field' as the hardware register or opcode extension, plus the SIB
+// byte and displacement the register or memory operand 'rm' needs
+static void modrm(Encoder* e, int field, const Operand* rm) {
+    field = (field & 7) << 3;
+    if (rm->kind == OPND_REG) {
+        byte(e, 0xC0 | field | hw_reg[rm->reg]);
+        return;
+    }
+
+    int base = rm->reg;
+    int displacement = rm->value;
+    if (base < 0 && !rm->scale) {
+        byte(e, 0x05 | field);
+        address(e, rm);
+        return;
+    }
+
+    // No displacement byte is possible with ebp as the base
+    int mod = 2;
+    if (base < 0) mod = 0;
+    else if (displacement == 0 && base != REG_EBP) mod = 0;
+    else if (fits_byte(displacement)) mod = 1;
+
+    if (rm->scale || base == REG_ESP) {
+        static const unsigned char scale_bits[] = {0, 0, 1, 0, 2, 0, 0, 0, 3};
+        int index = rm->scale ? hw_reg[rm->index] : 4;
+        byte(e, mod << 6 | field | 4);
+        byte(e, scale_bits[rm->scale] << 6 | index << 3 | (base < 0 ? 5 : hw_reg[base]));
+    } else {
+        byte(e, mod << 6 | field | hw_reg[base]);
+    }
+    if (base < 0 || mod == 2) dword(e, displacement);
+    else if (mod == 1) byte(e, displacement);
+}
+
+// --- Instructions ---
+
+// add, sub, and, xor and cmp: immediates take the sign-extended imm8 form
+// when they fit, then eax's short form
+static void encode_alu(Encoder* e, const Insn* insn, int ext) {
+    const Operand* dst = &insn->dst;
+    const Operand* src = &insn->src;
+    int bytes = is_byte(dst) || is_byte(src);
+    if (src->kind == OPND_IMM) {
+        if (bytes) {
+            if (is_reg(dst, REG_EAX)) {
+                byte(e, ext << 3 | 0x04);
+            } else {
+                byte(e, 0x80);
+                modrm(e, ext, dst);
+            }
+            byte(e, src->value);
+        } else if (fits_byte(src->value)) {
+            byte(e, 0x83);
+            modrm(e, ext, dst);
+            byte(e, src->value);
+        } else if (is_reg(dst, REG_EAX)) {
+            byte(e, ext << 3 | 0x05);
+            dword(e, src->value);
+        } else {
+            byte(e, 0x81);
+            modrm(e, ext, dst);
+            dword(e, src->value);
+        }
+    } else if (src->kind == OPND_REG) {
+        byte(e, ext << 3 | (bytes ? 0x00 : 0x01));
+        modrm(e, hw_reg[src->reg], dst);
+    } else if (dst->kind == OPND_REG) {
+        byte(e, ext << 3 | (bytes ? 0x02 : 0x03));
+        modrm(e, hw_reg[dst->reg], src);
+    } else {
+        cannot_encode(e, insn);
+    }
+}
+
+static void encode_mov(Encoder* e, const Insn* insn) {
+    const Operand* dst = &insn->dst;
+    const Operand* src = &insn->src;
+    int bytes = is_byte(dst) || is_byte(src);
+    if (dst->kind == OPND_REG && src->kind == OPND_IMM) {
+        byte(e, (bytes ? 0xB0 : 0xB8) + hw_reg[dst->reg]);
+        if (bytes) byte(e, src->value);
+        else dword(e, src->value);
+    } else if (is_reg(dst, REG_EAX) && is_absolute(src)) {
+        byte(e, bytes ? 0xA0 : 0xA1);
+        address(e, src);
+    } else if (is_absolute(dst) && is_reg(src, REG_EAX)) {
+        byte(e, bytes ? 0xA2 : 0xA3);
+        address(e, dst);
+    } else if (src->kind == OPND_REG) {
+        byte(e, bytes ? 0x88 : 0x89);
+        modrm(e, hw_reg[src->reg], dst);
+    } else if (dst->kind == OPND_REG && src->kind == OPND_MEM) {
+        byte(e, bytes ? 0x8A : 0x8B);
+        modrm(e, hw_reg[dst->reg], src);
+    } else if (dst->kind == OPND_MEM && src->kind == OPND_IMM) {
+        byte(e, bytes ? 0xC6 : 0xC7);
+        modrm(e, 0, dst);
+        if (bytes) byte(e, src->value);
+        else dword(e, src->value);
+    } else {
+        cannot_encode(e, insn);
+    }
+}
+
+// test r/m, reg, or test r/m, imm with eax's short form
+static void encode_test(Encoder* e, const Insn* insn) {
+    const Operand* dst = &insn->dst;
+    const Operand* src = &insn->src;
+    int bytes = is_byte(dst) || is_byte(src);
+    if (src->kind == OPND_REG) {
+        byte(e, bytes ? 0x84 : 0x85);
+        modrm(e, hw_reg[src->reg], dst);
+    } else if (src->kind == OPND_IMM && is_reg(dst, REG_EAX)) {
+        byte(e, bytes ? 0xA8 : 0xA9);
+        if (bytes) byte(e, src->value);
+        else dword(e, src->value);
+    } else if (src->kind == OPND_IMM) {
+        byte(e, bytes ? 0xF6 : 0xF7);
+        modrm(e, 0, dst);
+        if (bytes) byte(e, src->value);
+        else dword(e, src->value);
+    } else {
+        cannot_encode(e, insn);
+    }
+}
+
+// Shifts by a constant; a shift by one has its own opcode
+static void encode_shift(Encoder* e, const Insn* insn, int ext) {
+    int bytes = is_byte(&insn->dst);
+    if (insn->src.kind != OPND_IMM) {
+        cannot_encode(e, insn);
+        return;
+    }
+    if (insn->src.value == 1) {
+        byte(e, bytes ? 0xD0 : 0xD1);
+        modrm(e, ext, &insn->dst);
+    } else {
+        byte(e, bytes ? 0xC0 : 0xC1);
+        modrm(e, ext, &insn->dst);
+        byte(e, insn->src.value);
+    }
+}
+
+// neg, idiv and the one-operand imul share the F7 group
+static void encode_unary(Encoder* e, const Insn* insn, int ext) {
+    if (insn->dst.kind == OPND_NONE || insn->dst.kind == OPND_IMM) {
+        cannot_encode(e, insn);
+        return;
+    }
+    byte(e, is_byte(&insn->dst) ? 0xF6 : 0xF7);
+    modrm(e, ext, &insn->dst);
+}
+
+// inc and dec of a register have one-byte forms
+static void encode_inc_dec(Encoder* e, const Insn* insn, int ext) {
+    const Operand* dst = &insn->dst;
+    if (dst->kind == OPND_REG && !is_byte(dst)) {
+        byte(e, (ext ? 0x48 : 0x40) + hw_reg[dst->reg]);
+    } else {
+        byte(e, is_byte(dst) ? 0xFE : 0xFF);
+        modrm(e, ext, dst);
+    }
+}
+
+static void encode_imul(Encoder* e, const Insn* insn) {
+    const Operand* dst = &insn->dst;
+    const Operand* src = &insn->src;
+    if (dst->kind != OPND_REG) {
+        cannot_encode(e, insn);
+        return;
+    }
+    if (src->kind == OPND_IMM) {
+        // Three-operand form, dst = dst * imm
+        byte(e, fits_byte(src->value) ? 0x6B : 0x69);
+        modrm(e, hw_reg[dst->reg], dst);
+        if (fits_byte(src->value)) byte(e, src->value);
+        else dword(e, src->value);
+    } else {
+        byte(e, 0x0F);
+        byte(e, 0xAF);
+        modrm(e, hw_reg[dst->reg], src);
+    }
+}
+
+static void encode_push_pop(Encoder* e, const Insn* insn) {
+    const Operand* dst = &insn->dst;
+    int push = insn->op == OP_PUSH;
+    if (dst->kind == OPND_REG) {
+        byte(e, (push ? 0x50 : 0x58) + hw_reg[dst->reg]);
+    } else if (dst->kind == OPND_IMM && push) {
+        byte(e, fits_byte(dst->value) ? 0x6A : 0x68);
+        if (fits_byte(dst->value)) byte(e, dst->value);
+        else dword(e, dst->value);
+    } else if (dst->kind == OPND_MEM) {
+        byte(e, push ? 0xFF : 0x8F);
+        modrm(e, push ? 6 : 0, dst);
+    } else {
+        cannot_encode(e, insn);
+    }
+}
+
+int jump_length(Opcode op, int near) {
+    if (!near) return 2;
+    return op == OP_JMP ? 5 : 6;
+}
+
+int encode_insn(const Insn* insn, int near, int displacement, unsigned char* bytes, int* patch_at) {
+    Encoder encoder = {bytes, 0, -1, 0};
+    Encoder* e = &encoder;
+    switch (insn->op) {
+        case OP_NOP:
+        case OP_LABEL:
+            break;
+        case OP_ASM:
+            fprintf(stderr, "Error: Inline assembly needs --format=asm\n");
+            e->failed = 1;
+            break;
+        case OP_MOV:
+            encode_mov(e, insn);
+            break;
+        case OP_MOVZX:
+            if (insn->dst.kind != OPND_REG || !is_byte(&insn->src)) {
+                cannot_encode(e, insn);
+                break;
+            }
+            byte(e, 0x0F);
+            byte(e, 0xB6);
+            modrm(e, hw_reg[insn->dst.reg], &insn->src);
+            break;
+        case OP_LEA:
+            if (insn->dst.kind != OPND_REG || insn->src.kind != OPND_MEM) {
+                cannot_encode(e, insn);
+                break;
+            }
+            byte(e, 0x8D);
+            modrm(e, hw_reg[insn->dst.reg], &insn->src);
+            break;
+        case OP_ADD: encode_alu(e, insn, ALU_ADD); break;
+        case OP_SUB: encode_alu(e, insn, ALU_SUB); break;
+        case OP_AND: encode_alu(e, insn, ALU_AND); break;
+        case OP_XOR: encode_alu(e, insn, ALU_XOR); break;
+        case OP_CMP: encode_alu(e, insn, ALU_CMP); break;
+        case OP_TEST: encode_test(e, insn); break;
+        case OP_IMUL: encode_imul(e, insn); break;
+        case OP_NEG: encode_unary(e, insn, 3); break;
+        case OP_IMUL_WIDE: encode_unary(e, insn, 5); break;
+        case OP_IDIV: encode_unary(e, insn, 7); break;
+        case OP_INC: encode_inc_dec(e, insn, 0); break;
+        case OP_DEC: encode_inc_dec(e, insn, 1); break;
+        case OP_SHL: encode_shift(e, insn, 4); break;
+        case OP_SHR: encode_shift(e, insn, 5); break;
+        case OP_SAR: encode_shift(e, insn, 7); break;
+        case OP_SETE: case OP_SETNE: case OP_SETL: case OP_SETGE: case OP_SETLE: case OP_SETG:
+            byte(e, 0x0F);
+            byte(e, 0x90 | condition_codes[insn->op - OP_SETE]);
+            modrm(e, 0, &insn->dst);
+            break;
+        case OP_CDQ:
+            byte(e, 0x99);
+            break;
+        case OP_PUSH:
+        case OP_POP:
+            encode_push_pop(e, insn);
+            break;
+        case OP_CALL:
+            byte(e, 0xE8);
+            e->patch = e->length;
+            dword(e, 0);
+            break;
+        case OP_RET:
+            if (insn->dst.kind == OPND_IMM) {
+                byte(e, 0xC2);
+                word(e, insn->dst.value);
+            } else {
+                byte(e, 0xC3);
+            }
+            break;
+        case OP_JMP:
+            byte(e, near ? 0xE9 : 0xEB);
+            if (near) dword(e, displacement);
+            else byte(e, displacement);
+            break;
+        case OP_JE: case OP_JNE: case OP_JL: case OP_JGE: case OP_JLE: case OP_JG: {
+            int cc = condition_codes[insn->op - OP_JE];
+            if (near) {
+                byte(e, 0x0F);
+                byte(e, 0x80 | cc);
+                dword(e, displacement);
+            } else {
+                byte(e, 0x70 | cc);
+                byte(e, displacement);
+            }
+            break;
+        }
+        case OP_INT:
+            byte(e, 0xCD);
+            byte(e, insn->dst.value);
+            break;
+        default:
+            cannot_encode(e, insn);
+    }
+    *patch_at = e->patch;
+    return e->failed ? -1 : e->length;
+}
@@ -0,0 +1,22 @@
+// encode.h
+#ifndef ENCODE_H
+#define ENCODE_H
+
+#include "insn.h"
+
+// Longest encoding the code generator produces (opcode, ModRM, SIB, disp32, imm32)
+#define MAX_INSN_BYTES 12
+
+// Encode one instruction as x86-32 machine code into 'out' and return its
+// length; labels and deleted instructions take no bytes. Jumps use the
+// short rel8 form unless 'near', with 'displacement' counted from the end
+// of the instruction. Calls and memory operands naming a global get a 32-bit
+// field to resolve later, holding 0 or the operand's displacement; its
+// offset goes to 'patch_at', which is -1 otherwise. Returns -1 after
+// reporting inline assembly or an operand form x86 has no encoding for.
+int encode_insn(const Insn* insn, int near, int displacement, unsigned char* out, int* patch_at);
+
+// Length of a jump in its short or near form
+int jump_length(Opcode op, int near);
+
+#endif
@@ -0,0 +1,460 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "fold.h"
+#include "symbol_table.h"
+
+// Every variable in scope gets an index into the value arrays: globals first,
+// then the parameters and locals of the function being folded
+typedef struct {
+    SymbolTable symbols;
+    Arena* arena;
+    int* values;
+    unsigned char* known;
+    unsigned char* is_byte;
+    int num_vars, vars_capacity;
+    int num_globals;
+} Folder;
+
+// Helper function to grow the value arrays
+static void grow_vars(Folder* f) {
+    f->vars_capacity = f->vars_capacity ? f->vars_capacity * 2 : 256;
+    f->values = realloc(f->values, f->vars_capacity * sizeof(int));
+    f->known = realloc(f->known, f->vars_capacity);
+    f->is_byte = realloc(f->is_byte, f->vars_capacity);
+    if (!f->values || !f->known || !f->is_byte) {
+        fprintf(stderr, "Error: Out of memory\n");
+        exit(1);
+    }
+}
+
+// Helper function to declare a variable with an unknown value
+static Symbol* declare(Folder* f, ASTNode* decl) {
+    if (f->num_vars == f->vars_capacity) grow_vars(f);
+    Symbol* sym = symtab_add(&f->symbols, decl->value, decl->id);
+    sym->storage_type = SYM_MEM;
+    if (decl->num_children > 1) sym->storage_type = SYM_MMIO;
+    else if (decl->data_type == DT_PTR) sym->storage_type = SYM_PTR;  // Stays typed as a pointer
+    sym->data_type = decl->data_type;
+    sym->address = f->num_vars;
+    f->known[f->num_vars] = 0;
+    f->is_byte[f->num_vars] = decl->data_type == DT_BYTE;
+    f->num_vars++;
+    return sym;
+}
+
+// Helper function to find the value slot of a variable, or -1 for names
+// that are not variables or never hold a known value (memory-mapped I/O, pointers)
+static int variable_index(Folder* f, int id) {
+    Symbol* sym = symtab_find(&f->symbols, id);
+    if (!sym || sym->storage_type != SYM_MEM) return -1;
+    return sym->address;
+}
+
+// Helper function to record the value a variable holds after a store
+static void set_value(Folder* f, int var, ASTNode* value) {
+    if (var < 0) return;
+    if (value && value->type == NODE_NUMBER) {
+        f->known[var] = 1;
+        f->values[var] = f->is_byte[var] ? (value->number & 0xFF) : value->number;
+    } else {
+        f->known[var] = 0;
+    }
+}
+
+// Helper function to forget everything known about the current function's variables
+static void forget_locals(Folder* f) {
+    memset(f->known + f->num_globals, 0, f->num_vars - f->num_globals);
+}
+
+// Helper function to turn a node into an integer literal
+static ASTNode* make_number(Folder* f, ASTNode* node, int value) {
+    char text[16];
+    snprintf(text, sizeof(text), "%d", value);
+    node->type = NODE_NUMBER;
+    node->value = arena_strdup(f->arena, text);
+    node->number = value;
+    node->id = -1;
+    node->children = NULL;
+    node->num_children = 0;
+    return node;
+}
+
+// Helper function to create an empty block in place of a removed statement
+static ASTNode* make_block(Folder* f, ASTNode* like, ASTNode* child) {
+    ASTNode* block = arena_alloc(f->arena, sizeof(ASTNode));
+    memset(block, 0, sizeof(ASTNode));
+    block->type = NODE_BLOCK;
+    block->value = "block";
+    block->id = -1;
+    block->line = like->line;
+    if (child) {
+        block->children = arena_alloc(f->arena, sizeof(ASTNode*));
+        block->children[0] = child;
+        block->num_children = 1;
+    }
+    return block;
+}
+
+// Check whether evaluating an expression has no effect besides its value;
+// reading an 'at' global is a device read, which the device may act on
+static int is_pure(Folder* f, ASTNode* node) {
+    if (node->type == NODE_CALL || node->type == NODE_PTR) return 0;
+    if (node->type == NODE_IDENT) {
+        Symbol* sym = symtab_find(&f->symbols, node->id);
+        if (sym && sym->storage_type == SYM_MMIO) return 0;
+    }
+    for (int i = 0; i < node->num_children; i++) {
+        if (node->children[i] && !is_pure(f, node->children[i])) return 0;
+    }
+    return 1;
+}
+
+// Evaluate a binary operator on 32-bit two's complement values; returns 0 if
+// the result must be left to run time (division by zero, INT_MIN / -1)
+static int evaluate(const char* op, int left, int right, int* result) {
+    unsigned int a = (unsigned int)left, b = (unsigned int)right;
+    switch (op[0]) {
+        case '+': *result = (int)(a + b); return 1;
+        case '-': *result = (int)(a - b); return 1;
+        case '*': *result = (int)(a * b); return 1;
+        case '&': *result = (int)(a & b); return 1;
+        case '/':
+        case '%':
+            if (right == 0 || (a == 0x80000000u && right == -1)) return 0;
+            // Truncates toward zero like idiv; the remainder takes the dividend's sign
+            *result = op[0] == '/' ? left / right : left % right;
+            return 1;
+        case '<': *result = op[1] ? left <= right : left < right; return 1;
+        case '>': *result = op[1] ? left >= right : left > right; return 1;
+        case '=': *result = left == right; return 1;
+        case '!': *result = left != right; return 1;
+    }
+    return 0;
+}
+
+// Helper function to compute an expression from literals and known variables
+// without rewriting it; returns 0 if the value is not known
+static int evaluate_known(Folder* f, ASTNode* node, int* result) {
+    int left, right;
+    switch (node->type) {
+        case NODE_NUMBER:
+            *result = node->number;
+            return 1;
+        case NODE_IDENT: {
+            int var = variable_index(f, node->id);
+            if (var < 0 || !f->known[var]) return 0;
+            *result = f->values[var];
+            return 1;
+        }
+        case NODE_BINOP:
+            return evaluate_known(f, node->children[0], &left) &&
+                   evaluate_known(f, node->children[1], &right) &&
+                   evaluate(node->value, left, right, result);
+        default:
+            return 0;
+    }
+}
+
+// Helper function to record on a loop whether its first test must pass
+static void mark_entered(Folder* f, ASTNode* loop, ASTNode* cond) {
+    int value;
+    loop->number = cond && evaluate_known(f, cond, &value) && value;
+}
+
+// Fold an expression; returns the node that replaces it
+static ASTNode* fold_expr(Folder* f, ASTNode* node) {
+    if (!node) return NULL;
+
+    switch (node->type) {
+        case NODE_IDENT: {
+            int var = variable_index(f, node->id);
+            if (var >= 0 && f->known[var]) return make_number(f, node, f->values[var]);
+            return node;
+        }
+
+        case NODE_BINOP: {
+            ASTNode* left = node->children[0] = fold_expr(f, node->children[0]);
+            ASTNode* right = node->children[1] = fold_expr(f, node->children[1]);
+            char op = node->value[0];
+            int result;
+
+            if (left->type == NODE_NUMBER && right->type == NODE_NUMBER) {
+                if (evaluate(node->value, left->number, right->number, &result)) {
+                    return make_number(f, node, result);
+                }
+                return node;
+            }
+
+            // Reassociate (x + c1) + c2 and friends into a single constant
+            if (right->type == NODE_NUMBER && left->type == NODE_BINOP &&
+                left->children[1]->type == NODE_NUMBER) {
+                char inner = left->value[0];
+                int c1 = left->children[1]->number, c2 = right->number;
+                if ((op == '+' || op == '-') && (inner == '+' || inner == '-')) {
+                    unsigned int sum = (inner == '+' ? (unsigned int)c1 : -(unsigned int)c1) +
+                                       (op == '+' ? (unsigned int)c2 : -(unsigned int)c2);
+                    node->value = "+";
+                    node->children[0] = left->children[0];
+                    make_number(f, right, (int)sum);
+                    return fold_expr(f, node);
+                }
+                if ((op == '*' || op == '&') && inner == op) {
+                    evaluate(node->value, c1, c2, &result);
+                    node->children[0] = left->children[0];
+                    make_number(f, right, result);
+                    return fold_expr(f, node);
+                }
+            }
+
+            // Identities: x + 0, x - 0, x * 1, x / 1, x % 1, x & -1 and their mirrors
+            if (right->type == NODE_NUMBER) {
+                int c = right->number;
+                if (((op == '+' || op == '-') && c == 0) || ((op == '*' || op == '/') && c == 1) ||
+                    (op == '&' && c == -1)) {
+                    return left;
+                }
+                if ((op == '*' || op == '&') && c == 0 && is_pure(f, left)) return make_number(f, node, 0);
+                if (op == '%' && (c == 1 || c == -1) && is_pure(f, left)) return make_number(f, node, 0);
+            }
+            if (left->type == NODE_NUMBER) {
+                int c = left->number;
+                if ((op == '+' && c == 0) || (op == '*' && c == 1) || (op == '&' && c == -1)) {
+                    return right;
+                }
+                if ((op == '*' || op == '&') && c == 0 && is_pure(f, right)) return make_number(f, node, 0);
+            }
+            return node;
+        }
+
+        case NODE_DEREF:
+        case NODE_CALL:
+        case NODE_PTR:
+            for (int i = 0; i < node->num_children; i++) {
+                node->children[i] = fold_expr(f, node->children[i]);
+            }
+            return node;
+
+        default:
+            return node;
+    }
+}
+
+// Forget the values of every variable assigned anywhere in a subtree
+static void forget_assigned(Folder* f, ASTNode* node) {
+    if (!node) return;
+    if (node->type == NODE_ASSIGN) {
+        int var = variable_index(f, node->children[0]->id);
+        if (var >= 0) f->known[var] = 0;
+    } else if (node->type == NODE_ASM) {
+        forget_locals(f);
+    }
+    for (int i = 0; i < node->num_children; i++) {
+        forget_assigned(f, node->children[i]);
+    }
+}
+
+static ASTNode* fold_statement(Folder* f, ASTNode* node);
+
+// Fold one arm of an if in its own scope
+static ASTNode* fold_branch(Folder* f, ASTNode* node) {
+    symtab_push_scope(&f->symbols);
+    int vars = f->num_vars;
+    node = fold_statement(f, node);
+    f->num_vars = vars;
+    symtab_pop_scope(&f->symbols);
+    return node;
+}
+
+// Fold a statement; returns the node that replaces it
+static ASTNode* fold_statement(Folder* f, ASTNode* node) {
+    if (!node) return NULL;
+
+    switch (node->type) {
+        case NODE_VAR:
+        case NODE_REG: {
+            // Declared before the initializer is evaluated, as codegen does
+            Symbol* sym = declare(f, node);
+            node->children[0] = fold_expr(f, node->children[0]);
+            if (node->children[0]) set_value(f, sym->address, node->children[0]);
+            return node;
+        }
+
+        case NODE_ASSIGN: {
+            // Globals written by functions are never known (see find_global_stores)
+            node->children[1] = fold_expr(f, node->children[1]);
+            int var = variable_index(f, node->children[0]->id);
+            if (var >= f->num_globals) set_value(f, var, node->children[1]);
+            return node;
+        }
+
+        case NODE_BLOCK: {
+            symtab_push_scope(&f->symbols);
+            int vars = f->num_vars;
+            for (int i = 0; i < node->num_children; i++) {
+                node->children[i] = fold_statement(f, node->children[i]);
+            }
+            f->num_vars = vars;
+            symtab_pop_scope(&f->symbols);
+            return node;
+        }
+
+        case NODE_IF: {
+            ASTNode* cond = node->children[0] = fold_expr(f, node->children[0]);
+            if (cond->type == NODE_NUMBER) {
+                // Only the taken arm remains, in a block of its own
+                ASTNode* taken = cond->number ? node->children[1] : node->children[2];
+                if (!taken) return make_block(f, node, NULL);
+                taken = fold_branch(f, taken);
+                return taken->type == NODE_BLOCK ? taken : make_block(f, node, taken);
+            }
+
+            // Fold each arm from the same state, then keep what both agree on
+            int vars = f->num_vars, count = f->num_vars - f->num_globals;
+            int* before_values = malloc(count * sizeof(int) + 1);
+            unsigned char* before_known = malloc(count + 1);
+            memcpy(before_values, f->values + f->num_globals, count * sizeof(int));
+            memcpy(before_known, f->known + f->num_globals, count);
+
+            node->children[1] = fold_branch(f, node->children[1]);
+            int* then_values = malloc(count * sizeof(int) + 1);
+            unsigned char* then_known = malloc(count + 1);
+            memcpy(then_values, f->values + f->num_globals, count * sizeof(int));
+            memcpy(then_known, f->known + f->num_globals, count);
+
+            memcpy(f->values + f->num_globals, before_values, count * sizeof(int));
+            memcpy(f->known + f->num_globals, before_known, count);
+            node->children[2] = fold_branch(f, node->children[2]);
+
+            for (int i = 0; i < count; i++) {
+                int var = f->num_globals + i;
+                f->known[var] = f->known[var] && then_known[i] && f->values[var] == then_values[i];
+            }
+            f->num_vars = vars;
+            free(before_values);
+            free(before_known);
+            free(then_values);
+            free(then_known);
+            return node;
+        }
+
+        case NODE_WHILE: {
+            // The condition sees the state after any number of iterations
+            mark_entered(f, node, node->children[0]);
+            forget_assigned(f, node->children[0]);
+            forget_assigned(f, node->children[1]);
+            ASTNode* cond = node->children[0] = fold_expr(f, node->children[0]);
+            if (cond->type == NODE_NUMBER && cond->number == 0) return make_block(f, node, NULL);
+            if (cond->type == NODE_NUMBER) node->children[0] = NULL;  // Runs forever
+            node->children[1] = fold_branch(f, node->children[1]);
+            forget_assigned(f, node->children[1]);
+            return node;
+        }
+
+        case NODE_FOR: {
+            symtab_push_scope(&f->symbols);
+            int vars = f->num_vars;
+            node->children[0] = fold_statement(f, node->children[0]);  // Initializer
+            mark_entered(f, node, node->children[1]);
+            for (int i = 1; i < 4; i++) forget_assigned(f, node->children[i]);
+
+            ASTNode* cond = node->children[1] = fold_expr(f, node->children[1]);
+            if (cond && cond->type == NODE_NUMBER && cond->number == 0) {
+                // Only the initializer runs; keep it scoped
+                ASTNode* init = node->children[0];
+                f->num_vars = vars;
+                symtab_pop_scope(&f->symbols);
+                return make_block(f, node, init);
+            }
+            if (cond && cond->type == NODE_NUMBER) node->children[1] = NULL;  // Runs forever
+
+            node->children[3] = fold_branch(f, node->children[3]);    // Body
+            node->children[2] = fold_statement(f, node->children[2]); // Step
+            for (int i = 1; i < 4; i++) forget_assigned(f, node->children[i]);
+            f->num_vars = vars;
+            symtab_pop_scope(&f->symbols);
+            return node;
+        }
+
+        case NODE_RETURN:
+        case NODE_CALL:
+        case NODE_PTR:
+            for (int i = 0; i < node->num_children; i++) {
+                node->children[i] = fold_expr(f, node->children[i]);
+            }
+            return node;
+
+        case NODE_ASM:
+            forget_locals(f);
+            return node;
+
+        default:
+            return node;
+    }
+}
+
+// Helper function to mark globals that functions or inline assembly may change
+static void find_global_stores(Folder* f, ASTNode* node, int* has_asm) {
+    if (!node) return;
+    if (node->type == NODE_ASSIGN) {
+        // Any store to the name counts, even one that hits a shadowing local
+        int var = variable_index(f, node->children[0]->id);
+        if (var >= 0) f->known[var] = 0;
+    } else if (node->type == NODE_ASM) {
+        *has_asm = 1;
+    }
+    for (int i = 0; i < node->num_children; i++) {
+        find_global_stores(f, node->children[i], has_asm);
+    }
+}
+
+void fold_constants(ASTNode* root, Arena* arena) {
+    Folder folder;
+    memset(&folder, 0, sizeof(folder));
+    Folder* f = &folder;
+    f->arena = arena;
+    symtab_init(&f->symbols, arena);
+
+    // Globals keep their initial value if nothing ever stores to them;
+    // memory globals without an initializer start out zero in .data
+    for (int i = 0; i < root->num_children; i++) {
+        ASTNode* node = root->children[i];
+        if (node->type == NODE_FUNC) {
+            Symbol* sym = symtab_add(&f->symbols, node->value, node->id);
+            sym->storage_type = SYM_FUNC;
+            continue;
+        }
+        Symbol* sym = declare(f, node);
+        node->children[0] = fold_expr(f, node->children[0]);
+        if (node->children[0]) {
+            set_value(f, sym->address, node->children[0]);
+        } else if (node->type == NODE_VAR && sym->storage_type == SYM_MEM) {
+            f->known[sym->address] = 1;
+            f->values[sym->address] = 0;
+        }
+    }
+    f->num_globals = f->num_vars;
+
+    int has_asm = 0;
+    find_global_stores(f, root, &has_asm);
+    if (has_asm) memset(f->known, 0, f->num_globals);
+
+    for (int i = 0; i < root->num_children; i++) {
+        ASTNode* func = root->children[i];
+        if (func->type != NODE_FUNC) continue;
+
+        symtab_push_scope(&f->symbols);
+        ASTNode* params = func->children[0];
+        for (int j = 0; j < params->num_children; j++) {
+            declare(f, params->children[j]);
+        }
+        func->children[1] = fold_statement(f, func->children[1]);
+        f->num_vars = f->num_globals;
+        symtab_pop_scope(&f->symbols);
+    }
+
+    symtab_free(&f->symbols);
+    free(f->values);
+    free(f->known);
+    free(f->is_byte);
+}
@@ -0,0 +1,13 @@
+// fold.h
+#ifndef FOLD_H
+#define FOLD_H
+
+#include "parser.h"
+#include "arena.h"
+
+// Fold constant subexpressions and propagate constants through a program,
+// rewriting the tree in place. Arithmetic follows 32-bit two's complement,
+// stores to 'byte' variables keep the low 8 bits.
+void fold_constants(ASTNode* root, Arena* arena);
+
+#endif
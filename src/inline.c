@@ -0,0 +1,464 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "inline.h"
+#include "alloc.h"
+
+// A call costs about this many instructions besides one per argument: the
+// call itself, the return and the move of the result
+#define CALL_COST 2
+
+// Bodies at most this much larger than the call they replace are inlined at
+// every call site
+#define MAX_INLINE_GROWTH 4
+
+// A function with a single call site is moved into it whole up to this size
+#define MAX_SINGLE_SITE_SIZE 400
+
+// Inlining stops once a caller reaches this size
+#define MAX_CALLER_SIZE 4000
+
+typedef struct {
+    IrProgram* program;
+    FILE* report;
+    int* edge_first;            // Calls of function f are edges[edge_first[f] .. edge_first[f + 1]]
+    int* edges;                 // Callee of each call
+    int* site_count;            // Calls to each function in the whole program
+    int* size_of;               // Body size of each function
+    unsigned char* has_asm;
+    unsigned char* recursive;
+    int* order;                 // Every function after the functions it calls
+    int num_ordered;
+    int* dfs_index;             // Tarjan's strongly connected components
+    int* lowlink;
+    int* dfs_stack;
+    unsigned char* on_stack;
+    int dfs_top, next_index;
+    int num_inlined, num_kept, num_removed;
+} Inliner;
+
+// --- Helper Functions ---
+
+// Helper function to count the instructions of a function that survive
+// inlining; parameters, jumps and returns turn into copies or disappear
+static int body_size(const IrFunction* func) {
+    int size = 0;
+    for (int i = 0; i < func->num_insns; i++) {
+        int op = func->insns[i].op;
+        if (op != IR_NOP && op != IR_PARAM && op != IR_JUMP && op != IR_RET) size++;
+    }
+    return size;
+}
+
+// Helper function to count the IR instructions of the whole program
+static int program_size(Inliner* inl) {
+    int size = 0;
+    for (int f = 0; f < inl->program->num_funcs; f++) size += inl->program->funcs[f].num_insns;
+    return size;
+}
+
+// Helper function to check whether inline assembly names a function, which
+// keeps the function alive
+static int asm_mentions(Inliner* inl, const char* name) {
+    size_t length = strlen(name);
+    for (int t = 0; t < inl->program->num_asm; t++) {
+        const char* text = inl->program->asm_texts[t];
+        for (const char* p = strstr(text, name); p; p = strstr(p + 1, name)) {
+            int joined_before = p > text && (isalnum((unsigned char)p[-1]) || p[-1] == '_');
+            int joined_after = isalnum((unsigned char)p[length]) || p[length] == '_';
+            if (!joined_before && !joined_after) return 1;
+        }
+    }
+    return 0;
+}
+
+// Helper function to append a copy of an instruction to the builder
+static void emit_copy(IrBuilder* builder, const IrInsn* insn) {
+    ir_emit(builder, insn->op, insn->dst, insn->a, insn->b, insn->flags);
+    builder->insns[builder->num_insns - 1].size = insn->size;
+    builder->insns[builder->num_insns - 1].cond = insn->cond;
+}
+
+// Helper function to emit dst = a for a vreg or an immediate 'a'
+static void emit_move(IrBuilder* builder, int dst, int a, int flags) {
+    if (flags & IR_A_IMM) {
+        ir_emit(builder, IR_CONST, dst, a, -1, 0);
+    } else {
+        ir_emit(builder, IR_COPY, dst, a, -1, 0);
+    }
+}
+
+// --- Call Graph ---
+
+static void build_call_graph(Inliner* inl) {
+    int n = inl->program->num_funcs;
+    int num_edges = 0;
+    for (int f = 0; f < n; f++) {
+        for (int i = 0; i < inl->program->funcs[f].num_insns; i++) {
+            if (inl->program->funcs[f].insns[i].op == IR_CALL) num_edges++;
+        }
+    }
+    free(inl->edge_first);
+    free(inl->edges);
+    inl->edge_first = checked_calloc(n + 1, sizeof(int));
+    inl->edges = checked_calloc(num_edges, sizeof(int));
+    num_edges = 0;
+    for (int f = 0; f < n; f++) {
+        const IrFunction* func = &inl->program->funcs[f];
+        inl->edge_first[f] = num_edges;
+        for (int i = 0; i < func->num_insns; i++) {
+            if (func->insns[i].op == IR_CALL) inl->edges[num_edges++] = func->insns[i].b;
+        }
+    }
+    inl->edge_first[n] = num_edges;
+}
+
+// Tarjan's algorithm completes a component only after every component it
+// calls, so appending members as components complete orders callees first.
+// Functions in a component of several, or calling themselves, are recursive.
+static void visit(Inliner* inl, int f) {
+    inl->dfs_index[f] = inl->lowlink[f] = inl->next_index++;
+    inl->dfs_stack[inl->dfs_top++] = f;
+    inl->on_stack[f] = 1;
+    for (int e = inl->edge_first[f]; e < inl->edge_first[f + 1]; e++) {
+        int callee = inl->edges[e];
+        if (callee == f) inl->recursive[f] = 1;
+        if (inl->dfs_index[callee] < 0) {
+            visit(inl, callee);
+            if (inl->lowlink[callee] < inl->lowlink[f]) inl->lowlink[f] = inl->lowlink[callee];
+        } else if (inl->on_stack[callee] && inl->dfs_index[callee] < inl->lowlink[f]) {
+            inl->lowlink[f] = inl->dfs_index[callee];
+        }
+    }
+    if (inl->lowlink[f] != inl->dfs_index[f]) return;
+
+    int first = inl->num_ordered;
+    int member;
+    do {
+        member = inl->dfs_stack[--inl->dfs_top];
+        inl->on_stack[member] = 0;
+        inl->order[inl->num_ordered++] = member;
+    } while (member != f);
+    if (inl->num_ordered - first > 1) {
+        for (int i = first; i < inl->num_ordered; i++) inl->recursive[inl->order[i]] = 1;
+    }
+}
+
+// Drop the functions the entry point cannot reach, or that inline assembly
+// does not name. Without an entry point every function stays.
+static void remove_unreachable(Inliner* inl) {
+    int n = inl->program->num_funcs;
+    if (n == 0 || !inl->program->funcs[n - 1].is_entry) return;
+    build_call_graph(inl);
+
+    unsigned char* live = checked_calloc(n, 1);
+    int* worklist = checked_calloc(n, sizeof(int));
+    int top = 0;
+    for (int f = 0; f < n; f++) {
+        if (inl->program->funcs[f].is_entry || asm_mentions(inl, inl->program->funcs[f].name)) {
+            live[f] = 1;
+            worklist[top++] = f;
+        }
+    }
+    while (top > 0) {
+        int f = worklist[--top];
+        for (int e = inl->edge_first[f]; e < inl->edge_first[f + 1]; e++) {
+            if (!live[inl->edges[e]]) {
+                live[inl->edges[e]] = 1;
+                worklist[top++] = inl->edges[e];
+            }
+        }
+    }
+
+    // Compact the survivors and renumber the calls to them
+    int* new_index = worklist;
+    int kept = 0;
+    for (int f = 0; f < n; f++) {
+        if (!live[f]) {
+            if (inl->report) fprintf(inl->report, "  removed %s: unreachable\n", inl->program->funcs[f].name);
+            new_index[f] = -1;
+            inl->num_removed++;
+            continue;
+        }
+        new_index[f] = kept;
+        inl->program->funcs[kept++] = inl->program->funcs[f];
+    }
+    inl->program->num_funcs = kept;
+    for (int f = 0; f < kept; f++) {
+        IrFunction* func = &inl->program->funcs[f];
+        for (int i = 0; i < func->num_insns; i++) {
+            if (func->insns[i].op == IR_CALL) func->insns[i].b = new_index[func->insns[i].b];
+        }
+    }
+    free(live);
+    free(worklist);
+}
+
+// --- Inlining ---
+
+// Decide whether to inline a call: small bodies go everywhere, bodies with a
+// single call site go there unless huge. Returns NULL to inline, otherwise
+// why not.
+static const char* reject_reason(Inliner* inl, int callee, int num_args, int caller_size, int args_found) {
+    if (inl->recursive[callee]) return "recursive";
+    if (inl->has_asm[callee]) return "inline assembly";
+    if (!args_found) return "arguments in another block";
+    int size = inl->size_of[callee];
+    int small = size <= CALL_COST + num_args + MAX_INLINE_GROWTH;
+    if (!small && (inl->site_count[callee] > 1 || size > MAX_SINGLE_SITE_SIZE)) return "too large";
+    if (caller_size + size > MAX_CALLER_SIZE) return "caller too large";
+    return NULL;
+}
+
+// Replace a call with a copy of the callee's blocks; 'args' holds the
+// argument instruction of each parameter. Arguments are only evaluated
+// expressions, so their vregs still hold them at the call: parameters the
+// callee never assigns read them directly, the rest start as copies. Returns
+// copy the result and jump past the call.
+static void expand_call(Inliner* inl, IrBuilder* builder, const IrInsn* call, const IrInsn** args) {
+    const IrFunction* callee = &inl->program->funcs[call->b];
+    int vreg_base = builder->num_vregs;
+    int* map = checked_calloc(callee->num_vregs, sizeof(int));
+    int* defs = checked_calloc(callee->num_vregs, sizeof(int));
+    for (int i = 0; i < callee->num_insns; i++) {
+        if (callee->insns[i].dst >= 0) defs[callee->insns[i].dst]++;
+    }
+    for (int v = 0; v < callee->num_vregs; v++) {
+        map[v] = ir_new_vreg(builder, callee->vreg_names[v]);
+        builder->vreg_flags[map[v]] = callee->vreg_flags[v];
+    }
+    for (int i = 0; i < callee->num_insns; i++) {
+        const IrInsn* insn = &callee->insns[i];
+        const IrInsn* arg = insn->op == IR_PARAM ? args[insn->a] : NULL;
+        if (arg && defs[insn->dst] == 1 && !(arg->flags & IR_A_IMM)) map[insn->dst] = arg->a;
+    }
+    int block_base = builder->num_blocks;
+    for (int b = 0; b < callee->num_blocks; b++) ir_new_block(builder);
+    int after = ir_new_block(builder);
+    ir_jump(builder, block_base);
+
+    for (int b = 0; b < callee->num_blocks; b++) {
+        const IrBlock* block = &callee->blocks[b];
+        ir_start_block(builder, block_base + b);
+        for (int i = block->first; i < block->first + block->count; i++) {
+            IrInsn insn = callee->insns[i];
+            if (insn.dst >= 0) insn.dst = map[insn.dst];
+            if (insn.a >= 0 && !(insn.flags & IR_A_IMM)) insn.a = map[insn.a];
+            if (insn.b >= 0 && !(insn.flags & IR_B_IMM)) insn.b = map[insn.b];
+            switch (insn.op) {
+                case IR_NOP:
+                    break;
+                case IR_PARAM:
+                    if (insn.dst >= vreg_base) {
+                        emit_move(builder, insn.dst, args[insn.a]->a, args[insn.a]->flags);
+                    }
+                    break;
+                case IR_JUMP:
+                    ir_jump(builder, block_base + block->succ[0]);
+                    break;
+                case IR_BRANCH:
+                    ir_branch(builder, insn.cond, insn.a, insn.b, insn.flags,
+                              block_base + block->succ[0], block_base + block->succ[1]);
+                    break;
+                case IR_RET:
+                    if (call->dst >= 0) {
+                        if (insn.a >= 0 || (insn.flags & IR_A_IMM)) {
+                            emit_move(builder, call->dst, insn.a, insn.flags);
+                        } else {
+                            ir_emit(builder, IR_CONST, call->dst, 0, -1, 0);
+                        }
+                    }
+                    ir_jump(builder, after);
+                    break;
+                default:
+                    emit_copy(builder, &insn);
+            }
+        }
+    }
+    ir_start_block(builder, after);
+    free(map);
+    free(defs);
+}
+
+// Inline the calls of one function whose callees are already final
+static void inline_calls(Inliner* inl, int f, Arena* arena) {
+    IrFunction* func = &inl->program->funcs[f];
+    int n = func->num_insns;
+    int* call_of = checked_calloc(n, sizeof(int));      // Call each argument belongs to
+    int* arg_start = checked_calloc(n, sizeof(int));    // Each call's arguments in arg_list,
+    int* arg_list = checked_calloc(n, sizeof(int));     // in parameter order
+    int num_listed = 0;
+    char* inlined = checked_calloc(n, 1);               // Calls to expand
+    int* pending = checked_calloc(n, sizeof(int));
+    const IrInsn** args = checked_calloc(n + 1, sizeof(IrInsn*));
+    int size = inl->size_of[f];
+    int changed = 0;
+
+    // Each call takes the last 'a' arguments still pending, like the pushes
+    // it pops: stack arguments come last first, register arguments name
+    // their parameter
+    for (int b = 0; b < func->num_blocks; b++) {
+        IrBlock* block = &func->blocks[b];
+        int top = 0;
+        for (int i = block->first; i < block->first + block->count; i++) {
+            IrInsn* insn = &func->insns[i];
+            call_of[i] = -1;
+            if (insn->op == IR_ARG) pending[top++] = i;
+            if (insn->op != IR_CALL) continue;
+
+            int num_args = insn->a;
+            int args_found = top >= num_args;
+            if (args_found) {
+                int stack_args = 0;
+                arg_start[i] = num_listed;
+                for (int j = top - num_args; j < top; j++) {
+                    IrInsn* arg = &func->insns[pending[j]];
+                    int param = arg->flags & IR_B_IMM ? arg->b : num_args - 1 - stack_args++;
+                    call_of[pending[j]] = i;
+                    arg_list[num_listed + param] = pending[j];
+                }
+                num_listed += num_args;
+                top -= num_args;
+            } else {
+                top = 0;
+            }
+
+            int callee = insn->b;
+            const char* reason = reject_reason(inl, callee, num_args, size, args_found);
+            if (reason) {
+                if (inl->report) {
+                    fprintf(inl->report, "  %s: kept call to %s: %s\n", func->name,
+                            inl->program->funcs[callee].name, reason);
+                }
+                inl->num_kept++;
+                continue;
+            }
+            if (inl->report) {
+                fprintf(inl->report, "  %s: inlined %s (size %d, %d call site%s)\n", func->name,
+                        inl->program->funcs[callee].name, inl->size_of[callee], inl->site_count[callee],
+                        inl->site_count[callee] == 1 ? "" : "s");
+            }
+            inl->num_inlined++;
+            inlined[i] = 1;
+            size += inl->size_of[callee];
+            changed = 1;
+
+            // The call is gone, the callee's own calls are now made here too
+            const IrFunction* body = &inl->program->funcs[callee];
+            inl->site_count[callee]--;
+            for (int j = 0; j < body->num_insns; j++) {
+                if (body->insns[j].op == IR_CALL) inl->site_count[body->insns[j].b]++;
+            }
+        }
+    }
+
+    if (changed) {
+        IrBuilder builder;
+        ir_builder_init(&builder);
+        for (int v = 0; v < func->num_vregs; v++) {
+            ir_new_vreg(&builder, func->vreg_names[v]);
+            builder.vreg_flags[v] = func->vreg_flags[v];
+        }
+        for (int b = 0; b < func->num_blocks; b++) ir_new_block(&builder);
+
+        for (int b = 0; b < func->num_blocks; b++) {
+            IrBlock* block = &func->blocks[b];
+            ir_start_block(&builder, b);
+            for (int i = block->first; i < block->first + block->count; i++) {
+                IrInsn* insn = &func->insns[i];
+                if (insn->op == IR_ARG && call_of[i] >= 0 && inlined[call_of[i]]) {
+                    continue;  // Read by the expanded call
+                } else if (insn->op == IR_CALL && inlined[i]) {
+                    for (int p = 0; p < insn->a; p++) args[p] = &func->insns[arg_list[arg_start[i] + p]];
+                    expand_call(inl, &builder, insn, args);
+                } else if (insn->op == IR_JUMP) {
+                    ir_jump(&builder, block->succ[0]);
+                } else if (insn->op == IR_BRANCH) {
+                    ir_branch(&builder, insn->cond, insn->a, insn->b, insn->flags,
+                              block->succ[0], block->succ[1]);
+                } else if (insn->op != IR_NOP) {
+                    emit_copy(&builder, insn);
+                }
+            }
+        }
+
+        IrFunction rebuilt;
+        ir_finish(&builder, &rebuilt, arena);
+        ir_builder_free(&builder);
+        rebuilt.name = func->name;
+        rebuilt.is_entry = func->is_entry;
+        rebuilt.num_params = func->num_params;
+        rebuilt.num_reg_params = func->num_reg_params;
+        *func = rebuilt;
+        inl->size_of[f] = body_size(func);
+    }
+
+    free(call_of);
+    free(arg_start);
+    free(arg_list);
+    free(inlined);
+    free(pending);
+    free(args);
+}
+
+// --- Driver ---
+
+void inline_functions(IrProgram* program, FILE* report, Arena* arena) {
+    Inliner inliner;
+    memset(&inliner, 0, sizeof(inliner));
+    Inliner* inl = &inliner;
+    inl->program = program;
+    inl->report = report;
+    if (report) fprintf(report, "Inline report:\n");
+    int insns_before = program_size(inl);
+
+    // Dead functions first, so that their calls do not count as call sites
+    remove_unreachable(inl);
+    build_call_graph(inl);
+    int n = program->num_funcs;
+    inl->site_count = checked_calloc(n, sizeof(int));
+    inl->size_of = checked_calloc(n, sizeof(int));
+    inl->has_asm = checked_calloc(n, 1);
+    inl->recursive = checked_calloc(n, 1);
+    inl->order = checked_calloc(n, sizeof(int));
+    inl->dfs_index = checked_calloc(n, sizeof(int));
+    inl->lowlink = checked_calloc(n, sizeof(int));
+    inl->dfs_stack = checked_calloc(n, sizeof(int));
+    inl->on_stack = checked_calloc(n, 1);
+    for (int f = 0; f < n; f++) {
+        const IrFunction* func = &program->funcs[f];
+        inl->size_of[f] = body_size(func);
+        for (int i = 0; i < func->num_insns; i++) {
+            if (func->insns[i].op == IR_ASM) inl->has_asm[f] = 1;
+        }
+        inl->dfs_index[f] = -1;
+    }
+    for (int e = 0; e < inl->edge_first[n]; e++) inl->site_count[inl->edges[e]]++;
+
+    inl->num_ordered = inl->dfs_top = inl->next_index = 0;
+    for (int f = 0; f < n; f++) {
+        if (inl->dfs_index[f] < 0) visit(inl, f);
+    }
+    for (int k = 0; k < inl->num_ordered; k++) inline_calls(inl, inl->order[k], arena);
+
+    // Functions inlined at every call site are now unreachable
+    remove_unreachable(inl);
+    if (report) {
+        fprintf(report, "  %d calls inlined, %d kept, %d functions removed\n",
+                inl->num_inlined, inl->num_kept, inl->num_removed);
+        fprintf(report, "  %d IR instructions in, %d out\n", insns_before, program_size(inl));
+    }
+
+    free(inl->edge_first);
+    free(inl->edges);
+    free(inl->site_count);
+    free(inl->size_of);
+    free(inl->has_asm);
+    free(inl->recursive);
+    free(inl->order);
+    free(inl->dfs_index);
+    free(inl->lowlink);
+    free(inl->dfs_stack);
+    free(inl->on_stack);
+}
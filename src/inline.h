@@ -0,0 +1,16 @@
+// inline.h
+#ifndef INLINE_H
+#define INLINE_H
+
+#include <stdio.h>
+#include "arena.h"
+#include "ir.h"
+
+// Inline small functions, and functions called from a single place, into
+// their callers, callees before callers over the call graph; recursive
+// functions and functions with inline assembly keep their calls. Functions
+// the entry point can no longer reach are then dropped. Every decision is
+// written to 'report' unless it is NULL.
+void inline_functions(IrProgram* program, FILE* report, Arena* arena);
+
+#endif
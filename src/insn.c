@@ -0,0 +1,241 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "insn.h"
+
+// Names with their lengths, copied into the output as they are
+typedef struct {
+    const char* text;
+    int length;
+} Spelling;
+
+#define SPELL(s) {s, sizeof(s) - 1}
+
+static const Spelling reg_names[] = {
+    SPELL("eax"), SPELL("ebx"), SPELL("ecx"), SPELL("edx"), SPELL("esi"), SPELL("edi"), SPELL("esp"), SPELL("ebp")
+};
+static const Spelling reg8_names[] = {SPELL("al"), SPELL("bl"), SPELL("cl"), SPELL("dl")};
+
+static const Spelling mnemonics[NUM_OPCODES] = {
+    SPELL("nop"), SPELL(""), SPELL(""), SPELL("mov"), SPELL("movzx"), SPELL("lea"), SPELL("add"), SPELL("sub"),
+    SPELL("imul"), SPELL("and"), SPELL("xor"), SPELL("neg"), SPELL("inc"), SPELL("dec"),
+    SPELL("shl"), SPELL("sar"), SPELL("shr"), SPELL("cmp"), SPELL("test"),
+    SPELL("sete"), SPELL("setne"), SPELL("setl"), SPELL("setge"), SPELL("setle"), SPELL("setg"),
+    SPELL("cdq"), SPELL("idiv"), SPELL("imul"), SPELL("push"), SPELL("pop"), SPELL("call"), SPELL("ret"),
+    SPELL("jmp"), SPELL("je"), SPELL("jne"), SPELL("jl"), SPELL("jge"), SPELL("jle"), SPELL("jg"),
+    SPELL("int")
+};
+
+// Longest line an instruction prints besides the names in its operands
+#define MAX_LINE 128
+
+// --- Operands ---
+
+Operand op_none() {
+    Operand operand = {OPND_NONE, 0, -1, 0, NULL, -1, 0};
+    return operand;
+}
+
+Operand op_reg(int reg) {
+    Operand operand = {OPND_REG, 4, reg, 0, NULL, -1, 0};
+    return operand;
+}
+
+Operand op_reg8(int reg) {
+    Operand operand = {OPND_REG, 1, reg, 0, NULL, -1, 0};
+    return operand;
+}
+
+Operand op_imm(int value) {
+    Operand operand = {OPND_IMM, 0, -1, value, NULL, -1, 0};
+    return operand;
+}
+
+Operand op_mem(int size, int base, int displacement) {
+    Operand operand = {OPND_MEM, size, base, displacement, NULL, -1, 0};
+    return operand;
+}
+
+// The address base + index * scale, as lea computes it
+Operand op_scaled(int base, int index, int scale) {
+    Operand operand = {OPND_MEM, 0, base, 0, NULL, index, scale};
+    return operand;
+}
+
+Operand op_global(int size, const char* name) {
+    Operand operand = {OPND_MEM, size, -1, 0, name, -1, 0};
+    return operand;
+}
+
+Operand op_abs(int size, unsigned int address) {
+    Operand operand = {OPND_MEM, size, -1, (int)address, NULL, -1, 0};
+    return operand;
+}
+
+Operand op_label(int label) {
+    Operand operand = {OPND_LABEL, 0, -1, label, NULL, -1, 0};
+    return operand;
+}
+
+Operand op_name(const char* name) {
+    Operand operand = {OPND_LABEL, 0, -1, 0, name, -1, 0};
+    return operand;
+}
+
+// Check whether two operands denote the same register, value or location
+int operand_equal(const Operand* a, const Operand* b) {
+    if (a->kind != b->kind || a->reg != b->reg || a->value != b->value) return 0;
+    if (a->scale != b->scale || (a->scale && a->index != b->index)) return 0;
+    if (a->kind == OPND_REG && a->size != b->size) return 0;
+    if (a->name == b->name) return 1;
+    return a->name && b->name && strcmp(a->name, b->name) == 0;
+}
+
+// Check whether an operand reads or names a register, as itself, a base or an index
+int operand_uses_reg(const Operand* operand, int reg) {
+    if (operand->kind == OPND_MEM && operand->scale && operand->index == reg) return 1;
+    return (operand->kind == OPND_REG || operand->kind == OPND_MEM) && operand->reg == reg;
+}
+
+// --- Instruction lists ---
+
+void insn_list_init(InsnList* list) {
+    list->insns = NULL;
+    list->count = 0;
+    list->capacity = 0;
+}
+
+// Append an instruction
+void insn_emit(InsnList* list, Opcode op, Operand dst, Operand src) {
+    if (list->count == list->capacity) {
+        list->capacity = list->capacity ? list->capacity * 2 : 256;
+        list->insns = realloc(list->insns, list->capacity * sizeof(Insn));
+        if (!list->insns) {
+            fprintf(stderr, "Error: Out of memory\n");
+            exit(1);
+        }
+    }
+    Insn* insn = &list->insns[list->count++];
+    insn->op = op;
+    insn->dst = dst;
+    insn->src = src;
+}
+
+void insn_list_free(InsnList* list) {
+    free(list->insns);
+    insn_list_init(list);
+}
+
+// --- Printing ---
+
+// Helper function to copy a spelling to 'p' and return the end
+static char* put(char* p, const char* text, size_t length) {
+    memcpy(p, text, length);
+    return p + length;
+}
+
+// Helper function to write an operand in NASM syntax at 'p', which has
+// room for it, and return the end
+static char* put_operand(char* p, const Operand* operand) {
+    switch (operand->kind) {
+        case OPND_REG: {
+            const Spelling* name = operand->size == 1 ? &reg8_names[operand->reg] : &reg_names[operand->reg];
+            return put(p, name->text, name->length);
+        }
+        case OPND_IMM:
+            return text_put_int(p, operand->value);
+        case OPND_MEM:
+            if (operand->size == 1) p = put(p, "byte ", 5);
+            else if (operand->size == 4) p = put(p, "dword ", 6);
+            *p++ = '[';
+            if (operand->reg < 0 && !operand->name) {
+                p = put(p, "0x", 2);
+                p = text_put_hex(p, (unsigned int)operand->value);
+                *p++ = ']';
+                return p;
+            }
+            if (operand->name) p = put(p, operand->name, strlen(operand->name));
+            else p = put(p, reg_names[operand->reg].text, reg_names[operand->reg].length);
+            if (operand->scale) {
+                p = put(p, " + ", 3);
+                p = put(p, reg_names[operand->index].text, reg_names[operand->index].length);
+                *p++ = '*';
+                p = text_put_int(p, operand->scale);
+            }
+            if (operand->value > 0) {
+                p = put(p, " + ", 3);
+                p = text_put_int(p, operand->value);
+            } else if (operand->value < 0) {
+                p = put(p, " - ", 3);
+                p = text_put_int(p, -(long)operand->value);
+            }
+            *p++ = ']';
+            return p;
+        case OPND_LABEL:
+            if (operand->name) return put(p, operand->name, strlen(operand->name));
+            p = put(p, ".L", 2);
+            return text_put_int(p, operand->value);
+        default:
+            return p;
+    }
+}
+
+const char* insn_mnemonic(Opcode op) {
+    return mnemonics[op].text;
+}
+
+void insn_format(TextBuffer* text, const Insn* insn) {
+    if (insn->op == OP_NOP) return;
+    size_t names = 0;
+    if (insn->dst.name) names += 2 * strlen(insn->dst.name);
+    if (insn->src.name) names += strlen(insn->src.name);
+    text_reserve(text, MAX_LINE + names);
+    char* p = text->data + text->size;
+
+    if (insn->op == OP_LABEL) {
+        p = put_operand(p, &insn->dst);
+        p = put(p, ":\n", 2);
+    } else if (insn->op == OP_ASM) {
+        p = put(p, insn->dst.name, strlen(insn->dst.name));
+        *p++ = '\n';
+    } else {
+        p = put(p, "  ", 2);
+        p = put(p, mnemonics[insn->op].text, mnemonics[insn->op].length);
+        if (insn->dst.kind != OPND_NONE) {
+            *p++ = ' ';
+            p = put_operand(p, &insn->dst);
+        }
+        if (insn->op == OP_IMUL && insn->src.kind == OPND_IMM) {
+            p = put(p, ", ", 2);
+            p = put_operand(p, &insn->dst);
+        }
+        if (insn->src.kind != OPND_NONE) {
+            p = put(p, ", ", 2);
+            p = put_operand(p, &insn->src);
+        }
+        *p++ = '\n';
+    }
+    text->size = p - text->data;
+}
+
+void insn_list_format(TextBuffer* text, const InsnList* list) {
+    for (int i = 0; i < list->count; i++) {
+        insn_format(text, &list->insns[i]);
+    }
+}
+
+void insn_print(FILE* output, const Insn* insn) {
+    TextBuffer text;
+    text_init(&text, MAX_LINE);
+    insn_format(&text, insn);
+    fwrite(text.data, 1, text.size, output);
+    text_free(&text);
+}
+
+void insn_list_print(FILE* output, const InsnList* list) {
+    TextBuffer text;
+    text_init(&text, (size_t)list->count * 24 + MAX_LINE);
+    insn_list_format(&text, list);
+    fwrite(text.data, 1, text.size, output);
+    text_free(&text);
+}
@@ -0,0 +1,84 @@
+// insn.h
+#ifndef INSN_H
+#define INSN_H
+
+#include <stdio.h>
+#include "writer.h"
+
+// Register IDs; the first NUM_REGS are general purpose, esp and ebp hold the frame
+enum { REG_EAX, REG_EBX, REG_ECX, REG_EDX, REG_ESI, REG_EDI, NUM_REGS, REG_ESP = NUM_REGS, REG_EBP };
+
+typedef enum {
+    OP_NOP,      // Deleted by the peephole pass, never printed
+    OP_LABEL,    // dst = label (numbered .Ln or a function name)
+    OP_ASM,      // Inline assembly, dst.name = text
+    OP_MOV, OP_MOVZX, OP_LEA, OP_ADD, OP_SUB, OP_IMUL, OP_AND, OP_XOR, OP_NEG, OP_INC, OP_DEC,
+    OP_SHL, OP_SAR, OP_SHR, OP_CMP, OP_TEST,
+    OP_SETE, OP_SETNE, OP_SETL, OP_SETGE, OP_SETLE, OP_SETG,   // dst = low byte register
+    OP_CDQ, OP_IDIV,
+    OP_IMUL_WIDE,  // edx:eax = eax * dst, the one-operand imul
+    OP_PUSH, OP_POP,
+    OP_CALL,     // dst = function, dst.value = mask of registers carrying arguments
+    OP_RET,      // dst = bytes of arguments to pop, or none
+    OP_JMP,
+    OP_JE, OP_JNE, OP_JL, OP_JGE, OP_JLE, OP_JG,               // Each next to its negation
+    OP_INT,
+    NUM_OPCODES
+} Opcode;
+
+typedef enum {
+    OPND_NONE,
+    OPND_REG,    // reg, size 1 for the low byte (al, bl, cl, dl)
+    OPND_IMM,    // value
+    OPND_MEM,    // size [base + index * scale + value], or [name] / [value] without a base
+    OPND_LABEL,  // .L<value>, or name for functions
+} OperandKind;
+
+typedef struct {
+    unsigned char kind;
+    unsigned char size;   // Bytes accessed through memory operands, 0 if implied
+    signed char reg;      // Register, or base register of memory operands (-1 for none)
+    int value;            // Immediate, displacement, absolute address or label number
+    const char* name;     // Global or function name, or inline assembly text
+    signed char index;    // Index register of memory operands, used when scale is nonzero
+    unsigned char scale;
+} Operand;
+
+// imul with an immediate source is printed in its three-operand form, dst = dst * imm
+typedef struct {
+    Opcode op;
+    Operand dst;
+    Operand src;
+} Insn;
+
+typedef struct {
+    Insn* insns;
+    int count;
+    int capacity;
+} InsnList;
+
+Operand op_none();
+Operand op_reg(int reg);
+Operand op_reg8(int reg);
+Operand op_imm(int value);
+Operand op_mem(int size, int base, int displacement);
+Operand op_scaled(int base, int index, int scale);
+Operand op_global(int size, const char* name);
+Operand op_abs(int size, unsigned int address);
+Operand op_label(int label);
+Operand op_name(const char* name);
+
+void insn_list_init(InsnList* list);
+void insn_emit(InsnList* list, Opcode op, Operand dst, Operand src);
+void insn_list_free(InsnList* list);
+
+int operand_equal(const Operand* a, const Operand* b);
+int operand_uses_reg(const Operand* operand, int reg);
+const char* insn_mnemonic(Opcode op);
+// Append instructions as NASM text, one line each
+void insn_format(TextBuffer* text, const Insn* insn);
+void insn_list_format(TextBuffer* text, const InsnList* list);
+void insn_print(FILE* output, const Insn* insn);
+void insn_list_print(FILE* output, const InsnList* list);
+
+#endif
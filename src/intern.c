@@ -0,0 +1,114 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "intern.h"
+#include "arena.h"
+
+// Helper function to hash an identifier (FNV-1a)
+static unsigned int hash_name(const char* str, int length) {
+    unsigned int hash = 2166136261u;
+    for (int i = 0; i < length; i++) {
+        hash ^= (unsigned char)str[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// Helper function to abort on allocation failure
+static void* checked_realloc(void* ptr, size_t size) {
+    ptr = realloc(ptr, size);
+    if (!ptr) {
+        fprintf(stderr, "Error: Out of memory\n");
+        exit(1);
+    }
+    return ptr;
+}
+
+// Initialize an empty intern table
+void intern_init(InternTable* table, Arena* arena) {
+    table->num_slots = 256;
+    table->slots = calloc(table->num_slots, sizeof(int));
+    table->capacity = 128;
+    table->count = 0;
+    table->names = checked_realloc(NULL, table->capacity * sizeof(char*));
+    table->lengths = checked_realloc(NULL, table->capacity * sizeof(int));
+    table->hashes = checked_realloc(NULL, table->capacity * sizeof(unsigned int));
+    table->arena = arena;
+}
+
+// Helper function to find the slot for a name, or the empty slot it belongs in
+static int find_slot(InternTable* table, const char* str, int length, unsigned int hash) {
+    int mask = table->num_slots - 1;
+    int slot = hash & mask;
+    while (table->slots[slot]) {
+        int id = table->slots[slot] - 1;
+        if (table->hashes[id] == hash && table->lengths[id] == length &&
+            memcmp(table->names[id], str, length) == 0) {
+            break;
+        }
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+// Helper function to double the slot array once it is half full
+static void grow_slots(InternTable* table) {
+    free(table->slots);
+    table->num_slots *= 2;
+    table->slots = calloc(table->num_slots, sizeof(int));
+    int mask = table->num_slots - 1;
+    for (int id = 0; id < table->count; id++) {
+        int slot = table->hashes[id] & mask;
+        while (table->slots[slot]) slot = (slot + 1) & mask;
+        table->slots[slot] = id + 1;
+    }
+}
+
+// Return the id of a name, adding it on first sight
+int intern(InternTable* table, const char* str, int length) {
+    unsigned int hash = hash_name(str, length);
+    int slot = find_slot(table, str, length, hash);
+    if (table->slots[slot]) return table->slots[slot] - 1;
+
+    if (table->count == table->capacity) {
+        table->capacity *= 2;
+        table->names = checked_realloc(table->names, table->capacity * sizeof(char*));
+        table->lengths = checked_realloc(table->lengths, table->capacity * sizeof(int));
+        table->hashes = checked_realloc(table->hashes, table->capacity * sizeof(unsigned int));
+    }
+
+    int id = table->count++;
+    table->names[id] = arena_strndup(table->arena, str, length);
+    table->lengths[id] = length;
+    table->hashes[id] = hash;
+    table->slots[slot] = id + 1;
+
+    if (table->count * 2 > table->num_slots) grow_slots(table);
+    return id;
+}
+
+// Return the id of a name, or -1 if it was never interned
+int intern_lookup(InternTable* table, const char* str, int length) {
+    int slot = find_slot(table, str, length, hash_name(str, length));
+    return table->slots[slot] - 1;
+}
+
+// Return the spelling of an interned name
+const char* intern_name(InternTable* table, int id) {
+    return table->names[id];
+}
+
+// Forget every name but keep the arrays; call before the arena holding the
+// names is reset
+void intern_reset(InternTable* table) {
+    memset(table->slots, 0, table->num_slots * sizeof(int));
+    table->count = 0;
+}
+
+// Release the table; the names themselves belong to the arena
+void intern_free(InternTable* table) {
+    free(table->slots);
+    free(table->names);
+    free(table->lengths);
+    free(table->hashes);
+}
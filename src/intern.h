@@ -0,0 +1,26 @@
+// intern.h
+#ifndef INTERN_H
+#define INTERN_H
+
+#include "arena.h"
+
+// Maps identifier spellings to dense integer ids; id 0 is the first name seen
+typedef struct {
+    int* slots;             // Open-addressed hash slots holding id + 1, 0 if empty
+    int num_slots;          // Always a power of two
+    char** names;           // NUL-terminated copies, owned by the arena
+    int* lengths;
+    unsigned int* hashes;
+    int count;
+    int capacity;
+    Arena* arena;
+} InternTable;
+
+void intern_init(InternTable* table, Arena* arena);
+int intern(InternTable* table, const char* str, int length);
+int intern_lookup(InternTable* table, const char* str, int length);
+const char* intern_name(InternTable* table, int id);
+void intern_reset(InternTable* table);
+void intern_free(InternTable* table);
+
+#endif
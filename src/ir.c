@@ -0,0 +1,520 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ir.h"
+
+static const char* op_names[NUM_IR_OPS] = {
+    "nop", "param", "const", "copy", "add", "sub", "mul", "div", "mod", "and", "set",
+    "load", "store", "load_ptr", "store_ptr", "arg", "call", "alloc", "asm",
+    "spill", "reload", "count", "jump", "branch", "ret"
+};
+
+static const char* cond_names[] = {"eq", "ne", "lt", "ge", "le", "gt"};
+
+// Operands that never name a vreg for each opcode (indices, counts, immediates)
+static const unsigned char fixed_flags[NUM_IR_OPS] = {
+    [IR_PARAM] = IR_A_IMM, [IR_CONST] = IR_A_IMM,
+    [IR_LOAD] = IR_B_IMM, [IR_STORE] = IR_B_IMM,
+    [IR_CALL] = IR_A_IMM | IR_B_IMM, [IR_ASM] = IR_B_IMM,
+    [IR_SPILL] = IR_B_IMM, [IR_RELOAD] = IR_B_IMM, [IR_COUNT] = IR_B_IMM,
+};
+
+// Helper function to grow a builder array
+static void* grow(void* array, int* capacity, size_t element_size) {
+    *capacity = *capacity ? *capacity * 2 : 64;
+    array = realloc(array, *capacity * element_size);
+    if (!array) {
+        fprintf(stderr, "Error: Out of memory\n");
+        exit(1);
+    }
+    return array;
+}
+
+// --- Building ---
+
+void ir_builder_init(IrBuilder* builder) {
+    memset(builder, 0, sizeof(IrBuilder));
+    builder->current = -1;
+}
+
+void ir_builder_free(IrBuilder* builder) {
+    free(builder->insns);
+    free(builder->blocks);
+    free(builder->order);
+    free(builder->vreg_names);
+    free(builder->vreg_flags);
+    ir_builder_init(builder);
+}
+
+// Create a virtual register; 'name' is the variable it holds, NULL for temporaries
+int ir_new_vreg(IrBuilder* builder, const char* name) {
+    if (builder->num_vregs == builder->vregs_capacity) {
+        int capacity = builder->vregs_capacity;
+        builder->vreg_names = grow(builder->vreg_names, &capacity, sizeof(const char*));
+        builder->vreg_flags = grow(builder->vreg_flags, &builder->vregs_capacity, 1);
+    }
+    builder->vreg_names[builder->num_vregs] = name;
+    builder->vreg_flags[builder->num_vregs] = 0;
+    return builder->num_vregs++;
+}
+
+// Create an empty block; it is placed in the layout when started
+int ir_new_block(IrBuilder* builder) {
+    if (builder->num_blocks == builder->blocks_capacity) {
+        builder->blocks = grow(builder->blocks, &builder->blocks_capacity, sizeof(IrBlock));
+    }
+    IrBlock* block = &builder->blocks[builder->num_blocks];
+    block->first = -1;
+    block->count = 0;
+    block->succ[0] = block->succ[1] = -1;
+    block->num_preds = 0;
+    block->pred_first = 0;
+    block->loop_depth = 0;
+    return builder->num_blocks++;
+}
+
+// Continue emitting into 'block'; an unterminated current block falls into it
+void ir_start_block(IrBuilder* builder, int block) {
+    if (builder->current >= 0) ir_jump(builder, block);
+    if (builder->num_order == builder->order_capacity) {
+        builder->order = grow(builder->order, &builder->order_capacity, sizeof(int));
+    }
+    builder->order[builder->num_order++] = block;
+    builder->blocks[block].first = builder->num_insns;
+    builder->current = block;
+}
+
+// Append an instruction to the current block. Code after a terminator is
+// unreachable and goes to a fresh block that ir_finish() drops.
+void ir_emit(IrBuilder* builder, IrOp op, int dst, int a, int b, int flags) {
+    if (builder->current < 0) ir_start_block(builder, ir_new_block(builder));
+    if (builder->num_insns == builder->insns_capacity) {
+        builder->insns = grow(builder->insns, &builder->insns_capacity, sizeof(IrInsn));
+    }
+    IrInsn* insn = &builder->insns[builder->num_insns++];
+    insn->op = op;
+    insn->size = 4;
+    insn->flags = flags | fixed_flags[op];
+    insn->cond = IR_NE;
+    insn->dst = dst;
+    insn->a = a;
+    insn->b = b;
+    builder->blocks[builder->current].count++;
+    if (ir_is_terminator(op)) builder->current = -1;
+}
+
+void ir_jump(IrBuilder* builder, int target) {
+    int block = builder->current;
+    ir_emit(builder, IR_JUMP, -1, -1, -1, 0);
+    builder->blocks[block < 0 ? builder->num_blocks - 1 : block].succ[0] = target;
+}
+
+// End the current block with a test of 'a cond b'
+void ir_branch(IrBuilder* builder, IrCond cond, int a, int b, int flags, int if_true, int if_false) {
+    int block = builder->current;
+    ir_emit(builder, IR_BRANCH, -1, a, b, flags);
+    builder->insns[builder->num_insns - 1].cond = cond;
+    IrBlock* emitted = &builder->blocks[block < 0 ? builder->num_blocks - 1 : block];
+    emitted->succ[0] = if_true;
+    emitted->succ[1] = if_false;
+}
+
+// Helper function to count how many successors a block has
+static int num_succs(const IrBlock* block) {
+    return (block->succ[0] >= 0) + (block->succ[1] >= 0);
+}
+
+// Helper function to fill the packed predecessor lists from the successors;
+// 'preds' must have room for every edge
+static void link_preds(IrFunction* func) {
+    int num_blocks = func->num_blocks;
+    for (int b = 0; b < num_blocks; b++) func->blocks[b].num_preds = 0;
+    for (int b = 0; b < num_blocks; b++) {
+        for (int s = 0; s < 2; s++) {
+            if (func->blocks[b].succ[s] >= 0) func->blocks[func->blocks[b].succ[s]].num_preds++;
+        }
+    }
+    int offset = 0;
+    for (int b = 0; b < num_blocks; b++) {
+        func->blocks[b].pred_first = offset;
+        offset += func->blocks[b].num_preds;
+        func->blocks[b].num_preds = 0;
+    }
+    for (int b = 0; b < num_blocks; b++) {
+        for (int s = 0; s < 2; s++) {
+            IrBlock* succ = func->blocks[b].succ[s] >= 0 ? &func->blocks[func->blocks[b].succ[s]] : NULL;
+            if (succ) func->preds[succ->pred_first + succ->num_preds++] = b;
+        }
+    }
+}
+
+// Freeze the function: drop unreachable blocks, renumber the rest in layout
+// order, copy everything into the arena and compute predecessors and loops
+void ir_finish(IrBuilder* builder, IrFunction* func, Arena* arena) {
+    int n = builder->num_blocks;
+    int* index = malloc((n + 1) * sizeof(int));
+    int* stack = malloc((n + 1) * sizeof(int));
+    for (int i = 0; i < n; i++) index[i] = -1;
+
+    // Reachability from the first block started
+    int top = 0;
+    if (builder->num_order > 0) {
+        stack[top++] = builder->order[0];
+        index[builder->order[0]] = 0;
+    }
+    while (top > 0) {
+        IrBlock* block = &builder->blocks[stack[--top]];
+        for (int s = 0; s < 2; s++) {
+            int succ = block->succ[s];
+            if (succ >= 0 && index[succ] < 0) {
+                index[succ] = 0;
+                stack[top++] = succ;
+            }
+        }
+    }
+
+    // Layout order among reachable blocks
+    int num_blocks = 0, num_insns = 0, num_edges = 0;
+    for (int i = 0; i < builder->num_order; i++) {
+        IrBlock* block = &builder->blocks[builder->order[i]];
+        if (index[builder->order[i]] < 0) continue;
+        index[builder->order[i]] = num_blocks++;
+        num_insns += block->count;
+        num_edges += num_succs(block);
+    }
+
+    func->num_blocks = num_blocks;
+    func->blocks = arena_alloc(arena, (num_blocks + 1) * sizeof(IrBlock));
+    func->num_insns = num_insns;
+    func->insns = arena_alloc(arena, (num_insns + 1) * sizeof(IrInsn));
+    func->preds = arena_alloc(arena, (num_edges + 1) * sizeof(int));
+    num_insns = 0;
+    for (int i = 0; i < builder->num_order; i++) {
+        int old = builder->order[i];
+        if (index[old] < 0) continue;
+        IrBlock* block = &func->blocks[index[old]];
+        *block = builder->blocks[old];
+        memcpy(&func->insns[num_insns], &builder->insns[block->first], block->count * sizeof(IrInsn));
+        block->first = num_insns;
+        num_insns += block->count;
+        for (int s = 0; s < 2; s++) {
+            if (block->succ[s] >= 0) block->succ[s] = index[block->succ[s]];
+        }
+        block->num_preds = 0;
+    }
+
+    link_preds(func);
+
+    func->num_vregs = builder->num_vregs;
+    func->vreg_names = arena_alloc(arena, (func->num_vregs + 1) * sizeof(const char*));
+    func->vreg_flags = arena_alloc(arena, func->num_vregs + 1);
+    if (func->num_vregs > 0) {
+        memcpy(func->vreg_names, builder->vreg_names, func->num_vregs * sizeof(const char*));
+        memcpy(func->vreg_flags, builder->vreg_flags, func->num_vregs);
+    }
+
+    free(index);
+    free(stack);
+    ir_compute_loops(func);
+}
+
+void ir_reorder_blocks(IrFunction* func, const int* order, Arena* arena) {
+    int n = func->num_blocks;
+    int* index = malloc((n + 1) * sizeof(int));
+    if (!index) {
+        fprintf(stderr, "Error: Out of memory\n");
+        exit(1);
+    }
+    for (int i = 0; i < n; i++) index[order[i]] = i;
+
+    // Instructions move with their blocks; edges and loop depths stay
+    IrBlock* blocks = arena_alloc(arena, (n + 1) * sizeof(IrBlock));
+    IrInsn* insns = arena_alloc(arena, (func->num_insns + 1) * sizeof(IrInsn));
+    int num_insns = 0;
+    for (int i = 0; i < n; i++) {
+        IrBlock* block = &blocks[i];
+        *block = func->blocks[order[i]];
+        memcpy(&insns[num_insns], &func->insns[block->first], block->count * sizeof(IrInsn));
+        block->first = num_insns;
+        num_insns += block->count;
+        for (int s = 0; s < 2; s++) {
+            if (block->succ[s] >= 0) block->succ[s] = index[block->succ[s]];
+        }
+    }
+    func->blocks = blocks;
+    func->insns = insns;
+    link_preds(func);
+    free(index);
+}
+
+// --- Analysis ---
+
+int ir_is_terminator(IrOp op) {
+    return op == IR_JUMP || op == IR_BRANCH || op == IR_RET;
+}
+
+// Collect the vregs an instruction reads; returns how many
+int ir_uses(const IrInsn* insn, int uses[2]) {
+    int n = 0;
+    if (insn->a >= 0 && !(insn->flags & IR_A_IMM)) uses[n++] = insn->a;
+    if (insn->b >= 0 && !(insn->flags & IR_B_IMM)) uses[n++] = insn->b;
+    return n;
+}
+
+// The same test with its operands exchanged: a < b is b > a
+IrCond ir_swap_cond(IrCond cond) {
+    static const IrCond swapped[] = {IR_EQ, IR_NE, IR_GT, IR_LE, IR_GE, IR_LT};
+    return swapped[cond];
+}
+
+int ir_eval_cond(IrCond cond, int a, int b) {
+    switch (cond) {
+        case IR_EQ: return a == b;
+        case IR_NE: return a != b;
+        case IR_LT: return a < b;
+        case IR_GE: return a >= b;
+        case IR_LE: return a <= b;
+        case IR_GT: return a > b;
+    }
+    return 0;
+}
+
+// Helper function to walk up the dominator tree until both blocks meet
+static int intersect(const int* idom, const int* rpo_number, int a, int b) {
+    while (a != b) {
+        while (rpo_number[a] > rpo_number[b]) a = idom[a];
+        while (rpo_number[b] > rpo_number[a]) b = idom[b];
+    }
+    return a;
+}
+
+// Fill 'idom' with each block's immediate dominator (block 0 is its own,
+// unreachable blocks get -1) by the Cooper-Harvey-Kennedy iteration over
+// reverse postorder
+void ir_compute_dominators(const IrFunction* func, int* idom) {
+    int n = func->num_blocks;
+    if (n == 0) return;
+    int* rpo = malloc(n * sizeof(int));
+    int* rpo_number = malloc(n * sizeof(int));
+    int* stack = malloc(n * sizeof(int));
+    int* next_succ = malloc(n * sizeof(int));
+
+    // Iterative depth-first search for postorder
+    for (int b = 0; b < n; b++) {
+        rpo_number[b] = -1;
+        next_succ[b] = 0;
+        idom[b] = -1;
+    }
+    int top = 0, count = n;
+    stack[top++] = 0;
+    rpo_number[0] = 0;
+    while (top > 0) {
+        int b = stack[top - 1];
+        if (next_succ[b] < 2) {
+            int succ = func->blocks[b].succ[next_succ[b]++];
+            if (succ >= 0 && rpo_number[succ] < 0) {
+                rpo_number[succ] = 0;
+                stack[top++] = succ;
+            }
+        } else {
+            rpo[--count] = b;
+            top--;
+        }
+    }
+    for (int i = count; i < n; i++) rpo_number[rpo[i]] = i;
+
+    idom[0] = 0;
+    int changed = 1;
+    while (changed) {
+        changed = 0;
+        for (int i = count; i < n; i++) {
+            int b = rpo[i];
+            if (b == 0) continue;
+            int new_idom = -1;
+            const IrBlock* block = &func->blocks[b];
+            for (int p = 0; p < block->num_preds; p++) {
+                int pred = func->preds[block->pred_first + p];
+                if (idom[pred] < 0) continue;
+                new_idom = new_idom < 0 ? pred : intersect(idom, rpo_number, pred, new_idom);
+            }
+            if (new_idom != idom[b]) {
+                idom[b] = new_idom;
+                changed = 1;
+            }
+        }
+    }
+
+    free(rpo);
+    free(rpo_number);
+    free(stack);
+    free(next_succ);
+}
+
+// Collect the natural loop of 'header': the header plus every block that
+// reaches one of its back edges without passing through it. Members are
+// stamped with 'header' in 'mark' and listed in 'blocks'; returns how many,
+// 0 if no back edge enters 'header'.
+int ir_natural_loop(const IrFunction* func, const int* idom, int header, int* mark, int* blocks) {
+    const IrBlock* block = &func->blocks[header];
+    int count = 0;
+    for (int p = 0; p < block->num_preds; p++) {
+        int tail = func->preds[block->pred_first + p];
+        int d = tail;
+        while (d != header && d != 0 && idom[d] >= 0) d = idom[d];
+        if (d == header && mark[tail] != header) {
+            mark[tail] = header;
+            blocks[count++] = tail;
+        }
+    }
+    if (count == 0) return 0;
+    if (mark[header] != header) {
+        mark[header] = header;
+        blocks[count++] = header;
+    }
+
+    // The list doubles as the worklist
+    for (int i = 0; i < count; i++) {
+        if (blocks[i] == header) continue;
+        block = &func->blocks[blocks[i]];
+        for (int p = 0; p < block->num_preds; p++) {
+            int pred = func->preds[block->pred_first + p];
+            if (mark[pred] != header && idom[pred] >= 0) {
+                mark[pred] = header;
+                blocks[count++] = pred;
+            }
+        }
+    }
+    return count;
+}
+
+// Set each block's loop depth: one for every natural loop containing it
+void ir_compute_loops(IrFunction* func) {
+    int n = func->num_blocks;
+    if (n == 0) return;
+    int* idom = malloc(n * sizeof(int));
+    int* mark = malloc(n * sizeof(int));
+    int* blocks = malloc(n * sizeof(int));
+    ir_compute_dominators(func, idom);
+    for (int b = 0; b < n; b++) {
+        func->blocks[b].loop_depth = 0;
+        mark[b] = -1;
+    }
+    for (int h = 0; h < n; h++) {
+        int count = ir_natural_loop(func, idom, h, mark, blocks);
+        for (int i = 0; i < count; i++) func->blocks[blocks[i]].loop_depth++;
+    }
+    free(idom);
+    free(mark);
+    free(blocks);
+}
+
+// --- Dumping ---
+
+// Helper function to print operand 'a' or 'b' of an instruction
+static void dump_operand(FILE* output, int value, int is_imm) {
+    if (is_imm) fprintf(output, "%d", value);
+    else fprintf(output, "v%d", value);
+}
+
+const char* ir_op_name(IrOp op) {
+    return op_names[op];
+}
+
+// Helper function to print a global reference
+static void dump_global(FILE* output, const IrProgram* program, int index) {
+    const IrGlobal* global = &program->globals[index];
+    if (global->is_mmio) fprintf(output, "@0x%X", global->address);
+    else fprintf(output, "@%s", global->name);
+}
+
+static void dump_insn(FILE* output, const IrProgram* program, const IrFunction* func,
+                      const IrBlock* block, const IrInsn* insn) {
+    fputs("    ", output);
+    if (insn->dst >= 0) fprintf(output, "v%d = ", insn->dst);
+    fputs(op_names[insn->op], output);
+    if (insn->size == 1 && (insn->op == IR_LOAD || insn->op == IR_STORE)) fputs(".byte", output);
+
+    switch (insn->op) {
+        case IR_LOAD:
+            fputc(' ', output);
+            dump_global(output, program, insn->b);
+            break;
+        case IR_STORE:
+            fputc(' ', output);
+            dump_global(output, program, insn->b);
+            fputs(", ", output);
+            dump_operand(output, insn->a, insn->flags & IR_A_IMM);
+            break;
+        case IR_ARG:
+            fputc(' ', output);
+            dump_operand(output, insn->a, insn->flags & IR_A_IMM);
+            if (insn->flags & IR_B_IMM) fprintf(output, ", reg %d", insn->b);
+            break;
+        case IR_CALL:
+            fprintf(output, " @%s, %d", program->funcs[insn->b].name, insn->a);
+            break;
+        case IR_ASM:
+            fprintf(output, " \"%s\"", program->asm_texts[insn->b]);
+            break;
+        case IR_SPILL:
+            fprintf(output, " slot %d, v%d", insn->b, insn->a);
+            break;
+        case IR_RELOAD:
+            fprintf(output, " slot %d", insn->b);
+            break;
+        case IR_COUNT:
+            fprintf(output, " %d", insn->b);
+            break;
+        case IR_JUMP:
+            fprintf(output, " b%d", block->succ[0]);
+            break;
+        case IR_SET:
+        case IR_BRANCH:
+            fprintf(output, " %s ", cond_names[insn->cond]);
+            dump_operand(output, insn->a, insn->flags & IR_A_IMM);
+            fputs(", ", output);
+            dump_operand(output, insn->b, insn->flags & IR_B_IMM);
+            if (insn->op == IR_BRANCH) fprintf(output, ", b%d, b%d", block->succ[0], block->succ[1]);
+            break;
+        default:
+            if (insn->a >= 0 || (insn->flags & IR_A_IMM)) {
+                fputc(' ', output);
+                dump_operand(output, insn->a, insn->flags & IR_A_IMM);
+            }
+            if (insn->b >= 0 || (insn->flags & IR_B_IMM)) {
+                fputs(", ", output);
+                dump_operand(output, insn->b, insn->flags & IR_B_IMM);
+            }
+            break;
+    }
+    if (insn->dst >= 0 && func->vreg_names[insn->dst]) {
+        fprintf(output, "  ; %s", func->vreg_names[insn->dst]);
+    }
+    fputc('\n', output);
+}
+
+// Print every function's blocks and instructions in a readable text form
+void ir_dump(FILE* output, const IrProgram* program) {
+    for (int f = 0; f < program->num_funcs; f++) {
+        const IrFunction* func = &program->funcs[f];
+        fprintf(output, "function %s: %d params (%d in registers), %d vregs, %d blocks\n",
+                func->name, func->num_params, func->num_reg_params, func->num_vregs,
+                func->num_blocks);
+        for (int b = 0; b < func->num_blocks; b++) {
+            const IrBlock* block = &func->blocks[b];
+            fprintf(output, "  b%d:", b);
+            if (block->num_preds > 0) {
+                fputs("  preds", output);
+                for (int p = 0; p < block->num_preds; p++) {
+                    fprintf(output, " b%d", func->preds[block->pred_first + p]);
+                }
+            }
+            if (block->loop_depth > 0) fprintf(output, "  loop depth %d", block->loop_depth);
+            fputc('\n', output);
+            for (int i = block->first; i < block->first + block->count; i++) {
+                dump_insn(output, program, func, block, &func->insns[i]);
+            }
+        }
+        fputc('\n', output);
+    }
+}
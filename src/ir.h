@@ -0,0 +1,149 @@
+// ir.h
+#ifndef IR_H
+#define IR_H
+
+#include <stdio.h>
+#include "parser.h"
+#include "arena.h"
+
+// Three-address instructions over virtual registers (vregs). Operands 'a' and
+// 'b' are vregs unless the matching IR_*_IMM flag marks them as immediates;
+// -1 means absent. Block terminators (jump, branch, ret) are always last in
+// their block and take their targets from the block's successors.
+typedef enum {
+    IR_NOP,
+    IR_PARAM,       // dst = incoming argument number a; register arguments come first
+    IR_CONST,       // dst = a (immediate)
+    IR_COPY,        // dst = a
+    IR_ADD, IR_SUB, IR_MUL, IR_DIV, IR_MOD, IR_AND,   // dst = a op b
+    IR_SET,         // dst = 1 if a cond b, else 0
+    IR_LOAD,        // dst = global b (size bytes, zero-extended)
+    IR_STORE,       // global b = a (size bytes)
+    IR_LOAD_PTR,    // dst = [a]
+    IR_STORE_PTR,   // [a] = b
+    IR_ARG,         // Push a as the next argument, last argument first, or with an
+                    // immediate b pass it in argument register b; register
+                    // arguments directly precede their call
+    IR_CALL,        // dst = function b given a arguments; dst -1 discards
+    IR_ALLOC,       // dst = start of a new heap block of a bytes
+    IR_ASM,         // Inline assembly text b
+    IR_SPILL,       // Stack slot b = a (size bytes), inserted by register allocation
+    IR_RELOAD,      // dst = stack slot b (size bytes, zero-extended), inserted by register allocation
+    IR_COUNT,       // Add one to profile counter b, inserted by -fprofile-generate
+    IR_JUMP,        // Go to succ[0]
+    IR_BRANCH,      // Go to succ[0] if a cond b, else succ[1]
+    IR_RET,         // Return a (-1 for none); exits the program in the entry function
+    NUM_IR_OPS
+} IrOp;
+
+#define IR_A_IMM 1
+#define IR_B_IMM 2
+
+// Signed comparisons of IR_SET and IR_BRANCH; each is paired with its
+// negation, so 'cond ^ 1' inverts a test
+typedef enum {
+    IR_EQ, IR_NE, IR_LT, IR_GE, IR_LE, IR_GT
+} IrCond;
+
+typedef struct {
+    unsigned char op;
+    unsigned char size;     // Bytes accessed by loads and stores
+    unsigned char flags;    // IR_A_IMM, IR_B_IMM
+    unsigned char cond;     // IrCond of IR_SET and IR_BRANCH
+    int dst;
+    int a;
+    int b;
+} IrInsn;
+
+// Instructions [first, first + count) in layout order; edges are block indices
+typedef struct {
+    int first;
+    int count;
+    int succ[2];            // -1 if absent
+    int pred_first;         // Predecessors are preds[pred_first .. + num_preds]
+    int num_preds;
+    int loop_depth;
+} IrBlock;
+
+// Fastcall passes this many leading arguments in registers
+#define NUM_ARG_REGS 2
+
+// Vreg flags
+#define VREG_HINT 1         // Declared 'reg': expensive to spill
+#define VREG_SPILL 2        // Reload or spill temporary, never spilled itself
+
+typedef struct {
+    const char* name;
+    int is_entry;           // Program entry: global initializers, then main
+    int num_params;
+    int num_reg_params;     // Leading parameters passed in registers (fastcall)
+    IrInsn* insns;
+    int num_insns;
+    IrBlock* blocks;        // Block 0 is the entry, blocks follow layout order
+    int num_blocks;
+    int* preds;
+    int num_vregs;
+    const char** vreg_names;     // Variable a vreg holds, NULL for temporaries
+    unsigned char* vreg_flags;
+} IrFunction;
+
+typedef struct {
+    const char* name;
+    DataType data_type;
+    int is_reg;             // Declared 'reg'
+    int is_mmio;            // Lives at 'address' instead of the data section
+    unsigned int address;
+} IrGlobal;
+
+typedef struct {
+    IrFunction* funcs;      // The entry function, if any, is last
+    int num_funcs;
+    IrGlobal* globals;
+    int num_globals;
+    const char** asm_texts;
+    int num_asm;
+    int num_counters;       // Profile counters IR_COUNT increments
+} IrProgram;
+
+// --- Building ---
+
+// Accumulates one function in growable arrays; ir_finish() freezes it into
+// compact arena arrays with a clean CFG
+typedef struct {
+    IrInsn* insns;
+    int num_insns, insns_capacity;
+    IrBlock* blocks;
+    int num_blocks, blocks_capacity;
+    int* order;             // Blocks in the order they were started
+    int num_order, order_capacity;
+    const char** vreg_names;
+    unsigned char* vreg_flags;
+    int num_vregs, vregs_capacity;
+    int current;            // Block receiving instructions, -1 after a terminator
+} IrBuilder;
+
+void ir_builder_init(IrBuilder* builder);
+void ir_builder_free(IrBuilder* builder);
+int ir_new_vreg(IrBuilder* builder, const char* name);
+int ir_new_block(IrBuilder* builder);
+void ir_start_block(IrBuilder* builder, int block);
+void ir_emit(IrBuilder* builder, IrOp op, int dst, int a, int b, int flags);
+void ir_jump(IrBuilder* builder, int target);
+void ir_branch(IrBuilder* builder, IrCond cond, int a, int b, int flags, int if_true, int if_false);
+void ir_finish(IrBuilder* builder, IrFunction* func, Arena* arena);
+// Lay the blocks out in 'order', a permutation that keeps block 0 first
+void ir_reorder_blocks(IrFunction* func, const int* order, Arena* arena);
+
+// --- Analysis ---
+
+int ir_is_terminator(IrOp op);
+int ir_uses(const IrInsn* insn, int uses[2]);
+IrCond ir_swap_cond(IrCond cond);
+int ir_eval_cond(IrCond cond, int a, int b);
+void ir_compute_dominators(const IrFunction* func, int* idom);
+int ir_natural_loop(const IrFunction* func, const int* idom, int header, int* mark, int* blocks);
+void ir_compute_loops(IrFunction* func);
+const char* ir_op_name(IrOp op);
+void ir_dump(FILE* output, const IrProgram* program);
+
+#endif
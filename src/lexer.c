@@ -1,101 +1,183 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <ctype.h>
 #include "lexer.h"
+#include "lexer_tables.h"
+#include "intern.h"
+#include "scan.h"
+
+// Bulk scanner override; NULL picks the best one for the running CPU
+static const Scanner* scanner = NULL;
 
 // Helper function to check if a character is a valid identifier start
-int is_identifier_start(char c) {
-    return isalpha(c) || c == '_';
+static inline int is_identifier_start(char c) {
+    return char_class[(unsigned char)c] & CC_IDENT_START;
+}
+
+// Override the bulk scanner (benchmarks and tests compare implementations)
+void lexer_set_scanner(const Scanner* selected) {
+    scanner = selected;
 }
 
-// Helper function to check if a character is a valid identifier part
-int is_identifier_part(char c) {
-    return isalnum(c) || c == '_';
+// Helper function to append a token, doubling the array when it is full
+static void push_token(TokenStream* stream, Token token) {
+    if (stream->count == stream->capacity) {
+        stream->capacity *= 2;
+        stream->tokens = realloc(stream->tokens, stream->capacity * sizeof(Token));
+        if (!stream->tokens) {
+            fprintf(stderr, "Error: Out of memory\n");
+            exit(1);
+        }
+    }
+    stream->tokens[stream->count++] = token;
 }
 
-// Tokenize the input source code
-Token* tokenize(const char* input) {
-    Token* tokens = malloc(1024 * sizeof(Token)); // Allocate space for tokens
-    int token_count = 0;
+// Tokenize the input source code; returns nonzero after reporting a lexical error
+int tokenize(TokenStream* stream, const char* input, size_t length, InternTable* names) {
+    // Sources run two to four bytes a token; starting at a sixteenth of the
+    // input keeps small inputs small, and doubling gets to the end in a few steps
+    stream->capacity = length / 16 + 64;
+    stream->tokens = malloc(stream->capacity * sizeof(Token));
+    if (!stream->tokens) {
+        fprintf(stderr, "Error: Out of memory\n");
+        exit(1);
+    }
+    stream->count = 0;
+    stream->source = input;
+    stream->names = names;
+    const Scanner* scan = scanner ? scanner : scanner_best();
+
     int line = 1;
+    const char* line_start = input;
     const char* src = input;
+    const char* end = input + length;
 
-    while (*src) {
-        if (*src == '\n') line++;
-        // Skip whitespace
-        if (isspace(*src)) {
-            src++;
+    while (src < end) {
+        // Skip whitespace, counting lines as we go
+        if (char_class[(unsigned char)*src] & CC_SPACE) {
+            src = scan->skip_space(src, end, &line, &line_start);
             continue;
         }
 
+        // Skip line comments; the newline is left for skip_space to count
+        if (*src == '/' && src + 1 < end && src[1] == '/') {
+            src = scan->skip_line(src + 2, end);
+            continue;
+        }
+
+        const char* start = src;
+        Token token = {TOKEN_EOF, start - input, 0, line, start - line_start + 1, -1};
+
         // Handle identifiers and keywords
         if (is_identifier_start(*src)) {
-            const char* start = src;
-            while (is_identifier_part(*src)) src++;
-            int length = src - start;
-            char* value = malloc(length + 1);
-            strncpy(value, start, length);
-            value[length] = '\0';
-
-            // Check for keywords
-            if (strcmp(value, "reg") == 0) {
-                tokens[token_count++] = (Token){TOKEN_REG, value};
-            } else if (strcmp(value, "func") == 0) {
-                tokens[token_count++] = (Token){TOKEN_FUNC, value};
-            } else if (strcmp(value, "if") == 0) {
-                tokens[token_count++] = (Token){TOKEN_IF, value};
-            } else if (strcmp(value, "else") == 0) {
-                tokens[token_count++] = (Token){TOKEN_ELSE, value};
-            } else if (strcmp(value, "while") == 0) {
-                tokens[token_count++] = (Token){TOKEN_WHILE, value};
-            } else if (strcmp(value, "for") == 0) {
-                tokens[token_count++] = (Token){TOKEN_FOR, value};
-            } else if (strcmp(value, "return") == 0) {
-                tokens[token_count++] = (Token){TOKEN_RETURN, value};
-            } else if (strcmp(value, "asm") == 0) {
-                tokens[token_count++] = (Token){TOKEN_ASM, value};
-            } else {
-                tokens[token_count++] = (Token){TOKEN_IDENT, value};
+            src = scan->skip_ident(src + 1, end);
+            token.length = src - start;
+            token.type = keyword_type(start, token.length);
+            if (token.type == TOKEN_IDENT) {
+                token.id = intern(names, start, token.length);
             }
+            push_token(stream, token);
             continue;
         }
 
-        // Handle numbers
-        if (isdigit(*src)) {
-            const char* start = src;
-            while (isdigit(*src)) src++;
-            int length = src - start;
-            char* value = malloc(length + 1);
-            strncpy(value, start, length);
-            value[length] = '\0';
-            tokens[token_count++] = (Token){TOKEN_NUMBER, value};
+        // Handle numbers; the whole alphanumeric run is taken so that "0xFF"
+        // is one token and malformed literals are diagnosed by the parser
+        if (char_class[(unsigned char)*src] & CC_DIGIT) {
+            src = scan->skip_ident(src + 1, end);
+            token.type = TOKEN_NUMBER;
+            token.length = src - start;
+            push_token(stream, token);
             continue;
         }
 
+        // Handle string literals (asm text); the token keeps its quotes
+        if (*src == '"') {
+            src++;
+            while (src < end && *src != '"' && *src != '\n') {
+                if (*src == '\\' && src + 1 < end) src++;
+                src++;
+            }
+            if (src >= end || *src != '"') {
+                fprintf(stderr, "%d:%d: Unterminated string\n", token.line, token.column);
+                return 1;
+            }
+            src++;
+            token.type = TOKEN_STRING;
+            token.length = src - start;
+            push_token(stream, token);
+            continue;
+        }
+
+        // Handle operators followed by '=': comparisons and compound assignments
+        if (src + 1 < end && src[1] == '=') {
+            switch (*src) {
+                case '<': token.type = TOKEN_LE; break;
+                case '>': token.type = TOKEN_GE; break;
+                case '=': token.type = TOKEN_EQ_EQ; break;
+                case '!': token.type = TOKEN_NOT_EQ; break;
+                case '+': token.type = TOKEN_PLUS_EQ; break;
+                case '-': token.type = TOKEN_MINUS_EQ; break;
+                case '*': token.type = TOKEN_STAR_EQ; break;
+                default: break;
+            }
+            if (token.type != TOKEN_EOF) {
+                token.length = 2;
+                push_token(stream, token);
+                src += 2;
+                continue;
+            }
+        }
+
         // Handle symbols
         switch (*src) {
-            case '{': tokens[token_count++] = (Token){TOKEN_LBRACE, strdup("{"}; break;
-            case '}': tokens[token_count++] = (Token){TOKEN_RBRACE, strdup("}"); break;
-            case '(': tokens[token_count++] = (Token){TOKEN_LPAREN, strdup("("); break;
-            case ')': tokens[token_count++] = (Token){TOKEN_RPAREN, strdup(")"); break;
-            case ';': tokens[token_count++] = (Token){TOKEN_SEMICOLON, strdup(";"); break;
-            case ',': tokens[token_count++] = (Token){TOKEN_COMMA, strdup(","); break;
-            case '=': tokens[token_count++] = (Token){TOKEN_EQ, strdup("="); break;
-            case '+': tokens[token_count++] = (Token){TOKEN_PLUS, strdup("+"); break;
-            case '-': tokens[token_count++] = (Token){TOKEN_MINUS, strdup("-"); break;
-            case '*': tokens[token_count++] = (Token){TOKEN_STAR, strdup("*"); break;
-            case '/': tokens[token_count++] = (Token){TOKEN_SLASH, strdup("/"); break;
-            case '&': tokens[token_count++] = (Token){TOKEN_AND, strdup("&"); break;
-            case '@': tokens[token_count++] = (Token){TOKEN_AT, strdup("@"); break;
+            case '{': token.type = TOKEN_LBRACE; break;
+            case '}': token.type = TOKEN_RBRACE; break;
+            case '(': token.type = TOKEN_LPAREN; break;
+            case ')': token.type = TOKEN_RPAREN; break;
+            case ';': token.type = TOKEN_SEMICOLON; break;
+            case ',': token.type = TOKEN_COMMA; break;
+            case '=': token.type = TOKEN_EQ; break;
+            case '+': token.type = TOKEN_PLUS; break;
+            case '-': token.type = TOKEN_MINUS; break;
+            case '*': token.type = TOKEN_STAR; break;
+            case '/': token.type = TOKEN_SLASH; break;
+            case '%': token.type = TOKEN_PERCENT; break;
+            case '&': token.type = TOKEN_AND; break;
+            case '@': token.type = TOKEN_AT; break;
+            case '<': token.type = TOKEN_LT; break;
+            case '>': token.type = TOKEN_GT; break;
             default:
-                fprintf(stderr, "Unknown character: %c\n", *src);
-                exit(1);
+                fprintf(stderr, "%d:%d: Unknown character: %c\n",
+                        token.line, token.column, *src);
+                return 1;
         }
+        token.length = 1;
+        push_token(stream, token);
         src++;
     }
 
     // Add EOF token
-    tokens[token_count++] = (Token){TOKEN_EOF, NULL};
-    return tokens;
-}
\ No newline at end of file
+    push_token(stream, (Token){TOKEN_EOF, length, 0, line, end - line_start + 1, -1});
+    return 0;
+}
+
+// Return the spelling of a token; identifiers come from the intern table
+const char* token_text(TokenStream* stream, Token* token) {
+    char* buffer = stream->text;
+    if (token->type == TOKEN_IDENT) return intern_name(stream->names, token->id);
+    if (token->type == TOKEN_EOF) return "end of file";
+
+    int length = token->length < (int)sizeof(stream->text) - 1 ? token->length
+                                                            : (int)sizeof(stream->text) - 1;
+    memcpy(buffer, stream->source + token->offset, length);
+    buffer[length] = '\0';
+    return buffer;
+}
+
+// Release the token array
+void token_stream_free(TokenStream* stream) {
+    free(stream->tokens);
+    stream->tokens = NULL;
+    stream->count = 0;
+    stream->capacity = 0;
+}
@@ -1,15 +1,45 @@
 // lexer.h
+#ifndef LEXER_H
+#define LEXER_H
+
+#include <stddef.h>
+#include "intern.h"
+#include "scan.h"
+
 typedef enum {
-    TOKEN_EOF, TOKEN_REG, TOKEN_FUNC, TOKEN_INT, TOKEN_BYTE, TOKEN_PTR,
+    TOKEN_EOF, TOKEN_REG, TOKEN_FUNC, TOKEN_INT, TOKEN_BYTE, TOKEN_PTR, TOKEN_VOID,
     TOKEN_IF, TOKEN_ELSE, TOKEN_WHILE, TOKEN_FOR, TOKEN_RETURN, TOKEN_IDENT,
     TOKEN_NUMBER, TOKEN_STRING, TOKEN_ASM, TOKEN_LBRACE, TOKEN_RBRACE,
     TOKEN_LPAREN, TOKEN_RPAREN, TOKEN_SEMICOLON, TOKEN_COMMA, TOKEN_EQ,
-    TOKEN_PLUS, TOKEN_MINUS, TOKEN_STAR, TOKEN_SLASH, TOKEN_AND, TOKEN_AT
+    TOKEN_PLUS, TOKEN_MINUS, TOKEN_STAR, TOKEN_SLASH, TOKEN_PERCENT, TOKEN_AND, TOKEN_AT,
+    TOKEN_LT, TOKEN_GT, TOKEN_LE, TOKEN_GE, TOKEN_EQ_EQ, TOKEN_NOT_EQ,
+    TOKEN_PLUS_EQ, TOKEN_MINUS_EQ, TOKEN_STAR_EQ, TOKEN_CDECL, TOKEN_FASTCALL
 } TokenType;
 
+// A token is a slice of the source; nothing is copied out of the input
 typedef struct {
     TokenType type;
-    char* value;
+    int offset;     // Byte offset of the first character in the source
+    int length;     // Length in bytes
+    int line;
+    int column;
+    int id;         // Interned name for TOKEN_IDENT, -1 otherwise
 } Token;
 
-Token* tokenize(const char* input);
\ No newline at end of file
+// Growable array of tokens over one source buffer
+typedef struct {
+    Token* tokens;
+    int count;
+    int capacity;
+    const char* source;
+    InternTable* names;
+    char text[64];          // Spelling returned by token_text()
+} TokenStream;
+
+// Returns nonzero after reporting a lexical error; the stream must still be freed
+int tokenize(TokenStream* stream, const char* input, size_t length, InternTable* names);
+const char* token_text(TokenStream* stream, Token* token);
+void token_stream_free(TokenStream* stream);
+void lexer_set_scanner(const Scanner* selected);
+
+#endif
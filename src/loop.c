@@ -0,0 +1,570 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include "loop.h"
+#include "alloc.h"
+
+// How many single-predecessor blocks to look back through for a loop
+// variable's value on entry
+#define MAX_ENTRY_SEARCH 8
+
+// An instruction added when the function is rebuilt, ahead of 'before'
+typedef struct {
+    int before;
+    IrInsn insn;
+} Insertion;
+
+// The loop being optimized. Lowering gives every loop an empty preheader
+// that jumps to the header; loops without one are left alone.
+typedef struct {
+    int header;
+    int preheader;
+    int latch;              // Block holding the only back edge, -1 if several
+    int* blocks;            // Members in layout order
+    int num_blocks;
+    int has_call;           // A call or inline assembly may write any global
+    unsigned char* stored;  // Globals stored to inside the loop
+} Loop;
+
+typedef struct {
+    IrProgram* program;
+    IrFunction* func;       // Function being optimized
+    int* idom;              // Immediate dominator of each block
+    int* mark;              // Blocks stamped with the header of their loop
+    int* block_of;          // Block of each instruction
+    int* def_count;         // Definitions of each vreg inside the loop
+    int* visited;           // Liveness search stamps, per block
+    int* worklist;
+    int visit_stamp;
+    Insertion* insertions;
+    int num_insertions, insertions_capacity;
+    int num_vregs;          // Vregs of the function plus those created for the loop
+} LoopOptimizer;
+
+// --- Edits ---
+
+// Helper function to queue an instruction for insertion ahead of 'before'
+static void insert_insn(LoopOptimizer* lo, int before, const IrInsn* insn) {
+    if (lo->num_insertions == lo->insertions_capacity) {
+        lo->insertions_capacity = lo->insertions_capacity ? lo->insertions_capacity * 2 : 16;
+        lo->insertions = realloc(lo->insertions, lo->insertions_capacity * sizeof(Insertion));
+        if (!lo->insertions) {
+            fprintf(stderr, "Error: Out of memory\n");
+            exit(1);
+        }
+    }
+    lo->insertions[lo->num_insertions].before = before;
+    lo->insertions[lo->num_insertions].insn = *insn;
+    lo->num_insertions++;
+}
+
+static void insert(LoopOptimizer* lo, int before, IrOp op, int dst, int a, int b, int flags) {
+    IrInsn insn = {op, 4, flags, IR_NE, dst, a, b};
+    insert_insn(lo, before, &insn);
+}
+
+// Helper function to delete an instruction in place; rebuilding drops it
+static void delete_insn(IrInsn* insn) {
+    insn->op = IR_NOP;
+    insn->flags = 0;
+    insn->dst = insn->a = insn->b = -1;
+}
+
+// Helper function to append a copy of an instruction to the builder
+static void emit_copy(IrBuilder* builder, const IrInsn* insn) {
+    ir_emit(builder, insn->op, insn->dst, insn->a, insn->b, insn->flags);
+    builder->insns[builder->num_insns - 1].size = insn->size;
+    builder->insns[builder->num_insns - 1].cond = insn->cond;
+}
+
+// Apply the queued insertions and deletions by rebuilding the function. Edits
+// never change edges, so every block keeps its number.
+static void rebuild(LoopOptimizer* lo, Arena* arena) {
+    // Stable by position: insertions at one point keep the order they were made in
+    for (int i = 1; i < lo->num_insertions; i++) {
+        Insertion insertion = lo->insertions[i];
+        int j = i;
+        while (j > 0 && lo->insertions[j - 1].before > insertion.before) {
+            lo->insertions[j] = lo->insertions[j - 1];
+            j--;
+        }
+        lo->insertions[j] = insertion;
+    }
+
+    IrBuilder builder;
+    ir_builder_init(&builder);
+    for (int v = 0; v < lo->num_vregs; v++) {
+        ir_new_vreg(&builder, v < lo->func->num_vregs ? lo->func->vreg_names[v] : NULL);
+        if (v < lo->func->num_vregs) builder.vreg_flags[v] = lo->func->vreg_flags[v];
+    }
+    for (int b = 0; b < lo->func->num_blocks; b++) ir_new_block(&builder);
+
+    int next = 0;
+    for (int b = 0; b < lo->func->num_blocks; b++) {
+        IrBlock* block = &lo->func->blocks[b];
+        ir_start_block(&builder, b);
+        for (int i = block->first; i < block->first + block->count; i++) {
+            while (next < lo->num_insertions && lo->insertions[next].before == i) {
+                emit_copy(&builder, &lo->insertions[next++].insn);
+            }
+            IrInsn* insn = &lo->func->insns[i];
+            if (insn->op == IR_JUMP) {
+                ir_jump(&builder, block->succ[0]);
+            } else if (insn->op == IR_BRANCH) {
+                ir_branch(&builder, insn->cond, insn->a, insn->b, insn->flags,
+                          block->succ[0], block->succ[1]);
+            } else if (insn->op != IR_NOP) {
+                emit_copy(&builder, insn);
+            }
+        }
+    }
+
+    IrFunction rebuilt;
+    ir_finish(&builder, &rebuilt, arena);
+    ir_builder_free(&builder);
+    rebuilt.name = lo->func->name;
+    rebuilt.is_entry = lo->func->is_entry;
+    rebuilt.num_params = lo->func->num_params;
+    rebuilt.num_reg_params = lo->func->num_reg_params;
+    *lo->func = rebuilt;
+}
+
+// --- Analysis ---
+
+static int dominates(LoopOptimizer* lo, int a, int b) {
+    while (b != a && b != 0) b = lo->idom[b];
+    return b == a;
+}
+
+static int in_loop(LoopOptimizer* lo, const Loop* loop, int block) {
+    return lo->mark[block] == loop->header;
+}
+
+// Helper function to get a block's terminator
+static IrInsn* terminator(LoopOptimizer* lo, int block) {
+    return &lo->func->insns[lo->func->blocks[block].first + lo->func->blocks[block].count - 1];
+}
+
+// Helper function to check whether an instruction reads a vreg
+static int uses_vreg(const IrInsn* insn, int v) {
+    int uses[2];
+    int n = ir_uses(insn, uses);
+    for (int u = 0; u < n; u++) {
+        if (uses[u] == v) return 1;
+    }
+    return 0;
+}
+
+// Check whether some path from instruction 'i' of 'block' reads 'v' before
+// writing it. Queued insertions count as reads wherever they land.
+static int live_from(LoopOptimizer* lo, int block, int i, int v) {
+    lo->visit_stamp++;
+    int top = 0;
+    for (;;) {
+        IrBlock* current = &lo->func->blocks[block];
+        int end = current->first + current->count;
+        for (int k = 0; k < lo->num_insertions; k++) {
+            int at = lo->insertions[k].before;
+            if (at >= i && at < end && uses_vreg(&lo->insertions[k].insn, v)) return 1;
+        }
+        int killed = 0;
+        for (; i < end && !killed; i++) {
+            if (uses_vreg(&lo->func->insns[i], v)) return 1;
+            killed = lo->func->insns[i].dst == v;
+        }
+        for (int s = 0; s < 2 && !killed; s++) {
+            int succ = current->succ[s];
+            if (succ >= 0 && lo->visited[succ] != lo->visit_stamp) {
+                lo->visited[succ] = lo->visit_stamp;
+                lo->worklist[top++] = succ;
+            }
+        }
+        if (top == 0) return 0;
+        block = lo->worklist[--top];
+        i = lo->func->blocks[block].first;
+    }
+}
+
+// Helper function to check that 'v' keeps its value on every way out of the
+// loop when it is computed in 'block' instead of every iteration
+static int same_on_exit(LoopOptimizer* lo, const Loop* loop, int block, int v) {
+    for (int j = 0; j < loop->num_blocks; j++) {
+        int from = loop->blocks[j];
+        for (int s = 0; s < 2; s++) {
+            int succ = lo->func->blocks[from].succ[s];
+            if (succ < 0 || in_loop(lo, loop, succ) || dominates(lo, block, from)) continue;
+            if (live_from(lo, succ, lo->func->blocks[succ].first, v)) return 0;
+        }
+    }
+    return 1;
+}
+
+// Helper function to find the constant a vreg holds at the end of 'block',
+// looking back through blocks with a single predecessor
+static int entry_constant(LoopOptimizer* lo, int block, int v, int* value) {
+    for (int steps = 0; steps < MAX_ENTRY_SEARCH; steps++) {
+        IrBlock* current = &lo->func->blocks[block];
+        for (int i = current->first + current->count - 1; i >= current->first; i--) {
+            IrInsn* insn = &lo->func->insns[i];
+            if (insn->dst != v) continue;
+            if (insn->op != IR_CONST) return 0;
+            *value = insn->a;
+            return 1;
+        }
+        if (current->num_preds != 1) return 0;
+        block = lo->func->preds[current->pred_first];
+    }
+    return 0;
+}
+
+// Helper function to order the loop's blocks by layout
+static int compare_ints(const void* a, const void* b) {
+    return *(const int*)a - *(const int*)b;
+}
+
+// Gather the loop headed by 'header'; returns 0 if it has no preheader
+static int find_loop(LoopOptimizer* lo, int header, Loop* loop) {
+    for (int b = 0; b < lo->func->num_blocks; b++) lo->mark[b] = -1;
+    loop->header = header;
+    loop->num_blocks = ir_natural_loop(lo->func, lo->idom, header, lo->mark, loop->blocks);
+    if (loop->num_blocks == 0) return 0;
+    qsort(loop->blocks, loop->num_blocks, sizeof(int), compare_ints);
+
+    IrBlock* block = &lo->func->blocks[header];
+    loop->preheader = -1;
+    loop->latch = -1;
+    int num_outside = 0, num_latches = 0;
+    for (int p = 0; p < block->num_preds; p++) {
+        int pred = lo->func->preds[block->pred_first + p];
+        if (in_loop(lo, loop, pred)) {
+            loop->latch = pred;
+            num_latches++;
+        } else {
+            loop->preheader = pred;
+            num_outside++;
+        }
+    }
+    if (num_latches > 1) loop->latch = -1;
+    if (num_outside != 1 || lo->func->blocks[loop->preheader].succ[1] >= 0) return 0;
+
+    memset(lo->def_count, 0, lo->num_vregs * sizeof(int));
+    memset(loop->stored, 0, lo->program->num_globals + 1);
+    loop->has_call = 0;
+    for (int j = 0; j < loop->num_blocks; j++) {
+        IrBlock* member = &lo->func->blocks[loop->blocks[j]];
+        for (int i = member->first; i < member->first + member->count; i++) {
+            IrInsn* insn = &lo->func->insns[i];
+            if (insn->dst >= 0) lo->def_count[insn->dst]++;
+            if (insn->op == IR_CALL || insn->op == IR_ASM) loop->has_call = 1;
+            if (insn->op == IR_STORE) loop->stored[insn->b] = 1;
+        }
+    }
+    return 1;
+}
+
+// --- Loop-invariant code motion ---
+
+// Check whether an instruction computes the same value on every iteration
+// and can run once in the preheader instead
+static int is_hoistable(LoopOptimizer* lo, const Loop* loop, int i) {
+    IrInsn* insn = &lo->func->insns[i];
+    switch (insn->op) {
+        case IR_COPY: case IR_ADD: case IR_SUB: case IR_MUL: case IR_AND: case IR_SET:
+            break;
+        case IR_LOAD:
+            // Device registers change behind the program's back: every read stays
+            if (lo->program->globals[insn->b].is_mmio) return 0;
+            if (loop->has_call || loop->stored[insn->b]) return 0;
+            break;
+        default:
+            return 0;  // Constants are free as immediates; the rest may fault or have effects
+    }
+    if (lo->def_count[insn->dst] != 1) return 0;
+    int uses[2];
+    int n = ir_uses(insn, uses);
+    for (int u = 0; u < n; u++) {
+        if (lo->def_count[uses[u]] > 0) return 0;
+    }
+
+    // The old value must not be needed in the loop or after leaving it early
+    if (live_from(lo, loop->header, lo->func->blocks[loop->header].first, insn->dst)) return 0;
+    return same_on_exit(lo, loop, lo->block_of[i], insn->dst);
+}
+
+// Move invariant computations to the end of the preheader, repeating until
+// nothing depends on a value still computed inside the loop
+static void hoist_invariants(LoopOptimizer* lo, const Loop* loop) {
+    int before = lo->func->blocks[loop->preheader].first + lo->func->blocks[loop->preheader].count - 1;
+    int changed = 1;
+    while (changed) {
+        changed = 0;
+        for (int j = 0; j < loop->num_blocks; j++) {
+            IrBlock* block = &lo->func->blocks[loop->blocks[j]];
+            for (int i = block->first; i < block->first + block->count; i++) {
+                if (!is_hoistable(lo, loop, i)) continue;
+                lo->def_count[lo->func->insns[i].dst] = 0;
+                insert_insn(lo, before, &lo->func->insns[i]);
+                delete_insn(&lo->func->insns[i]);
+                changed = 1;
+            }
+        }
+    }
+}
+
+// --- Induction variables ---
+
+// Helper function to get the step of 'v = v + c' or 'v = v - c', or 0
+static int iv_step(const IrInsn* insn, int v) {
+    if (insn->dst != v || insn->a != v || (insn->flags & IR_A_IMM) || !(insn->flags & IR_B_IMM)) {
+        return 0;
+    }
+    if (insn->op == IR_ADD) return insn->b;
+    if (insn->op == IR_SUB) return (int)(0u - (unsigned int)insn->b);
+    return 0;
+}
+
+// Check whether every definition of 'v' in the loop steps it by a constant
+static int is_basic_iv(LoopOptimizer* lo, const Loop* loop, int v) {
+    if (lo->def_count[v] == 0) return 0;
+    for (int j = 0; j < loop->num_blocks; j++) {
+        IrBlock* block = &lo->func->blocks[loop->blocks[j]];
+        for (int i = block->first; i < block->first + block->count; i++) {
+            if (lo->func->insns[i].dst == v && iv_step(&lo->func->insns[i], v) == 0) return 0;
+        }
+    }
+    return 1;
+}
+
+// Replace 't = v * c' for an induction variable v by a running product w
+// that starts at v * c in the preheader and moves by step * c wherever v
+// moves, so the loop multiplies no more
+static void reduce_strength(LoopOptimizer* lo, const Loop* loop) {
+    int before = lo->func->blocks[loop->preheader].first + lo->func->blocks[loop->preheader].count - 1;
+    for (int j = 0; j < loop->num_blocks; j++) {
+        IrBlock* block = &lo->func->blocks[loop->blocks[j]];
+        for (int i = block->first; i < block->first + block->count; i++) {
+            IrInsn* insn = &lo->func->insns[i];
+            if (insn->op != IR_MUL || (insn->flags & IR_A_IMM) || !(insn->flags & IR_B_IMM)) continue;
+            int v = insn->a;
+            unsigned int factor = (unsigned int)insn->b;
+            if (insn->dst == v || !is_basic_iv(lo, loop, v)) continue;
+
+            int w = lo->num_vregs++;
+            int start;
+            if (entry_constant(lo, loop->preheader, v, &start)) {
+                insert(lo, before, IR_CONST, w, (int)((unsigned int)start * factor), -1, IR_A_IMM);
+            } else {
+                insert(lo, before, IR_MUL, w, v, (int)factor, IR_B_IMM);
+            }
+            for (int k = 0; k < loop->num_blocks; k++) {
+                IrBlock* other = &lo->func->blocks[loop->blocks[k]];
+                for (int d = other->first; d < other->first + other->count; d++) {
+                    int step = lo->func->insns[d].dst == v ? iv_step(&lo->func->insns[d], v) : 0;
+                    if (step != 0) insert(lo, d + 1, IR_ADD, w, w, (int)((unsigned int)step * factor), IR_B_IMM);
+                }
+            }
+            insn->op = IR_COPY;
+            insn->a = w;
+            insn->b = -1;
+            insn->flags = 0;
+        }
+    }
+}
+
+// Helper function to turn 'v <= L' into 'v < L + 1' and 'v >= L' into
+// 'v > L - 1' when L is a constant that allows it
+static void normalize_test(IrCond* cond, int* limit, int limit_imm) {
+    if (!limit_imm) return;
+    if (*cond == IR_LE && *limit != INT_MAX) {
+        *cond = IR_LT;
+        (*limit)++;
+    } else if (*cond == IR_GE && *limit != INT_MIN) {
+        *cond = IR_GT;
+        (*limit)--;
+    }
+}
+
+// Helper function to read the test a branch makes to reach 'target' as
+// 'v cond limit'; returns 0 if 'v' is not one of its operands
+static int read_test(LoopOptimizer* lo, int block, int target, int v, IrCond* cond, int* limit, int* limit_imm) {
+    IrInsn* insn = terminator(lo, block);
+    if (insn->op != IR_BRANCH) return 0;
+    *cond = lo->func->blocks[block].succ[0] == target ? insn->cond : insn->cond ^ 1;
+    if (insn->a == v && !(insn->flags & IR_A_IMM)) {
+        *limit = insn->b;
+        *limit_imm = (insn->flags & IR_B_IMM) != 0;
+    } else if (insn->b == v && !(insn->flags & IR_B_IMM)) {
+        *limit = insn->a;
+        *limit_imm = (insn->flags & IR_A_IMM) != 0;
+        *cond = ir_swap_cond(*cond);
+    } else {
+        return 0;
+    }
+    normalize_test(cond, limit, *limit_imm);
+    return 1;
+}
+
+// Check that the block before the preheader already made the loop's test,
+// so the first iteration is known to pass it
+static int is_guarded(LoopOptimizer* lo, const Loop* loop, int v, IrCond cond, int limit, int limit_imm) {
+    IrBlock* preheader = &lo->func->blocks[loop->preheader];
+    if (preheader->num_preds != 1) return 0;
+    for (int i = preheader->first; i < preheader->first + preheader->count; i++) {
+        int dst = lo->func->insns[i].dst;
+        if (dst >= 0 && (dst == v || (!limit_imm && dst == limit))) return 0;
+    }
+
+    IrCond guard_cond;
+    int guard_limit, guard_imm;
+    if (!read_test(lo, lo->func->preds[preheader->pred_first], loop->preheader, v,
+                   &guard_cond, &guard_limit, &guard_imm)) {
+        return 0;
+    }
+    return guard_cond == cond && guard_limit == limit && guard_imm == limit_imm;
+}
+
+// Counted loops 'v = v0; do { ...; v += 1; } while (v < L)' whose v is
+// needed for nothing else count n = L - v0 down to zero instead: the exit
+// test becomes dec n / jnz and v disappears from the loop. Steps of -1 with
+// '>' work the same; '!=' tests need no proof that the first test passes.
+static void replace_exit_test(LoopOptimizer* lo, const Loop* loop) {
+    if (loop->latch < 0) return;
+    IrBlock* latch = &lo->func->blocks[loop->latch];
+    IrInsn* branch = terminator(lo, loop->latch);
+    if (branch->op != IR_BRANCH) return;
+
+    // Try each side of the test as the induction variable
+    for (int side = 0; side < 2; side++) {
+        int v = side == 0 ? branch->a : branch->b;
+        if (branch->flags & (side == 0 ? IR_A_IMM : IR_B_IMM) || lo->def_count[v] != 1) continue;
+
+        IrCond cond;
+        int limit, limit_imm;
+        if (!read_test(lo, loop->latch, loop->header, v, &cond, &limit, &limit_imm)) continue;
+        if (!limit_imm && (limit == v || lo->def_count[limit] > 0)) continue;
+
+        // The single step must run exactly once per iteration
+        int def = -1, uses = 0;
+        for (int j = 0; j < loop->num_blocks; j++) {
+            IrBlock* block = &lo->func->blocks[loop->blocks[j]];
+            for (int i = block->first; i < block->first + block->count; i++) {
+                if (lo->func->insns[i].dst == v) def = i;
+                if (uses_vreg(&lo->func->insns[i], v)) uses++;
+            }
+        }
+        int step = iv_step(&lo->func->insns[def], v);
+        if (step != 1 && step != -1) continue;
+        int def_block = lo->block_of[def];
+        if (!dominates(lo, def_block, loop->latch) ||
+            lo->func->blocks[def_block].loop_depth != lo->func->blocks[loop->header].loop_depth) {
+            continue;
+        }
+        if (uses != 2 || !same_on_exit(lo, loop, -1, v)) continue;
+        if (!(cond == IR_NE || (step == 1 && cond == IR_LT) || (step == -1 && cond == IR_GT))) continue;
+
+        int start;
+        int known = entry_constant(lo, loop->preheader, v, &start);
+        if (cond != IR_NE && !(known && limit_imm && ir_eval_cond(cond, start, limit)) &&
+            !is_guarded(lo, loop, v, cond, limit, limit_imm)) {
+            continue;
+        }
+
+        int n = lo->num_vregs++;
+        int before = lo->func->blocks[loop->preheader].first + lo->func->blocks[loop->preheader].count - 1;
+        if (known && limit_imm) {
+            unsigned int count = step == 1 ? (unsigned int)limit - (unsigned int)start
+                                           : (unsigned int)start - (unsigned int)limit;
+            insert(lo, before, IR_CONST, n, (int)count, -1, IR_A_IMM);
+        } else if (step == 1) {
+            insert(lo, before, IR_SUB, n, limit, v, limit_imm ? IR_A_IMM : 0);
+        } else {
+            insert(lo, before, IR_SUB, n, v, limit, limit_imm ? IR_B_IMM : 0);
+        }
+        delete_insn(&lo->func->insns[def]);
+        insert(lo, latch->first + latch->count - 1, IR_SUB, n, n, 1, IR_B_IMM);
+        branch->cond = latch->succ[0] == loop->header ? IR_NE : IR_EQ;
+        branch->a = n;
+        branch->b = 0;
+        branch->flags = IR_B_IMM;
+        return;
+    }
+}
+
+// --- Driver ---
+
+static int compare_keys(const void* a, const void* b) {
+    unsigned long long x = *(const unsigned long long*)a, y = *(const unsigned long long*)b;
+    return x < y ? -1 : x > y;
+}
+
+static void optimize_function(LoopOptimizer* lo, IrFunction* ir, Arena* arena) {
+    lo->func = ir;
+    int n = lo->func->num_blocks;
+    if (n == 0) return;
+    lo->idom = checked_calloc(n, sizeof(int));
+    lo->mark = checked_calloc(n, sizeof(int));
+    lo->visited = checked_calloc(n, sizeof(int));
+    lo->worklist = checked_calloc(n, sizeof(int));
+    unsigned long long* headers = checked_calloc(n, sizeof(unsigned long long));
+    Loop loop;
+    loop.blocks = checked_calloc(n, sizeof(int));
+    loop.stored = checked_calloc(lo->program->num_globals + 1, 1);
+
+    // Headers innermost first, so hoisted code can move out again with the
+    // enclosing loop, each keyed by depth then number
+    int num_headers = 0;
+    ir_compute_dominators(lo->func, lo->idom);
+    for (int h = 0; h < n; h++) {
+        IrBlock* block = &lo->func->blocks[h];
+        for (int p = 0; p < block->num_preds; p++) {
+            if (dominates(lo, h, lo->func->preds[block->pred_first + p])) {
+                unsigned long long depth = INT_MAX - lo->func->blocks[h].loop_depth;
+                headers[num_headers++] = depth << 32 | (unsigned long long)h;
+                break;
+            }
+        }
+    }
+    qsort(headers, num_headers, sizeof(unsigned long long), compare_keys);
+
+    for (int k = 0; k < num_headers; k++) {
+        ir_compute_dominators(lo->func, lo->idom);
+        lo->num_vregs = lo->func->num_vregs;
+        lo->num_insertions = 0;
+        // Room for the vregs a loop can add: two per multiplication, one counter
+        lo->def_count = checked_calloc(lo->num_vregs + lo->func->num_insns + 1, sizeof(int));
+        lo->block_of = checked_calloc(lo->func->num_insns, sizeof(int));
+        for (int b = 0; b < n; b++) {
+            for (int i = lo->func->blocks[b].first; i < lo->func->blocks[b].first + lo->func->blocks[b].count; i++) {
+                lo->block_of[i] = b;
+            }
+        }
+
+        if (find_loop(lo, (int)(headers[k] & 0xFFFFFFFFu), &loop)) {
+            hoist_invariants(lo, &loop);
+            reduce_strength(lo, &loop);
+            replace_exit_test(lo, &loop);
+        }
+        if (lo->num_insertions > 0) rebuild(lo, arena);
+        free(lo->def_count);
+        free(lo->block_of);
+    }
+
+    free(lo->idom);
+    free(lo->mark);
+    free(lo->visited);
+    free(lo->worklist);
+    free(headers);
+    free(loop.blocks);
+    free(loop.stored);
+}
+
+void optimize_loops(IrProgram* program, Arena* arena) {
+    LoopOptimizer optimizer;
+    memset(&optimizer, 0, sizeof(optimizer));
+    optimizer.program = program;
+    for (int f = 0; f < program->num_funcs; f++) {
+        optimize_function(&optimizer, &program->funcs[f], arena);
+    }
+    free(optimizer.insertions);
+}
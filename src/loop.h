@@ -0,0 +1,15 @@
+// loop.h
+#ifndef LOOP_H
+#define LOOP_H
+
+#include "arena.h"
+#include "ir.h"
+
+// Optimize the natural loops of every function, innermost first: hoist
+// loop-invariant computations into the preheader, replace multiplications of
+// induction variables by running sums, and turn counted exit tests into a
+// down-counter compared against zero. Loops must come with an empty
+// preheader, as lowering provides.
+void optimize_loops(IrProgram* program, Arena* arena);
+
+#endif
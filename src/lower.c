@@ -0,0 +1,709 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "lower.h"
+#include "symbol_table.h"
+
+// Symbols map names to IR entities: locals and parameters are SYM_REG with
+// 'reg' holding their vreg, globals keep their index into program->globals in
+// 'address' and functions their index into program->funcs
+typedef struct {
+    SymbolTable symbols;
+    Arena* arena;
+    IrProgram* program;
+    IrBuilder builder;
+    const char* current_func;
+    const char** asm_texts;
+    int asm_capacity;
+    int has_error;
+    CallConv default_callconv;  // For functions that name none
+    Tracer* tracer;             // Times each node kind, NULL when off
+} Lowerer;
+
+// An expression result: a vreg, or an immediate that needs no register
+typedef struct {
+    int value;
+    int is_imm;
+} Value;
+
+static void error(Lowerer* lw, const char* msg, const char* context) {
+    fprintf(stderr, "Error: %s (%s)\n", msg, context);
+    lw->has_error = 1;
+}
+
+// --- Names and types ---
+
+// Check if a symbol exists in the current scope
+static Symbol* check_symbol_exists(Lowerer* lw, ASTNode* node) {
+    Symbol* sym = symtab_find(&lw->symbols, node->id);
+    if (!sym) {
+        error(lw, "Undeclared variable", node->value);
+        return NULL;
+    }
+    return sym;
+}
+
+// Check type compatibility; int and byte convert implicitly, pointers do not
+static void check_type(Lowerer* lw, DataType expected, DataType actual, const char* context) {
+    int numeric = (expected == DT_INT || expected == DT_BYTE) &&
+                  (actual == DT_INT || actual == DT_BYTE);
+    if (expected != actual && !numeric) {
+        fprintf(stderr, "Type error: Expected %d, got %d (%s)\n",
+                expected, actual, context);
+        lw->has_error = 1;
+    }
+}
+
+// Helper function to map a comparison operator to its IR test, or -1
+static int comparison(ASTNode* node) {
+    if (node->type != NODE_BINOP) return -1;
+    const char* op = node->value;
+    if (op[0] == '<') return op[1] ? IR_LE : IR_LT;
+    if (op[0] == '>') return op[1] ? IR_GE : IR_GT;
+    if (op[0] == '=') return IR_EQ;
+    if (op[0] == '!') return IR_NE;
+    return -1;
+}
+
+// Determine the type of an expression node
+static DataType get_expression_type(Lowerer* lw, ASTNode* node) {
+    switch (node->type) {
+        case NODE_IDENT:
+        case NODE_CALL: {
+            Symbol* sym = symtab_find(&lw->symbols, node->id);
+            return sym ? sym->data_type : DT_INT;  // Default to int on error
+        }
+        case NODE_NUMBER: return DT_INT;
+        case NODE_BINOP: {
+            if (comparison(node) >= 0) return DT_INT;
+            DataType left = get_expression_type(lw, node->children[0]);
+            DataType right = get_expression_type(lw, node->children[1]);
+            return (left == DT_PTR || right == DT_PTR) ? DT_PTR : left;
+        }
+        case NODE_PTR: return DT_PTR;
+        default: return DT_INT;
+    }
+}
+
+// Add a symbol to the innermost scope; the name is interned and outlives lowering
+static Symbol* add_symbol(Lowerer* lw, ASTNode* decl, int storage_type, int reg, int address) {
+    Symbol* sym = symtab_add(&lw->symbols, decl->value, decl->id);
+    sym->storage_type = storage_type;
+    sym->data_type = decl->data_type;
+    sym->reg = reg;
+    sym->address = address;
+    return sym;
+}
+
+// --- Emission helpers ---
+
+static Value imm(int value) {
+    Value result = {value, 1};
+    return result;
+}
+
+static Value vreg(int value) {
+    Value result = {value, 0};
+    return result;
+}
+
+// Helper function to create a temporary vreg
+static int temp(Lowerer* lw) {
+    return ir_new_vreg(&lw->builder, NULL);
+}
+
+// Helper function to materialize a value in a vreg
+static int to_vreg(Lowerer* lw, Value value) {
+    if (!value.is_imm) return value.value;
+    int result = temp(lw);
+    ir_emit(&lw->builder, IR_CONST, result, value.value, -1, 0);
+    return result;
+}
+
+// Helper function to set the access size of the instruction just emitted
+static void set_size(Lowerer* lw, DataType type) {
+    lw->builder.insns[lw->builder.num_insns - 1].size = type == DT_BYTE ? 1 : 4;
+}
+
+// Helper function to get a variable's value into a vreg
+static int load_variable(Lowerer* lw, Symbol* sym) {
+    if (sym->storage_type == SYM_REG) return sym->reg;
+    int result = temp(lw);
+    ir_emit(&lw->builder, IR_LOAD, result, -1, sym->address, 0);
+    set_size(lw, sym->data_type);
+    return result;
+}
+
+// Store a value into a local's vreg, keeping byte variables within 8 bits.
+// A temporary computed by the previous instruction is renamed instead of copied.
+static void assign_local(Lowerer* lw, Symbol* sym, Value value) {
+    int var = sym->reg;
+    if (value.is_imm) {
+        int number = sym->data_type == DT_BYTE ? (value.value & 0xFF) : value.value;
+        ir_emit(&lw->builder, IR_CONST, var, number, -1, 0);
+    } else if (sym->data_type == DT_BYTE) {
+        ir_emit(&lw->builder, IR_AND, var, value.value, 0xFF, IR_B_IMM);
+    } else if (lw->builder.current >= 0 && lw->builder.num_insns > 0 && !lw->builder.vreg_names[value.value] &&
+               lw->builder.insns[lw->builder.num_insns - 1].dst == value.value) {
+        lw->builder.insns[lw->builder.num_insns - 1].dst = var;
+    } else {
+        ir_emit(&lw->builder, IR_COPY, var, value.value, -1, 0);
+    }
+}
+
+// Store a value into a variable of any kind
+static void assign(Lowerer* lw, Symbol* sym, Value value) {
+    if (sym->storage_type == SYM_REG) {
+        assign_local(lw, sym, value);
+    } else {
+        ir_emit(&lw->builder, IR_STORE, -1, value.value, sym->address, value.is_imm ? IR_A_IMM : 0);
+        set_size(lw, sym->data_type);
+    }
+}
+
+// --- Expressions ---
+
+static Value lower_expr(Lowerer* lw, ASTNode* node);
+static void lower_node(Lowerer* lw, ASTNode* node);
+
+// Sethi-Ullman label: registers needed to evaluate without touching the stack.
+// The heavier operand is lowered first so fewer temporaries overlap.
+static int register_need(ASTNode* node) {
+    if (node->type == NODE_DEREF) return register_need(node->children[0]);
+    if (node->type != NODE_BINOP) return 1;
+    int left = register_need(node->children[0]);
+    int right = node->children[1]->type == NODE_NUMBER ? 0 : register_need(node->children[1]);
+    return left == right ? left + 1 : (left > right ? left : right);
+}
+
+// Helper function to check whether evaluating an expression can change
+// memory: a call may write globals, and alloc or free moves the heap
+static int has_effects(ASTNode* node) {
+    if (node->type == NODE_CALL || node->type == NODE_ASM) return 1;
+    if (node->type == NODE_PTR && node->num_children > 0) return 1;
+    for (int i = 0; i < node->num_children; i++) {
+        if (node->children[i] && has_effects(node->children[i])) return 1;
+    }
+    return 0;
+}
+
+// Helper function to check and lower both operands of a binary operator,
+// the one needing more registers first unless either side has effects the
+// other could see, which keeps them left to right
+static void lower_operands(Lowerer* lw, ASTNode* node, Value* a, Value* b) {
+    ASTNode* left = node->children[0];
+    ASTNode* right = node->children[1];
+    DataType left_type = get_expression_type(lw, left);
+    DataType right_type = get_expression_type(lw, right);
+
+    // Allow int + byte (promote byte to int)
+    if (left_type == DT_BYTE && right_type == DT_INT) {
+        left_type = DT_INT;
+    } else if (right_type == DT_BYTE && left_type == DT_INT) {
+        right_type = DT_INT;
+    }
+    check_type(lw, left_type, right_type, "binary operation");
+    if ((left_type == DT_PTR || right_type == DT_PTR) && comparison(node) < 0) {
+        error(lw, "Invalid operation for pointer type", node->value);
+    }
+
+    if (register_need(right) > register_need(left) && !has_effects(left) && !has_effects(right)) {
+        *b = lower_expr(lw, right);
+        *a = lower_expr(lw, left);
+    } else {
+        *a = lower_expr(lw, left);
+        *b = lower_expr(lw, right);
+    }
+}
+
+// Helper function to put a comparison in the form cmp takes: a register
+// first. Returns 0 with the outcome in *result when both sides are constant.
+static int order_comparison(IrCond* cond, Value* a, Value* b, int* result) {
+    if (a->is_imm && b->is_imm) {
+        *result = ir_eval_cond(*cond, a->value, b->value);
+        return 0;
+    }
+    if (a->is_imm) {
+        Value swap = *a;
+        *a = *b;
+        *b = swap;
+        *cond = ir_swap_cond(*cond);
+    }
+    return 1;
+}
+
+static Value lower_binop(Lowerer* lw, ASTNode* node) {
+    Value a, b;
+    lower_operands(lw, node, &a, &b);
+
+    int test = comparison(node);
+    if (test >= 0) {
+        IrCond cond = test;
+        int outcome;
+        if (!order_comparison(&cond, &a, &b, &outcome)) return imm(outcome);
+        int result = temp(lw);
+        ir_emit(&lw->builder, IR_SET, result, a.value, b.value, b.is_imm ? IR_B_IMM : 0);
+        lw->builder.insns[lw->builder.num_insns - 1].cond = cond;
+        return vreg(result);
+    }
+
+    IrOp op = IR_ADD;
+    switch (node->value[0]) {
+        case '-': op = IR_SUB; break;
+        case '*': op = IR_MUL; break;
+        case '/': op = IR_DIV; break;
+        case '%': op = IR_MOD; break;
+        case '&': op = IR_AND; break;
+    }
+    if ((op == IR_DIV || op == IR_MOD) && b.is_imm && b.value != 0) {
+        a = vreg(to_vreg(lw, a));  // Constant divisors become multiplies and shifts of a register
+    } else if (op == IR_DIV || op == IR_MOD) {
+        b = vreg(to_vreg(lw, b));  // idiv takes no immediate
+    } else if (a.is_imm && !b.is_imm && op != IR_SUB) {
+        Value swap = a;  // Commutative: keep the immediate second
+        a = b;
+        b = swap;
+    }
+
+    int result = temp(lw);
+    ir_emit(&lw->builder, op, result, a.value, b.value,
+            (a.is_imm ? IR_A_IMM : 0) | (b.is_imm ? IR_B_IMM : 0));
+    return vreg(result);
+}
+
+// Lower a call; the result vreg is -1 when 'discard' is set
+static int lower_call(Lowerer* lw, ASTNode* node, int discard) {
+    char* func_name = node->value;
+    Symbol* func_sym = check_symbol_exists(lw, node);
+
+    // Check if symbol is a function
+    if (func_sym && func_sym->storage_type != SYM_FUNC) {
+        error(lw, "Not a function", func_name);
+        return discard ? -1 : to_vreg(lw, imm(0));
+    }
+
+    // Check argument count and types (simplified)
+    int expected_args = func_sym ? func_sym->num_params : node->num_children;
+    if (node->num_children != expected_args) {
+        error(lw, "Argument count mismatch", func_name);
+    }
+
+    // Push right to left so the first argument ends up nearest the return
+    // address; register arguments are evaluated last and passed just before
+    // the call, so nothing in between can disturb the argument registers
+    int num_reg_args = func_sym ? func_sym->num_reg_params : 0;
+    if (num_reg_args > node->num_children) num_reg_args = node->num_children;
+    Value reg_args[NUM_ARG_REGS];
+    for (int i = node->num_children - 1; i >= 0; i--) {
+        Value arg = lower_expr(lw, node->children[i]);
+        if (func_sym && i < func_sym->num_params) {
+            check_type(lw, func_sym->param_types[i], get_expression_type(lw, node->children[i]), func_name);
+        }
+        if (i < num_reg_args) {
+            reg_args[i] = arg;
+        } else {
+            ir_emit(&lw->builder, IR_ARG, -1, arg.value, -1, arg.is_imm ? IR_A_IMM : 0);
+        }
+    }
+    for (int i = 0; i < num_reg_args; i++) {
+        ir_emit(&lw->builder, IR_ARG, -1, reg_args[i].value, i,
+                (reg_args[i].is_imm ? IR_A_IMM : 0) | IR_B_IMM);
+    }
+
+    int result = discard ? -1 : temp(lw);
+    ir_emit(&lw->builder, IR_CALL, result, node->num_children, func_sym ? func_sym->address : 0, 0);
+    return result;
+}
+
+// Lower an expression to the vreg or immediate holding its value
+static Value lower_expr_body(Lowerer* lw, ASTNode* node) {
+    switch (node->type) {
+        case NODE_NUMBER:
+            return imm(node->number);
+
+        case NODE_IDENT: {
+            Symbol* sym = check_symbol_exists(lw, node);
+            if (!sym) return imm(0);
+            if (sym->storage_type == SYM_FUNC) {
+                error(lw, "Function used as a value", sym->name);
+                return imm(0);
+            }
+            return vreg(load_variable(lw, sym));
+        }
+
+        case NODE_DEREF: {
+            if (get_expression_type(lw, node->children[0]) != DT_PTR) {
+                error(lw, "Expected pointer type", lw->current_func);
+            }
+            int pointer = to_vreg(lw, lower_expr(lw, node->children[0]));
+            int result = temp(lw);
+            ir_emit(&lw->builder, IR_LOAD_PTR, result, pointer, -1, 0);
+            return vreg(result);
+        }
+
+        case NODE_BINOP:
+            return lower_binop(lw, node);
+
+        case NODE_CALL:
+            return vreg(lower_call(lw, node, 0));
+
+        case NODE_PTR:
+            if (strcmp(node->value, "alloc") == 0) {
+                // Grow the heap with brk; the result is the start of the new block
+                int size = to_vreg(lw, lower_expr(lw, node->children[0]));
+                int result = temp(lw);
+                ir_emit(&lw->builder, IR_ALLOC, result, size, -1, 0);
+                return vreg(result);
+            }
+            lower_node(lw, node);
+            return imm(0);
+
+        default:
+            lower_node(lw, node);
+            return imm(0);
+    }
+}
+
+// --- Statements ---
+
+// Helper function to branch on a condition to 'if_true' or 'if_false'.
+// Comparisons become the branch's own test instead of a 0/1 value.
+static void lower_condition(Lowerer* lw, ASTNode* cond, int if_true, int if_false) {
+    int test = comparison(cond);
+    Value a, b;
+    IrCond ir_cond = IR_NE;
+    int outcome;
+    if (test >= 0) {
+        lower_operands(lw, cond, &a, &b);
+        ir_cond = test;
+    } else {
+        a = lower_expr(lw, cond);
+        b = imm(0);
+    }
+    if (!order_comparison(&ir_cond, &a, &b, &outcome)) {
+        ir_jump(&lw->builder, outcome ? if_true : if_false);
+    } else {
+        ir_branch(&lw->builder, ir_cond, a.value, b.value, b.is_imm ? IR_B_IMM : 0, if_true, if_false);
+    }
+}
+
+// Helper function to declare a local or parameter in a fresh vreg
+static Symbol* declare_local(Lowerer* lw, ASTNode* decl) {
+    int var = ir_new_vreg(&lw->builder, decl->value);
+    if (decl->type == NODE_REG) lw->builder.vreg_flags[var] |= VREG_HINT;
+    return add_symbol(lw, decl, SYM_REG, var, -1);
+}
+
+static void lower_node_body(Lowerer* lw, ASTNode* node) {
+
+    switch (node->type) {
+        case NODE_ASSIGN: {
+            ASTNode* expr = node->children[1];
+            Symbol* sym = check_symbol_exists(lw, node->children[0]);
+            Value value = lower_expr(lw, expr);
+            if (sym) {
+                if (sym->storage_type == SYM_FUNC) {
+                    error(lw, "Cannot assign to a function", sym->name);
+                    break;
+                }
+                check_type(lw, sym->data_type, get_expression_type(lw, expr), "assignment");
+                assign(lw, sym, value);
+            }
+            break;
+        }
+
+        // --- Values ---
+        case NODE_IDENT:
+        case NODE_NUMBER:
+        case NODE_BINOP:
+        case NODE_DEREF:
+            lower_expr(lw, node);
+            break;
+
+        case NODE_CALL:
+            lower_call(lw, node, 1);
+            break;
+
+        case NODE_BLOCK:
+            symtab_push_scope(&lw->symbols);
+            for (int i = 0; i < node->num_children; i++) {
+                lower_node(lw, node->children[i]);
+            }
+            symtab_pop_scope(&lw->symbols);
+            break;
+
+        case NODE_RETURN:
+            if (node->children[0]) {
+                Value value = lower_expr(lw, node->children[0]);
+                ir_emit(&lw->builder, IR_RET, -1, value.value, -1, value.is_imm ? IR_A_IMM : 0);
+            } else {
+                ir_emit(&lw->builder, IR_RET, -1, -1, -1, 0);
+            }
+            break;
+
+        // 'reg' is a strong hint; both get a register when the allocator finds one
+        case NODE_REG:
+        case NODE_VAR: {
+            if (symtab_find_local(&lw->symbols, node->id)) {
+                error(lw, "Redeclared variable", node->value);
+                break;
+            }
+            Symbol* sym = declare_local(lw, node);
+            if (node->children[0]) {  // Initial value
+                Value value = lower_expr(lw, node->children[0]);
+                check_type(lw, node->data_type, get_expression_type(lw, node->children[0]), node->value);
+                assign(lw, sym, value);
+            }
+            break;
+        }
+
+        // --- Inline Assembly ---
+        case NODE_ASM:
+            if (lw->program->num_asm == lw->asm_capacity) {
+                lw->asm_capacity = lw->asm_capacity ? lw->asm_capacity * 2 : 16;
+                lw->asm_texts = realloc(lw->asm_texts, lw->asm_capacity * sizeof(const char*));
+                if (!lw->asm_texts) {
+                    fprintf(stderr, "Error: Out of memory\n");
+                    exit(1);
+                }
+            }
+            lw->asm_texts[lw->program->num_asm] = node->value;
+            ir_emit(&lw->builder, IR_ASM, -1, -1, lw->program->num_asm++, 0);
+            break;
+
+        // --- Control Flow ---
+        case NODE_IF: {
+            int then_block = ir_new_block(&lw->builder);
+            int else_block = node->children[2] ? ir_new_block(&lw->builder) : -1;
+            int end_block = ir_new_block(&lw->builder);
+
+            lower_condition(lw, node->children[0], then_block, else_block >= 0 ? else_block : end_block);
+            ir_start_block(&lw->builder, then_block);
+            lower_node(lw, node->children[1]);
+            if (else_block >= 0) {
+                if (lw->builder.current >= 0) ir_jump(&lw->builder, end_block);
+                ir_start_block(&lw->builder, else_block);
+                lower_node(lw, node->children[2]);
+            }
+            ir_start_block(&lw->builder, end_block);
+            break;
+        }
+
+        // Loops are rotated: the condition is tested once on entry and again
+        // at the bottom, so each iteration takes a single conditional branch.
+        // The empty preheader gives later passes a place to hoist code to.
+        case NODE_WHILE:
+        case NODE_FOR: {
+            int is_for = node->type == NODE_FOR;
+            ASTNode* cond = node->children[is_for ? 1 : 0];
+            int preheader = ir_new_block(&lw->builder);
+            int body = ir_new_block(&lw->builder);
+            int exit = ir_new_block(&lw->builder);
+
+            // The initializer's declarations are scoped to the loop
+            symtab_push_scope(&lw->symbols);
+            if (is_for) lower_node(lw, node->children[0]);
+            if (cond && !node->number) {  // Constant folding drops always-true conditions
+                lower_condition(lw, cond, preheader, exit);
+            }
+            ir_start_block(&lw->builder, preheader);
+            ir_start_block(&lw->builder, body);
+            lower_node(lw, node->children[is_for ? 3 : 1]);
+            if (is_for) lower_node(lw, node->children[2]);
+            if (lw->builder.current >= 0) {
+                if (cond) lower_condition(lw, cond, body, exit);
+                else ir_jump(&lw->builder, body);
+            }
+            ir_start_block(&lw->builder, exit);
+            symtab_pop_scope(&lw->symbols);
+            break;
+        }
+
+        // --- Pointers and Memory ---
+        case NODE_PTR: {
+            if (strcmp(node->value, "alloc") == 0) {
+                lower_expr(lw, node);
+            } else if (strcmp(node->value, "free") == 0) {
+                // No-op for this simple implementation
+            } else {
+                // Pointer assignment
+                Symbol* sym = check_symbol_exists(lw, node);
+                if (sym && sym->data_type != DT_PTR) {
+                    error(lw, "Expected pointer type", node->value);
+                } else if (sym) {
+                    Value value = lower_expr(lw, node->children[0]);
+                    int pointer = load_variable(lw, sym);
+                    ir_emit(&lw->builder, IR_STORE_PTR, -1, pointer, value.value,
+                            value.is_imm ? IR_B_IMM : 0);
+                }
+            }
+            break;
+        }
+
+        default: {
+            char type[16];
+            snprintf(type, sizeof(type), "%d", node->type);
+            error(lw, "Unknown node type", type);
+            break;
+        }
+    }
+}
+
+// --- Functions ---
+
+// Helper function to freeze the function being built into its program slot
+static void finish_function(Lowerer* lw, IrFunction* func, const char* name, int num_params,
+                            int num_reg_params, int is_entry) {
+    if (lw->builder.current >= 0) ir_emit(&lw->builder, IR_RET, -1, -1, -1, 0);
+    func->name = name;
+    func->num_params = num_params;
+    func->num_reg_params = num_reg_params;
+    func->is_entry = is_entry;
+    ir_finish(&lw->builder, func, lw->arena);
+    ir_builder_free(&lw->builder);
+}
+
+static void lower_function(Lowerer* lw, ASTNode* node, Symbol* func_sym, IrFunction* func) {
+    ASTNode* params = node->children[0];
+    lw->current_func = node->value;
+    symtab_push_scope(&lw->symbols);
+    ir_builder_init(&lw->builder);
+    ir_start_block(&lw->builder, ir_new_block(&lw->builder));
+
+    // Register arguments come first; the rest were pushed right to left
+    // above the return address
+    for (int i = 0; i < params->num_children; i++) {
+        ASTNode* param = params->children[i];
+        if (symtab_find_local(&lw->symbols, param->id)) {
+            error(lw, "Redeclared parameter", param->value);
+            continue;
+        }
+        Symbol* sym = declare_local(lw, param);
+        ir_emit(&lw->builder, IR_PARAM, sym->reg, i, -1, 0);
+        if (param->data_type == DT_BYTE) {
+            ir_emit(&lw->builder, IR_AND, sym->reg, sym->reg, 0xFF, IR_B_IMM);
+        }
+    }
+
+    lower_node(lw, node->children[1]);
+    symtab_pop_scope(&lw->symbols);
+    finish_function(lw, func, node->value, params->num_children, func_sym->num_reg_params, 0);
+}
+
+// Declare every function and global up front so that order does not matter
+static void declare_globals(Lowerer* lw, ASTNode* root) {
+    for (int i = 0; i < root->num_children; i++) {
+        ASTNode* node = root->children[i];
+        if (symtab_find(&lw->symbols, node->id)) {
+            error(lw, "Redeclared symbol", node->value);
+            continue;
+        }
+
+        if (node->type == NODE_FUNC) {
+            ASTNode* params = node->children[0];
+            Symbol* sym = add_symbol(lw, node, SYM_FUNC, -1, lw->program->num_funcs++);
+            sym->num_params = params->num_children;
+            CallConv callconv = node->number != CALLCONV_DEFAULT ? (CallConv)node->number : lw->default_callconv;
+            if (callconv == CALLCONV_FASTCALL) {
+                sym->num_reg_params = params->num_children < NUM_ARG_REGS ? params->num_children
+                                                                          : NUM_ARG_REGS;
+            }
+            sym->param_types = arena_alloc(lw->arena, params->num_children * sizeof(DataType));
+            for (int j = 0; j < params->num_children; j++) {
+                sym->param_types[j] = params->children[j]->data_type;
+            }
+        } else {
+            IrGlobal* global = &lw->program->globals[lw->program->num_globals];
+            global->name = node->value;
+            global->data_type = node->data_type;
+            global->is_reg = node->type == NODE_REG;
+            global->is_mmio = node->num_children > 1;
+            global->address = global->is_mmio ? (unsigned int)node->children[1]->number : 0;
+            add_symbol(lw, node, global->is_mmio ? SYM_MMIO : SYM_GLOBAL, -1, lw->program->num_globals++);
+        }
+    }
+}
+
+// Lower the program: one IR function per source function, then the entry
+// point that runs global initializers and exits with main's result
+// Both entry points time the kind of node they were given when tracing;
+// everything they lower on its behalf counts as nested time
+static Value lower_expr(Lowerer* lw, ASTNode* node) {
+    if (!lw->tracer) return lower_expr_body(lw, node);
+    TraceKindMark mark;
+    trace_kind_begin(lw->tracer, 0, &lw->tracer->nodes[node->type], &mark);
+    Value value = lower_expr_body(lw, node);
+    trace_kind_end(lw->tracer, 0, &lw->tracer->nodes[node->type], &mark);
+    return value;
+}
+
+static void lower_node(Lowerer* lw, ASTNode* node) {
+    if (!node) return;
+    if (!lw->tracer) {
+        lower_node_body(lw, node);
+        return;
+    }
+    TraceKindMark mark;
+    trace_kind_begin(lw->tracer, 0, &lw->tracer->nodes[node->type], &mark);
+    lower_node_body(lw, node);
+    trace_kind_end(lw->tracer, 0, &lw->tracer->nodes[node->type], &mark);
+}
+
+int lower_program(ASTNode* root, IrProgram* program, CallConv callconv, Arena* arena, Tracer* tracer) {
+    Lowerer lowerer;
+    memset(&lowerer, 0, sizeof(lowerer));
+    Lowerer* lw = &lowerer;
+    lw->arena = arena;
+    lw->default_callconv = callconv;
+    lw->tracer = tracer;
+    lw->program = program;
+    lw->current_func = "";
+    memset(program, 0, sizeof(IrProgram));
+    program->globals = arena_alloc(arena, (root->num_children + 1) * sizeof(IrGlobal));
+    symtab_init(&lw->symbols, arena);
+    declare_globals(lw, root);
+
+    Symbol* main_sym = NULL;
+    for (int i = 0; i < root->num_children; i++) {
+        ASTNode* node = root->children[i];
+        if (node->type == NODE_FUNC && strcmp(node->value, "main") == 0) {
+            main_sym = symtab_find(&lw->symbols, node->id);
+        }
+    }
+
+    int num_funcs = program->num_funcs;
+    program->funcs = arena_alloc(arena, (num_funcs + 1) * sizeof(IrFunction));
+    for (int i = 0; i < root->num_children; i++) {
+        ASTNode* node = root->children[i];
+        Symbol* sym = symtab_find(&lw->symbols, node->id);
+        if (node->type == NODE_FUNC && sym->storage_type == SYM_FUNC) {
+            lower_function(lw, node, sym, &program->funcs[sym->address]);
+        }
+    }
+
+    if (main_sym) {
+        lw->current_func = "_start";
+        ir_builder_init(&lw->builder);
+        ir_start_block(&lw->builder, ir_new_block(&lw->builder));
+        for (int i = 0; i < root->num_children; i++) {
+            ASTNode* node = root->children[i];
+            if (node->type != NODE_FUNC && node->children[0]) {
+                Value value = lower_expr(lw, node->children[0]);
+                check_type(lw, node->data_type, get_expression_type(lw, node->children[0]), node->value);
+                assign(lw, symtab_find(&lw->symbols, node->id), value);
+            }
+        }
+        int result = temp(lw);
+        ir_emit(&lw->builder, IR_CALL, result, 0, main_sym->address, 0);
+        ir_emit(&lw->builder, IR_RET, -1, result, -1, 0);
+        finish_function(lw, &program->funcs[program->num_funcs++], "_start", 0, 0, 1);
+    }
+
+    program->asm_texts = arena_alloc(arena, (program->num_asm + 1) * sizeof(const char*));
+    if (program->num_asm > 0) {
+        memcpy(program->asm_texts, lw->asm_texts, program->num_asm * sizeof(const char*));
+    }
+    free(lw->asm_texts);
+    symtab_free(&lw->symbols);
+    return lw->has_error;
+}
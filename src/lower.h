@@ -0,0 +1,15 @@
+// lower.h
+#ifndef LOWER_H
+#define LOWER_H
+
+#include "parser.h"
+#include "arena.h"
+#include "ir.h"
+#include "trace.h"
+
+// Check names and types and translate the program into IR; functions that
+// name no calling convention use 'callconv'. Returns nonzero if errors were
+// reported. Each node kind lowered is timed into 'tracer' unless it is NULL.
+int lower_program(ASTNode* root, IrProgram* program, CallConv callconv, Arena* arena, Tracer* tracer);
+
+#endif
@@ -1,29 +1,173 @@
-#include "lexer.h"
-#include "parser.h"
-#include "codegen.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include "source.h"
+#include "compiler.h"
+#include "server.h"
+
+// Helper function to name the output of one input in an output directory:
+// the input's file name with the format's extension
+static char* output_in_dir(const char* dir, const char* input, OutputFormat format) {
+    static const char* extensions[] = {".asm", ".o", ".bin"};
+    const char* name = strrchr(input, '/') ? strrchr(input, '/') + 1 : input;
+    const char* dot = strrchr(name, '.');
+    size_t stem = dot && dot != name ? (size_t)(dot - name) : strlen(name);
+    size_t dir_length = strlen(dir);
+    int slash = dir_length > 0 && dir[dir_length - 1] != '/';
+    char* path = malloc(dir_length + slash + stem + strlen(extensions[format]) + 1);
+    if (!path) {
+        fprintf(stderr, "Error: Out of memory\n");
+        exit(1);
+    }
+    sprintf(path, "%s%s%.*s%s", dir, slash ? "/" : "", (int)stem, name, extensions[format]);
+    return path;
+}
+
+// Compile one input file to 'output_path', or to stdout when it is NULL;
+// nothing is left in a file on failure, and devices such as /dev/null stay
+static int compile_file(Compiler* compiler, const CompileOptions* options,
+                        const char* input_path, const char* output_path) {
+    SourceFile source;
+    if (source_open(&source, input_path) != 0) {
+        fprintf(stderr, "Error: Cannot open %s\n", input_path);
+        return 1;
+    }
+    if (!output_path) {
+        int failed = compile_source(compiler, options, source.data, source.length, stdout);
+        fflush(stdout);
+        source_close(&source);
+        return failed;
+    }
+    FILE* output = fopen(output_path, "wb");
+    if (!output) {
+        fprintf(stderr, "Error: Cannot write %s\n", output_path);
+        source_close(&source);
+        return 1;
+    }
+    int failed = compile_source(compiler, options, source.data, source.length, output);
+    fclose(output);
+    struct stat info;
+    if (failed && stat(output_path, &info) == 0 && S_ISREG(info.st_mode)) remove(output_path);
+    source_close(&source);
+    return failed;
+}
 
 int main(int argc, char** argv) {
-    if (argc < 2) {
-        fprintf(stderr, "Usage: hiasc <input.hiasm>\n");
+    CompileOptions options;
+    compile_options_init(&options);
+    const char** inputs = malloc(argc * sizeof(char*));
+    int num_inputs = 0;
+    const char* output_path = NULL;
+    int server = 0;
+    const char* socket_path = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            char flag[32];
+            snprintf(flag, sizeof(flag), "-j%s", argv[++i]);
+            if (compile_option(&options, flag) < 0) return 1;
+            continue;
+        }
+        if (strcmp(argv[i], "--cache-dir") == 0 && i + 1 < argc) {
+            options.cache_dir = argv[++i];
+            continue;
+        }
+        if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            options.trace_path = argv[++i];
+            continue;
+        }
+        int applied = compile_option(&options, argv[i]);
+        if (applied < 0) return 1;
+        if (applied) continue;
+        if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            output_path = argv[++i];
+            if (output_path[0] == '\0') {
+                fprintf(stderr, "Error: -o needs an output file, - or a directory\n");
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--server") == 0) {
+            server = 1;
+        } else if (strncmp(argv[i], "--server=", 9) == 0) {
+            server = 1;
+            socket_path = argv[i] + 9;
+        } else {
+            inputs[num_inputs++] = argv[i];
+        }
+    }
+
+    if (num_inputs == 0 && !server) {
+        fprintf(stderr, "Usage: hiasc [-O0|-O1] [--callconv=cdecl|fastcall] [--format=asm|elf|bin] "
+                        "[-o output|-o -|-o dir/] [-j threads] [--mem-report] [--peephole-report] "
+                        "[--inline-report] [--dump-ir] [--cache-dir dir] [--cache-report] [--time-report] [--trace file] "
+                        "[--stack-usage] [--run] [--run-limit=N] [-fprofile-generate[=file]] [-fprofile-use[=file]] "
+                        "<input.hiasm>...\n"
+                        "       hiasc --server[=socket] [options]\n");
         return 1;
     }
 
-    // Read input file
-    FILE* input = fopen(argv[1], "r");
-    fseek(input, 0, SEEK_END);
-    long size = ftell(input);
-    rewind(input);
-    char* source = malloc(size + 1);
-    fread(source, 1, size, input);
-    fclose(input);
-
-    // Lex, parse, generate code
-    Token* tokens = tokenize(source);
-    ASTNode* ast = parse(tokens);
-    FILE* output = fopen("output.asm", "w");
-    codegen(ast, output);
-    fclose(output);
+    // "-o -" writes the output to stdout
+    int to_stdout = output_path && strcmp(output_path, "-") == 0;
+
+    // One compiler for every input, so later ones reuse the arena and tables
+    Compiler compiler;
+    compiler_init(&compiler);
+    int failed = 0;
+    if (server) {
+        if (num_inputs > 0 || output_path) {
+            fprintf(stderr, "Error: --server takes its sources from requests\n");
+            return 1;
+        }
+        failed = run_server(&compiler, &options, socket_path);
+    } else if (options.run && (!output_path || to_stdout)) {
+        // Run reports go to stdout, one after another
+        for (int i = 0; i < num_inputs; i++) {
+            if (compile_file(&compiler, &options, inputs[i], NULL) != 0) failed = 1;
+        }
+    } else if (to_stdout) {
+        if (num_inputs > 1) {
+            fprintf(stderr, "Error: Several inputs need -o dir/\n");
+            return 1;
+        }
+        failed = compile_file(&compiler, &options, inputs[0], NULL);
+    } else if (num_inputs == 1 && !(output_path && output_path[strlen(output_path) - 1] == '/')) {
+        static const char* default_paths[] = {"output.asm", "output.o", "output.bin"};
+        failed = compile_file(&compiler, &options, inputs[0], output_path ? output_path : default_paths[options.format]);
+    } else {
+        // Several inputs go to a directory, one output each
+        if (!output_path) {
+            fprintf(stderr, "Error: Several inputs need -o dir/\n");
+            return 1;
+        }
+        if (mkdir(output_path, 0777) != 0 && errno != EEXIST) {
+            fprintf(stderr, "Error: Cannot create %s\n", output_path);
+            return 1;
+        }
+        char** paths = malloc(num_inputs * sizeof(char*));
+        for (int i = 0; i < num_inputs; i++) {
+            paths[i] = output_in_dir(output_path, inputs[i], options.format);
+            for (int j = 0; j < i; j++) {
+                if (strcmp(paths[i], paths[j]) == 0) {
+                    fprintf(stderr, "Error: %s and %s both compile to %s\n", inputs[j], inputs[i], paths[i]);
+                    return 1;
+                }
+            }
+        }
+        for (int i = 0; i < num_inputs; i++) {
+            if (compile_file(&compiler, &options, inputs[i], paths[i]) != 0) failed = 1;
+            free(paths[i]);
+        }
+        free(paths);
+    }
+
+    // One trace covers every input
+    if (options.trace_path && !server && trace_write(&compiler.tracer, options.trace_path) != 0) {
+        fprintf(stderr, "Error: Cannot write %s\n", options.trace_path);
+        failed = 1;
+    }
 
-    free(source);
-    return 0;
-}
\ No newline at end of file
+    compiler_free(&compiler);
+    free(inputs);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,224 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "muldiv.h"
+
+// imul reg, imm costs about as much as three simple instructions; a sequence
+// replaces it only when strictly cheaper
+#define IMUL_COST 3
+
+// lea computes x * factor in one instruction as [x + x*(factor - 1)]
+static const int lea_factors[] = {3, 5, 9};
+#define NUM_LEA_FACTORS 3
+
+// A multiply by a constant as up to two lea steps, a left shift, an add or
+// subtract of the source and a final negation, in that order
+typedef struct {
+    int factors[2];   // lea factors applied in turn, 0 if unused
+    int shift;
+    int adjust;       // +1 adds the source after the shift, -1 subtracts it
+    int negate;
+    int cost;         // Instructions, not counting the initial move
+} MulPlan;
+
+// --- Helper Functions ---
+
+// Helper function to return k when 'value' is 2^k, or -1
+static int log2_exact(unsigned int value) {
+    if (value == 0 || (value & (value - 1))) return -1;
+    return __builtin_ctz(value);
+}
+
+// Helper function to take the magnitude of a constant, 2^31 included
+static unsigned int magnitude_of(int value) {
+    return value < 0 ? 0u - (unsigned int)value : (unsigned int)value;
+}
+
+// Helper function to move between registers unless they are the same
+static void emit_move(InsnList* code, int dst, int src) {
+    if (dst != src) insn_emit(code, OP_MOV, op_reg(dst), op_reg(src));
+}
+
+// Helper function to keep a plan if it beats the best so far
+static void consider(MulPlan* best, int first, int second, int shift, int adjust, int negate) {
+    MulPlan plan = {{first, second}, shift, adjust, negate, 0};
+    plan.cost = (first != 0) + (second != 0) + (shift > 0) + (adjust != 0) + negate;
+    if (plan.cost < best->cost) *best = plan;
+}
+
+// Find the cheapest sequence for a multiply by 'magnitude'; the result costs
+// IMUL_COST when nothing beats imul. Shift-and-add forms read the source after
+// the destination is written, so they need distinct registers.
+static MulPlan plan_multiply(unsigned int magnitude, int negate, int in_place) {
+    MulPlan best = {{0, 0}, 0, 0, 0, IMUL_COST};
+    int shift = log2_exact(magnitude);
+    if (shift >= 0) consider(&best, 0, 0, shift, 0, negate);
+
+    for (int i = 0; i < NUM_LEA_FACTORS; i++) {
+        unsigned int factor = lea_factors[i];
+        if (magnitude % factor != 0) continue;
+        shift = log2_exact(magnitude / factor);
+        if (shift >= 0) consider(&best, factor, 0, shift, 0, negate);
+        for (int j = 0; j < NUM_LEA_FACTORS; j++) {
+            if (magnitude / factor == (unsigned int)lea_factors[j]) {
+                consider(&best, factor, lea_factors[j], 0, 0, negate);
+            }
+        }
+    }
+
+    if (!in_place) {
+        shift = log2_exact(magnitude - 1);
+        if (shift > 0) consider(&best, 0, 0, shift, 1, negate);
+        shift = log2_exact(magnitude + 1);
+        if (shift > 0) consider(&best, 0, 0, shift, -1, negate);
+    }
+    return best;
+}
+
+// --- Multiplication ---
+
+void emit_mul_const(InsnList* code, int dst, int src, int constant) {
+    if (constant == 0) {
+        insn_emit(code, OP_MOV, op_reg(dst), op_imm(0));
+        return;
+    }
+
+    MulPlan plan = plan_multiply(magnitude_of(constant), constant < 0, dst == src);
+    if (plan.cost >= IMUL_COST) {
+        emit_move(code, dst, src);
+        insn_emit(code, OP_IMUL, op_reg(dst), op_imm(constant));
+        return;
+    }
+
+    int from = src;
+    for (int i = 0; i < 2 && plan.factors[i]; i++) {
+        insn_emit(code, OP_LEA, op_reg(dst), op_scaled(from, from, plan.factors[i] - 1));
+        from = dst;
+    }
+    emit_move(code, dst, from);
+    if (plan.shift == 1) {
+        insn_emit(code, OP_ADD, op_reg(dst), op_reg(dst));
+    } else if (plan.shift > 1) {
+        insn_emit(code, OP_SHL, op_reg(dst), op_imm(plan.shift));
+    }
+    if (plan.adjust) insn_emit(code, plan.adjust > 0 ? OP_ADD : OP_SUB, op_reg(dst), op_reg(src));
+    if (plan.negate) insn_emit(code, OP_NEG, op_reg(dst), op_none());
+}
+
+// --- Division ---
+
+DivMagic div_magic(int divisor) {
+    const unsigned int two31 = 0x80000000u;
+    unsigned int magnitude = magnitude_of(divisor);
+    unsigned int t = two31 + ((unsigned int)divisor >> 31);
+    unsigned int limit = t - 1 - t % magnitude;  // |nc|, the last dividend before a wrong rounding
+
+    // Find the smallest p with 2^p > limit * (magnitude - 2^p mod magnitude)
+    int p = 31;
+    unsigned int q1 = two31 / limit, r1 = two31 - q1 * limit;
+    unsigned int q2 = two31 / magnitude, r2 = two31 - q2 * magnitude;
+    unsigned int delta;
+    do {
+        p++;
+        q1 *= 2;
+        r1 *= 2;
+        if (r1 >= limit) {
+            q1++;
+            r1 -= limit;
+        }
+        q2 *= 2;
+        r2 *= 2;
+        if (r2 >= magnitude) {
+            q2++;
+            r2 -= magnitude;
+        }
+        delta = magnitude - r2;
+    } while (q1 < delta || (q1 == delta && r1 == 0));
+
+    DivMagic magic;
+    magic.multiplier = (int)(divisor < 0 ? 0u - (q2 + 1) : q2 + 1);
+    magic.shift = p - 32;
+    return magic;
+}
+
+// Division by ±2^k: cdq turns edx into the sign mask, which adds the 2^k - 1
+// bias that makes the arithmetic shift round negative dividends toward zero
+static void emit_div_pow2(InsnList* code, int dst, int src, int divisor, int shift, int remainder) {
+    int mask = (int)(magnitude_of(divisor) - 1);
+    emit_move(code, REG_EAX, src);
+    insn_emit(code, OP_CDQ, op_none(), op_none());
+    if (remainder) {
+        // The remainder keeps the dividend's sign: ((n + bias) & mask) - bias
+        insn_emit(code, OP_SHR, op_reg(REG_EDX), op_imm(32 - shift));
+        insn_emit(code, OP_ADD, op_reg(REG_EAX), op_reg(REG_EDX));
+        insn_emit(code, OP_AND, op_reg(REG_EAX), op_imm(mask));
+        insn_emit(code, OP_SUB, op_reg(REG_EAX), op_reg(REG_EDX));
+    } else {
+        if (shift == 1) {
+            insn_emit(code, OP_SUB, op_reg(REG_EAX), op_reg(REG_EDX));
+        } else {
+            insn_emit(code, OP_AND, op_reg(REG_EDX), op_imm(mask));
+            insn_emit(code, OP_ADD, op_reg(REG_EAX), op_reg(REG_EDX));
+        }
+        insn_emit(code, OP_SAR, op_reg(REG_EAX), op_imm(shift));
+        if (divisor < 0) insn_emit(code, OP_NEG, op_reg(REG_EAX), op_none());
+    }
+    emit_move(code, dst, REG_EAX);
+}
+
+int div_const_result_reg(int divisor, int remainder) {
+    unsigned int magnitude = magnitude_of(divisor);
+    if (magnitude == 1) return -1;
+    if (log2_exact(magnitude) > 0) return REG_EAX;
+    return remainder ? -1 : REG_EDX;
+}
+
+void emit_div_const(InsnList* code, int dst, int src, int divisor, int remainder) {
+    unsigned int magnitude = magnitude_of(divisor);
+    if (magnitude == 1) {
+        if (remainder) {
+            insn_emit(code, OP_MOV, op_reg(dst), op_imm(0));
+        } else {
+            emit_move(code, dst, src);
+            if (divisor < 0) insn_emit(code, OP_NEG, op_reg(dst), op_none());
+        }
+        return;
+    }
+
+    int shift = log2_exact(magnitude);
+    if (shift > 0) {
+        emit_div_pow2(code, dst, src, divisor, shift, remainder);
+        return;
+    }
+
+    // Quotient in edx: the high half of n * multiplier, corrected by n when
+    // the multiplier's sign disagrees with the divisor's, shifted, plus one
+    // when negative so that it rounds toward zero
+    DivMagic magic = div_magic(divisor);
+    insn_emit(code, OP_MOV, op_reg(REG_EAX), op_imm(magic.multiplier));
+    insn_emit(code, OP_IMUL_WIDE, op_reg(src), op_none());
+    if (divisor > 0 && magic.multiplier < 0) {
+        insn_emit(code, OP_ADD, op_reg(REG_EDX), op_reg(src));
+    } else if (divisor < 0 && magic.multiplier > 0) {
+        insn_emit(code, OP_SUB, op_reg(REG_EDX), op_reg(src));
+    }
+    if (magic.shift > 0) insn_emit(code, OP_SAR, op_reg(REG_EDX), op_imm(magic.shift));
+    insn_emit(code, OP_MOV, op_reg(REG_EAX), op_reg(REG_EDX));
+    insn_emit(code, OP_SHR, op_reg(REG_EAX), op_imm(31));
+    insn_emit(code, OP_ADD, op_reg(REG_EDX), op_reg(REG_EAX));
+    if (!remainder) {
+        emit_move(code, dst, REG_EDX);
+        return;
+    }
+
+    // Remainder: n - quotient * divisor
+    emit_mul_const(code, REG_EDX, REG_EDX, divisor);
+    if (dst == src) {
+        insn_emit(code, OP_SUB, op_reg(dst), op_reg(REG_EDX));
+    } else if (dst == REG_EDX) {
+        insn_emit(code, OP_NEG, op_reg(REG_EDX), op_none());
+        insn_emit(code, OP_ADD, op_reg(REG_EDX), op_reg(src));
+    } else {
+        insn_emit(code, OP_MOV, op_reg(dst), op_reg(src));
+        insn_emit(code, OP_SUB, op_reg(dst), op_reg(REG_EDX));
+    }
+}
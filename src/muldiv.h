@@ -0,0 +1,31 @@
+// muldiv.h
+#ifndef MULDIV_H
+#define MULDIV_H
+
+#include "insn.h"
+
+// Multiplier and shift that turn signed division by a constant into a high
+// multiply: n / d = (mulhs(n, multiplier) [+ or - n]) >> shift, rounded
+// toward zero (Granlund and Montgomery; Hacker's Delight 10-1)
+typedef struct {
+    int multiplier;
+    int shift;
+} DivMagic;
+
+// Magic numbers for a divisor with 2 <= |divisor| that is not a power of two
+DivMagic div_magic(int divisor);
+
+// Emit dst = src * constant as shifts, lea and add when that is cheaper than
+// imul. dst and src may be the same register; nothing else is written.
+void emit_mul_const(InsnList* code, int dst, int src, int constant);
+
+// Emit dst = src / divisor, or src % divisor with 'remainder', for a nonzero
+// divisor with idiv's rounding. Clobbers eax and edx, so src must be in
+// neither; INT_MIN / -1 wraps instead of trapping.
+void emit_div_const(InsnList* code, int dst, int src, int divisor, int remainder);
+
+// Register the division sequence computes its result in before moving it to
+// dst, or -1 when it is cheapest for dst to reuse src
+int div_const_result_reg(int divisor, int remainder);
+
+#endif
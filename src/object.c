@@ -0,0 +1,453 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "object.h"
+#include "encode.h"
+
+// ELF constants (System V ABI, Intel386 supplement)
+#define ELF_HEADER_SIZE 52
+#define ELF_SECTION_HEADER_SIZE 40
+#define ELF_SYMBOL_SIZE 16
+#define ELF_REL_SIZE 8
+#define ET_REL 1
+#define EM_386 3
+#define SHT_PROGBITS 1
+#define SHT_SYMTAB 2
+#define SHT_STRTAB 3
+#define SHT_REL 9
+#define SHF_WRITE 1
+#define SHF_ALLOC 2
+#define SHF_EXECINSTR 4
+#define SHF_INFO_LINK 0x40
+#define STB_LOCAL 0
+#define STB_GLOBAL 1
+#define STT_OBJECT 1
+#define STT_FUNC 2
+#define STT_SECTION 3
+#define R_386_32 1
+
+// Sections of the object file, in header order
+enum { SEC_NULL, SEC_TEXT, SEC_DATA, SEC_REL_TEXT, SEC_SYMTAB, SEC_STRTAB, SEC_SHSTRTAB, NUM_SECTIONS };
+
+// Growable byte buffer for building the file
+typedef struct {
+    unsigned char* bytes;
+    int size;
+    int capacity;
+} Buffer;
+
+// --- Helper Functions ---
+
+// Helper function to make room for 'count' more elements of a growable array
+static void* reserve(void* array, int count, int* capacity, int needed, size_t element_size) {
+    if (count + needed <= *capacity) return array;
+    while (count + needed > *capacity) *capacity = *capacity ? *capacity * 2 : 64;
+    array = realloc(array, *capacity * element_size);
+    if (!array) {
+        fprintf(stderr, "Error: Out of memory\n");
+        exit(1);
+    }
+    return array;
+}
+
+static void put8(Buffer* buffer, int value) {
+    buffer->bytes = reserve(buffer->bytes, buffer->size, &buffer->capacity, 1, 1);
+    buffer->bytes[buffer->size++] = (unsigned char)value;
+}
+
+static void put16(Buffer* buffer, int value) {
+    put8(buffer, value);
+    put8(buffer, value >> 8);
+}
+
+static void put32(Buffer* buffer, unsigned int value) {
+    put16(buffer, value);
+    put16(buffer, value >> 16);
+}
+
+static void put_bytes(Buffer* buffer, const void* bytes, int count) {
+    buffer->bytes = reserve(buffer->bytes, buffer->size, &buffer->capacity, count, 1);
+    if (count > 0) memcpy(buffer->bytes + buffer->size, bytes, count);
+    buffer->size += count;
+}
+
+static void align(Buffer* buffer, int alignment) {
+    while (buffer->size % alignment) put8(buffer, 0);
+}
+
+static unsigned int read32(const unsigned char* bytes) {
+    return bytes[0] | bytes[1] << 8 | bytes[2] << 16 | (unsigned int)bytes[3] << 24;
+}
+
+static void write32(unsigned char* bytes, unsigned int value) {
+    for (int i = 0; i < 4; i++) bytes[i] = (unsigned char)(value >> (8 * i));
+}
+
+// Helper function to add a name to a string table and return its offset
+static int add_string(Buffer* table, const char* name) {
+    int offset = table->size;
+    put_bytes(table, name, (int)strlen(name) + 1);
+    return offset;
+}
+
+static ObjectSymbol* add_symbol(ObjectSymbol** symbols, int* count, int* capacity,
+                                const char* name, int offset, int size) {
+    *symbols = reserve(*symbols, *count, capacity, 1, sizeof(ObjectSymbol));
+    ObjectSymbol* symbol = &(*symbols)[(*count)++];
+    symbol->name = name;
+    symbol->offset = offset;
+    symbol->size = size;
+    return symbol;
+}
+
+// --- Symbol lookup ---
+
+// Open-addressing table from names to symbol indices
+typedef struct {
+    int* slots;
+    int mask;
+    const ObjectSymbol* symbols;
+} SymbolIndex;
+
+static unsigned int hash_name(const char* name) {
+    unsigned int hash = 2166136261u;
+    for (; *name; name++) hash = (hash ^ (unsigned char)*name) * 16777619u;
+    return hash;
+}
+
+static void index_symbols(SymbolIndex* index, const ObjectSymbol* symbols, int count) {
+    int num_slots = 16;
+    while (num_slots < count * 2) num_slots *= 2;
+    index->slots = malloc(num_slots * sizeof(int));
+    if (!index->slots) {
+        fprintf(stderr, "Error: Out of memory\n");
+        exit(1);
+    }
+    index->mask = num_slots - 1;
+    index->symbols = symbols;
+    for (int i = 0; i < num_slots; i++) index->slots[i] = -1;
+    for (int i = 0; i < count; i++) {
+        unsigned int slot = hash_name(symbols[i].name) & index->mask;
+        while (index->slots[slot] >= 0) slot = (slot + 1) & index->mask;
+        index->slots[slot] = i;
+    }
+}
+
+// Find a symbol by name; NULL after reporting it undefined
+static const ObjectSymbol* find_symbol(const SymbolIndex* index, const char* name) {
+    unsigned int slot = hash_name(name) & index->mask;
+    for (; index->slots[slot] >= 0; slot = (slot + 1) & index->mask) {
+        const ObjectSymbol* symbol = &index->symbols[index->slots[slot]];
+        if (strcmp(symbol->name, name) == 0) return symbol;
+    }
+    fprintf(stderr, "Error: Undefined symbol %s\n", name);
+    return NULL;
+}
+
+// --- Assembling ---
+
+void object_init(ObjectFile* object) {
+    memset(object, 0, sizeof(ObjectFile));
+}
+
+void object_free(ObjectFile* object) {
+    free(object->text);
+    free(object->funcs);
+    free(object->data);
+    free(object->devices);
+    free(object->fixups);
+    free(object->label_insn);
+    object_init(object);
+}
+
+void object_add_data(ObjectFile* object, const char* name, int size) {
+    add_symbol(&object->data, &object->num_data, &object->data_capacity, name, object->data_size, size);
+    object->data_size += size;
+}
+
+void object_add_device(ObjectFile* object, const char* name, unsigned int address, int size) {
+    add_symbol(&object->devices, &object->num_devices, &object->devices_capacity,
+               name, (int)address, size);
+}
+
+static int is_jump(Opcode op) {
+    return op == OP_JMP || (op >= OP_JE && op <= OP_JG);
+}
+
+int object_assemble(ObjectFile* object, const InsnList* code) {
+    const Insn* insns = code->insns;
+    int n = code->count;
+
+    // Numbered labels are unique to one function
+    int max_label = -1;
+    for (int i = 0; i < n; i++) {
+        if (insns[i].op == OP_LABEL && !insns[i].dst.name && insns[i].dst.value > max_label) {
+            max_label = insns[i].dst.value;
+        }
+    }
+    object->label_insn = reserve(object->label_insn, 0, &object->labels_capacity, max_label + 1, sizeof(int));
+    for (int i = 0; i < n; i++) {
+        if (insns[i].op == OP_LABEL && !insns[i].dst.name) object->label_insn[insns[i].dst.value] = i;
+    }
+
+    int* offset = malloc((n + 1) * sizeof(int));
+    int* lengths = malloc((n + 1) * sizeof(int));
+    unsigned char* near = calloc(n + 1, 1);
+    if (!offset || !lengths || !near) {
+        fprintf(stderr, "Error: Out of memory\n");
+        exit(1);
+    }
+    unsigned char scratch[MAX_INSN_BYTES];
+    int patch_at;
+    int failed = 0;
+    for (int i = 0; i < n; i++) {
+        lengths[i] = is_jump(insns[i].op) ? jump_length(insns[i].op, 0)
+                                          : encode_insn(&insns[i], 0, 0, scratch, &patch_at);
+        if (lengths[i] < 0) failed = 1;
+    }
+    if (failed) {
+        free(offset);
+        free(lengths);
+        free(near);
+        return 1;
+    }
+
+    // Every jump starts short; one that cannot reach grows, which only moves
+    // code further apart, so repeat until nothing grows
+    int changed = 1;
+    while (changed) {
+        changed = 0;
+        offset[0] = 0;
+        for (int i = 0; i < n; i++) offset[i + 1] = offset[i] + lengths[i];
+        for (int i = 0; i < n; i++) {
+            if (!is_jump(insns[i].op) || near[i]) continue;
+            int target = offset[object->label_insn[insns[i].dst.value]];
+            int displacement = target - offset[i + 1];
+            if (displacement < -128 || displacement > 127) {
+                near[i] = 1;
+                lengths[i] = jump_length(insns[i].op, 1);
+                changed = 1;
+            }
+        }
+    }
+
+    object->text = reserve(object->text, object->text_size, &object->text_capacity, offset[n], 1);
+    int base = object->text_size;
+    for (int i = 0; i < n; i++) {
+        const Insn* insn = &insns[i];
+        if (insn->op == OP_LABEL && insn->dst.name) {
+            add_symbol(&object->funcs, &object->num_funcs, &object->funcs_capacity,
+                       insn->dst.name, base + offset[i], 0);
+        }
+        int displacement = 0;
+        if (is_jump(insn->op)) displacement = offset[object->label_insn[insn->dst.value]] - offset[i + 1];
+        encode_insn(insn, near[i], displacement, object->text + base + offset[i], &patch_at);
+        if (patch_at < 0) continue;
+
+        object->fixups = reserve(object->fixups, object->num_fixups, &object->fixups_capacity,
+                                 1, sizeof(Fixup));
+        Fixup* fixup = &object->fixups[object->num_fixups++];
+        fixup->offset = base + offset[i] + patch_at;
+        fixup->is_call = insn->op == OP_CALL;
+        fixup->name = insn->op == OP_CALL || (insn->dst.kind == OPND_MEM && insn->dst.name) ?
+                      insn->dst.name : insn->src.name;
+    }
+    object->text_size = base + offset[n];
+
+    free(offset);
+    free(lengths);
+    free(near);
+    return 0;
+}
+
+// --- Writing ---
+
+// Fill in call targets and global addresses, with globals at 'data_address';
+// returns nonzero after reporting undefined symbols
+static int resolve_fixups(ObjectFile* object, unsigned int data_address) {
+    SymbolIndex funcs, data;
+    index_symbols(&funcs, object->funcs, object->num_funcs);
+    index_symbols(&data, object->data, object->num_data);
+    int failed = 0;
+    for (int i = 0; i < object->num_fixups; i++) {
+        Fixup* fixup = &object->fixups[i];
+        unsigned char* field = object->text + fixup->offset;
+        const ObjectSymbol* symbol = find_symbol(fixup->is_call ? &funcs : &data, fixup->name);
+        if (!symbol) {
+            failed = 1;
+        } else if (fixup->is_call) {
+            write32(field, symbol->offset - (fixup->offset + 4));
+        } else {
+            write32(field, read32(field) + data_address + symbol->offset);
+        }
+    }
+    free(funcs.slots);
+    free(data.slots);
+    return failed;
+}
+
+// Helper function to compute each function's size from where the next starts
+static void size_functions(ObjectFile* object) {
+    for (int f = 0; f < object->num_funcs; f++) {
+        int end = f + 1 < object->num_funcs ? object->funcs[f + 1].offset : object->text_size;
+        object->funcs[f].size = end - object->funcs[f].offset;
+    }
+}
+
+static void put_symbol(Buffer* symtab, int name, int value, int size, int binding, int type, int section) {
+    put32(symtab, name);
+    put32(symtab, value);
+    put32(symtab, size);
+    put8(symtab, binding << 4 | type);
+    put8(symtab, 0);
+    put16(symtab, section);
+}
+
+static void put_section_header(Buffer* file, int name, int type, int flags, int offset, int size,
+                               int link, int info, int alignment, int entry_size) {
+    put32(file, name);
+    put32(file, type);
+    put32(file, flags);
+    put32(file, 0);
+    put32(file, offset);
+    put32(file, size);
+    put32(file, link);
+    put32(file, info);
+    put32(file, alignment);
+    put32(file, entry_size);
+}
+
+// ELF32 relocatable object: global references are relocated against the
+// data section with the offset as the addend, as assemblers do
+static int write_elf(ObjectFile* object, FILE* output) {
+    if (resolve_fixups(object, 0) != 0) return 1;
+    size_functions(object);
+
+    Buffer rel = {NULL, 0, 0}, symtab = {NULL, 0, 0}, strtab = {NULL, 0, 0}, shstrtab = {NULL, 0, 0};
+    for (int i = 0; i < object->num_fixups; i++) {
+        if (object->fixups[i].is_call) continue;
+        put32(&rel, object->fixups[i].offset);
+        put32(&rel, SEC_DATA << 8 | R_386_32);  // Section symbols are numbered like sections
+    }
+
+    // Locals first: the null symbol, the section symbols, functions and data
+    put8(&strtab, 0);
+    put_symbol(&symtab, 0, 0, 0, STB_LOCAL, 0, 0);
+    put_symbol(&symtab, 0, 0, 0, STB_LOCAL, STT_SECTION, SEC_TEXT);
+    put_symbol(&symtab, 0, 0, 0, STB_LOCAL, STT_SECTION, SEC_DATA);
+    const ObjectSymbol* entry = NULL;
+    for (int f = 0; f < object->num_funcs; f++) {
+        const ObjectSymbol* func = &object->funcs[f];
+        if (strcmp(func->name, "_start") == 0) {
+            entry = func;
+            continue;
+        }
+        put_symbol(&symtab, add_string(&strtab, func->name), func->offset, func->size,
+                   STB_LOCAL, STT_FUNC, SEC_TEXT);
+    }
+    for (int g = 0; g < object->num_data; g++) {
+        const ObjectSymbol* global = &object->data[g];
+        put_symbol(&symtab, add_string(&strtab, global->name), global->offset, global->size,
+                   STB_LOCAL, STT_OBJECT, SEC_DATA);
+    }
+    int first_global = symtab.size / ELF_SYMBOL_SIZE;
+    if (entry) {
+        put_symbol(&symtab, add_string(&strtab, entry->name), entry->offset, entry->size,
+                   STB_GLOBAL, STT_FUNC, SEC_TEXT);
+    }
+
+    int names[NUM_SECTIONS];
+    static const char* section_names[] = {"", ".text", ".data", ".rel.text", ".symtab", ".strtab", ".shstrtab"};
+    for (int s = 0; s < NUM_SECTIONS; s++) names[s] = add_string(&shstrtab, section_names[s]);
+
+    // Header, sections in order, then the section header table
+    Buffer file = {NULL, 0, 0};
+    int offsets[NUM_SECTIONS] = {0};
+    put_bytes(&file, "\177ELF\1\1\1", 7);
+    while (file.size < 16) put8(&file, 0);
+    put16(&file, ET_REL);
+    put16(&file, EM_386);
+    put32(&file, 1);
+    put32(&file, 0);                        // Entry
+    put32(&file, 0);                        // Program headers
+    int section_headers_at = file.size;
+    put32(&file, 0);                        // Section headers, filled in below
+    put32(&file, 0);
+    put16(&file, ELF_HEADER_SIZE);
+    put16(&file, 0);
+    put16(&file, 0);
+    put16(&file, ELF_SECTION_HEADER_SIZE);
+    put16(&file, NUM_SECTIONS);
+    put16(&file, SEC_SHSTRTAB);
+
+    align(&file, 16);
+    offsets[SEC_TEXT] = file.size;
+    put_bytes(&file, object->text, object->text_size);
+    align(&file, 4);
+    offsets[SEC_DATA] = file.size;
+    for (int i = 0; i < object->data_size; i++) put8(&file, 0);
+    align(&file, 4);
+    offsets[SEC_REL_TEXT] = file.size;
+    put_bytes(&file, rel.bytes, rel.size);
+    offsets[SEC_SYMTAB] = file.size;
+    put_bytes(&file, symtab.bytes, symtab.size);
+    offsets[SEC_STRTAB] = file.size;
+    put_bytes(&file, strtab.bytes, strtab.size);
+    offsets[SEC_SHSTRTAB] = file.size;
+    put_bytes(&file, shstrtab.bytes, shstrtab.size);
+    align(&file, 4);
+    write32(file.bytes + section_headers_at, file.size);
+
+    put_section_header(&file, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+    put_section_header(&file, names[SEC_TEXT], SHT_PROGBITS, SHF_ALLOC | SHF_EXECINSTR,
+                       offsets[SEC_TEXT], object->text_size, 0, 0, 16, 0);
+    put_section_header(&file, names[SEC_DATA], SHT_PROGBITS, SHF_WRITE | SHF_ALLOC,
+                       offsets[SEC_DATA], object->data_size, 0, 0, 4, 0);
+    put_section_header(&file, names[SEC_REL_TEXT], SHT_REL, SHF_INFO_LINK,
+                       offsets[SEC_REL_TEXT], rel.size, SEC_SYMTAB, SEC_TEXT, 4, ELF_REL_SIZE);
+    put_section_header(&file, names[SEC_SYMTAB], SHT_SYMTAB, 0,
+                       offsets[SEC_SYMTAB], symtab.size, SEC_STRTAB, first_global, 4, ELF_SYMBOL_SIZE);
+    put_section_header(&file, names[SEC_STRTAB], SHT_STRTAB, 0,
+                       offsets[SEC_STRTAB], strtab.size, 0, 0, 1, 0);
+    put_section_header(&file, names[SEC_SHSTRTAB], SHT_STRTAB, 0,
+                       offsets[SEC_SHSTRTAB], shstrtab.size, 0, 0, 1, 0);
+
+    fwrite(file.bytes, 1, file.size, output);
+    free(file.bytes);
+    free(rel.bytes);
+    free(symtab.bytes);
+    free(strtab.bytes);
+    free(shstrtab.bytes);
+    return 0;
+}
+
+// Flat image: code from FLAT_IMAGE_BASE, the entry point first, then the
+// zeroed data. Memory-mapped globals keep their fixed addresses, so the image
+// must stay clear of them.
+static int write_bin(ObjectFile* object, FILE* output) {
+    int data_offset = (object->text_size + 3) & ~3;
+    unsigned int image_end = FLAT_IMAGE_BASE + data_offset + object->data_size;
+    for (int d = 0; d < object->num_devices; d++) {
+        const ObjectSymbol* device = &object->devices[d];
+        unsigned int address = (unsigned int)device->offset;
+        if (address < image_end && address + device->size > FLAT_IMAGE_BASE) {
+            fprintf(stderr, "Error: MMIO global %s at 0x%X overlaps the image (0x%X-0x%X)\n",
+                    device->name, address, FLAT_IMAGE_BASE, image_end);
+            return 1;
+        }
+    }
+    if (resolve_fixups(object, FLAT_IMAGE_BASE + data_offset) != 0) return 1;
+
+    Buffer image = {NULL, 0, 0};
+    put_bytes(&image, object->text, object->text_size);
+    align(&image, 4);
+    for (int i = 0; i < object->data_size; i++) put8(&image, 0);
+    fwrite(image.bytes, 1, image.size, output);
+    free(image.bytes);
+    return 0;
+}
+
+int object_write(ObjectFile* object, OutputFormat format, FILE* output) {
+    if (format == FORMAT_BIN) return write_bin(object, output);
+    return write_elf(object, output);
+}
@@ -0,0 +1,66 @@
+// object.h
+#ifndef OBJECT_H
+#define OBJECT_H
+
+#include <stdio.h>
+#include "insn.h"
+
+// Flat images are linked to run from this address
+#define FLAT_IMAGE_BASE 0
+
+typedef enum {
+    FORMAT_ASM,     // NASM source
+    FORMAT_ELF,     // ELF32 relocatable object
+    FORMAT_BIN      // Flat image: code, then data
+} OutputFormat;
+
+// A 32-bit field in the code to fill in once every address is known
+typedef struct {
+    int offset;
+    int is_call;            // rel32 to a function, else the absolute address of a global
+    const char* name;
+} Fixup;
+
+typedef struct {
+    const char* name;
+    int offset;             // In the code or data section
+    int size;
+} ObjectSymbol;
+
+// Machine code and data being assembled into an object file or flat image
+typedef struct {
+    unsigned char* text;
+    int text_size, text_capacity;
+    int data_size;
+    ObjectSymbol* funcs;
+    int num_funcs, funcs_capacity;
+    ObjectSymbol* data;
+    int num_data, data_capacity;
+    ObjectSymbol* devices;  // MMIO globals: offset is the fixed address
+    int num_devices, devices_capacity;
+    Fixup* fixups;
+    int num_fixups, fixups_capacity;
+    int* label_insn;        // Instruction of each numbered label in the function being assembled
+    int labels_capacity;
+} ObjectFile;
+
+void object_init(ObjectFile* object);
+void object_free(ObjectFile* object);
+
+// Reserve zeroed storage for a global in the data section
+void object_add_data(ObjectFile* object, const char* name, int size);
+
+// Note a memory-mapped global so flat images can be checked against it
+void object_add_device(ObjectFile* object, const char* name, unsigned int address, int size);
+
+// Append one function's instructions to the code, each jump in its shortest
+// form that reaches. Returns nonzero after reporting an instruction that
+// cannot be encoded.
+int object_assemble(ObjectFile* object, const InsnList* code);
+
+// Resolve calls and global references and write the object or image;
+// returns nonzero after reporting an undefined symbol or a device the image
+// would overlap
+int object_write(ObjectFile* object, OutputFormat format, FILE* output);
+
+#endif
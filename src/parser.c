@@ -1,93 +1,515 @@
+#include <setjmp.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include "parser.h"
+#include "arena.h"
 
-// Current token index
-int current_token = 0;
-Token* tokens = NULL;
+// State of one parse
+typedef struct {
+    TokenStream* stream;
+    Token* tokens;
+    int current;            // Index of the current token
+    Arena* arena;
+    ASTNode** scratch;      // Stack collecting children until their final count is known
+    int scratch_count;
+    int scratch_capacity;
+    jmp_buf error;          // Where a syntax error unwinds to, in parse()
+} Parser;
+
+static ASTNode* parse_statement(Parser* p);
+static ASTNode* parse_expression(Parser* p);
 
 // Helper function to advance to the next token
-void advance() {
-    current_token++;
+static void advance(Parser* p) {
+    p->current++;
 }
 
 // Helper function to check the current token type
-int match(TokenType type) {
-    return tokens[current_token].type == type;
+static int match(Parser* p, TokenType type) {
+    return p->tokens[p->current].type == type;
+}
+
+// Helper function to report a syntax error at the current token and abandon
+// the parse; everything built so far is in the arena
+static void syntax_error(Parser* p, const char* msg) {
+    Token* token = &p->tokens[p->current];
+    fprintf(stderr, "%d:%d: %s, found '%s'\n",
+            token->line, token->column, msg, token_text(p->stream, token));
+    longjmp(p->error, 1);
+}
+
+// Helper function to consume a token of the given type or fail
+static void expect(Parser* p, TokenType type, const char* msg) {
+    if (!match(p, type)) syntax_error(p, msg);
+    advance(p);
 }
 
 // Helper function to create an AST node
-ASTNode* create_node(NodeType type, char* value) {
-    ASTNode* node = malloc(sizeof(ASTNode));
+static ASTNode* create_node(Parser* p, NodeType type, char* value) {
+    ASTNode* node = arena_alloc(p->arena, sizeof(ASTNode));
     node->type = type;
     node->value = value;
     node->children = NULL;
     node->num_children = 0;
+    node->id = -1;
+    node->number = 0;
+    node->data_type = DT_INT;
+    node->line = p->tokens[p->current].line;
     return node;
 }
 
-// Parse a function
-ASTNode* parse_function() {
-    if (!match(TOKEN_FUNC)) return NULL;
+// Helper function to give a node a fixed number of (initially NULL) children
+static void set_num_children(Parser* p, ASTNode* node, int num_children) {
+    node->children = arena_alloc(p->arena, num_children * sizeof(ASTNode*));
+    memset(node->children, 0, num_children * sizeof(ASTNode*));
+    node->num_children = num_children;
+}
 
-    advance(); // Consume 'func'
-    char* name = tokens[current_token].value;
-    advance(); // Consume function name
+// Helper function to push a child onto the scratch stack
+static void scratch_push(Parser* p, ASTNode* node) {
+    if (p->scratch_count == p->scratch_capacity) {
+        p->scratch_capacity = p->scratch_capacity ? p->scratch_capacity * 2 : 64;
+        p->scratch = realloc(p->scratch, p->scratch_capacity * sizeof(ASTNode*));
+        if (!p->scratch) {
+            fprintf(stderr, "Error: Out of memory\n");
+            exit(1);
+        }
+    }
+    p->scratch[p->scratch_count++] = node;
+}
 
-    if (!match(TOKEN_LPAREN)) {
-        fprintf(stderr, "Expected '(' after function name\n");
-        exit(1);
+// Helper function to move the children pushed since 'base' into the node
+static void scratch_pop_into(Parser* p, ASTNode* node, int base) {
+    int count = p->scratch_count - base;
+    set_num_children(p, node, count);
+    if (count > 0) memcpy(node->children, p->scratch + base, count * sizeof(ASTNode*));
+    p->scratch_count = base;
+}
+
+// Helper function to create a node for the identifier at the current token
+static ASTNode* parse_identifier(Parser* p) {
+    if (!match(p, TOKEN_IDENT)) syntax_error(p, "Expected identifier");
+    Token* token = &p->tokens[p->current];
+    ASTNode* node = create_node(p, NODE_IDENT, (char*)intern_name(p->stream->names, token->id));
+    node->id = token->id;
+    advance(p);
+    return node;
+}
+
+// Helper function to check for a type keyword
+static int match_type(Parser* p) {
+    return match(p, TOKEN_INT) || match(p, TOKEN_BYTE) || match(p, TOKEN_PTR) || match(p, TOKEN_VOID);
+}
+
+// Parse a type keyword
+static DataType parse_type(Parser* p) {
+    DataType type = DT_INT;
+    if (match(p, TOKEN_BYTE)) type = DT_BYTE;
+    else if (match(p, TOKEN_PTR)) type = DT_PTR;
+    else if (match(p, TOKEN_VOID)) type = DT_VOID;
+    else if (!match(p, TOKEN_INT)) syntax_error(p, "Expected type");
+    advance(p);
+    return type;
+}
+
+// Parse a decimal or 0x-prefixed hexadecimal literal into 32 bits
+static ASTNode* parse_number(Parser* p) {
+    Token* token = &p->tokens[p->current];
+    const char* text = p->stream->source + token->offset;
+    unsigned long long value = 0;
+    int base = 10, i = 0;
+
+    if (token->length > 2 && text[0] == '0' && (text[1] == 'x' || text[1] == 'X')) {
+        base = 16;
+        i = 2;
+    }
+    for (; i < token->length; i++) {
+        char c = text[i];
+        int digit;
+        if (c >= '0' && c <= '9') digit = c - '0';
+        else if (base == 16 && c >= 'a' && c <= 'f') digit = c - 'a' + 10;
+        else if (base == 16 && c >= 'A' && c <= 'F') digit = c - 'A' + 10;
+        else syntax_error(p, "Malformed number");
+        value = value * base + digit;
+        if (value > 0xFFFFFFFFull) syntax_error(p, "Number does not fit in 32 bits");
     }
-    advance(); // Consume '('
 
-    // Parse parameters (if any)
-    ASTNode* params = create_node(NODE_FUNC, "params");
-    while (!match(TOKEN_RPAREN)) {
-        // Add parameter parsing logic here
-        advance();
+    ASTNode* node = create_node(p, NODE_NUMBER, arena_strndup(p->arena, text, token->length));
+    node->number = (int)(unsigned int)value;
+    advance(p);
+    return node;
+}
+
+// --- Expressions ---
+
+// Parse a call's argument list; the name has been consumed already
+static ASTNode* parse_call(Parser* p, ASTNode* name) {
+    ASTNode* call = create_node(p, NODE_CALL, name->value);
+    call->id = name->id;
+    call->line = name->line;
+    expect(p, TOKEN_LPAREN, "Expected '('");
+
+    int base = p->scratch_count;
+    while (!match(p, TOKEN_RPAREN)) {
+        scratch_push(p, parse_expression(p));
+        if (!match(p, TOKEN_COMMA)) break;
+        advance(p); // Consume ','
     }
-    advance(); // Consume ')'
+    expect(p, TOKEN_RPAREN, "Expected ')' after arguments");
+    scratch_pop_into(p, call, base);
 
-    if (!match(TOKEN_LBRACE)) {
-        fprintf(stderr, "Expected '{' after function parameters\n");
-        exit(1);
+    // alloc() and free() are the pointer builtins
+    if (strcmp(call->value, "alloc") == 0 || strcmp(call->value, "free") == 0) {
+        if (call->num_children != 1) syntax_error(p, "Expected one argument");
+        call->type = NODE_PTR;
+        call->id = -1;
     }
-    advance(); // Consume '{'
+    return call;
+}
 
-    // Parse function body
-    ASTNode* body = create_node(NODE_FUNC, "body");
-    while (!match(TOKEN_RBRACE)) {
-        // Add statement parsing logic here
-        advance();
+// Parse a literal, name, call, dereference, negation or parenthesized expression
+static ASTNode* parse_primary(Parser* p) {
+    if (match(p, TOKEN_NUMBER)) return parse_number(p);
+
+    if (match(p, TOKEN_IDENT)) {
+        ASTNode* name = parse_identifier(p);
+        if (match(p, TOKEN_LPAREN)) return parse_call(p, name);
+        return name;
+    }
+
+    if (match(p, TOKEN_LPAREN)) {
+        advance(p); // Consume '('
+        ASTNode* expr = parse_expression(p);
+        expect(p, TOKEN_RPAREN, "Expected ')'");
+        return expr;
+    }
+
+    if (match(p, TOKEN_STAR)) {
+        ASTNode* deref = create_node(p, NODE_DEREF, "*");
+        advance(p); // Consume '*'
+        set_num_children(p, deref, 1);
+        deref->children[0] = parse_primary(p);
+        return deref;
+    }
+
+    if (match(p, TOKEN_MINUS)) {
+        // Negation is subtraction from zero
+        ASTNode* neg = create_node(p, NODE_BINOP, "-");
+        ASTNode* zero = create_node(p, NODE_NUMBER, "0");
+        advance(p); // Consume '-'
+        set_num_children(p, neg, 2);
+        neg->children[0] = zero;
+        neg->children[1] = parse_primary(p);
+        return neg;
+    }
+
+    syntax_error(p, "Expected expression");
+    return NULL;
+}
+
+// Helper function to build a binary operator node
+static ASTNode* create_binop(Parser* p, char* op, ASTNode* left, ASTNode* right) {
+    ASTNode* node = create_node(p, NODE_BINOP, op);
+    node->line = left->line;
+    set_num_children(p, node, 2);
+    node->children[0] = left;
+    node->children[1] = right;
+    return node;
+}
+
+// Parse '*', '/' and '%'
+static ASTNode* parse_term(Parser* p) {
+    ASTNode* left = parse_primary(p);
+    while (match(p, TOKEN_STAR) || match(p, TOKEN_SLASH) || match(p, TOKEN_PERCENT)) {
+        char* op = match(p, TOKEN_STAR) ? "*" : match(p, TOKEN_SLASH) ? "/" : "%";
+        advance(p);
+        left = create_binop(p, op, left, parse_primary(p));
+    }
+    return left;
+}
+
+// Parse '+' and '-'
+static ASTNode* parse_sum(Parser* p) {
+    ASTNode* left = parse_term(p);
+    while (match(p, TOKEN_PLUS) || match(p, TOKEN_MINUS)) {
+        char* op = match(p, TOKEN_PLUS) ? "+" : "-";
+        advance(p);
+        left = create_binop(p, op, left, parse_term(p));
+    }
+    return left;
+}
+
+// Parse '<', '>', '<=' and '>='
+static ASTNode* parse_relation(Parser* p) {
+    ASTNode* left = parse_sum(p);
+    while (match(p, TOKEN_LT) || match(p, TOKEN_GT) || match(p, TOKEN_LE) || match(p, TOKEN_GE)) {
+        char* op = match(p, TOKEN_LT) ? "<" : match(p, TOKEN_GT) ? ">" : match(p, TOKEN_LE) ? "<=" : ">=";
+        advance(p);
+        left = create_binop(p, op, left, parse_sum(p));
+    }
+    return left;
+}
+
+// Parse '==' and '!='
+static ASTNode* parse_equality(Parser* p) {
+    ASTNode* left = parse_relation(p);
+    while (match(p, TOKEN_EQ_EQ) || match(p, TOKEN_NOT_EQ)) {
+        char* op = match(p, TOKEN_EQ_EQ) ? "==" : "!=";
+        advance(p);
+        left = create_binop(p, op, left, parse_relation(p));
+    }
+    return left;
+}
+
+// Parse an expression; '&' binds loosest, below the comparisons as in C
+static ASTNode* parse_expression(Parser* p) {
+    ASTNode* left = parse_equality(p);
+    while (match(p, TOKEN_AND)) {
+        advance(p);
+        left = create_binop(p, "&", left, parse_equality(p));
+    }
+    return left;
+}
+
+// --- Statements ---
+
+// Parse '[reg] type name [at address] [= value]' without the trailing ';'
+static ASTNode* parse_declaration(Parser* p) {
+    NodeType type = NODE_VAR;
+    if (match(p, TOKEN_REG)) {
+        type = NODE_REG;
+        advance(p); // Consume 'reg'
+    }
+    DataType data_type = parse_type(p);
+    if (data_type == DT_VOID) syntax_error(p, "Variables cannot be void");
+
+    ASTNode* name = parse_identifier(p);
+    ASTNode* decl = create_node(p, type, name->value);
+    decl->id = name->id;
+    decl->data_type = data_type;
+    decl->line = name->line;
+    set_num_children(p, decl, 1);
+
+    if (match(p, TOKEN_AT)) {
+        if (type == NODE_REG) syntax_error(p, "Register variables cannot have an address");
+        advance(p); // Consume 'at'
+        ASTNode* address = parse_number(p);
+        ASTNode* init = decl->children[0];
+        set_num_children(p, decl, 2);
+        decl->children[0] = init;
+        decl->children[1] = address;
+    }
+
+    if (match(p, TOKEN_EQ)) {
+        advance(p); // Consume '='
+        decl->children[0] = parse_expression(p);
+    }
+    return decl;
+}
+
+// Parse an assignment, pointer store or call without the trailing ';'
+static ASTNode* parse_simple_statement(Parser* p) {
+    if (match(p, TOKEN_REG) || match_type(p)) return parse_declaration(p);
+
+    if (match(p, TOKEN_STAR)) {
+        advance(p); // Consume '*'
+        ASTNode* target = parse_identifier(p);
+        ASTNode* store = create_node(p, NODE_PTR, target->value);
+        store->id = target->id;
+        store->line = target->line;
+        expect(p, TOKEN_EQ, "Expected '=' after pointer");
+        set_num_children(p, store, 1);
+        store->children[0] = parse_expression(p);
+        return store;
+    }
+
+    ASTNode* target = parse_identifier(p);
+    if (match(p, TOKEN_LPAREN)) return parse_call(p, target);
+
+    ASTNode* assign = create_node(p, NODE_ASSIGN, "=");
+    assign->line = target->line;
+    set_num_children(p, assign, 2);
+    assign->children[0] = target;
+
+    // 'x op= e' is 'x = x op e'
+    if (match(p, TOKEN_PLUS_EQ) || match(p, TOKEN_MINUS_EQ) || match(p, TOKEN_STAR_EQ)) {
+        char* op = match(p, TOKEN_PLUS_EQ) ? "+" : match(p, TOKEN_MINUS_EQ) ? "-" : "*";
+        advance(p);
+        ASTNode* value = create_node(p, NODE_IDENT, target->value);
+        value->id = target->id;
+        value->line = target->line;
+        assign->children[1] = create_binop(p, op, value, parse_expression(p));
+        return assign;
+    }
+    expect(p, TOKEN_EQ, "Expected '=' or '('");
+    assign->children[1] = parse_expression(p);
+    return assign;
+}
+
+// Parse '{ statement* }'
+static ASTNode* parse_block(Parser* p) {
+    ASTNode* block = create_node(p, NODE_BLOCK, "block");
+    expect(p, TOKEN_LBRACE, "Expected '{'");
+    int base = p->scratch_count;
+    while (!match(p, TOKEN_RBRACE)) {
+        if (match(p, TOKEN_EOF)) syntax_error(p, "Expected '}'");
+        scratch_push(p, parse_statement(p));
+    }
+    advance(p); // Consume '}'
+    scratch_pop_into(p, block, base);
+    return block;
+}
+
+// Parse '(condition)' for if and while
+static ASTNode* parse_condition(Parser* p) {
+    expect(p, TOKEN_LPAREN, "Expected '('");
+    ASTNode* condition = parse_expression(p);
+    expect(p, TOKEN_RPAREN, "Expected ')'");
+    return condition;
+}
+
+// Parse a statement
+static ASTNode* parse_statement(Parser* p) {
+    if (match(p, TOKEN_LBRACE)) return parse_block(p);
+
+    if (match(p, TOKEN_IF)) {
+        ASTNode* node = create_node(p, NODE_IF, "if");
+        advance(p); // Consume 'if'
+        set_num_children(p, node, 3);
+        node->children[0] = parse_condition(p);
+        node->children[1] = parse_statement(p);
+        if (match(p, TOKEN_ELSE)) {
+            advance(p); // Consume 'else'
+            node->children[2] = parse_statement(p);
+        }
+        return node;
+    }
+
+    if (match(p, TOKEN_WHILE)) {
+        ASTNode* node = create_node(p, NODE_WHILE, "while");
+        advance(p); // Consume 'while'
+        set_num_children(p, node, 2);
+        node->children[0] = parse_condition(p);
+        node->children[1] = parse_statement(p);
+        return node;
+    }
+
+    if (match(p, TOKEN_FOR)) {
+        ASTNode* node = create_node(p, NODE_FOR, "for");
+        advance(p); // Consume 'for'
+        set_num_children(p, node, 4);
+        expect(p, TOKEN_LPAREN, "Expected '(' after 'for'");
+        if (!match(p, TOKEN_SEMICOLON)) node->children[0] = parse_simple_statement(p);
+        expect(p, TOKEN_SEMICOLON, "Expected ';' after loop initializer");
+        if (!match(p, TOKEN_SEMICOLON)) node->children[1] = parse_expression(p);
+        expect(p, TOKEN_SEMICOLON, "Expected ';' after loop condition");
+        if (!match(p, TOKEN_RPAREN)) node->children[2] = parse_simple_statement(p);
+        expect(p, TOKEN_RPAREN, "Expected ')' after loop step");
+        node->children[3] = parse_statement(p);
+        return node;
+    }
+
+    if (match(p, TOKEN_RETURN)) {
+        ASTNode* node = create_node(p, NODE_RETURN, "return");
+        advance(p); // Consume 'return'
+        set_num_children(p, node, 1);
+        if (!match(p, TOKEN_SEMICOLON)) node->children[0] = parse_expression(p);
+        expect(p, TOKEN_SEMICOLON, "Expected ';' after return");
+        return node;
+    }
+
+    if (match(p, TOKEN_ASM)) {
+        advance(p); // Consume 'asm'
+        expect(p, TOKEN_LPAREN, "Expected '(' after 'asm'");
+        if (!match(p, TOKEN_STRING)) syntax_error(p, "Expected assembly string");
+        Token* token = &p->tokens[p->current];
+        ASTNode* node = create_node(p, NODE_ASM,
+            arena_strndup(p->arena, p->stream->source + token->offset + 1, token->length - 2));
+        advance(p); // Consume string
+        expect(p, TOKEN_RPAREN, "Expected ')' after assembly string");
+        expect(p, TOKEN_SEMICOLON, "Expected ';' after asm");
+        return node;
     }
-    advance(); // Consume '}'
+
+    ASTNode* node = parse_simple_statement(p);
+    expect(p, TOKEN_SEMICOLON, "Expected ';'");
+    return node;
+}
+
+// Parse a function
+static ASTNode* parse_function(Parser* p) {
+    if (!match(p, TOKEN_FUNC)) return NULL;
+
+    advance(p); // Consume 'func'
+    CallConv callconv = CALLCONV_DEFAULT;
+    if (match(p, TOKEN_CDECL) || match(p, TOKEN_FASTCALL)) {
+        callconv = match(p, TOKEN_CDECL) ? CALLCONV_CDECL : CALLCONV_FASTCALL;
+        advance(p); // Consume the calling convention
+    }
+    DataType return_type = DT_VOID;
+    if (match_type(p)) return_type = parse_type(p);
+    ASTNode* name = parse_identifier(p);
+
+    expect(p, TOKEN_LPAREN, "Expected '(' after function name");
+
+    // Parse parameters (if any)
+    ASTNode* params = create_node(p, NODE_BLOCK, "params");
+    int base = p->scratch_count;
+    while (!match(p, TOKEN_RPAREN)) {
+        ASTNode* param = parse_declaration(p);
+        if (param->children[0] || param->num_children > 1) {
+            syntax_error(p, "Parameters cannot have initializers or addresses");
+        }
+        scratch_push(p, param);
+        if (!match(p, TOKEN_COMMA)) break;
+        advance(p); // Consume ','
+    }
+    expect(p, TOKEN_RPAREN, "Expected ')' after function parameters");
+    scratch_pop_into(p, params, base);
+
+    // Parse function body
+    ASTNode* body = parse_block(p);
 
     // Create function node
-    ASTNode* func_node = create_node(NODE_FUNC, name);
-    func_node->children = malloc(2 * sizeof(ASTNode*));
+    ASTNode* func_node = create_node(p, NODE_FUNC, name->value);
+    func_node->id = name->id;
+    func_node->data_type = return_type;
+    func_node->number = callconv;
+    func_node->line = name->line;
+    set_num_children(p, func_node, 2);
     func_node->children[0] = params;
     func_node->children[1] = body;
-    func_node->num_children = 2;
 
     return func_node;
 }
 
-// Parse the entire program
-ASTNode* parse(Token* input_tokens) {
-    tokens = input_tokens;
-    ASTNode* program = create_node(NODE_FUNC, "program");
+// Parse the entire program: functions and global declarations
+ASTNode* parse(TokenStream* stream, Arena* arena) {
+    Parser parser;
+    memset(&parser, 0, sizeof(parser));
+    parser.stream = stream;
+    parser.tokens = stream->tokens;
+    parser.arena = arena;
+    Parser* p = &parser;
+    if (setjmp(p->error)) {
+        free(p->scratch);
+        return NULL;
+    }
+    ASTNode* program = create_node(p, NODE_BLOCK, "program");
+    int base = p->scratch_count;
 
-    while (!match(TOKEN_EOF)) {
-        ASTNode* func = parse_function();
-        if (func) {
-            program->children = realloc(program->children, (program->num_children + 1) * sizeof(ASTNode*));
-            program->children[program->num_children++] = func;
-        } else {
-            fprintf(stderr, "Unexpected token: %s\n", tokens[current_token].value);
-            exit(1);
+    while (!match(p, TOKEN_EOF)) {
+        ASTNode* node = parse_function(p);
+        if (!node) {
+            if (!match(p, TOKEN_REG) && !match_type(p)) syntax_error(p, "Unexpected token");
+            node = parse_declaration(p);
+            expect(p, TOKEN_SEMICOLON, "Expected ';' after declaration");
         }
+        scratch_push(p, node);
     }
+    scratch_pop_into(p, program, base);
 
+    free(p->scratch);
     return program;
-}
\ No newline at end of file
+}
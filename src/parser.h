@@ -1,14 +1,59 @@
 // parser.h
+#ifndef PARSER_H
+#define PARSER_H
+
+#include "lexer.h"
+#include "arena.h"
+
 typedef enum {
     NODE_FUNC, NODE_VAR, NODE_REG, NODE_ASM, NODE_IF, NODE_WHILE,
-    NODE_FOR, NODE_ASSIGN, NODE_BINOP, NODE_CALL, NODE_RETURN
+    NODE_FOR, NODE_ASSIGN, NODE_BINOP, NODE_CALL, NODE_RETURN,
+    NODE_IDENT, NODE_NUMBER, NODE_PTR, NODE_BLOCK, NODE_DEREF,
+    NUM_NODE_TYPES
 } NodeType;
 
+// Calling convention of a function: cdecl pushes every argument and the
+// caller pops them; fastcall passes the first two in ecx and edx and the
+// callee pops the rest. The default is chosen on the command line.
+typedef enum {
+    CALLCONV_DEFAULT, CALLCONV_CDECL, CALLCONV_FASTCALL
+} CallConv;
+
+typedef enum {
+    DT_INT,     // Integer type (32-bit)
+    DT_BYTE,    // Byte type (8-bit)
+    DT_PTR,     // Pointer type (32-bit address)
+    DT_VOID     // Function without a result
+} DataType;
+
+// Node layouts (absent optional children are NULL):
+//   NODE_FUNC    value = name, data_type = return type, number = CallConv,
+//                children = [params NODE_BLOCK of NODE_VAR/NODE_REG, body NODE_BLOCK]
+//   NODE_VAR/REG value = name, data_type, children = [initializer] or
+//                [initializer, address] for 'at' declarations
+//   NODE_IF      [condition, then, else]     NODE_WHILE [condition, body]
+//   NODE_FOR     [init, condition, step, body]; a NULL loop condition is always true.
+//                Constant folding sets number = 1 on loops whose first test must pass.
+//   NODE_ASSIGN  [target NODE_IDENT, value]; 'x op= e' is parsed as 'x = x op e'
+//   NODE_BINOP   value = operator ("+", "-", "*", "/", "%", "&", "<", ">",
+//                "<=", ">=", "==", "!="), [left, right]; comparisons yield 0 or 1
+//   NODE_RETURN  [value]
+//   NODE_CALL    value = name, children = arguments
+//   NODE_PTR     value = "alloc"/"free" with [operand], or a pointer name
+//                with [value] for '*name = value'
+//   NODE_DEREF   [pointer]                   NODE_ASM value = assembly text
 typedef struct ASTNode {
     NodeType type;
     struct ASTNode** children;
     int num_children;
     char* value;
+    int id;             // Interned name for identifiers, declarations and functions, -1 otherwise
+    int number;         // Value of NODE_NUMBER literals, see NODE_FOR and NODE_FUNC
+    DataType data_type; // Declared type of NODE_VAR, NODE_REG and NODE_FUNC
+    int line;
 } ASTNode;
 
-ASTNode* parse(Token* tokens);
\ No newline at end of file
+// Returns NULL after reporting a syntax error
+ASTNode* parse(TokenStream* stream, Arena* arena);
+
+#endif
@@ -0,0 +1,494 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "peephole.h"
+
+// How far ahead liveness is checked before assuming a register is still needed
+#define LOOKAHEAD 64
+#define MAX_PASSES 32
+
+// State shared by the rules during one sweep over a function
+typedef struct {
+    InsnList* list;
+    int* label_uses;     // Jumps to each numbered label, by label - label_base
+    int* label_index;    // Position of each numbered label
+    int label_base;
+    int num_labels;
+    int unknown_uses;    // Stands in for the use count of a named or foreign label
+} Peephole;
+
+// A rule sees 'size' consecutive live instructions; 'next' indexes the one
+// after the window. It returns 1 if it rewrote anything.
+typedef struct {
+    const char* name;
+    int size;
+    int (*apply)(Peephole* p, Insn** w, int next);
+} PeepholeRule;
+
+// --- Helpers ---
+
+// Helper function to delete an instruction in place
+static void kill(Insn* insn) {
+    insn->op = OP_NOP;
+}
+
+// Helper function to find the next live instruction at or after 'i', or -1
+static int next_live(InsnList* list, int i) {
+    while (i < list->count && list->insns[i].op == OP_NOP) i++;
+    return i < list->count ? i : -1;
+}
+
+static int is_conditional(Opcode op) {
+    return op >= OP_JE && op <= OP_JG;
+}
+
+static int is_jump(Opcode op) {
+    return op == OP_JMP || is_conditional(op);
+}
+
+// Helper function to check for instructions that read only the zero flag
+static int reads_zero_flag_only(Opcode op) {
+    return op == OP_JE || op == OP_JNE || op == OP_SETE || op == OP_SETNE;
+}
+
+static int is_reg(const Operand* operand, int reg) {
+    return operand->kind == OPND_REG && operand->reg == reg;
+}
+
+// Helper function to check whether an instruction depends on a register's value
+static int reads_reg(const Insn* insn, int reg) {
+    const Operand* dst = &insn->dst;
+    const Operand* src = &insn->src;
+    if (dst->kind == OPND_MEM && operand_uses_reg(dst, reg)) return 1;  // Address
+    if (operand_uses_reg(src, reg)) return 1;
+    switch (insn->op) {
+        case OP_MOV:
+        case OP_MOVZX:
+        case OP_LEA:
+            return is_reg(dst, reg) && dst->size == 1;  // Partial write keeps the rest
+        case OP_POP:
+        case OP_LABEL:
+            return 0;
+        case OP_CDQ:
+            return reg == REG_EAX;
+        case OP_IDIV:
+            return reg == REG_EAX || reg == REG_EDX || operand_uses_reg(dst, reg);
+        case OP_IMUL_WIDE:
+            return reg == REG_EAX || operand_uses_reg(dst, reg);
+        default:
+            return operand_uses_reg(dst, reg);
+    }
+}
+
+// Helper function to check whether an instruction overwrites all of a register
+static int writes_reg(const Insn* insn, int reg) {
+    switch (insn->op) {
+        case OP_MOV: case OP_MOVZX: case OP_LEA: case OP_ADD: case OP_SUB: case OP_IMUL:
+        case OP_AND: case OP_XOR: case OP_NEG: case OP_INC: case OP_DEC:
+        case OP_SHL: case OP_SAR: case OP_SHR: case OP_POP:
+            return is_reg(&insn->dst, reg) && insn->dst.size == 4;
+        case OP_CDQ:
+            return reg == REG_EDX;
+        case OP_IDIV:
+        case OP_IMUL_WIDE:
+            return reg == REG_EAX || reg == REG_EDX;
+        default:
+            return 0;
+    }
+}
+
+// Helper function to find the instruction index of a numbered label, or -1
+static int label_position(Peephole* p, const Operand* label) {
+    int index = label->value - p->label_base;
+    if (label->name || index < 0 || index >= p->num_labels) return -1;
+    return p->label_index[index];
+}
+
+// Check that no path from instruction 'i' reads 'reg' before writing it.
+// Jumps are followed while 'budget' lasts; inline assembly and syscalls
+// count as reads.
+static int reg_dead_from(Peephole* p, int i, int reg, int* budget) {
+    InsnList* list = p->list;
+    while ((*budget)-- > 0) {
+        i = next_live(list, i);
+        if (i < 0) return 0;
+        Insn* insn = &list->insns[i++];
+        switch (insn->op) {
+            case OP_LABEL:
+                continue;  // Falling through a label keeps the same path
+            case OP_CALL:
+                // Calls clobber the caller-saved registers, except those
+                // carrying arguments; the rest may be read
+                if (insn->dst.value & (1u << reg)) return 0;
+                return reg == REG_EAX || reg == REG_ECX || reg == REG_EDX;
+            case OP_RET:
+                return reg == REG_ECX || reg == REG_EDX;
+            case OP_JMP:
+                i = label_position(p, &insn->dst);
+                if (i < 0) return 0;
+                continue;
+            case OP_JE: case OP_JNE: case OP_JL: case OP_JGE: case OP_JLE: case OP_JG: {
+                int target = label_position(p, &insn->dst);
+                if (target < 0 || !reg_dead_from(p, target, reg, budget)) return 0;
+                continue;
+            }
+            case OP_INT:
+            case OP_ASM:
+                return 0;
+            default:
+                if (reads_reg(insn, reg)) return 0;
+                if (writes_reg(insn, reg)) return 1;
+        }
+    }
+    return 0;
+}
+
+static int reg_dead(Peephole* p, int i, int reg) {
+    int budget = LOOKAHEAD;
+    return reg_dead_from(p, i, reg, &budget);
+}
+
+// Helper function to check whether the instruction at 'i' consumes flags
+static int reads_flags(Peephole* p, int i) {
+    i = next_live(p->list, i);
+    if (i < 0) return 0;
+    Opcode op = p->list->insns[i].op;
+    return is_conditional(op) || (op >= OP_SETE && op <= OP_SETG);
+}
+
+// Helper function to count a jump to a numbered label
+static int* uses_of(Peephole* p, const Operand* label) {
+    int index = label->value - p->label_base;
+    if (label->name || index < 0 || index >= p->num_labels) {
+        p->unknown_uses = 1;  // Named or foreign labels always count as used
+        return &p->unknown_uses;
+    }
+    return &p->label_uses[index];
+}
+
+// --- Rules ---
+
+// push X; pop Y  ->  mov Y, X
+static int push_pop(Peephole* p, Insn** w, int next) {
+    (void)p; (void)next;
+    if (w[0]->op != OP_PUSH || w[1]->op != OP_POP) return 0;
+    if (w[0]->dst.kind == OPND_MEM && w[1]->dst.kind == OPND_MEM) return 0;
+    if (operand_equal(&w[0]->dst, &w[1]->dst)) {
+        kill(w[1]);
+    } else {
+        w[1]->op = OP_MOV;
+        w[1]->src = w[0]->dst;
+    }
+    kill(w[0]);
+    return 1;
+}
+
+// mov r, r  ->  (nothing)
+static int self_move(Peephole* p, Insn** w, int next) {
+    (void)p; (void)next;
+    if (w[0]->op != OP_MOV || !operand_equal(&w[0]->dst, &w[0]->src)) return 0;
+    kill(w[0]);
+    return 1;
+}
+
+// mov a, X; mov b, a  ->  mov b, X  when a is dead afterwards; also for
+// movzx and for stores of a to memory
+static int forward_move(Peephole* p, Insn** w, int next) {
+    if ((w[0]->op != OP_MOV && w[0]->op != OP_MOVZX) || w[1]->op != OP_MOV) return 0;
+    if (w[0]->dst.kind != OPND_REG || w[0]->dst.size != 4) return 0;
+    int a = w[0]->dst.reg;
+    Operand* dst = &w[1]->dst;
+    Operand* src = &w[1]->src;
+    if (!is_reg(src, a) || (dst->kind == OPND_MEM && operand_uses_reg(dst, a))) return 0;
+    if (a == REG_ESP || a == REG_EBP || !reg_dead(p, next, a)) return 0;
+
+    if (dst->kind == OPND_REG && src->size == 4) {
+        w[1]->op = w[0]->op;
+        w[1]->src = w[0]->src;
+    } else if (dst->kind == OPND_MEM && w[0]->op == OP_MOV && w[0]->src.kind == OPND_IMM) {
+        // Store the immediate directly; byte stores keep the low 8 bits
+        dst->size = src->size;
+        w[1]->src = op_imm(src->size == 1 ? (w[0]->src.value & 0xFF) : w[0]->src.value);
+    } else if (dst->kind == OPND_MEM && src->size == 4 && w[0]->op == OP_MOV &&
+               w[0]->src.kind == OPND_REG) {
+        w[1]->src = w[0]->src;
+    } else {
+        return 0;
+    }
+    kill(w[0]);
+    return 1;
+}
+
+// mov a, X; op a, Y; mov b, a  ->  mov b, X; op b, Y  when a is dead afterwards
+static int retarget(Peephole* p, Insn** w, int next) {
+    Opcode op = w[1]->op;
+    if (w[0]->op != OP_MOV || w[2]->op != OP_MOV) return 0;
+    if (op != OP_ADD && op != OP_SUB && op != OP_AND && op != OP_IMUL && op != OP_XOR) return 0;
+    if (w[0]->dst.kind != OPND_REG || w[0]->dst.size != 4) return 0;
+    int a = w[0]->dst.reg;
+    if (!is_reg(&w[1]->dst, a) || !is_reg(&w[2]->src, a) || w[2]->src.size != 4) return 0;
+    if (w[2]->dst.kind != OPND_REG || w[2]->dst.size != 4) return 0;
+    int b = w[2]->dst.reg;
+    if (b == a || operand_uses_reg(&w[1]->src, a) || operand_uses_reg(&w[1]->src, b)) return 0;
+    if (a == REG_ESP || b == REG_ESP || !reg_dead(p, next, a)) return 0;
+
+    w[0]->dst = op_reg(b);
+    w[1]->dst = op_reg(b);
+    kill(w[2]);
+    return 1;
+}
+
+// Helper function to check whether an operand is an absolute address, which
+// is where MMIO devices live: reading or writing one has effects
+static int is_device(const Operand* operand) {
+    return operand->kind == OPND_MEM && operand->reg < 0 && !operand->name;
+}
+
+// mov r, X  ->  (nothing)  when r is dead afterwards and X is not a device
+static int dead_move(Peephole* p, Insn** w, int next) {
+    if ((w[0]->op != OP_MOV && w[0]->op != OP_MOVZX) || w[0]->dst.kind != OPND_REG) return 0;
+    if (w[0]->dst.size != 4 || w[0]->dst.reg == REG_ESP || w[0]->dst.reg == REG_EBP) return 0;
+    if (is_device(&w[0]->src)) return 0;
+    if (!reg_dead(p, next, w[0]->dst.reg)) return 0;
+    kill(w[0]);
+    return 1;
+}
+
+// mov X, Y; mov Y, X  ->  mov X, Y  unless either is a device, which sees
+// every write
+static int move_back(Peephole* p, Insn** w, int next) {
+    (void)p; (void)next;
+    if (w[0]->op != OP_MOV || w[1]->op != OP_MOV) return 0;
+    if (is_device(&w[0]->dst) || is_device(&w[0]->src)) return 0;
+    if (!operand_equal(&w[0]->dst, &w[1]->src) || !operand_equal(&w[0]->src, &w[1]->dst)) return 0;
+    if (w[0]->dst.kind == OPND_MEM && operand_uses_reg(&w[0]->dst, w[0]->src.reg)) return 0;
+    kill(w[1]);
+    return 1;
+}
+
+// jmp .L; .L:  ->  .L:  (other labels may sit in between)
+static int jump_to_next(Peephole* p, Insn** w, int next) {
+    if (!is_jump(w[0]->op) || w[0]->dst.name) return 0;
+    for (int i = next_live(p->list, next); i >= 0; i = next_live(p->list, i + 1)) {
+        Insn* insn = &p->list->insns[i];
+        if (insn->op != OP_LABEL) return 0;
+        if (operand_equal(&insn->dst, &w[0]->dst)) {
+            (*uses_of(p, &w[0]->dst))--;
+            kill(w[0]);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// jcc .La; jmp .Lb; .La:  ->  jncc .Lb; .La:
+static int branch_over_jump(Peephole* p, Insn** w, int next) {
+    (void)next;
+    if (!is_conditional(w[0]->op) || w[1]->op != OP_JMP) return 0;
+    if (w[2]->op != OP_LABEL || !operand_equal(&w[0]->dst, &w[2]->dst)) return 0;
+    (*uses_of(p, &w[0]->dst))--;
+    w[1]->op = OP_JE + ((w[0]->op - OP_JE) ^ 1);  // Negations are paired
+    kill(w[0]);
+    return 1;
+}
+
+// jcc .La where .La: jmp .Lb  ->  jcc .Lb
+static int thread_jump(Peephole* p, Insn** w, int next) {
+    (void)next;
+    if (!is_jump(w[0]->op) || w[0]->dst.name) return 0;
+    int index = w[0]->dst.value - p->label_base;
+    if (index < 0 || index >= p->num_labels || p->label_index[index] < 0) return 0;
+    int target = next_live(p->list, p->label_index[index] + 1);
+    if (target < 0) return 0;
+    Insn* insn = &p->list->insns[target];
+    if (insn->op != OP_JMP || operand_equal(&insn->dst, &w[0]->dst)) return 0;
+    (*uses_of(p, &w[0]->dst))--;
+    (*uses_of(p, &insn->dst))++;
+    w[0]->dst = insn->dst;
+    return 1;
+}
+
+// Instructions after jmp or ret up to the next label never run
+static int unreachable(Peephole* p, Insn** w, int next) {
+    (void)p; (void)next;
+    if (w[0]->op != OP_JMP && w[0]->op != OP_RET) return 0;
+    if (w[1]->op == OP_LABEL || w[1]->op == OP_ASM) return 0;
+    if (is_jump(w[1]->op)) (*uses_of(p, &w[1]->dst))--;
+    kill(w[1]);
+    return 1;
+}
+
+// .L: with no jumps to it  ->  (nothing)
+static int dead_label(Peephole* p, Insn** w, int next) {
+    (void)next;
+    if (w[0]->op != OP_LABEL || w[0]->dst.name || *uses_of(p, &w[0]->dst) > 0) return 0;
+    kill(w[0]);
+    return 1;
+}
+
+// add r, 0 / sub r, 0  ->  (nothing)
+static int add_zero(Peephole* p, Insn** w, int next) {
+    if (w[0]->op != OP_ADD && w[0]->op != OP_SUB) return 0;
+    if (w[0]->src.kind != OPND_IMM || w[0]->src.value != 0 || reads_flags(p, next)) return 0;
+    kill(w[0]);
+    return 1;
+}
+
+// cmp r, 0  ->  test r, r
+static int compare_zero(Peephole* p, Insn** w, int next) {
+    (void)p; (void)next;
+    if (w[0]->op != OP_CMP || w[0]->dst.kind != OPND_REG) return 0;
+    if (w[0]->src.kind != OPND_IMM || w[0]->src.value != 0) return 0;
+    w[0]->op = OP_TEST;
+    w[0]->src = w[0]->dst;
+    return 1;
+}
+
+// op r, X; test r, r  ->  op r, X  when only the zero flag is read, which
+// the arithmetic already set from r
+static int redundant_test(Peephole* p, Insn** w, int next) {
+    Opcode op = w[0]->op;
+    if (op != OP_ADD && op != OP_SUB && op != OP_AND && op != OP_XOR && op != OP_NEG &&
+        op != OP_INC && op != OP_DEC) return 0;
+    if (w[1]->op != OP_TEST || w[0]->dst.kind != OPND_REG || w[0]->dst.size != 4) return 0;
+    if (!operand_equal(&w[1]->dst, &w[0]->dst) || !operand_equal(&w[1]->src, &w[0]->dst)) return 0;
+    int user = next_live(p->list, next);
+    if (user < 0 || !reads_zero_flag_only(p->list->insns[user].op)) return 0;
+    if (reads_flags(p, user + 1)) return 0;
+    kill(w[1]);
+    return 1;
+}
+
+// add X, 1 / sub X, 1  ->  inc X / dec X; only the carry flag differs, and
+// no generated code reads it
+static int inc_dec(Peephole* p, Insn** w, int next) {
+    (void)p; (void)next;
+    if (w[0]->op != OP_ADD && w[0]->op != OP_SUB) return 0;
+    if (w[0]->src.kind != OPND_IMM || (w[0]->src.value != 1 && w[0]->src.value != -1)) return 0;
+    if (w[0]->dst.kind == OPND_REG && w[0]->dst.reg == REG_ESP) return 0;
+    w[0]->op = (w[0]->op == OP_ADD) == (w[0]->src.value == 1) ? OP_INC : OP_DEC;
+    w[0]->src = op_none();
+    return 1;
+}
+
+// mov r, 0  ->  xor r, r  (unless flags are live)
+static int zero_idiom(Peephole* p, Insn** w, int next) {
+    if (w[0]->op != OP_MOV || w[0]->dst.kind != OPND_REG || w[0]->dst.size != 4) return 0;
+    if (w[0]->src.kind != OPND_IMM || w[0]->src.value != 0 || reads_flags(p, next)) return 0;
+    w[0]->op = OP_XOR;
+    w[0]->src = w[0]->dst;
+    return 1;
+}
+
+// Tried in order at every position; the rewrites that enable others come first
+static const PeepholeRule rules[] = {
+    {"push-pop", 2, push_pop},
+    {"self-move", 1, self_move},
+    {"forward-move", 2, forward_move},
+    {"retarget", 3, retarget},
+    {"move-back", 2, move_back},
+    {"dead-move", 1, dead_move},
+    {"unreachable", 2, unreachable},
+    {"jump-to-next", 1, jump_to_next},
+    {"branch-over-jump", 3, branch_over_jump},
+    {"thread-jump", 1, thread_jump},
+    {"dead-label", 1, dead_label},
+    {"add-zero", 1, add_zero},
+    {"compare-zero", 1, compare_zero},
+    {"redundant-test", 2, redundant_test},
+    {"inc-dec", 1, inc_dec},
+    {"zero-idiom", 1, zero_idiom},
+};
+#define NUM_RULES ((int)(sizeof(rules) / sizeof(rules[0])))
+
+// --- Driver ---
+
+// Helper function to index the numbered labels and count the jumps to them
+static void index_labels(Peephole* p) {
+    InsnList* list = p->list;
+    int low = 0, high = -1;
+    for (int i = 0; i < list->count; i++) {
+        Insn* insn = &list->insns[i];
+        if ((insn->op == OP_LABEL || is_jump(insn->op)) && !insn->dst.name) {
+            if (high < low) low = high = insn->dst.value;
+            if (insn->dst.value < low) low = insn->dst.value;
+            if (insn->dst.value > high) high = insn->dst.value;
+        }
+    }
+    p->label_base = low;
+    p->num_labels = high - low + 1;
+    int* uses = realloc(p->label_uses, (p->num_labels + 1) * sizeof(int));
+    if (uses) p->label_uses = uses;
+    int* index = realloc(p->label_index, (p->num_labels + 1) * sizeof(int));
+    if (index) p->label_index = index;
+    if (!uses || !index) {
+        fprintf(stderr, "Error: Out of memory\n");
+        exit(1);
+    }
+    for (int i = 0; i < p->num_labels; i++) {
+        p->label_uses[i] = 0;
+        p->label_index[i] = -1;
+    }
+    for (int i = 0; i < list->count; i++) {
+        Insn* insn = &list->insns[i];
+        if (insn->dst.name) continue;
+        if (insn->op == OP_LABEL) p->label_index[insn->dst.value - low] = i;
+        else if (is_jump(insn->op)) p->label_uses[insn->dst.value - low]++;
+    }
+}
+
+// Helper function to squeeze deleted instructions out of the list
+static void compact(InsnList* list) {
+    int kept = 0;
+    for (int i = 0; i < list->count; i++) {
+        if (list->insns[i].op != OP_NOP) list->insns[kept++] = list->insns[i];
+    }
+    list->count = kept;
+}
+
+void peephole(InsnList* list, PeepholeStats* stats) {
+    Peephole p = {list, NULL, NULL, 0, 0, 0};
+    stats->insns_in += list->count;
+
+    // Jumps between two jumps could thread forever; the cap keeps that finite
+    int changed = 1;
+    for (int pass = 0; changed && pass < MAX_PASSES; pass++) {
+        changed = 0;
+        stats->passes++;
+        index_labels(&p);
+        for (int i = next_live(list, 0); i >= 0; i = next_live(list, i + 1)) {
+            for (int r = 0; r < NUM_RULES; r++) {
+                // Gather the window of live instructions starting at i
+                Insn* window[3];
+                int n = 0, j = i;
+                while (n < rules[r].size && j >= 0) {
+                    window[n++] = &list->insns[j];
+                    j = next_live(list, j + 1);
+                }
+                if (n < rules[r].size) continue;
+                if (j < 0) j = list->count;
+
+                if (rules[r].apply(&p, window, j)) {
+                    stats->fired[r]++;
+                    changed = 1;
+                    if (list->insns[i].op == OP_NOP) break;
+                }
+            }
+        }
+        compact(list);
+    }
+
+    free(p.label_uses);
+    free(p.label_index);
+    stats->insns_out += list->count;
+}
+
+void peephole_report(const PeepholeStats* stats, FILE* output) {
+    fprintf(output, "Peephole report:\n");
+    fprintf(output, "  %-18s %10s\n", "rule", "fired");
+    for (int r = 0; r < NUM_RULES; r++) {
+        fprintf(output, "  %-18s %10ld\n", rules[r].name, stats->fired[r]);
+    }
+    fprintf(output, "  %ld instructions in, %ld out, %ld passes\n",
+            stats->insns_in, stats->insns_out, stats->passes);
+}
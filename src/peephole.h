@@ -0,0 +1,22 @@
+// peephole.h
+#ifndef PEEPHOLE_H
+#define PEEPHOLE_H
+
+#include <stdio.h>
+#include "insn.h"
+
+#define MAX_PEEPHOLE_RULES 32
+
+// How often each rule fired, summed over every function optimized
+typedef struct {
+    long fired[MAX_PEEPHOLE_RULES];
+    long insns_in;
+    long insns_out;
+    long passes;
+} PeepholeStats;
+
+// Rewrite a function's instructions with the rule table until nothing changes
+void peephole(InsnList* list, PeepholeStats* stats);
+void peephole_report(const PeepholeStats* stats, FILE* output);
+
+#endif
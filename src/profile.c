@@ -0,0 +1,293 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "profile.h"
+#include "alloc.h"
+
+#define PROFILE_VERSION 1
+
+// An edge of the control flow graph and how often it ran
+typedef struct {
+    long weight;
+    int from;
+    int to;
+} Edge;
+
+// Helper function to hash a function's control flow and instructions
+// (FNV-1a), leaving out the counters themselves
+static unsigned int function_checksum(const IrFunction* func) {
+    unsigned int hash = 2166136261u;
+    unsigned int values[3];
+    for (int b = 0; b < func->num_blocks; b++) {
+        const IrBlock* block = &func->blocks[b];
+        values[0] = (unsigned int)block->succ[0];
+        values[1] = (unsigned int)block->succ[1];
+        values[2] = 0;
+        for (int i = block->first; i < block->first + block->count; i++) {
+            if (func->insns[i].op == IR_COUNT) continue;
+            values[2] = values[2] * 31 + func->insns[i].op;
+        }
+        for (int k = 0; k < 3; k++) {
+            for (int shift = 0; shift < 32; shift += 8) {
+                hash ^= values[k] >> shift & 0xFF;
+                hash *= 16777619u;
+            }
+        }
+    }
+    return hash;
+}
+
+// --- Instrumentation ---
+
+void profile_instrument(IrProgram* program, Profile* profile, Arena* arena) {
+    profile->num_funcs = program->num_funcs;
+    profile->funcs = arena_alloc(arena, (program->num_funcs + 1) * sizeof(ProfileFunction));
+    int counter = 0;
+    for (int f = 0; f < program->num_funcs; f++) {
+        IrFunction* func = &program->funcs[f];
+        ProfileFunction* record = &profile->funcs[f];
+        record->name = func->name;
+        record->checksum = function_checksum(func);
+        record->num_blocks = func->num_blocks;
+        record->first_counter = counter;
+        record->counts = NULL;
+
+        // Each block counts itself on entry; block 0 after taking its parameters
+        IrInsn* insns = arena_alloc(arena, (func->num_insns + func->num_blocks + 1) * sizeof(IrInsn));
+        int count = 0;
+        for (int b = 0; b < func->num_blocks; b++) {
+            IrBlock* block = &func->blocks[b];
+            int i = block->first;
+            int first = count;
+            while (i < block->first + block->count && func->insns[i].op == IR_PARAM) insns[count++] = func->insns[i++];
+            IrInsn increment = {IR_COUNT, 4, IR_B_IMM, IR_NE, -1, -1, counter++};
+            insns[count++] = increment;
+            while (i < block->first + block->count) insns[count++] = func->insns[i++];
+            block->first = first;
+            block->count = count - first;
+        }
+        func->insns = insns;
+        func->num_insns = count;
+    }
+    program->num_counters = counter;
+}
+
+int profile_write(const Profile* profile, const unsigned char* counters, const char* path) {
+    FILE* output = fopen(path, "w");
+    if (!output) return 1;
+    fprintf(output, "hiasc-profile %d\n", PROFILE_VERSION);
+    for (int f = 0; f < profile->num_funcs; f++) {
+        const ProfileFunction* record = &profile->funcs[f];
+        fprintf(output, "function %s %d %08x\n", record->name, record->num_blocks, record->checksum);
+        for (int b = 0; b < record->num_blocks; b++) {
+            const unsigned char* bytes = counters + 4 * (record->first_counter + b);
+            unsigned int count = bytes[0] | bytes[1] << 8 | bytes[2] << 16 | (unsigned int)bytes[3] << 24;
+            fprintf(output, "%s%u", b % 16 == 0 ? "  " : " ", count);
+            if (b % 16 == 15 || b == record->num_blocks - 1) fputc('\n', output);
+        }
+    }
+    return fclose(output) != 0;
+}
+
+// --- Reading ---
+
+// Helper function to order functions by name for lookup
+static int compare_name(const void* a, const void* b) {
+    return strcmp(((const ProfileFunction*)a)->name, ((const ProfileFunction*)b)->name);
+}
+
+int profile_read(Profile* profile, const char* path, Arena* arena) {
+    FILE* input = fopen(path, "r");
+    if (!input) return 1;
+    profile->funcs = NULL;
+    profile->num_funcs = 0;
+    int version, capacity = 0, failed = 0;
+    if (fscanf(input, "hiasc-profile %d", &version) != 1 || version != PROFILE_VERSION) failed = 1;
+
+    char name[256];
+    ProfileFunction record;
+    while (!failed && fscanf(input, " function %255s %d %x", name, &record.num_blocks, &record.checksum) == 3) {
+        if (record.num_blocks < 0) {
+            failed = 1;
+            break;
+        }
+        record.name = arena_strdup(arena, name);
+        record.first_counter = 0;
+        record.counts = arena_alloc(arena, (record.num_blocks + 1) * sizeof(long));
+        for (int b = 0; b < record.num_blocks; b++) {
+            if (fscanf(input, "%ld", &record.counts[b]) != 1 || record.counts[b] < 0) failed = 1;
+        }
+        if (profile->num_funcs == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            profile->funcs = realloc(profile->funcs, capacity * sizeof(ProfileFunction));
+            if (!profile->funcs) {
+                fprintf(stderr, "Error: Out of memory\n");
+                exit(1);
+            }
+        }
+        profile->funcs[profile->num_funcs++] = record;
+    }
+    if (!failed && !feof(input) && fscanf(input, " %1s", name) == 1) failed = 1;
+    fclose(input);
+
+    // Keep the records in the arena like the rest of the compilation
+    ProfileFunction* funcs = arena_alloc(arena, (profile->num_funcs + 1) * sizeof(ProfileFunction));
+    if (profile->num_funcs > 0) memcpy(funcs, profile->funcs, profile->num_funcs * sizeof(ProfileFunction));
+    free(profile->funcs);
+    profile->funcs = funcs;
+    qsort(profile->funcs, profile->num_funcs, sizeof(ProfileFunction), compare_name);
+    return failed;
+}
+
+// --- Layout ---
+
+// Helper function to order edges by weight, heaviest first; ties keep the
+// original layout order so the result is deterministic
+static int compare_edge(const void* a, const void* b) {
+    const Edge* x = a;
+    const Edge* y = b;
+    if (x->weight != y->weight) return x->weight > y->weight ? -1 : 1;
+    if (x->from != y->from) return x->from - y->from;
+    return x->to - y->to;
+}
+
+// Helper function to find the representative of a block's chain
+static int find_chain(int* parent, int b) {
+    while (parent[b] != b) {
+        parent[b] = parent[parent[b]];
+        b = parent[b];
+    }
+    return b;
+}
+
+// Helper function to estimate how often each edge ran from the block counts.
+// An edge into a block with a single predecessor ran as often as that
+// block; the other edge of a branch gets the rest, and when neither side
+// tells, the count is split in proportion to the targets.
+static int collect_edges(const IrFunction* func, const long* counts, Edge* edges) {
+    int num_edges = 0;
+    for (int b = 0; b < func->num_blocks; b++) {
+        const IrBlock* block = &func->blocks[b];
+        long weights[2] = {counts[b], 0};
+        if (block->succ[1] >= 0) {
+            int s0 = block->succ[0], s1 = block->succ[1];
+            if (func->blocks[s0].num_preds == 1) {
+                weights[0] = counts[s0];
+            } else if (func->blocks[s1].num_preds == 1) {
+                weights[0] = counts[b] - counts[s1];
+            } else if (counts[s0] + counts[s1] > 0) {
+                weights[0] = (long)((double)counts[b] * counts[s0] / (counts[s0] + counts[s1]));
+            } else {
+                weights[0] = 0;
+            }
+            if (weights[0] < 0) weights[0] = 0;
+            if (weights[0] > counts[b]) weights[0] = counts[b];
+            weights[1] = counts[b] - weights[0];
+        }
+        for (int s = 0; s < 2; s++) {
+            int to = block->succ[s];
+            if (to < 0 || to == b || to == 0 || weights[s] == 0) continue;
+            edges[num_edges].weight = weights[s];
+            edges[num_edges].from = b;
+            edges[num_edges].to = to;
+            num_edges++;
+        }
+    }
+    return num_edges;
+}
+
+// Chain blocks along their heaviest edges, bottom-up as Pettis and Hansen
+// do, then place the entry's chain first, the chains that ran by their
+// first block's count and the ones that never ran last. Returns nonzero if
+// the order differs from the current layout.
+static int layout_function(const IrFunction* func, const long* counts, int* order) {
+    int n = func->num_blocks;
+    Edge* edges = checked_calloc(2 * n, sizeof(Edge));
+    int* next = checked_calloc(n, sizeof(int));
+    int* prev = checked_calloc(n, sizeof(int));
+    int* parent = checked_calloc(n, sizeof(int));
+    long* hottest = checked_calloc(n, sizeof(long));
+    for (int b = 0; b < n; b++) {
+        next[b] = prev[b] = -1;
+        parent[b] = b;
+    }
+
+    // A heavy edge becomes a fall-through when it links a chain's tail to
+    // another chain's head
+    int num_edges = collect_edges(func, counts, edges);
+    qsort(edges, num_edges, sizeof(Edge), compare_edge);
+    for (int e = 0; e < num_edges; e++) {
+        int from = edges[e].from, to = edges[e].to;
+        if (next[from] >= 0 || prev[to] >= 0) continue;
+        int a = find_chain(parent, from), c = find_chain(parent, to);
+        if (a == c) continue;
+        next[from] = to;
+        prev[to] = from;
+        parent[c] = a;
+    }
+
+    // Chains by their first block
+    int* heads = checked_calloc(n, sizeof(int));
+    int num_heads = 0;
+    for (int b = 0; b < n; b++) {
+        int chain = find_chain(parent, b);
+        if (counts[b] > hottest[chain]) hottest[chain] = counts[b];
+    }
+    for (int b = 1; b < n; b++) {
+        if (prev[b] < 0) heads[num_heads++] = b;
+    }
+
+    // Insertion sort keeps ties in layout order: hot chains by the count of
+    // their first block, then cold chains
+    for (int i = 1; i < num_heads; i++) {
+        int head = heads[i];
+        int hot = hottest[find_chain(parent, head)] > 0;
+        int j = i;
+        while (j > 0) {
+            int other = heads[j - 1];
+            int other_hot = hottest[find_chain(parent, other)] > 0;
+            if (other_hot > hot || (other_hot == hot && (!hot || counts[other] >= counts[head]))) break;
+            heads[j] = other;
+            j--;
+        }
+        heads[j] = head;
+    }
+
+    int count = 0;
+    for (int b = 0; b >= 0; b = next[b]) order[count++] = b;
+    for (int i = 0; i < num_heads; i++) {
+        for (int b = heads[i]; b >= 0; b = next[b]) order[count++] = b;
+    }
+    int changed = 0;
+    for (int i = 0; i < n; i++) {
+        if (order[i] != i) changed = 1;
+    }
+
+    free(edges);
+    free(next);
+    free(prev);
+    free(parent);
+    free(hottest);
+    free(heads);
+    return changed;
+}
+
+void profile_layout(IrProgram* program, const Profile* profile, Arena* arena) {
+    for (int f = 0; f < program->num_funcs; f++) {
+        IrFunction* func = &program->funcs[f];
+        ProfileFunction key;
+        key.name = func->name;
+        const ProfileFunction* record = bsearch(&key, profile->funcs, profile->num_funcs,
+                                                sizeof(ProfileFunction), compare_name);
+        if (!record) continue;
+        if (record->num_blocks != func->num_blocks || record->checksum != function_checksum(func)) {
+            fprintf(stderr, "Warning: Profile of %s does not match its code, ignored\n", func->name);
+            continue;
+        }
+        if (func->num_blocks < 2 || record->counts[0] == 0) continue;
+
+        int* order = checked_calloc(func->num_blocks, sizeof(int));
+        if (layout_function(func, record->counts, order)) ir_reorder_blocks(func, order, arena);
+        free(order);
+    }
+}
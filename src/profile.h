@@ -0,0 +1,41 @@
+// profile.h
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include "arena.h"
+#include "ir.h"
+
+// Data symbol of the 32-bit block counters, placed after every global
+#define PROFILE_COUNTERS "__profile_counters"
+#define PROFILE_DEFAULT_PATH "hiasc.profile"
+
+// Execution counts of one function's blocks, in the order its IR had before
+// any layout; the checksum ties them to that IR
+typedef struct {
+    const char* name;
+    unsigned int checksum;
+    int num_blocks;
+    int first_counter;      // Counter of block 0 in an instrumented program
+    long* counts;           // Per block, NULL until read
+} ProfileFunction;
+
+typedef struct {
+    ProfileFunction* funcs;
+    int num_funcs;
+} Profile;
+
+// Count every block of every function: each gets one IR_COUNT at its start
+// and a counter in PROFILE_COUNTERS. 'profile' describes the counters.
+void profile_instrument(IrProgram* program, Profile* profile, Arena* arena);
+// Write the counters of an instrumented run; 'counters' is the memory of
+// PROFILE_COUNTERS. Returns nonzero if the file cannot be written.
+int profile_write(const Profile* profile, const unsigned char* counters, const char* path);
+// Read a profile written by profile_write(). Returns nonzero if the file
+// cannot be read or is not a profile.
+int profile_read(Profile* profile, const char* path, Arena* arena);
+// Lay out the blocks of each profiled function so the hot path falls
+// through: frequent edges become fall-throughs, which also picks the branch
+// sense, and blocks that never ran go to the end
+void profile_layout(IrProgram* program, const Profile* profile, Arena* arena);
+
+#endif
@@ -0,0 +1,606 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include "regalloc.h"
+#include "arena.h"
+#include "muldiv.h"
+#include "alloc.h"
+
+// 'reg' declarations multiply their spill cost, so they lose their register
+// only to variables used far more often
+#define REG_HINT_BOOST 16
+
+// Each use counts 8^depth for loops nested up to this deep
+#define MAX_WEIGHT_DEPTH 5
+
+// Reload and spill temporaries always win against ordinary ranges
+#define SPILL_TEMP_WEIGHT (1 << 28)
+
+// Marks vregs without a stack slot; PARAM_SLOT() values are negative
+#define NO_SLOT INT_MIN
+
+// Rounds of spilling before giving up; each round only adds tiny ranges
+#define MAX_ROUNDS 8
+
+const int arg_regs[NUM_ARG_REGS] = {REG_ECX, REG_EDX};
+
+unsigned int ir_clobbers(const IrInsn* insn) {
+    switch (insn->op) {
+        case IR_DIV:
+        case IR_MOD: return REG_BIT(REG_EAX) | REG_BIT(REG_EDX);
+        case IR_CALL: return REG_BIT(REG_EAX) | REG_BIT(REG_ECX) | REG_BIT(REG_EDX);
+        case IR_ALLOC: return REG_BIT(REG_EAX) | REG_BIT(REG_EBX) | REG_BIT(REG_ECX);
+        case IR_ASM: return ALL_REGS;  // Unknown instructions may write anything
+        default: return 0;
+    }
+}
+
+// Helper function to find registers an operand cannot live in at all:
+// idiv's divisor must avoid edx:eax, and so must the dividend of a division
+// by a constant, which is read again after the high multiply writes them;
+// byte stores and byte spills need a low-byte register
+static unsigned int operand_constraints(const IrInsn* insn, int v) {
+    if ((insn->op == IR_DIV || insn->op == IR_MOD) && (v == insn->b || (insn->flags & IR_B_IMM))) {
+        return REG_BIT(REG_EAX) | REG_BIT(REG_EDX);
+    }
+    if ((insn->op == IR_STORE || insn->op == IR_SPILL) && insn->size == 1) {
+        return REG_BIT(REG_ESI) | REG_BIT(REG_EDI);
+    }
+    return 0;
+}
+
+// Weigh one use by how deeply it is nested in loops
+int loop_weight(int depth) {
+    int weight = 1;
+    for (int i = 0; i < depth && i < MAX_WEIGHT_DEPTH; i++) weight *= 8;
+    return weight;
+}
+
+// --- Liveness ---
+
+// Compute the vregs live into and out of every block, as bitsets of 'words'
+// words per block, by backward iteration to a fixpoint
+static void compute_liveness(IrFunction* func, unsigned int* live_in, unsigned int* live_out,
+                             int words) {
+    int n = func->num_blocks;
+    unsigned int* gen = checked_calloc((size_t)n * words, sizeof(unsigned int));
+    unsigned int* kill = checked_calloc((size_t)n * words, sizeof(unsigned int));
+
+    for (int b = 0; b < n; b++) {
+        IrBlock* block = &func->blocks[b];
+        unsigned int* block_gen = gen + (size_t)b * words;
+        unsigned int* block_kill = kill + (size_t)b * words;
+        for (int i = block->first; i < block->first + block->count; i++) {
+            IrInsn* insn = &func->insns[i];
+            int uses[2];
+            int num_uses = ir_uses(insn, uses);
+            for (int u = 0; u < num_uses; u++) {
+                int v = uses[u];
+                if (!(block_kill[v / 32] & (1u << (v % 32)))) block_gen[v / 32] |= 1u << (v % 32);
+            }
+            if (insn->dst >= 0) block_kill[insn->dst / 32] |= 1u << (insn->dst % 32);
+        }
+    }
+
+    int changed = 1;
+    while (changed) {
+        changed = 0;
+        for (int b = n - 1; b >= 0; b--) {
+            IrBlock* block = &func->blocks[b];
+            unsigned int* out = live_out + (size_t)b * words;
+            unsigned int* in = live_in + (size_t)b * words;
+            for (int s = 0; s < 2; s++) {
+                if (block->succ[s] < 0) continue;
+                unsigned int* succ_in = live_in + (size_t)block->succ[s] * words;
+                for (int w = 0; w < words; w++) out[w] |= succ_in[w];
+            }
+            unsigned int* block_gen = gen + (size_t)b * words;
+            unsigned int* block_kill = kill + (size_t)b * words;
+            for (int w = 0; w < words; w++) {
+                unsigned int value = block_gen[w] | (out[w] & ~block_kill[w]);
+                if (value != in[w]) {
+                    in[w] = value;
+                    changed = 1;
+                }
+            }
+        }
+    }
+
+    free(gen);
+    free(kill);
+}
+
+// --- Live ranges ---
+
+// Helper function to extend a range over a position
+static void touch(LiveRange* range, int position) {
+    if (range->start < 0 || position < range->start) range->start = position;
+    if (position > range->end) range->end = position;
+}
+
+// Build one range per vreg from block liveness, then mark the registers
+// clobbered strictly inside each range
+static void build_ranges(IrFunction* func, LiveRange* ranges, unsigned int* used_regs) {
+    int words = (func->num_vregs + 31) / 32;
+    unsigned int* live_in = checked_calloc((size_t)func->num_blocks * words, sizeof(unsigned int));
+    unsigned int* live_out = checked_calloc((size_t)func->num_blocks * words, sizeof(unsigned int));
+    compute_liveness(func, live_in, live_out, words);
+
+    for (int v = 0; v < func->num_vregs; v++) {
+        LiveRange* range = &ranges[v];
+        range->start = range->end = -1;
+        range->weight = 0;
+        range->forbidden = 0;
+        range->hint = -1;
+        range->prefer = -1;
+        range->reg = -1;
+    }
+
+    // Prefix counts of clobbers per register answer "clobbered in [start, end)"
+    int num_positions = 2 * func->num_insns + 1;
+    int* counts = checked_calloc((size_t)NUM_REGS * (num_positions + 1), sizeof(int));
+    *used_regs = 0;
+
+    for (int b = 0; b < func->num_blocks; b++) {
+        IrBlock* block = &func->blocks[b];
+        int weight = loop_weight(block->loop_depth);
+        int last = block->first + block->count - 1;
+        for (int w = 0; w < words; w++) {
+            for (unsigned int bits = live_in[(size_t)b * words + w]; bits; bits &= bits - 1) {
+                touch(&ranges[w * 32 + __builtin_ctz(bits)], 2 * block->first);
+            }
+            for (unsigned int bits = live_out[(size_t)b * words + w]; bits; bits &= bits - 1) {
+                touch(&ranges[w * 32 + __builtin_ctz(bits)], 2 * last + 1);
+            }
+        }
+
+        for (int i = block->first; i <= last; i++) {
+            IrInsn* insn = &func->insns[i];
+            int uses[2];
+            int num_uses = ir_uses(insn, uses);
+            for (int u = 0; u < num_uses; u++) {
+                LiveRange* range = &ranges[uses[u]];
+                touch(range, 2 * i);
+                range->weight += weight;
+                range->forbidden |= operand_constraints(insn, uses[u]);
+            }
+
+            // Register arguments are moved into place by the call, so their
+            // values must survive until it
+            if (insn->op == IR_ARG && (insn->flags & IR_B_IMM) && num_uses > 0) {
+                int call = i;
+                while (call < last && func->insns[call].op != IR_CALL) call++;
+                touch(&ranges[uses[0]], 2 * call);
+            }
+
+            // A register parameter holds its value from entry until read here;
+            // the parameters before it must not land in that register
+            if (insn->op == IR_PARAM && insn->a < func->num_reg_params) {
+                int reg = arg_regs[insn->a];
+                for (int j = block->first; j < i; j++) {
+                    if (func->insns[j].dst >= 0) ranges[func->insns[j].dst].forbidden |= REG_BIT(reg);
+                }
+                ranges[insn->dst].prefer = reg;
+            }
+            if (insn->dst >= 0) {
+                LiveRange* range = &ranges[insn->dst];
+                touch(range, 2 * i + 1);
+                range->weight += weight;
+
+                // Two-address forms are cheapest when the result reuses an operand
+                int commutative = insn->op == IR_ADD || insn->op == IR_MUL || insn->op == IR_AND;
+                int by_constant = (insn->op == IR_DIV || insn->op == IR_MOD) && (insn->flags & IR_B_IMM);
+                int result_reg = by_constant ? div_const_result_reg(insn->b, insn->op == IR_MOD) : -1;
+                if (by_constant && result_reg >= 0) {
+                    range->prefer = result_reg;
+                } else if (insn->op == IR_COPY || insn->op == IR_SUB || commutative || by_constant) {
+                    if (num_uses > 0 && range->hint < 0) range->hint = uses[0];
+                } else if (insn->op == IR_CALL || insn->op == IR_DIV || insn->op == IR_ALLOC) {
+                    range->prefer = REG_EAX;
+                } else if (insn->op == IR_MOD) {
+                    range->prefer = REG_EDX;
+                } else if (insn->op == IR_SET) {
+                    range->forbidden |= REG_BIT(REG_ESI) | REG_BIT(REG_EDI);  // setcc writes a byte register
+                }
+            }
+            if (insn->op == IR_RET && num_uses > 0) ranges[uses[0]].prefer = REG_EAX;
+
+            unsigned int clobbers = ir_clobbers(insn);
+            *used_regs |= clobbers;
+            for (int r = 0; r < NUM_REGS; r++) {
+                if (clobbers & REG_BIT(r)) counts[r * (num_positions + 1) + 2 * i + 1]++;
+            }
+        }
+    }
+
+    for (int r = 0; r < NUM_REGS; r++) {
+        int* row = counts + r * (num_positions + 1);
+        for (int p = 1; p <= num_positions; p++) row[p] += row[p - 1];
+    }
+    for (int v = 0; v < func->num_vregs; v++) {
+        LiveRange* range = &ranges[v];
+        if (range->start < 0) continue;
+        for (int r = 0; r < NUM_REGS; r++) {
+            int* row = counts + r * (num_positions + 1);
+            if (row[range->end] - row[range->start] > 0) range->forbidden |= REG_BIT(r);
+        }
+        if (func->vreg_flags[v] & VREG_SPILL) {
+            range->weight = SPILL_TEMP_WEIGHT;
+        } else if (func->vreg_flags[v] & VREG_HINT) {
+            range->weight = range->weight * REG_HINT_BOOST + REG_HINT_BOOST;
+        }
+    }
+
+    free(counts);
+    free(live_in);
+    free(live_out);
+}
+
+// --- Linear scan ---
+
+// Helper function to order vregs by range start for the scan; keys hold the
+// start above the vreg, so ties go to the lower vreg
+static int compare_start(const void* a, const void* b) {
+    unsigned long long x = *(const unsigned long long*)a, y = *(const unsigned long long*)b;
+    return x < y ? -1 : x > y;
+}
+
+// Free registers are tried caller-saved first, which need no save in the prologue
+static const int pick_order[NUM_REGS] = {REG_ECX, REG_EDX, REG_EAX, REG_ESI, REG_EDI, REG_EBX};
+
+// Assign registers in order of range start; a range may not take a register
+// clobbered inside it. When none is free, the cheapest range competing for
+// an allowed register is spilled. Returns how many ranges were spilled.
+static int linear_scan(LiveRange* ranges, int num_ranges, unsigned int available) {
+    int* order = checked_calloc(num_ranges, sizeof(int));
+    int* active = checked_calloc(num_ranges, sizeof(int));
+    int num_order = 0, num_active = 0, num_spilled = 0;
+    unsigned long long* keys = checked_calloc(num_ranges, sizeof(unsigned long long));
+    for (int v = 0; v < num_ranges; v++) {
+        if (ranges[v].start >= 0) keys[num_order++] = (unsigned long long)ranges[v].start << 32 | (unsigned int)v;
+    }
+    qsort(keys, num_order, sizeof(unsigned long long), compare_start);
+    for (int i = 0; i < num_order; i++) order[i] = (int)(keys[i] & 0xFFFFFFFFu);
+    free(keys);
+
+    for (int i = 0; i < num_order; i++) {
+        LiveRange* range = &ranges[order[i]];
+
+        // Expire ranges that ended before this one starts
+        int kept = 0;
+        unsigned int busy = 0;
+        for (int j = 0; j < num_active; j++) {
+            if (ranges[active[j]].end >= range->start) {
+                active[kept++] = active[j];
+                busy |= REG_BIT(ranges[active[j]].reg);
+            }
+        }
+        num_active = kept;
+
+        unsigned int allowed = available & ~range->forbidden;
+        unsigned int free_regs = allowed & ~busy;
+        int hinted = range->hint >= 0 ? ranges[range->hint].reg : -1;
+        if (hinted >= 0 && (free_regs & REG_BIT(hinted))) {
+            range->reg = hinted;
+        } else if (range->prefer >= 0 && (free_regs & REG_BIT(range->prefer))) {
+            range->reg = range->prefer;
+        } else if (free_regs) {
+            for (int j = 0; j < NUM_REGS; j++) {
+                if (free_regs & REG_BIT(pick_order[j])) {
+                    range->reg = pick_order[j];
+                    break;
+                }
+            }
+        } else {
+            // Spill whichever of the competitors is cheapest
+            int victim = -1;
+            for (int j = 0; j < num_active; j++) {
+                LiveRange* other = &ranges[active[j]];
+                if ((allowed & REG_BIT(other->reg)) &&
+                    (victim < 0 || other->weight < ranges[active[victim]].weight)) {
+                    victim = j;
+                }
+            }
+            if (victim >= 0 && ranges[active[victim]].weight < range->weight) {
+                range->reg = ranges[active[victim]].reg;
+                ranges[active[victim]].reg = -1;
+                active[victim] = active[--num_active];
+            }
+            num_spilled++;
+        }
+
+        if (range->reg >= 0) active[num_active++] = order[i];
+    }
+
+    free(order);
+    free(active);
+    return num_spilled;
+}
+
+// --- Spilling ---
+
+// Helper function to add a reload or spill temporary; the vreg arrays were
+// sized for the worst case by rewrite_spills()
+static int spill_temp(IrFunction* func) {
+    func->vreg_names[func->num_vregs] = NULL;
+    func->vreg_flags[func->num_vregs] = VREG_SPILL;
+    return func->num_vregs++;
+}
+
+// Helper function to check whether an instruction always defines a value
+// from 0 to 255
+static int defines_byte(const IrInsn* insn) {
+    switch (insn->op) {
+        case IR_CONST: return insn->a >= 0 && insn->a <= 0xFF;
+        case IR_AND:
+            return ((insn->flags & IR_A_IMM) && insn->a >= 0 && insn->a <= 0xFF) ||
+                   ((insn->flags & IR_B_IMM) && insn->b >= 0 && insn->b <= 0xFF);
+        case IR_SET: return 1;
+        case IR_LOAD:
+        case IR_RELOAD: return insn->size == 1;
+        default: return 0;
+    }
+}
+
+// Rewrite every spilled vreg to live in a stack slot: reload it into a fresh
+// temporary before each use and store a fresh temporary after each definition.
+// Spilled parameters keep living in their incoming argument slot, and vregs
+// whose every definition fits in a byte get a byte slot.
+static void rewrite_spills(IrFunction* func, LiveRange* ranges, int* slot_of, int* num_slots,
+                           Arena* arena) {
+    int old_vregs = func->num_vregs;
+    unsigned char* is_byte = checked_calloc(old_vregs, 1);
+    memset(is_byte, 1, old_vregs);
+    for (int i = 0; i < func->num_insns; i++) {
+        IrInsn* insn = &func->insns[i];
+        if (insn->dst >= 0 && !defines_byte(insn)) is_byte[insn->dst] = 0;
+    }
+    for (int v = 0; v < old_vregs; v++) {
+        if (ranges[v].start < 0 || ranges[v].reg >= 0 || slot_of[v] != NO_SLOT) continue;
+        slot_of[v] = (*num_slots)++;
+    }
+
+    // Each instruction gains at most two reloads and one spill
+    int capacity = old_vregs + 3 * func->num_insns + 1;
+    const char** names = arena_alloc(arena, capacity * sizeof(const char*));
+    unsigned char* flags = arena_alloc(arena, capacity);
+    memcpy(names, func->vreg_names, old_vregs * sizeof(const char*));
+    memcpy(flags, func->vreg_flags, old_vregs);
+    func->vreg_names = names;
+    func->vreg_flags = flags;
+    IrInsn* insns = arena_alloc(arena, (4 * func->num_insns + 1) * sizeof(IrInsn));
+    int count = 0;
+    for (int b = 0; b < func->num_blocks; b++) {
+        IrBlock* block = &func->blocks[b];
+        int first = count;
+        for (int i = block->first; i < block->first + block->count; i++) {
+            IrInsn insn = func->insns[i];
+            int spilled_dst = insn.dst >= 0 && insn.dst < old_vregs && ranges[insn.dst].reg < 0 &&
+                              ranges[insn.dst].start >= 0;
+
+            // The argument already sits in its slot
+            if (insn.op == IR_PARAM && spilled_dst && slot_of[insn.dst] == PARAM_SLOT(insn.a)) continue;
+
+            int reloaded[2] = {-1, -1};
+            for (int k = 0; k < 2; k++) {
+                int* operand = k == 0 ? &insn.a : &insn.b;
+                int is_vreg = *operand >= 0 && !(insn.flags & (k == 0 ? IR_A_IMM : IR_B_IMM));
+                if (!is_vreg || ranges[*operand].reg >= 0) continue;
+                if (k == 1 && insn.b == insn.a && reloaded[0] >= 0) {
+                    *operand = reloaded[0];
+                    continue;
+                }
+                int original = *operand;
+                int t = spill_temp(func);
+                int size = slot_of[original] >= 0 && is_byte[original] ? 1 : 4;
+                IrInsn reload = {IR_RELOAD, size, IR_B_IMM, IR_NE, t, -1, slot_of[original]};
+                insns[count++] = reload;
+                *operand = t;
+                reloaded[k] = t;
+            }
+            if (spilled_dst) {
+                int original = insn.dst;
+                insn.dst = spill_temp(func);
+                insns[count++] = insn;
+                int size = slot_of[original] >= 0 && is_byte[original] ? 1 : 4;
+                IrInsn spill = {IR_SPILL, size, IR_B_IMM, IR_NE, -1, insn.dst, slot_of[original]};
+                insns[count++] = spill;
+            } else {
+                insns[count++] = insn;
+            }
+        }
+        block->first = first;
+        block->count = count - first;
+    }
+    func->insns = insns;
+    func->num_insns = count;
+    free(is_byte);
+}
+
+// --- Stack slots ---
+
+// Helper function to find the slots live out of every block, as bitsets of
+// 'words' words per block: reloads read a slot and spills write it
+static void slot_liveness(IrFunction* func, unsigned int* live_in, unsigned int* live_out, int words) {
+    int n = func->num_blocks;
+    unsigned int* gen = checked_calloc((size_t)n * words, sizeof(unsigned int));
+    unsigned int* kill = checked_calloc((size_t)n * words, sizeof(unsigned int));
+    for (int b = 0; b < n; b++) {
+        IrBlock* block = &func->blocks[b];
+        unsigned int* block_gen = gen + (size_t)b * words;
+        unsigned int* block_kill = kill + (size_t)b * words;
+        for (int i = block->first; i < block->first + block->count; i++) {
+            IrInsn* insn = &func->insns[i];
+            int s = insn->b;
+            if ((insn->op != IR_SPILL && insn->op != IR_RELOAD) || s < 0) continue;
+            if (insn->op == IR_SPILL) {
+                block_kill[s / 32] |= 1u << (s % 32);
+            } else if (!(block_kill[s / 32] & (1u << (s % 32)))) {
+                block_gen[s / 32] |= 1u << (s % 32);
+            }
+        }
+    }
+
+    int changed = 1;
+    while (changed) {
+        changed = 0;
+        for (int b = n - 1; b >= 0; b--) {
+            IrBlock* block = &func->blocks[b];
+            unsigned int* out = live_out + (size_t)b * words;
+            unsigned int* in = live_in + (size_t)b * words;
+            for (int s = 0; s < 2; s++) {
+                if (block->succ[s] < 0) continue;
+                unsigned int* succ_in = live_in + (size_t)block->succ[s] * words;
+                for (int w = 0; w < words; w++) out[w] |= succ_in[w];
+            }
+            unsigned int* block_gen = gen + (size_t)b * words;
+            unsigned int* block_kill = kill + (size_t)b * words;
+            for (int w = 0; w < words; w++) {
+                unsigned int value = block_gen[w] | (out[w] & ~block_kill[w]);
+                if (value != in[w]) {
+                    in[w] = value;
+                    changed = 1;
+                }
+            }
+        }
+    }
+
+    free(gen);
+    free(kill);
+}
+
+// Helper function to record that two slots are live at the same time
+static void interfere(unsigned int* matrix, int words, int s, int t) {
+    matrix[(size_t)s * words + t / 32] |= 1u << (t % 32);
+    matrix[(size_t)t * words + s / 32] |= 1u << (s % 32);
+}
+
+// Lay out the spill slots: slots never live at the same time share memory
+// (greedy colouring of the interference graph, one per slot size), then the
+// 4-byte slots come first and the byte slots are packed after them. Rewrites
+// slot numbers to byte offsets and returns the size of the area.
+static int layout_slots(IrFunction* func, int num_slots) {
+    if (num_slots == 0) return 0;
+    int words = (num_slots + 31) / 32;
+    int n = func->num_blocks;
+    unsigned int* live_in = checked_calloc((size_t)n * words, sizeof(unsigned int));
+    unsigned int* live_out = checked_calloc((size_t)n * words, sizeof(unsigned int));
+    unsigned int* matrix = checked_calloc((size_t)num_slots * words, sizeof(unsigned int));
+    unsigned char* size = checked_calloc(num_slots, 1);
+    slot_liveness(func, live_in, live_out, words);
+
+    // A slot interferes with every slot live where it is written; one live
+    // into the entry, read before any write, keeps its own memory
+    unsigned int* live = checked_calloc(words, sizeof(unsigned int));
+    for (int b = 0; b < n; b++) {
+        IrBlock* block = &func->blocks[b];
+        memcpy(live, live_out + (size_t)b * words, words * sizeof(unsigned int));
+        for (int i = block->first + block->count - 1; i >= block->first; i--) {
+            IrInsn* insn = &func->insns[i];
+            int s = insn->b;
+            if ((insn->op != IR_SPILL && insn->op != IR_RELOAD) || s < 0) continue;
+            size[s] = insn->size;
+            if (insn->op == IR_RELOAD) {
+                live[s / 32] |= 1u << (s % 32);
+                continue;
+            }
+            for (int t = 0; t < num_slots; t++) {
+                if (t != s && (live[t / 32] & (1u << (t % 32)))) interfere(matrix, words, s, t);
+            }
+            live[s / 32] &= ~(1u << (s % 32));
+        }
+    }
+    for (int s = 0; s < num_slots; s++) {
+        if (!(live_in[s / 32] & (1u << (s % 32)))) continue;
+        for (int t = 0; t < num_slots; t++) {
+            if (t != s) interfere(matrix, words, s, t);
+        }
+    }
+
+    // Lowest colour free among the neighbours of the same size
+    int* colour = checked_calloc(num_slots, sizeof(int));
+    unsigned char* taken = checked_calloc(num_slots, 1);
+    int num_colours[2] = {0, 0};
+    for (int s = 0; s < num_slots; s++) {
+        int byte = size[s] == 1;
+        memset(taken, 0, num_slots);
+        for (int t = 0; t < s; t++) {
+            if ((size[t] == 1) == byte && (matrix[(size_t)s * words + t / 32] & (1u << (t % 32)))) {
+                taken[colour[t]] = 1;
+            }
+        }
+        int c = 0;
+        while (taken[c]) c++;
+        colour[s] = c;
+        if (c + 1 > num_colours[byte]) num_colours[byte] = c + 1;
+    }
+
+    for (int i = 0; i < func->num_insns; i++) {
+        IrInsn* insn = &func->insns[i];
+        if ((insn->op != IR_SPILL && insn->op != IR_RELOAD) || insn->b < 0) continue;
+        int s = insn->b;
+        insn->b = size[s] == 1 ? 4 * num_colours[0] + colour[s] : 4 * colour[s];
+    }
+    int bytes = (4 * num_colours[0] + num_colours[1] + 3) & ~3;
+
+    free(live_in);
+    free(live_out);
+    free(matrix);
+    free(size);
+    free(live);
+    free(colour);
+    free(taken);
+    return bytes;
+}
+
+int allocate_registers(IrFunction* func, unsigned int available, Allocation* alloc, Arena* arena) {
+    int num_slots = 0;
+    int* slot_of = NULL;
+    int slots_known = 0;
+    LiveRange* ranges = NULL;
+
+    for (int round = 0; ; round++) {
+        ranges = realloc(ranges, (func->num_vregs + 1) * sizeof(LiveRange));
+        if (!ranges) {
+            fprintf(stderr, "Error: Out of memory\n");
+            exit(1);
+        }
+        build_ranges(func, ranges, &alloc->used_regs);
+        if (linear_scan(ranges, func->num_vregs, available) == 0) break;
+        if (round == MAX_ROUNDS) {
+            fprintf(stderr, "Error: Register allocation failed in %s\n", func->name);
+            free(ranges);
+            free(slot_of);
+            return 1;
+        }
+
+        // Slots for the vregs spilled this round; stack parameters use their argument
+        slot_of = realloc(slot_of, (func->num_vregs + 1) * sizeof(int));
+        if (!slot_of) {
+            fprintf(stderr, "Error: Out of memory\n");
+            exit(1);
+        }
+        for (int v = slots_known; v < func->num_vregs; v++) slot_of[v] = NO_SLOT;
+        slots_known = func->num_vregs;
+        for (int i = 0; i < func->num_insns; i++) {
+            IrInsn* insn = &func->insns[i];
+            if (insn->op == IR_PARAM && insn->a >= func->num_reg_params &&
+                ranges[insn->dst].reg < 0 && slot_of[insn->dst] == NO_SLOT) {
+                slot_of[insn->dst] = PARAM_SLOT(insn->a);
+            }
+        }
+        rewrite_spills(func, ranges, slot_of, &num_slots, arena);
+    }
+
+    alloc->num_ranges = func->num_vregs;
+    alloc->ranges = arena_alloc(arena, (func->num_vregs + 1) * sizeof(LiveRange));
+    memcpy(alloc->ranges, ranges, func->num_vregs * sizeof(LiveRange));
+    for (int v = 0; v < func->num_vregs; v++) {
+        if (ranges[v].reg >= 0) alloc->used_regs |= REG_BIT(ranges[v].reg);
+    }
+    free(ranges);
+    free(slot_of);
+    alloc->frame_bytes = layout_slots(func, num_slots);
+    return 0;
+}
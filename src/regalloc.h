@@ -0,0 +1,52 @@
+// regalloc.h
+#ifndef REGALLOC_H
+#define REGALLOC_H
+
+#include "arena.h"
+#include "ir.h"
+#include "insn.h"
+
+#define REG_BIT(r) (1u << (r))
+#define ALL_REGS ((1u << NUM_REGS) - 1)
+#define CALLEE_SAVED (REG_BIT(REG_EBX) | REG_BIT(REG_ESI) | REG_BIT(REG_EDI))
+
+// Live range of one vreg over instruction positions: instruction i reads its
+// operands at 2i and writes its result at 2i + 1
+typedef struct {
+    int start;                // -1 if the vreg is never defined or used
+    int end;
+    int weight;               // Spill cost: uses weighted by loop depth, boosted for 'reg'
+    unsigned int forbidden;   // Registers clobbered inside the range or unfit for its uses
+    int hint;                 // Vreg whose register this one would like to share, or -1
+    int prefer;               // Register fixed instructions would like, or -1
+    int reg;                  // Assigned register, or -1 if spilled
+} LiveRange;
+
+typedef struct {
+    LiveRange* ranges;        // Indexed by vreg
+    int num_ranges;
+    int frame_bytes;          // Size of the spill slots, a multiple of 4
+    unsigned int used_regs;   // Registers written by fixed instructions or assigned to a range
+} Allocation;
+
+// Stack slot b < 0 of IR_SPILL / IR_RELOAD is the incoming argument -b - 1.
+// After allocation, b >= 0 is the byte offset of the slot among the spill
+// slots and 'size' is 1 for byte slots, 4 otherwise.
+#define PARAM_SLOT(i) (-(i) - 1)
+
+// Registers of the leading fastcall arguments
+extern const int arg_regs[NUM_ARG_REGS];
+
+// Registers an instruction overwrites regardless of allocation
+unsigned int ir_clobbers(const IrInsn* insn);
+int loop_weight(int depth);
+
+// Assign registers to the vregs of a function (Poletto & Sarkar linear scan).
+// Vregs that lose are rewritten to short-lived reloads and spills around each
+// use and definition, and the scan repeats until everything fits. Spilled
+// vregs that only ever hold a byte get byte slots, and slots that are never
+// live at the same time share their memory. Returns nonzero after reporting
+// a function that still does not fit after several scans.
+int allocate_registers(IrFunction* func, unsigned int available, Allocation* alloc, Arena* arena);
+
+#endif
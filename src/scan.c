@@ -0,0 +1,208 @@
+#include <stdio.h>
+#include <string.h>
+#include "scan.h"
+#include "lexer.h"
+#include "lexer_tables.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define HAVE_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+// --- Scalar fallback ---
+
+static const char* scalar_skip_space(const char* src, const char* end, int* line,
+                                     const char** line_start) {
+    while (src < end && (char_class[(unsigned char)*src] & CC_SPACE)) {
+        if (*src == '\n') {
+            (*line)++;
+            *line_start = src + 1;
+        }
+        src++;
+    }
+    return src;
+}
+
+static const char* scalar_skip_line(const char* src, const char* end) {
+    while (src < end && *src != '\n') src++;
+    return src;
+}
+
+static const char* scalar_skip_ident(const char* src, const char* end) {
+    while (src < end && (char_class[(unsigned char)*src] & CC_IDENT_PART)) src++;
+    return src;
+}
+
+static const Scanner scalar_scanner = {
+    "scalar", scalar_skip_space, scalar_skip_line, scalar_skip_ident
+};
+
+#ifdef HAVE_X86_SIMD
+
+// Byte classes are computed with signed compares after biasing, since SSE2 and
+// AVX2 have no unsigned byte compare: (x + 128 - lo) < (-128 + n) holds exactly
+// for lo <= x < lo + n.
+
+// Helper function to account for the newlines in the bits of 'newlines'
+static inline void count_lines(const char* chunk, unsigned int newlines, int* line,
+                               const char** line_start) {
+    if (newlines) {
+        *line += __builtin_popcount(newlines);
+        *line_start = chunk + (31 - __builtin_clz(newlines)) + 1;
+    }
+}
+
+// --- SSE2, 16 bytes per step ---
+
+__attribute__((target("sse2")))
+static inline __m128i sse2_in_range(__m128i v, char lo, char n) {
+    __m128i biased = _mm_add_epi8(v, _mm_set1_epi8((char)(128 - lo)));
+    return _mm_cmplt_epi8(biased, _mm_set1_epi8((char)(-128 + n)));
+}
+
+__attribute__((target("sse2")))
+static inline unsigned int sse2_space_mask(__m128i v) {
+    __m128i space = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')),
+                                 sse2_in_range(v, '\t', 5));  // \t \n \v \f \r
+    return _mm_movemask_epi8(space);
+}
+
+__attribute__((target("sse2")))
+static inline unsigned int sse2_ident_mask(__m128i v) {
+    __m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+    __m128i ident = _mm_or_si128(sse2_in_range(lower, 'a', 26), sse2_in_range(v, '0', 10));
+    ident = _mm_or_si128(ident, _mm_cmpeq_epi8(v, _mm_set1_epi8('_')));
+    return _mm_movemask_epi8(ident);
+}
+
+__attribute__((target("sse2")))
+static const char* sse2_skip_space(const char* src, const char* end, int* line,
+                                   const char** line_start) {
+    while (end - src >= 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)src);
+        unsigned int space = sse2_space_mask(v);
+        unsigned int newlines = _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')));
+        if (space != 0xFFFF) {
+            int stop = __builtin_ctz(~space);
+            count_lines(src, newlines & ((1u << stop) - 1), line, line_start);
+            return src + stop;
+        }
+        count_lines(src, newlines, line, line_start);
+        src += 16;
+    }
+    return scalar_skip_space(src, end, line, line_start);
+}
+
+__attribute__((target("sse2")))
+static const char* sse2_skip_line(const char* src, const char* end) {
+    while (end - src >= 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)src);
+        unsigned int newlines = _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')));
+        if (newlines) return src + __builtin_ctz(newlines);
+        src += 16;
+    }
+    return scalar_skip_line(src, end);
+}
+
+__attribute__((target("sse2")))
+static const char* sse2_skip_ident(const char* src, const char* end) {
+    while (end - src >= 16) {
+        unsigned int ident = sse2_ident_mask(_mm_loadu_si128((const __m128i*)src));
+        if (ident != 0xFFFF) return src + __builtin_ctz(~ident);
+        src += 16;
+    }
+    return scalar_skip_ident(src, end);
+}
+
+static const Scanner sse2_scanner = {
+    "sse2", sse2_skip_space, sse2_skip_line, sse2_skip_ident
+};
+
+// --- AVX2, 32 bytes per step ---
+
+__attribute__((target("avx2")))
+static inline __m256i avx2_in_range(__m256i v, char lo, char n) {
+    __m256i biased = _mm256_add_epi8(v, _mm256_set1_epi8((char)(128 - lo)));
+    return _mm256_cmpgt_epi8(_mm256_set1_epi8((char)(-128 + n)), biased);
+}
+
+__attribute__((target("avx2")))
+static inline unsigned int avx2_space_mask(__m256i v) {
+    __m256i space = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')),
+                                    avx2_in_range(v, '\t', 5));
+    return _mm256_movemask_epi8(space);
+}
+
+__attribute__((target("avx2")))
+static inline unsigned int avx2_ident_mask(__m256i v) {
+    __m256i lower = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+    __m256i ident = _mm256_or_si256(avx2_in_range(lower, 'a', 26), avx2_in_range(v, '0', 10));
+    ident = _mm256_or_si256(ident, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('_')));
+    return _mm256_movemask_epi8(ident);
+}
+
+__attribute__((target("avx2")))
+static const char* avx2_skip_space(const char* src, const char* end, int* line,
+                                   const char** line_start) {
+    while (end - src >= 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)src);
+        unsigned int space = avx2_space_mask(v);
+        unsigned int newlines = _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')));
+        if (space != 0xFFFFFFFFu) {
+            int stop = __builtin_ctz(~space);
+            count_lines(src, newlines & ((1u << stop) - 1), line, line_start);
+            return src + stop;
+        }
+        count_lines(src, newlines, line, line_start);
+        src += 32;
+    }
+    return sse2_skip_space(src, end, line, line_start);
+}
+
+__attribute__((target("avx2")))
+static const char* avx2_skip_line(const char* src, const char* end) {
+    while (end - src >= 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)src);
+        unsigned int newlines = _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')));
+        if (newlines) return src + __builtin_ctz(newlines);
+        src += 32;
+    }
+    return sse2_skip_line(src, end);
+}
+
+__attribute__((target("avx2")))
+static const char* avx2_skip_ident(const char* src, const char* end) {
+    while (end - src >= 32) {
+        unsigned int ident = avx2_ident_mask(_mm256_loadu_si256((const __m256i*)src));
+        if (ident != 0xFFFFFFFFu) return src + __builtin_ctz(~ident);
+        src += 32;
+    }
+    return sse2_skip_ident(src, end);
+}
+
+static const Scanner avx2_scanner = {
+    "avx2", avx2_skip_space, avx2_skip_line, avx2_skip_ident
+};
+
+#endif
+
+// Pick the widest scanner the running CPU supports
+const Scanner* scanner_best(void) {
+#ifdef HAVE_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return &avx2_scanner;
+    if (__builtin_cpu_supports("sse2")) return &sse2_scanner;
+#endif
+    return &scalar_scanner;
+}
+
+// Look up a scanner by name; NULL if unknown or unsupported on this CPU
+const Scanner* scanner_by_name(const char* name) {
+    if (strcmp(name, "scalar") == 0) return &scalar_scanner;
+#ifdef HAVE_X86_SIMD
+    __builtin_cpu_init();
+    if (strcmp(name, "sse2") == 0 && __builtin_cpu_supports("sse2")) return &sse2_scanner;
+    if (strcmp(name, "avx2") == 0 && __builtin_cpu_supports("avx2")) return &avx2_scanner;
+#endif
+    return NULL;
+}
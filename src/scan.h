@@ -0,0 +1,24 @@
+// scan.h
+#ifndef SCAN_H
+#define SCAN_H
+
+// Bulk byte scanners used by the lexer. Every routine stops at 'end' and never
+// reads past it, so they are safe on a memory-mapped file without padding.
+typedef struct {
+    const char* name;
+
+    // Skip whitespace, adding the newlines crossed to *line and moving
+    // *line_start to the byte after the last one
+    const char* (*skip_space)(const char* src, const char* end, int* line, const char** line_start);
+
+    // Skip to the next '\n' (or 'end'), used for comment bodies
+    const char* (*skip_line)(const char* src, const char* end);
+
+    // Skip [A-Za-z0-9_], the tail of identifiers and numbers
+    const char* (*skip_ident)(const char* src, const char* end);
+} Scanner;
+
+const Scanner* scanner_best(void);
+const Scanner* scanner_by_name(const char* name);
+
+#endif
@@ -0,0 +1,219 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include "server.h"
+
+// --- Framing ---
+
+// Helper function to read exactly 'length' bytes; -1 on end of input or error
+static int read_full(int fd, void* buffer, size_t length) {
+    char* data = buffer;
+    while (length > 0) {
+        ssize_t n = read(fd, data, length);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        data += n;
+        length -= n;
+    }
+    return 0;
+}
+
+static int write_full(int fd, const void* buffer, size_t length) {
+    const char* data = buffer;
+    while (length > 0) {
+        ssize_t n = write(fd, data, length);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        data += n;
+        length -= n;
+    }
+    return 0;
+}
+
+static int read_u32(int fd, unsigned int* value) {
+    unsigned char bytes[4];
+    if (read_full(fd, bytes, 4) != 0) return -1;
+    *value = bytes[0] | bytes[1] << 8 | bytes[2] << 16 | (unsigned int)bytes[3] << 24;
+    return 0;
+}
+
+// Helper function to write a length-prefixed string
+static int write_string(int fd, const char* data, size_t length) {
+    unsigned char bytes[4] = {length & 0xFF, length >> 8 & 0xFF, length >> 16 & 0xFF, length >> 24 & 0xFF};
+    if (write_full(fd, bytes, 4) != 0) return -1;
+    return write_full(fd, data, length);
+}
+
+// Helper function to read a length-prefixed string into a NUL-terminated
+// buffer; NULL on end of input, error or an oversized message
+static char* read_string(int fd, unsigned int* length) {
+    if (read_u32(fd, length) != 0 || *length > SERVER_MAX_MESSAGE) return NULL;
+    char* data = malloc(*length + 1);
+    if (!data) {
+        fprintf(stderr, "Error: Out of memory\n");
+        exit(1);
+    }
+    if (read_full(fd, data, *length) != 0) {
+        free(data);
+        return NULL;
+    }
+    data[*length] = '\0';
+    return data;
+}
+
+// Helper function to read back everything written to a temporary file
+static char* read_back(FILE* file, size_t* length) {
+    fflush(file);
+    int fd = fileno(file);
+    struct stat st;
+    if (fstat(fd, &st) != 0 || lseek(fd, 0, SEEK_SET) != 0) st.st_size = 0;
+    char* data = malloc(st.st_size + 1);
+    if (!data) {
+        fprintf(stderr, "Error: Out of memory\n");
+        exit(1);
+    }
+    *length = read_full(fd, data, st.st_size) == 0 ? (size_t)st.st_size : 0;
+    return data;
+}
+
+// --- Requests ---
+
+// Compile a request's source in this process, so every request after the
+// first finds the compiler's arena and name table already grown; each
+// compilation resets them for the next, and a bad source or option comes
+// back as an error status. Diagnostics are whatever the
+// compiler writes to stdout or stderr meanwhile.
+static int compile_request(Compiler* compiler, const CompileOptions* defaults, char* flags,
+                           const char* source, size_t length, FILE* output, FILE* diagnostics) {
+    fflush(stdout);
+    fflush(stderr);
+    int saved_stdout = dup(STDOUT_FILENO);
+    int saved_stderr = dup(STDERR_FILENO);
+    if (saved_stdout < 0 || saved_stderr < 0) {
+        fprintf(diagnostics, "Error: Cannot redirect diagnostics: %s\n", strerror(errno));
+        if (saved_stdout >= 0) close(saved_stdout);
+        if (saved_stderr >= 0) close(saved_stderr);
+        return 1;
+    }
+    dup2(fileno(diagnostics), STDOUT_FILENO);
+    dup2(fileno(diagnostics), STDERR_FILENO);
+
+    CompileOptions options = *defaults;
+    int failed = 0;
+    for (char* flag = strtok(flags, " \t\n"); flag && !failed; flag = strtok(NULL, " \t\n")) {
+        int applied = compile_option(&options, flag);
+        if (applied == 0) fprintf(stderr, "Error: Unknown option %s\n", flag);
+        failed = applied <= 0;
+    }
+    if (!failed) {
+        failed = compile_source(compiler, &options, source, length, output);
+        if (options.trace_path && trace_write(&compiler->tracer, options.trace_path) != 0) {
+            fprintf(stderr, "Error: Cannot write %s\n", options.trace_path);
+            failed = 1;
+        }
+        // A long-lived server keeps only one request's spans at a time
+        trace_clear_events(&compiler->tracer);
+    }
+
+    fflush(stdout);
+    fflush(stderr);
+    dup2(saved_stdout, STDOUT_FILENO);
+    dup2(saved_stderr, STDERR_FILENO);
+    close(saved_stdout);
+    close(saved_stderr);
+    return failed ? 1 : 0;
+}
+
+// Answer requests until the client is done; returns -1 if it broke off
+// mid-request or could not be written to
+static int serve_stream(Compiler* compiler, const CompileOptions* options, int in, int out) {
+    for (;;) {
+        unsigned int flags_length, source_length;
+        char* flags = read_string(in, &flags_length);
+        if (!flags) return 0;
+        char* source = read_string(in, &source_length);
+        if (!source) {
+            fprintf(stderr, "Error: Request cut short or larger than %u bytes\n", SERVER_MAX_MESSAGE);
+            free(flags);
+            return -1;
+        }
+
+        FILE* output = tmpfile();
+        FILE* diagnostics = tmpfile();
+        if (!output || !diagnostics) {
+            fprintf(stderr, "Error: Cannot create temporary files\n");
+            exit(1);
+        }
+        int status = compile_request(compiler, options, flags, source, source_length, output, diagnostics);
+        size_t output_length, diagnostics_length;
+        char* output_data = read_back(output, &output_length);
+        char* diagnostics_data = read_back(diagnostics, &diagnostics_length);
+        unsigned char status_bytes[4] = {status, 0, 0, 0};
+        int written = write_full(out, status_bytes, 4) == 0 &&
+                      write_string(out, status == 0 ? output_data : "", status == 0 ? output_length : 0) == 0 &&
+                      write_string(out, diagnostics_data, diagnostics_length) == 0;
+
+        free(output_data);
+        free(diagnostics_data);
+        fclose(output);
+        fclose(diagnostics);
+        free(flags);
+        free(source);
+        if (!written) return -1;
+    }
+}
+
+// --- Server ---
+
+int run_server(Compiler* compiler, const CompileOptions* options, const char* socket_path) {
+    // A client hanging up must not kill the server
+    signal(SIGPIPE, SIG_IGN);
+    if (!socket_path) {
+        return serve_stream(compiler, options, STDIN_FILENO, STDOUT_FILENO) == 0 ? 0 : 1;
+    }
+
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "Error: Socket path too long: %s\n", socket_path);
+        return 1;
+    }
+    strcpy(address.sun_path, socket_path);
+
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(socket_path);
+    if (listener < 0 || bind(listener, (struct sockaddr*)&address, sizeof(address)) != 0 ||
+        listen(listener, 64) != 0) {
+        fprintf(stderr, "Error: Cannot listen on %s: %s\n", socket_path, strerror(errno));
+        return 1;
+    }
+
+    // Connections are served side by side; finished ones are reaped by the
+    // kernel
+    signal(SIGCHLD, SIG_IGN);
+    for (;;) {
+        int connection = accept(listener, NULL, NULL);
+        if (connection < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            fprintf(stderr, "Error: Cannot accept on %s: %s\n", socket_path, strerror(errno));
+            return 1;
+        }
+        pid_t pid = fork();
+        if (pid == 0) {
+            close(listener);
+            signal(SIGCHLD, SIG_DFL);
+            int result = serve_stream(compiler, options, connection, connection);
+            close(connection);
+            exit(result == 0 ? 0 : 1);
+        }
+        if (pid < 0) fprintf(stderr, "Error: Cannot fork: %s\n", strerror(errno));
+        close(connection);
+    }
+}
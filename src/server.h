@@ -0,0 +1,25 @@
+// server.h
+#ifndef SERVER_H
+#define SERVER_H
+
+#include "compiler.h"
+
+// Compile server protocol. Every integer is 32 bits, little-endian; each
+// string is its length followed by that many bytes.
+//
+//   request:  options, source
+//   response: status, output, diagnostics
+//
+// 'options' are command-line flags separated by spaces, such as
+// "-O0 --format=elf", applied over the server's own. 'status' is 0 when the
+// source compiled and 1 when errors were reported, which are then in
+// 'diagnostics' along with any report asked for. A connection carries any
+// number of requests and ends when the client closes it.
+#define SERVER_MAX_MESSAGE (256u * 1024 * 1024)
+
+// Serve requests on a Unix socket, one process per connection, or on stdin
+// and stdout when 'socket_path' is NULL. Returns once stdin ends; a socket
+// is served until the process is killed.
+int run_server(Compiler* compiler, const CompileOptions* options, const char* socket_path);
+
+#endif
@@ -0,0 +1,717 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include "sim.h"
+#include "object.h"
+#include "alloc.h"
+
+#define DECODE_CACHE_SIZE 65536     // Decoded instructions, direct-mapped by address
+#define MEMORY_CYCLES 3             // Added for each memory operand an instruction touches
+#define TAKEN_JUMP_CYCLES 2         // Added when a jump leaves the straight line
+
+// Estimated cycles of each opcode with register operands, roughly those of
+// a simple in-order core
+static const unsigned char op_costs[NUM_OPCODES] = {
+    [OP_MOV] = 1, [OP_MOVZX] = 1, [OP_LEA] = 1, [OP_ADD] = 1, [OP_SUB] = 1, [OP_IMUL] = 3,
+    [OP_AND] = 1, [OP_XOR] = 1, [OP_NEG] = 1, [OP_INC] = 1, [OP_DEC] = 1,
+    [OP_SHL] = 1, [OP_SAR] = 1, [OP_SHR] = 1, [OP_CMP] = 1, [OP_TEST] = 1,
+    [OP_SETE] = 1, [OP_SETNE] = 1, [OP_SETL] = 1, [OP_SETGE] = 1, [OP_SETLE] = 1, [OP_SETG] = 1,
+    [OP_CDQ] = 1, [OP_IDIV] = 25, [OP_IMUL_WIDE] = 4, [OP_PUSH] = 1, [OP_POP] = 1,
+    [OP_CALL] = 2, [OP_RET] = 2, [OP_JMP] = 1,
+    [OP_JE] = 1, [OP_JNE] = 1, [OP_JL] = 1, [OP_JGE] = 1, [OP_JLE] = 1, [OP_JG] = 1,
+    [OP_INT] = 50,
+};
+
+// Register IDs of the hardware register numbers, the inverse of the encoder's
+static const signed char reg_of_hw[] = {REG_EAX, REG_ECX, REG_EDX, REG_EBX, REG_ESP, REG_EBP, REG_ESI, REG_EDI};
+
+// Jumps and setcc by their condition code, -1 where the code generator uses none
+static const signed char condition_index[16] = {-1, -1, -1, -1, 0, 1, -1, -1, -1, -1, -1, -1, 2, 3, 4, 5};
+
+// Arithmetic group extensions to opcodes
+static const signed char alu_ops[8] = {OP_ADD, -1, -1, -1, OP_AND, OP_SUB, OP_XOR, OP_CMP};
+
+typedef struct {
+    unsigned int address;   // Tag, or 0xFFFFFFFF when empty
+    int length;
+    Insn insn;
+} DecodedInsn;
+
+typedef struct {
+    unsigned int regs[8];   // By register ID
+    unsigned int eip;
+    int zf, sf, of, cf;
+    unsigned char* memory;  // The image, then the heap up to 'brk'
+    unsigned int image_end;
+    unsigned int brk;
+    size_t capacity;
+    unsigned char* stack;
+    const SimDevice* devices;
+    int num_devices;
+    unsigned int* device_values;    // Last value written to each device, read back
+    DecodedInsn* cache;
+    SimResult* result;
+    int stopped;
+} Sim;
+
+// Helper function to stop the run with a reason
+static void fault(Sim* sim, const char* format, ...) {
+    if (sim->stopped) return;
+    va_list args;
+    va_start(args, format);
+    int n = vsnprintf(sim->result->fault, sizeof(sim->result->fault), format, args);
+    va_end(args);
+    snprintf(sim->result->fault + n, sizeof(sim->result->fault) > (size_t)n ? sizeof(sim->result->fault) - n : 0,
+             " at 0x%X", sim->eip);
+    sim->stopped = 1;
+}
+
+// --- Memory ---
+
+static int find_device(const Sim* sim, unsigned int address) {
+    for (int d = 0; d < sim->num_devices; d++) {
+        if (address - sim->devices[d].address < (unsigned int)sim->devices[d].size) return d;
+    }
+    return -1;
+}
+
+// Helper function to find the host bytes behind an address, NULL if it is
+// not mapped memory
+static unsigned char* locate(Sim* sim, unsigned int address, int size) {
+    unsigned int offset = address - FLAT_IMAGE_BASE;
+    if (offset < sim->brk && sim->brk - offset >= (unsigned int)size) return sim->memory + offset;
+    offset = address - (SIM_STACK_TOP - SIM_STACK_SIZE);
+    if (offset < SIM_STACK_SIZE && SIM_STACK_SIZE - offset >= (unsigned int)size) return sim->stack + offset;
+    return NULL;
+}
+
+static unsigned int load(Sim* sim, unsigned int address, int size) {
+    unsigned char* bytes = locate(sim, address, size);
+    if (bytes) {
+        unsigned int value = bytes[0];
+        if (size == 4) value |= bytes[1] << 8 | bytes[2] << 16 | (unsigned int)bytes[3] << 24;
+        return value;
+    }
+    int d = find_device(sim, address);
+    if (d >= 0) {
+        sim->result->num_reads++;
+        return size == 1 ? sim->device_values[d] & 0xFF : sim->device_values[d];
+    }
+    fault(sim, "Read of unmapped address 0x%X", address);
+    return 0;
+}
+
+static void store(Sim* sim, unsigned int address, int size, unsigned int value) {
+    unsigned char* bytes = locate(sim, address, size);
+    if (bytes) {
+        bytes[0] = value;
+        if (size == 4) {
+            bytes[1] = value >> 8;
+            bytes[2] = value >> 16;
+            bytes[3] = value >> 24;
+        }
+        return;
+    }
+    int d = find_device(sim, address);
+    if (d < 0) {
+        fault(sim, "Write to unmapped address 0x%X", address);
+        return;
+    }
+    if (size == 1) value &= 0xFF;
+    sim->device_values[d] = value;
+
+    SimResult* result = sim->result;
+    if (result->num_writes == result->writes_capacity) {
+        result->writes_capacity = result->writes_capacity ? result->writes_capacity * 2 : 64;
+        result->writes = realloc(result->writes, result->writes_capacity * sizeof(SimWrite));
+        if (!result->writes) {
+            fprintf(stderr, "Error: Out of memory\n");
+            exit(1);
+        }
+    }
+    SimWrite* write = &result->writes[result->num_writes++];
+    write->insn = result->retired;
+    write->cycle = result->cycles;
+    write->device = &sim->devices[d];
+    write->value = value;
+}
+
+// Move the break as brk(2) does: an address outside the heap's range leaves
+// it where it is, and the result is the break afterwards
+static unsigned int set_break(Sim* sim, unsigned int address) {
+    unsigned int offset = address - FLAT_IMAGE_BASE;
+    if (offset < sim->image_end || offset > SIM_HEAP_LIMIT) return FLAT_IMAGE_BASE + sim->brk;
+    if (offset > sim->capacity) {
+        size_t capacity = sim->capacity;
+        while (capacity < offset) capacity *= 2;
+        sim->memory = realloc(sim->memory, capacity);
+        if (!sim->memory) {
+            fprintf(stderr, "Error: Out of memory\n");
+            exit(1);
+        }
+        memset(sim->memory + sim->capacity, 0, capacity - sim->capacity);
+        sim->capacity = capacity;
+    }
+    sim->brk = offset;
+    return address;
+}
+
+// --- Decoding ---
+
+// Bytes of the instruction being decoded
+typedef struct {
+    unsigned char bytes[16];
+    int available;
+    int pos;
+    int failed;
+} Fetch;
+
+static unsigned int next8(Fetch* fetch) {
+    if (fetch->pos >= fetch->available) {
+        fetch->failed = 1;
+        return 0;
+    }
+    return fetch->bytes[fetch->pos++];
+}
+
+static int next_s8(Fetch* fetch) {
+    return (signed char)next8(fetch);
+}
+
+static int next32(Fetch* fetch) {
+    unsigned int value = next8(fetch);
+    value |= next8(fetch) << 8;
+    value |= next8(fetch) << 16;
+    value |= next8(fetch) << 24;
+    return (int)value;
+}
+
+// Helper function to decode a ModRM byte and what follows it: the register
+// field goes to 'field', the register or memory operand to 'rm'
+static void decode_modrm(Fetch* fetch, int size, int* field, Operand* rm) {
+    unsigned int modrm = next8(fetch);
+    int mod = modrm >> 6;
+    *field = modrm >> 3 & 7;
+    int low = modrm & 7;
+    if (mod == 3) {
+        if (size == 1 && low >= 4) fetch->failed = 1;   // ah, ch, dh and bh are never used
+        *rm = size == 1 ? op_reg8(reg_of_hw[low]) : op_reg(reg_of_hw[low]);
+        return;
+    }
+
+    *rm = op_mem(size, -1, 0);
+    if (low == 4) {
+        unsigned int sib = next8(fetch);
+        int index = sib >> 3 & 7;
+        int base = sib & 7;
+        if (index != 4) {
+            rm->index = reg_of_hw[index];
+            rm->scale = 1 << (sib >> 6);
+        }
+        if (base == 5 && mod == 0) rm->value = next32(fetch);
+        else rm->reg = reg_of_hw[base];
+    } else if (low == 5 && mod == 0) {
+        rm->value = next32(fetch);
+    } else {
+        rm->reg = reg_of_hw[low];
+    }
+    if (mod == 1) rm->value = next_s8(fetch);
+    else if (mod == 2) rm->value = next32(fetch);
+}
+
+static Operand reg_operand(int hw, int size, Fetch* fetch) {
+    if (size == 1 && hw >= 4) fetch->failed = 1;
+    return size == 1 ? op_reg8(reg_of_hw[hw]) : op_reg(reg_of_hw[hw]);
+}
+
+// Decode the instruction at 'eip' from the forms the encoder produces; jump
+// and call targets become absolute addresses. Returns its length, 0 if it is
+// not one of them.
+static int decode(Sim* sim, unsigned int eip, Insn* insn) {
+    Fetch fetch;
+    fetch.pos = 0;
+    fetch.failed = 0;
+    fetch.available = 0;
+    unsigned int offset = eip - FLAT_IMAGE_BASE;
+    if (offset < sim->brk) {
+        fetch.available = sim->brk - offset < sizeof(fetch.bytes) ? (int)(sim->brk - offset) : (int)sizeof(fetch.bytes);
+        memcpy(fetch.bytes, sim->memory + offset, fetch.available);
+    }
+    Fetch* f = &fetch;
+    insn->op = OP_NOP;
+    insn->dst = op_none();
+    insn->src = op_none();
+
+    unsigned int opcode = next8(f);
+    int field;
+    int size = opcode & 1 ? 4 : 1;
+    if (opcode < 0x40 && (opcode & 7) < 6 && alu_ops[opcode >> 3] >= 0) {
+        // add, and, sub, xor and cmp in their register, memory and accumulator forms
+        insn->op = alu_ops[opcode >> 3];
+        if ((opcode & 7) >= 4) {
+            insn->dst = reg_operand(0, size, f);
+            insn->src = op_imm(size == 1 ? next_s8(f) : next32(f));
+        } else if (opcode & 2) {
+            decode_modrm(f, size, &field, &insn->src);
+            insn->dst = reg_operand(field, size, f);
+        } else {
+            decode_modrm(f, size, &field, &insn->dst);
+            insn->src = reg_operand(field, size, f);
+        }
+    } else if (opcode >= 0x40 && opcode <= 0x4F) {
+        insn->op = opcode < 0x48 ? OP_INC : OP_DEC;
+        insn->dst = op_reg(reg_of_hw[opcode & 7]);
+    } else if (opcode >= 0x50 && opcode <= 0x5F) {
+        insn->op = opcode < 0x58 ? OP_PUSH : OP_POP;
+        insn->dst = op_reg(reg_of_hw[opcode & 7]);
+    } else if (opcode == 0x68 || opcode == 0x6A) {
+        insn->op = OP_PUSH;
+        insn->dst = op_imm(opcode == 0x6A ? next_s8(f) : next32(f));
+    } else if (opcode == 0x69 || opcode == 0x6B) {
+        insn->op = OP_IMUL;
+        Operand source;
+        decode_modrm(f, 4, &field, &source);
+        insn->dst = op_reg(reg_of_hw[field]);
+        if (!operand_equal(&source, &insn->dst)) f->failed = 1;
+        insn->src = op_imm(opcode == 0x6B ? next_s8(f) : next32(f));
+    } else if (opcode >= 0x70 && opcode <= 0x7F) {
+        int index = condition_index[opcode & 0xF];
+        insn->op = index >= 0 ? OP_JE + index : OP_NOP;
+        int displacement = next_s8(f);
+        insn->dst = op_imm((int)(eip + f->pos + displacement));
+        if (index < 0) f->failed = 1;
+    } else if (opcode == 0x80 || opcode == 0x81 || opcode == 0x83) {
+        decode_modrm(f, opcode == 0x80 ? 1 : 4, &field, &insn->dst);
+        insn->op = alu_ops[field] >= 0 ? alu_ops[field] : OP_NOP;
+        insn->src = op_imm(opcode == 0x81 ? next32(f) : next_s8(f));
+        if (alu_ops[field] < 0) f->failed = 1;
+    } else if (opcode == 0x84 || opcode == 0x85) {
+        insn->op = OP_TEST;
+        decode_modrm(f, size, &field, &insn->dst);
+        insn->src = reg_operand(field, size, f);
+    } else if (opcode >= 0x88 && opcode <= 0x8B) {
+        insn->op = OP_MOV;
+        if (opcode & 2) {
+            decode_modrm(f, size, &field, &insn->src);
+            insn->dst = reg_operand(field, size, f);
+        } else {
+            decode_modrm(f, size, &field, &insn->dst);
+            insn->src = reg_operand(field, size, f);
+        }
+    } else if (opcode == 0x8D) {
+        insn->op = OP_LEA;
+        decode_modrm(f, 0, &field, &insn->src);
+        insn->dst = op_reg(reg_of_hw[field]);
+        if (insn->src.kind != OPND_MEM) f->failed = 1;
+    } else if (opcode == 0x8F) {
+        insn->op = OP_POP;
+        decode_modrm(f, 4, &field, &insn->dst);
+        if (field != 0) f->failed = 1;
+    } else if (opcode == 0x99) {
+        insn->op = OP_CDQ;
+    } else if (opcode >= 0xA0 && opcode <= 0xA3) {
+        insn->op = OP_MOV;
+        Operand memory = op_abs(size, (unsigned int)next32(f));
+        Operand accumulator = reg_operand(0, size, f);
+        insn->dst = opcode & 2 ? memory : accumulator;
+        insn->src = opcode & 2 ? accumulator : memory;
+    } else if (opcode == 0xA8 || opcode == 0xA9) {
+        insn->op = OP_TEST;
+        insn->dst = reg_operand(0, size, f);
+        insn->src = op_imm(size == 1 ? next_s8(f) : next32(f));
+    } else if (opcode >= 0xB0 && opcode <= 0xBF) {
+        insn->op = OP_MOV;
+        size = opcode >= 0xB8 ? 4 : 1;
+        insn->dst = reg_operand(opcode & 7, size, f);
+        insn->src = op_imm(size == 1 ? next_s8(f) : next32(f));
+    } else if (opcode == 0xC0 || opcode == 0xC1 || opcode == 0xD0 || opcode == 0xD1) {
+        decode_modrm(f, size, &field, &insn->dst);
+        insn->op = field == 4 ? OP_SHL : field == 5 ? OP_SHR : field == 7 ? OP_SAR : OP_NOP;
+        insn->src = op_imm(opcode >= 0xD0 ? 1 : (int)next8(f));
+        if (insn->op == OP_NOP) f->failed = 1;
+    } else if (opcode == 0xC2 || opcode == 0xC3) {
+        insn->op = OP_RET;
+        if (opcode == 0xC2) {
+            int low = next8(f);
+            insn->dst = op_imm(low | next8(f) << 8);
+        }
+    } else if (opcode == 0xC6 || opcode == 0xC7) {
+        insn->op = OP_MOV;
+        decode_modrm(f, size, &field, &insn->dst);
+        insn->src = op_imm(size == 1 ? next_s8(f) : next32(f));
+        if (field != 0) f->failed = 1;
+    } else if (opcode == 0xCD) {
+        insn->op = OP_INT;
+        insn->dst = op_imm(next8(f));
+    } else if (opcode == 0xE8 || opcode == 0xE9 || opcode == 0xEB) {
+        insn->op = opcode == 0xE8 ? OP_CALL : OP_JMP;
+        int displacement = opcode == 0xEB ? next_s8(f) : next32(f);
+        insn->dst = op_imm((int)(eip + f->pos + displacement));
+    } else if (opcode == 0xF6 || opcode == 0xF7) {
+        decode_modrm(f, size, &field, &insn->dst);
+        if (field == 0) {
+            insn->op = OP_TEST;
+            insn->src = op_imm(size == 1 ? next_s8(f) : next32(f));
+        } else {
+            insn->op = field == 3 ? OP_NEG : field == 5 ? OP_IMUL_WIDE : field == 7 ? OP_IDIV : OP_NOP;
+            if (insn->op == OP_NOP) f->failed = 1;
+        }
+    } else if (opcode == 0xFE || opcode == 0xFF) {
+        decode_modrm(f, size, &field, &insn->dst);
+        insn->op = field == 0 ? OP_INC : field == 1 ? OP_DEC : field == 6 && size == 4 ? OP_PUSH : OP_NOP;
+        if (insn->op == OP_NOP) f->failed = 1;
+    } else if (opcode == 0x0F) {
+        unsigned int second = next8(f);
+        if (second == 0xB6) {
+            insn->op = OP_MOVZX;
+            decode_modrm(f, 1, &field, &insn->src);
+            insn->dst = op_reg(reg_of_hw[field]);
+        } else if (second == 0xAF) {
+            insn->op = OP_IMUL;
+            decode_modrm(f, 4, &field, &insn->src);
+            insn->dst = op_reg(reg_of_hw[field]);
+        } else if (second >= 0x80 && second <= 0x9F && condition_index[second & 0xF] >= 0) {
+            int index = condition_index[second & 0xF];
+            if (second < 0x90) {
+                insn->op = OP_JE + index;
+                int displacement = next32(f);
+                insn->dst = op_imm((int)(eip + f->pos + displacement));
+            } else {
+                insn->op = OP_SETE + index;
+                decode_modrm(f, 1, &field, &insn->dst);
+            }
+        } else {
+            f->failed = 1;
+        }
+    } else {
+        f->failed = 1;
+    }
+    return f->failed ? 0 : f->pos;
+}
+
+// --- Execution ---
+
+static unsigned int address_of(const Sim* sim, const Operand* operand) {
+    unsigned int address = (unsigned int)operand->value;
+    if (operand->reg >= 0) address += sim->regs[operand->reg];
+    if (operand->scale) address += sim->regs[operand->index] * operand->scale;
+    return address;
+}
+
+static unsigned int read_operand(Sim* sim, const Operand* operand, int size) {
+    switch (operand->kind) {
+        case OPND_REG:
+            return size == 1 ? sim->regs[operand->reg] & 0xFF : sim->regs[operand->reg];
+        case OPND_IMM:
+            return size == 1 ? (unsigned int)operand->value & 0xFF : (unsigned int)operand->value;
+        default:
+            return load(sim, address_of(sim, operand), size);
+    }
+}
+
+static void write_operand(Sim* sim, const Operand* operand, int size, unsigned int value) {
+    if (operand->kind == OPND_REG) {
+        unsigned int* reg = &sim->regs[operand->reg];
+        *reg = size == 1 ? (*reg & ~0xFFu) | (value & 0xFF) : value;
+    } else {
+        store(sim, address_of(sim, operand), size, value);
+    }
+}
+
+// Helper function to set the zero and sign flags of a result
+static void set_result_flags(Sim* sim, unsigned int result, int size) {
+    unsigned int sign = size == 1 ? 0x80 : 0x80000000u;
+    unsigned int mask = size == 1 ? 0xFF : 0xFFFFFFFFu;
+    sim->zf = (result & mask) == 0;
+    sim->sf = (result & sign) != 0;
+}
+
+static unsigned int add_flags(Sim* sim, unsigned int a, unsigned int b, int size) {
+    unsigned int result = a + b;
+    unsigned int sign = size == 1 ? 0x80 : 0x80000000u;
+    set_result_flags(sim, result, size);
+    sim->of = ((a ^ result) & (b ^ result) & sign) != 0;
+    sim->cf = size == 1 ? result > 0xFF : result < a;
+    return result;
+}
+
+static unsigned int sub_flags(Sim* sim, unsigned int a, unsigned int b, int size) {
+    unsigned int result = a - b;
+    unsigned int sign = size == 1 ? 0x80 : 0x80000000u;
+    set_result_flags(sim, result, size);
+    sim->of = ((a ^ b) & (a ^ result) & sign) != 0;
+    sim->cf = a < b;
+    return result;
+}
+
+static unsigned int logic_flags(Sim* sim, unsigned int result, int size) {
+    set_result_flags(sim, result, size);
+    sim->of = sim->cf = 0;
+    return result;
+}
+
+// Helper function to evaluate a condition of je through jg and the setcc
+static int condition(const Sim* sim, int index) {
+    switch (index) {
+        case 0: return sim->zf;
+        case 1: return !sim->zf;
+        case 2: return sim->sf != sim->of;
+        case 3: return sim->sf == sim->of;
+        case 4: return sim->zf || sim->sf != sim->of;
+        default: return !sim->zf && sim->sf == sim->of;
+    }
+}
+
+static void push(Sim* sim, unsigned int value) {
+    sim->regs[REG_ESP] -= 4;
+    store(sim, sim->regs[REG_ESP], 4, value);
+}
+
+static unsigned int pop(Sim* sim) {
+    unsigned int value = load(sim, sim->regs[REG_ESP], 4);
+    sim->regs[REG_ESP] += 4;
+    return value;
+}
+
+// The system calls the code generator emits: exit and brk
+static void system_call(Sim* sim) {
+    unsigned int number = sim->regs[REG_EAX];
+    if (number == 1) {
+        sim->result->exited = 1;
+        sim->result->exit_status = sim->regs[REG_EBX] & 0xFF;
+        sim->stopped = 1;
+    } else if (number == 45) {
+        sim->regs[REG_EAX] = set_break(sim, sim->regs[REG_EBX]);
+    } else {
+        fault(sim, "Unsupported system call %u", number);
+    }
+}
+
+static void divide(Sim* sim, const Insn* insn, int size) {
+    int divisor = size == 1 ? (signed char)read_operand(sim, &insn->dst, 1) : (int)read_operand(sim, &insn->dst, 4);
+    long long dividend = size == 1 ? (short)sim->regs[REG_EAX]
+                                   : (long long)((unsigned long long)sim->regs[REG_EDX] << 32 | sim->regs[REG_EAX]);
+    if (divisor == 0) {
+        fault(sim, "Division by zero");
+        return;
+    }
+    long long quotient = dividend / divisor;
+    long long remainder = dividend % divisor;
+    long long limit = size == 1 ? 127 : 2147483647LL;
+    if (quotient > limit || quotient < -limit - 1) {
+        fault(sim, "Division overflow");
+        return;
+    }
+    if (size == 1) {
+        sim->regs[REG_EAX] = (sim->regs[REG_EAX] & ~0xFFFFu) | ((unsigned int)remainder & 0xFF) << 8 |
+                             ((unsigned int)quotient & 0xFF);
+    } else {
+        sim->regs[REG_EAX] = (unsigned int)quotient;
+        sim->regs[REG_EDX] = (unsigned int)remainder;
+    }
+}
+
+// Execute one decoded instruction; 'next' is the address after it
+static void execute(Sim* sim, const Insn* insn, unsigned int next) {
+    const Operand* dst = &insn->dst;
+    const Operand* src = &insn->src;
+    int size = dst->size == 1 || src->size == 1 ? 1 : 4;
+    sim->eip = next;
+    switch (insn->op) {
+        case OP_MOV:
+            write_operand(sim, dst, size, read_operand(sim, src, size));
+            break;
+        case OP_MOVZX:
+            write_operand(sim, dst, 4, read_operand(sim, src, 1));
+            break;
+        case OP_LEA:
+            write_operand(sim, dst, 4, address_of(sim, src));
+            break;
+        case OP_ADD:
+            write_operand(sim, dst, size, add_flags(sim, read_operand(sim, dst, size), read_operand(sim, src, size), size));
+            break;
+        case OP_SUB:
+            write_operand(sim, dst, size, sub_flags(sim, read_operand(sim, dst, size), read_operand(sim, src, size), size));
+            break;
+        case OP_CMP:
+            sub_flags(sim, read_operand(sim, dst, size), read_operand(sim, src, size), size);
+            break;
+        case OP_AND:
+            write_operand(sim, dst, size, logic_flags(sim, read_operand(sim, dst, size) & read_operand(sim, src, size), size));
+            break;
+        case OP_XOR:
+            write_operand(sim, dst, size, logic_flags(sim, read_operand(sim, dst, size) ^ read_operand(sim, src, size), size));
+            break;
+        case OP_TEST:
+            logic_flags(sim, read_operand(sim, dst, size) & read_operand(sim, src, size), size);
+            break;
+        case OP_NEG:
+            write_operand(sim, dst, size, sub_flags(sim, 0, read_operand(sim, dst, size), size));
+            break;
+        case OP_INC:
+        case OP_DEC: {
+            int cf = sim->cf;
+            unsigned int value = read_operand(sim, dst, size);
+            value = insn->op == OP_INC ? add_flags(sim, value, 1, size) : sub_flags(sim, value, 1, size);
+            sim->cf = cf;
+            write_operand(sim, dst, size, value);
+            break;
+        }
+        case OP_SHL:
+        case OP_SHR:
+        case OP_SAR: {
+            unsigned int value = read_operand(sim, dst, size);
+            int count = src->value & 31;
+            if (count == 0) break;
+            unsigned int result;
+            if (insn->op == OP_SHL) result = value << count;
+            else if (insn->op == OP_SHR) result = value >> count;
+            else result = size == 1 ? (unsigned int)((signed char)value >> count) : (unsigned int)((int)value >> count);
+            logic_flags(sim, result, size);
+            write_operand(sim, dst, size, result);
+            break;
+        }
+        case OP_IMUL: {
+            long long product = (long long)(int)read_operand(sim, dst, 4) * (int)read_operand(sim, src, 4);
+            set_result_flags(sim, (unsigned int)product, 4);
+            sim->of = sim->cf = product != (int)product;
+            write_operand(sim, dst, 4, (unsigned int)product);
+            break;
+        }
+        case OP_IMUL_WIDE: {
+            long long product = (long long)(int)sim->regs[REG_EAX] * (int)read_operand(sim, dst, 4);
+            sim->regs[REG_EAX] = (unsigned int)product;
+            sim->regs[REG_EDX] = (unsigned int)((unsigned long long)product >> 32);
+            sim->of = sim->cf = product != (int)product;
+            break;
+        }
+        case OP_IDIV:
+            divide(sim, insn, size);
+            break;
+        case OP_CDQ:
+            sim->regs[REG_EDX] = (int)sim->regs[REG_EAX] < 0 ? 0xFFFFFFFFu : 0;
+            break;
+        case OP_SETE: case OP_SETNE: case OP_SETL: case OP_SETGE: case OP_SETLE: case OP_SETG:
+            write_operand(sim, dst, 1, condition(sim, insn->op - OP_SETE));
+            break;
+        case OP_PUSH:
+            push(sim, read_operand(sim, dst, 4));
+            break;
+        case OP_POP: {
+            unsigned int value = pop(sim);
+            write_operand(sim, dst, 4, value);
+            break;
+        }
+        case OP_CALL:
+            push(sim, next);
+            sim->eip = (unsigned int)dst->value;
+            break;
+        case OP_RET:
+            sim->eip = pop(sim);
+            if (dst->kind == OPND_IMM) sim->regs[REG_ESP] += dst->value;
+            break;
+        case OP_JMP:
+            sim->eip = (unsigned int)dst->value;
+            break;
+        case OP_JE: case OP_JNE: case OP_JL: case OP_JGE: case OP_JLE: case OP_JG:
+            if (condition(sim, insn->op - OP_JE)) sim->eip = (unsigned int)dst->value;
+            break;
+        case OP_INT:
+            if (dst->value == 0x80) system_call(sim);
+            else fault(sim, "Unsupported interrupt 0x%X", dst->value);
+            break;
+        default:
+            fault(sim, "Cannot execute %s", insn_mnemonic(insn->op));
+            break;
+    }
+}
+
+int simulate(const unsigned char* image, size_t size, const SimDevice* devices, int num_devices,
+             long limit, SimResult* result) {
+    memset(result, 0, sizeof(*result));
+    Sim sim;
+    memset(&sim, 0, sizeof(sim));
+    sim.result = result;
+    sim.capacity = size > 4096 ? size : 4096;
+    sim.memory = checked_calloc(sim.capacity, 1);
+    memcpy(sim.memory, image, size);
+    sim.image_end = sim.brk = (unsigned int)size;
+    sim.stack = checked_calloc(SIM_STACK_SIZE, 1);
+    sim.devices = devices;
+    sim.num_devices = num_devices;
+    sim.device_values = checked_calloc(num_devices + 1, sizeof(unsigned int));
+    sim.cache = malloc(DECODE_CACHE_SIZE * sizeof(DecodedInsn));
+    if (!sim.cache) {
+        fprintf(stderr, "Error: Out of memory\n");
+        exit(1);
+    }
+    for (int i = 0; i < DECODE_CACHE_SIZE; i++) sim.cache[i].address = 0xFFFFFFFFu;
+    sim.regs[REG_ESP] = SIM_STACK_TOP;
+    sim.eip = FLAT_IMAGE_BASE;
+
+    // Code is never written, so an instruction is decoded once per cache slot
+    while (!sim.stopped && result->retired < limit) {
+        DecodedInsn* decoded = &sim.cache[sim.eip % DECODE_CACHE_SIZE];
+        if (decoded->address != sim.eip) {
+            decoded->length = decode(&sim, sim.eip, &decoded->insn);
+            if (decoded->length == 0) {
+                fault(&sim, "Cannot decode instruction");
+                break;
+            }
+            decoded->address = sim.eip;
+        }
+        const Insn* insn = &decoded->insn;
+        int cost = op_costs[insn->op] + MEMORY_CYCLES * ((insn->dst.kind == OPND_MEM) + (insn->src.kind == OPND_MEM &&
+                                                                                           insn->op != OP_LEA));
+        result->counts[insn->op]++;
+        result->op_cycles[insn->op] += cost;
+        result->cycles += cost;
+        unsigned int next = sim.eip + decoded->length;
+        execute(&sim, insn, next);
+        if (insn->op >= OP_JMP && insn->op <= OP_JG && sim.eip != next) {
+            result->taken_jumps++;
+            result->op_cycles[insn->op] += TAKEN_JUMP_CYCLES;
+            result->cycles += TAKEN_JUMP_CYCLES;
+        }
+        result->retired++;
+    }
+
+    result->memory = sim.memory;
+    result->image_size = size;
+    free(sim.stack);
+    free(sim.device_values);
+    free(sim.cache);
+    return result->fault[0] != '\0';
+}
+
+void sim_report(const SimResult* result, long limit, FILE* output) {
+    fprintf(output, "Run report:\n");
+    if (result->exited) fprintf(output, "  exited with status %d\n", result->exit_status);
+    else if (result->fault[0]) fprintf(output, "  stopped: %s\n", result->fault);
+    else fprintf(output, "  stopped after the limit of %ld instructions\n", limit);
+    fprintf(output, "  %ld instructions retired, %ld estimated cycles (%.2f per instruction)\n",
+            result->retired, result->cycles, result->retired ? (double)result->cycles / result->retired : 0.0);
+    fprintf(output, "  %ld jumps taken\n", result->taken_jumps);
+    fprintf(output, "  %-10s %14s %14s\n", "opcode", "count", "cycles");
+    for (int op = 0; op < NUM_OPCODES; op++) {
+        if (result->counts[op] == 0) continue;
+        fprintf(output, "  %-10s %14ld %14ld\n", op == OP_IMUL_WIDE ? "imul wide" : insn_mnemonic(op),
+                result->counts[op], result->op_cycles[op]);
+    }
+    fprintf(output, "  %ld MMIO reads\n", result->num_reads);
+    fprintf(output, "  %d MMIO writes\n", result->num_writes);
+    for (int i = 0; i < result->num_writes; i++) {
+        const SimWrite* write = &result->writes[i];
+        fprintf(output, "    %12ld %14ld  %s [0x%08X] = 0x%0*X\n", write->insn, write->cycle, write->device->name,
+                write->device->address, write->device->size * 2, write->value);
+    }
+}
+
+void sim_result_free(SimResult* result) {
+    free(result->writes);
+    free(result->memory);
+    result->writes = NULL;
+    result->memory = NULL;
+    result->num_writes = result->writes_capacity = 0;
+}
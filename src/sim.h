@@ -0,0 +1,58 @@
+// sim.h
+#ifndef SIM_H
+#define SIM_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include "insn.h"
+
+// Where the simulated program's stack lives; the image and its heap start at
+// FLAT_IMAGE_BASE and memory-mapped globals keep their own addresses
+#define SIM_STACK_TOP 0xC0000000u
+#define SIM_STACK_SIZE (8 * 1024 * 1024)
+#define SIM_HEAP_LIMIT (256 * 1024 * 1024)
+#define SIM_DEFAULT_LIMIT 100000000L
+
+// A memory-mapped global; every write to it is logged
+typedef struct {
+    const char* name;
+    unsigned int address;
+    int size;
+} SimDevice;
+
+typedef struct {
+    long insn;              // Instructions retired before the write
+    long cycle;
+    const SimDevice* device;
+    unsigned int value;
+} SimWrite;
+
+// What a run did: how it ended, instructions and estimated cycles per
+// opcode (a taken jump costs more than one that falls through), how often
+// devices were read, and the device writes in order
+typedef struct {
+    int exited;
+    int exit_status;
+    char fault[160];        // Why the run stopped early, empty if it did not
+    long retired;
+    long cycles;
+    long taken_jumps;       // Jumps and branches that did not fall through
+    long counts[NUM_OPCODES];
+    long op_cycles[NUM_OPCODES];
+    long num_reads;         // Loads from device addresses
+    SimWrite* writes;
+    int num_writes;
+    int writes_capacity;
+    unsigned char* memory;  // The image as the run left it, 'image_size' bytes
+    size_t image_size;
+} SimResult;
+
+// Run a flat image (see FORMAT_BIN) from its first byte until it exits
+// through int 0x80, faults or retires 'limit' instructions. Returns nonzero
+// on a fault.
+int simulate(const unsigned char* image, size_t size, const SimDevice* devices, int num_devices,
+             long limit, SimResult* result);
+void sim_report(const SimResult* result, long limit, FILE* output);
+void sim_result_free(SimResult* result);
+
+#endif
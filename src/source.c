@@ -0,0 +1,49 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "source.h"
+
+// Map an input file into memory; returns 0 on success
+int source_open(SourceFile* source, const char* path) {
+    source->data = "";
+    source->length = 0;
+    source->mapped = 0;
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return -1;
+
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        return -1;
+    }
+
+    // An empty file cannot be mapped, the empty string stands in for it
+    if (st.st_size > 0) {
+        void* data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            close(fd);
+            return -1;
+        }
+        madvise(data, st.st_size, MADV_SEQUENTIAL);
+        source->data = data;
+        source->length = st.st_size;
+        source->mapped = 1;
+    }
+
+    close(fd);
+    return 0;
+}
+
+// Unmap an input file
+void source_close(SourceFile* source) {
+    if (source->mapped) {
+        munmap((void*)source->data, source->length);
+    }
+    source->data = "";
+    source->length = 0;
+    source->mapped = 0;
+}
@@ -0,0 +1,17 @@
+// source.h
+#ifndef SOURCE_H
+#define SOURCE_H
+
+#include <stddef.h>
+
+// A read-only view of an input file, memory-mapped when possible
+typedef struct {
+    const char* data;
+    size_t length;
+    int mapped;
+} SourceFile;
+
+int source_open(SourceFile* source, const char* path);
+void source_close(SourceFile* source);
+
+#endif
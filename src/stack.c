@@ -0,0 +1,217 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "stack.h"
+#include "alloc.h"
+
+// Marks the worst case of a function that can recurse
+#define UNBOUNDED -1
+
+// A place to continue following the code from, with the depth there
+typedef struct {
+    int position;
+    int depth;
+} StackPath;
+
+// Helper function to check whether an operand is a given register
+static int is_reg(const Operand* operand, int reg) {
+    return operand->kind == OPND_REG && operand->reg == reg;
+}
+
+// Helper function to check whether an instruction jumps to a numbered label
+static int is_jump(Opcode op) {
+    return op == OP_JMP || (op >= OP_JE && op <= OP_JG);
+}
+
+// Helper function to order functions by name
+static int compare_name(const void* a, const void* b) {
+    return strcmp(((const StackFunction*)a)->name, ((const StackFunction*)b)->name);
+}
+
+void stack_sort(StackFunction* funcs, int num_funcs) {
+    qsort(funcs, num_funcs, sizeof(StackFunction), compare_name);
+}
+
+// Helper function to find a function by name among sorted ones
+static const StackFunction* find_function(const StackFunction* funcs, int num_funcs, const char* name) {
+    StackFunction key = {name, -1, 0};
+    return bsearch(&key, funcs, num_funcs, sizeof(StackFunction), compare_name);
+}
+
+// --- Measuring ---
+
+void stack_measure(const InsnList* code, const StackFunction* callees, int num_callees, StackUsage* usage,
+                   Arena* arena) {
+    usage->frame = 0;
+    usage->has_asm = 0;
+    usage->calls = NULL;
+    usage->num_calls = 0;
+
+    // Position of every numbered label
+    int low = 0, high = -1;
+    for (int i = 0; i < code->count; i++) {
+        const Insn* insn = &code->insns[i];
+        if (insn->op != OP_LABEL || insn->dst.name) continue;
+        if (high < low) low = high = insn->dst.value;
+        if (insn->dst.value < low) low = insn->dst.value;
+        if (insn->dst.value > high) high = insn->dst.value;
+    }
+    int* label_at = checked_calloc(high - low + 1, sizeof(int));
+    for (int i = 0; i < code->count; i++) {
+        const Insn* insn = &code->insns[i];
+        if (insn->op == OP_LABEL && !insn->dst.name) label_at[insn->dst.value - low] = i;
+    }
+
+    // Every instruction is reached at one depth, so each is followed once
+    unsigned char* visited = checked_calloc(code->count, 1);
+    StackPath* paths = checked_calloc(code->count + 1, sizeof(StackPath));
+    int num_paths = 0;
+    StackCall* calls = NULL;
+    int calls_capacity = 0;
+    int ebp_depth = 0;
+    paths[num_paths++] = (StackPath){0, 0};
+    while (num_paths > 0) {
+        StackPath path = paths[--num_paths];
+        int depth = path.depth;
+        for (int i = path.position; i < code->count && !visited[i]; i++) {
+            const Insn* insn = &code->insns[i];
+            visited[i] = 1;
+            int stop = 0;
+            switch (insn->op) {
+                case OP_PUSH: depth += 4; break;
+                case OP_POP: depth -= 4; break;
+                case OP_SUB:
+                    if (is_reg(&insn->dst, REG_ESP) && insn->src.kind == OPND_IMM) depth += insn->src.value;
+                    break;
+                case OP_ADD:
+                    if (is_reg(&insn->dst, REG_ESP) && insn->src.kind == OPND_IMM) depth -= insn->src.value;
+                    break;
+                case OP_MOV:
+                    if (is_reg(&insn->dst, REG_EBP) && is_reg(&insn->src, REG_ESP)) ebp_depth = depth;
+                    if (is_reg(&insn->dst, REG_ESP) && is_reg(&insn->src, REG_EBP)) depth = ebp_depth;
+                    break;
+                case OP_ASM: usage->has_asm = 1; break;
+                case OP_CALL: {
+                    if (usage->num_calls == calls_capacity) {
+                        calls_capacity = calls_capacity ? calls_capacity * 2 : 16;
+                        calls = realloc(calls, calls_capacity * sizeof(StackCall));
+                        if (!calls) {
+                            fprintf(stderr, "Error: Out of memory\n");
+                            exit(1);
+                        }
+                    }
+                    calls[usage->num_calls].callee = insn->dst.name;
+                    calls[usage->num_calls].depth = depth;
+                    usage->num_calls++;
+                    const StackFunction* callee = find_function(callees, num_callees, insn->dst.name);
+                    if (callee) depth -= callee->popped;
+                    break;
+                }
+                case OP_RET: stop = 1; break;
+                default:
+                    if (!is_jump(insn->op) || insn->dst.name) break;
+                    paths[num_paths++] = (StackPath){label_at[insn->dst.value - low], depth};
+                    stop = insn->op == OP_JMP;
+                    break;
+            }
+            if (depth > usage->frame) usage->frame = depth;
+            if (stop) break;
+        }
+    }
+
+    if (usage->num_calls > 0) {
+        usage->calls = arena_alloc(arena, usage->num_calls * sizeof(StackCall));
+        memcpy(usage->calls, calls, usage->num_calls * sizeof(StackCall));
+    }
+    free(calls);
+    free(label_at);
+    free(visited);
+    free(paths);
+}
+
+// --- Reporting ---
+
+// The call graph while its worst cases are found
+typedef struct {
+    const StackUsage* funcs;
+    StackFunction* by_name; // Sorted by name
+    int num_funcs;
+    int* worst;             // Bytes below the return address with every callee, or UNBOUNDED
+    int* deepest;           // Callee on the worst path, or -1
+    unsigned char* state;   // 0 not yet seen, 1 on the current path, 2 done
+} CallGraph;
+
+// Helper function to find the worst case of a function and its callees,
+// depth first; reaching a function again on the same path is recursion
+static int worst_case(CallGraph* graph, int f) {
+    if (graph->state[f] == 2) return graph->worst[f];
+    if (graph->state[f] == 1) return UNBOUNDED;
+    graph->state[f] = 1;
+    const StackUsage* usage = &graph->funcs[f];
+    int worst = usage->frame;
+    for (int c = 0; c < usage->num_calls && worst != UNBOUNDED; c++) {
+        const StackFunction* found = find_function(graph->by_name, graph->num_funcs, usage->calls[c].callee);
+        if (!found) continue;
+        int callee = found->index;
+        int below = worst_case(graph, callee);
+        if (below == UNBOUNDED) {
+            worst = UNBOUNDED;
+            graph->deepest[f] = callee;
+        } else if (usage->calls[c].depth + 4 + below > worst) {
+            worst = usage->calls[c].depth + 4 + below;
+            graph->deepest[f] = callee;
+        }
+    }
+    graph->worst[f] = worst;
+    graph->state[f] = 2;
+    return worst;
+}
+
+void stack_report(const StackUsage* funcs, int num_funcs, FILE* output) {
+    CallGraph graph;
+    graph.funcs = funcs;
+    graph.num_funcs = num_funcs;
+    graph.by_name = checked_calloc(num_funcs, sizeof(StackFunction));
+    graph.worst = checked_calloc(num_funcs, sizeof(int));
+    graph.deepest = checked_calloc(num_funcs, sizeof(int));
+    graph.state = checked_calloc(num_funcs, 1);
+    for (int f = 0; f < num_funcs; f++) {
+        graph.by_name[f].name = funcs[f].name;
+        graph.by_name[f].index = f;
+        graph.by_name[f].popped = 0;
+        graph.deepest[f] = -1;
+    }
+    stack_sort(graph.by_name, num_funcs);
+
+    fprintf(output, "Stack usage:\n");
+    fprintf(output, "  %-24s %10s %10s\n", "function", "frame", "worst");
+    int entry = -1;
+    for (int f = 0; f < num_funcs; f++) {
+        int worst = worst_case(&graph, f);
+        char text[16];
+        if (worst == UNBOUNDED) snprintf(text, sizeof(text), "unbounded");
+        else snprintf(text, sizeof(text), "%d", worst);
+        fprintf(output, "  %-24s %10d %10s%s\n", funcs[f].name, funcs[f].frame, text,
+                funcs[f].has_asm ? "  (inline assembly not counted)" : "");
+        if (funcs[f].is_entry && entry < 0) entry = f;
+    }
+
+    // The chain of calls behind the entry point's worst case; a recursive
+    // one ends where it comes back around
+    if (entry >= 0) {
+        if (graph.worst[entry] == UNBOUNDED) fprintf(output, "  deepest: unbounded, ");
+        else fprintf(output, "  deepest: %d bytes, ", graph.worst[entry]);
+        memset(graph.state, 0, num_funcs);
+        for (int f = entry; f >= 0; f = graph.deepest[f]) {
+            fprintf(output, "%s%s", f == entry ? "" : " -> ", funcs[f].name);
+            if (graph.state[f]) break;
+            graph.state[f] = 1;
+        }
+        fprintf(output, "\n");
+    }
+
+    free(graph.by_name);
+    free(graph.worst);
+    free(graph.deepest);
+    free(graph.state);
+}
@@ -0,0 +1,45 @@
+// stack.h
+#ifndef STACK_H
+#define STACK_H
+
+#include <stdio.h>
+#include "arena.h"
+#include "insn.h"
+
+// A call and how deep the caller's stack is when it is made
+typedef struct {
+    const char* callee;
+    int depth;              // Bytes below the caller's return address, arguments included
+} StackCall;
+
+// Stack use of one function's final code
+typedef struct {
+    const char* name;
+    int is_entry;           // Entered without a return address
+    int frame;              // Deepest the function itself goes below its return address
+    int has_asm;            // Inline assembly may move esp further than counted
+    StackCall* calls;
+    int num_calls;
+} StackUsage;
+
+// A function by name, for looking up callees
+typedef struct {
+    const char* name;
+    int index;              // Its position among the program's functions
+    int popped;             // Bytes of arguments it pops when it returns
+} StackFunction;
+
+// Sort functions by name for stack_measure()
+void stack_sort(StackFunction* funcs, int num_funcs);
+// Follow esp through the code of a function from its first instruction:
+// pushes, pops, esp adjustments and the ebp frame, along every jump, with
+// 'callees' sorted by stack_sort(). Fills in the frame and the calls of
+// 'usage'.
+void stack_measure(const InsnList* code, const StackFunction* callees, int num_callees, StackUsage* usage,
+                   Arena* arena);
+// Print the frame of each function and its worst case with everything it
+// calls, then the deepest chain of calls from the entry point; recursion
+// makes the depth unbounded
+void stack_report(const StackUsage* funcs, int num_funcs, FILE* output);
+
+#endif
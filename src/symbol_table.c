@@ -0,0 +1,133 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "symbol_table.h"
+#include "arena.h"
+
+// Helper function to abort on allocation failure
+static void* checked_realloc(void* ptr, size_t size) {
+    ptr = realloc(ptr, size);
+    if (!ptr) {
+        fprintf(stderr, "Error: Out of memory\n");
+        exit(1);
+    }
+    return ptr;
+}
+
+// Helper function to spread interned ids over the table; multiplying by an odd
+// constant is a bijection on the low bits, so dense ids never collide
+static inline unsigned int hash_id(int id) {
+    return (unsigned int)id * 2654435769u;
+}
+
+// Helper function to allocate an empty slot array
+static SymbolSlot* new_slots(int num_slots) {
+    SymbolSlot* slots = checked_realloc(NULL, num_slots * sizeof(SymbolSlot));
+    for (int i = 0; i < num_slots; i++) {
+        slots[i].id = -1;
+        slots[i].symbol = NULL;
+    }
+    return slots;
+}
+
+// Initialize an empty table with the global scope open
+void symtab_init(SymbolTable* table, Arena* arena) {
+    table->num_slots = 1024;
+    table->slots = new_slots(table->num_slots);
+    table->num_names = 0;
+    table->declared_capacity = 256;
+    table->declared = checked_realloc(NULL, table->declared_capacity * sizeof(Symbol*));
+    table->num_declared = 0;
+    table->scope_capacity = 16;
+    table->scope_starts = checked_realloc(NULL, table->scope_capacity * sizeof(int));
+    table->depth = 0;
+    table->arena = arena;
+}
+
+// Helper function to find the slot of a name, or the empty slot it would use
+static SymbolSlot* find_slot(SymbolTable* table, int id) {
+    unsigned int mask = table->num_slots - 1;
+    unsigned int i = hash_id(id) & mask;
+    while (table->slots[i].id != id && table->slots[i].id != -1) {
+        i = (i + 1) & mask;
+    }
+    return &table->slots[i];
+}
+
+// Helper function to double the slot array once it is half full
+static void grow_slots(SymbolTable* table) {
+    SymbolSlot* old = table->slots;
+    int old_count = table->num_slots;
+    table->num_slots *= 2;
+    table->slots = new_slots(table->num_slots);
+    for (int i = 0; i < old_count; i++) {
+        if (old[i].id != -1) *find_slot(table, old[i].id) = old[i];
+    }
+    free(old);
+}
+
+// Open a scope (function body or block)
+void symtab_push_scope(SymbolTable* table) {
+    if (table->depth == table->scope_capacity) {
+        table->scope_capacity *= 2;
+        table->scope_starts = checked_realloc(table->scope_starts,
+                                              table->scope_capacity * sizeof(int));
+    }
+    table->scope_starts[table->depth++] = table->num_declared;
+}
+
+// Close the innermost scope, uncovering any names it shadowed
+void symtab_pop_scope(SymbolTable* table) {
+    int start = table->scope_starts[--table->depth];
+    while (table->num_declared > start) {
+        Symbol* sym = table->declared[--table->num_declared];
+        find_slot(table, sym->id)->symbol = sym->shadowed;
+    }
+}
+
+// Declare a name in the innermost scope; the caller fills in the rest
+Symbol* symtab_add(SymbolTable* table, char* name, int id) {
+    SymbolSlot* slot = find_slot(table, id);
+    if (slot->id == -1) {
+        slot->id = id;
+        if (++table->num_names * 2 > table->num_slots) {
+            grow_slots(table);
+            slot = find_slot(table, id);
+        }
+    }
+
+    Symbol* sym = arena_alloc(table->arena, sizeof(Symbol));
+    memset(sym, 0, sizeof(Symbol));
+    sym->name = name;
+    sym->id = id;
+    sym->reg = -1;
+    sym->depth = table->depth;
+    sym->shadowed = slot->symbol;
+    slot->symbol = sym;
+
+    if (table->num_declared == table->declared_capacity) {
+        table->declared_capacity *= 2;
+        table->declared = checked_realloc(table->declared,
+                                          table->declared_capacity * sizeof(Symbol*));
+    }
+    table->declared[table->num_declared++] = sym;
+    return sym;
+}
+
+// Find the innermost visible declaration of a name
+Symbol* symtab_find(SymbolTable* table, int id) {
+    return find_slot(table, id)->symbol;
+}
+
+// Find a declaration of a name in the innermost scope only
+Symbol* symtab_find_local(SymbolTable* table, int id) {
+    Symbol* sym = symtab_find(table, id);
+    return sym && sym->depth == table->depth ? sym : NULL;
+}
+
+// Release the table; symbols themselves belong to the arena
+void symtab_free(SymbolTable* table) {
+    free(table->slots);
+    free(table->declared);
+    free(table->scope_starts);
+}
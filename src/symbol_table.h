@@ -0,0 +1,52 @@
+// symbol_table.h
+#ifndef SYMBOL_TABLE_H
+#define SYMBOL_TABLE_H
+
+#include "parser.h"
+#include "arena.h"
+
+typedef struct Symbol {
+    char* name;
+    int id;                   // Interned name, compared instead of the spelling
+    enum { SYM_REG, SYM_MEM, SYM_PTR, SYM_FUNC, SYM_GLOBAL, SYM_MMIO } storage_type;
+    DataType data_type;       // Data type (int, byte, ptr), return type for functions
+    int reg;                  // Vreg of locals and parameters when lowering
+    int address;              // Global or function index when lowering, value slot when folding
+    int num_params;           // Parameter count (functions only)
+    int num_reg_params;       // Leading parameters passed in registers (functions only)
+    DataType* param_types;    // Parameter types (functions only)
+    int depth;                // Scope depth the symbol was declared at, 0 is global
+    struct Symbol* shadowed;  // Outer symbol with the same name, restored on scope exit
+} Symbol;
+
+// One hash slot per name ever declared; 'symbol' is the innermost visible
+// declaration of that name, or NULL once all of its scopes have closed
+typedef struct {
+    int id;
+    Symbol* symbol;
+} SymbolSlot;
+
+// Scoped symbol table: open addressing keyed by interned name, with a stack of
+// declarations so that closing a scope only touches the names it declared
+typedef struct {
+    SymbolSlot* slots;        // id -1 marks an empty slot
+    int num_slots;            // Always a power of two
+    int num_names;
+    Symbol** declared;        // Declarations in scope order
+    int num_declared;
+    int declared_capacity;
+    int* scope_starts;        // Index into 'declared' where each open scope begins
+    int depth;
+    int scope_capacity;
+    Arena* arena;
+} SymbolTable;
+
+void symtab_init(SymbolTable* table, Arena* arena);
+void symtab_push_scope(SymbolTable* table);
+void symtab_pop_scope(SymbolTable* table);
+Symbol* symtab_add(SymbolTable* table, char* name, int id);
+Symbol* symtab_find(SymbolTable* table, int id);
+Symbol* symtab_find_local(SymbolTable* table, int id);
+void symtab_free(SymbolTable* table);
+
+#endif
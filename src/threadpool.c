@@ -0,0 +1,115 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "threadpool.h"
+
+// Tasks a worker has not started yet: next to end - 1. The owner takes from
+// the front; a thief takes the back half, which then becomes its own range.
+typedef struct {
+    pthread_mutex_t lock;
+    int next;
+    int end;
+} TaskRange;
+
+typedef struct {
+    TaskRange ranges[MAX_WORKERS];
+    int num_workers;
+    TaskFunc func;
+    void* context;
+} TaskPool;
+
+typedef struct {
+    TaskPool* pool;
+    int worker;
+} Worker;
+
+// --- Helper Functions ---
+
+// Helper function to take the next task of a range, or -1 when it is empty
+static int take_task(TaskRange* range) {
+    pthread_mutex_lock(&range->lock);
+    int task = range->next < range->end ? range->next++ : -1;
+    pthread_mutex_unlock(&range->lock);
+    return task;
+}
+
+// Move the back half of another worker's range to the thief, whose range is
+// empty, and return its first task; -1 when every range is empty
+static int steal_task(TaskPool* pool, int thief) {
+    for (int k = 1; k < pool->num_workers; k++) {
+        TaskRange* victim = &pool->ranges[(thief + k) % pool->num_workers];
+        pthread_mutex_lock(&victim->lock);
+        int left = victim->end - victim->next;
+        if (left <= 0) {
+            pthread_mutex_unlock(&victim->lock);
+            continue;
+        }
+        int first = victim->next + left / 2;
+        int end = victim->end;
+        victim->end = first;
+        pthread_mutex_unlock(&victim->lock);
+
+        TaskRange* own = &pool->ranges[thief];
+        pthread_mutex_lock(&own->lock);
+        own->next = first + 1;
+        own->end = end;
+        pthread_mutex_unlock(&own->lock);
+        return first;
+    }
+    return -1;
+}
+
+static void* run_worker(void* arg) {
+    Worker* worker = arg;
+    TaskPool* pool = worker->pool;
+    TaskRange* own = &pool->ranges[worker->worker];
+    for (;;) {
+        int task = take_task(own);
+        if (task < 0) task = steal_task(pool, worker->worker);
+        if (task < 0) break;
+        pool->func(pool->context, task, worker->worker);
+    }
+    return NULL;
+}
+
+void run_tasks(int num_tasks, int num_workers, TaskFunc func, void* context) {
+    if (num_workers > num_tasks) num_workers = num_tasks;
+    if (num_workers > MAX_WORKERS) num_workers = MAX_WORKERS;
+    if (num_workers <= 1) {
+        for (int task = 0; task < num_tasks; task++) func(context, task, 0);
+        return;
+    }
+
+    // Contiguous shares, so each worker mostly runs neighbouring tasks
+    TaskPool* pool = malloc(sizeof(TaskPool));
+    Worker* workers = malloc(num_workers * sizeof(Worker));
+    pthread_t* threads = malloc(num_workers * sizeof(pthread_t));
+    if (!pool || !workers || !threads) {
+        fprintf(stderr, "Error: Out of memory\n");
+        exit(1);
+    }
+    pool->num_workers = num_workers;
+    pool->func = func;
+    pool->context = context;
+    for (int w = 0; w < num_workers; w++) {
+        pthread_mutex_init(&pool->ranges[w].lock, NULL);
+        pool->ranges[w].next = (int)((long)num_tasks * w / num_workers);
+        pool->ranges[w].end = (int)((long)num_tasks * (w + 1) / num_workers);
+        workers[w].pool = pool;
+        workers[w].worker = w;
+    }
+
+    for (int w = 1; w < num_workers; w++) {
+        if (pthread_create(&threads[w], NULL, run_worker, &workers[w]) != 0) {
+            fprintf(stderr, "Error: Cannot start worker thread\n");
+            exit(1);
+        }
+    }
+    run_worker(&workers[0]);
+    for (int w = 1; w < num_workers; w++) pthread_join(threads[w], NULL);
+
+    for (int w = 0; w < num_workers; w++) pthread_mutex_destroy(&pool->ranges[w].lock);
+    free(threads);
+    free(workers);
+    free(pool);
+}
@@ -0,0 +1,16 @@
+// threadpool.h
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#define MAX_WORKERS 64
+
+// One task: 'worker' identifies the thread running it, 0 to num_workers - 1
+typedef void (*TaskFunc)(void* context, int task, int worker);
+
+// Run tasks 0 to num_tasks - 1 on 'num_workers' threads, the caller being
+// worker 0, and return once all are done. Each worker starts on its own
+// share of the tasks, lowest numbers first, and steals from the far end of
+// another's share when it runs out. One worker runs everything in order.
+void run_tasks(int num_tasks, int num_workers, TaskFunc func, void* context);
+
+#endif
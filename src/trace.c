@@ -0,0 +1,223 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "trace.h"
+
+// Names of the AST node kinds, for the report
+static const char* node_names[NUM_NODE_TYPES] = {
+    "func", "var", "reg", "asm", "if", "while", "for", "assign", "binop", "call", "return",
+    "ident", "number", "ptr", "block", "deref"
+};
+
+// Helper function to read a clock in microseconds
+static double clock_us(clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+void tracer_init(Tracer* tracer) {
+    memset(tracer, 0, sizeof(*tracer));
+    tracer->origin = clock_us(CLOCK_MONOTONIC);
+    for (int w = 0; w < MAX_WORKERS; w++) arena_init(&tracer->workers[w].names, 0);
+}
+
+void tracer_free(Tracer* tracer) {
+    for (int w = 0; w < MAX_WORKERS; w++) {
+        free(tracer->workers[w].events);
+        arena_free(&tracer->workers[w].names);
+    }
+}
+
+void trace_reset_kinds(Tracer* tracer) {
+    memset(tracer->nodes, 0, sizeof(tracer->nodes));
+    for (int w = 0; w < MAX_WORKERS; w++) {
+        memset(tracer->workers[w].ops, 0, sizeof(tracer->workers[w].ops));
+        tracer->workers[w].nested = 0;
+    }
+}
+
+void trace_clear_events(Tracer* tracer) {
+    for (int w = 0; w < MAX_WORKERS; w++) {
+        tracer->workers[w].num_events = 0;
+        arena_reset(&tracer->workers[w].names);
+    }
+}
+
+double trace_now(void) {
+    return clock_us(CLOCK_MONOTONIC);
+}
+
+// --- Spans ---
+
+void trace_begin(const Tracer* tracer, TraceMark* mark, const Arena* arena) {
+    if (!tracer) return;
+    mark->wall = clock_us(CLOCK_MONOTONIC);
+    mark->cpu = clock_us(CLOCK_THREAD_CPUTIME_ID);
+    mark->allocations = arena ? arena->num_allocations : 0;
+    mark->bytes = arena ? arena->bytes_allocated : 0;
+}
+
+// Names are copied, since events outlive the compilation they came from
+void trace_end(Tracer* tracer, const TraceMark* mark, const char* name, const char* category,
+               int worker, const Arena* arena) {
+    if (!tracer) return;
+    TraceBuffer* buffer = &tracer->workers[worker];
+    if (buffer->num_events == buffer->capacity) {
+        buffer->capacity = buffer->capacity ? buffer->capacity * 2 : 256;
+        buffer->events = realloc(buffer->events, buffer->capacity * sizeof(TraceEvent));
+        if (!buffer->events) {
+            fprintf(stderr, "Error: Out of memory\n");
+            exit(1);
+        }
+    }
+    TraceEvent* event = &buffer->events[buffer->num_events++];
+    double now = clock_us(CLOCK_MONOTONIC);
+    event->name = arena_strdup(&buffer->names, name);
+    event->category = category;
+    event->start = mark->wall - tracer->origin;
+    event->wall = now - mark->wall;
+    event->cpu = clock_us(CLOCK_THREAD_CPUTIME_ID) - mark->cpu;
+    event->allocations = arena ? arena->num_allocations - mark->allocations : 0;
+    event->bytes = arena ? arena->bytes_allocated - mark->bytes : 0;
+}
+
+void trace_kind_begin(Tracer* tracer, int worker, TraceKind* kind, TraceKindMark* mark) {
+    TraceBuffer* buffer = &tracer->workers[worker];
+    kind->depth++;
+    mark->start = clock_us(CLOCK_MONOTONIC);
+    mark->nested = buffer->nested;
+    buffer->nested = 0;
+}
+
+// A kind's own time excludes the kinds that finished inside it; the parent
+// then sees this whole call as nested time
+void trace_kind_end(Tracer* tracer, int worker, TraceKind* kind, const TraceKindMark* mark) {
+    TraceBuffer* buffer = &tracer->workers[worker];
+    double elapsed = clock_us(CLOCK_MONOTONIC) - mark->start;
+    kind->count++;
+    if (--kind->depth == 0) kind->total += elapsed;
+    kind->self += elapsed - buffer->nested;
+    buffer->nested = mark->nested + elapsed;
+}
+
+// --- Output ---
+
+// One row of the report: the events of a name summed
+typedef struct {
+    const char* name;
+    const char* category;
+    long count;
+    double wall;
+    double cpu;
+    size_t allocations;
+    size_t bytes;
+} TraceTotal;
+
+static void print_kind(FILE* output, const char* name, const TraceKind* kind) {
+    fprintf(output, "  %-12s %10ld %10.3f %10.3f\n", name, kind->count, kind->total / 1e3, kind->self / 1e3);
+}
+
+void trace_report(const Tracer* tracer, const int* first_event, FILE* output) {
+    // Phases and passes by first appearance; functions only counted
+    int num_totals = 0, capacity = 16;
+    TraceTotal* totals = malloc(capacity * sizeof(TraceTotal));
+    long functions = 0;
+    double function_wall = 0;
+    for (int w = 0; w < MAX_WORKERS; w++) {
+        const TraceBuffer* buffer = &tracer->workers[w];
+        for (int e = first_event ? first_event[w] : 0; e < buffer->num_events; e++) {
+            const TraceEvent* event = &buffer->events[e];
+            if (strcmp(event->category, "function") == 0) {
+                functions++;
+                function_wall += event->wall;
+                continue;
+            }
+            int t = 0;
+            while (t < num_totals && strcmp(totals[t].name, event->name) != 0) t++;
+            if (t == num_totals) {
+                if (num_totals == capacity) {
+                    capacity *= 2;
+                    totals = realloc(totals, capacity * sizeof(TraceTotal));
+                }
+                if (!totals) {
+                    fprintf(stderr, "Error: Out of memory\n");
+                    exit(1);
+                }
+                memset(&totals[t], 0, sizeof(TraceTotal));
+                totals[t].name = event->name;
+                totals[t].category = event->category;
+                num_totals++;
+            }
+            totals[t].count++;
+            totals[t].wall += event->wall;
+            totals[t].cpu += event->cpu;
+            totals[t].allocations += event->allocations;
+            totals[t].bytes += event->bytes;
+        }
+    }
+
+    fprintf(output, "Time report (ms; passes summed over workers):\n");
+    fprintf(output, "  %-12s %-6s %8s %10s %10s %12s %14s\n",
+            "name", "kind", "calls", "wall", "cpu", "allocations", "bytes");
+    for (int t = 0; t < num_totals; t++) {
+        fprintf(output, "  %-12s %-6s %8ld %10.3f %10.3f %12zu %14zu\n", totals[t].name, totals[t].category,
+                totals[t].count, totals[t].wall / 1e3, totals[t].cpu / 1e3, totals[t].allocations, totals[t].bytes);
+    }
+    fprintf(output, "  %ld functions generated in %.3f ms\n", functions, function_wall / 1e3);
+    free(totals);
+
+    fprintf(output, "Lowering by node kind (ms):\n");
+    fprintf(output, "  %-12s %10s %10s %10s\n", "node", "calls", "total", "self");
+    for (int k = 0; k < NUM_NODE_TYPES; k++) {
+        if (tracer->nodes[k].count > 0) print_kind(output, node_names[k], &tracer->nodes[k]);
+    }
+    fprintf(output, "Instruction selection by IR op (ms):\n");
+    fprintf(output, "  %-12s %10s %10s %10s\n", "op", "calls", "total", "self");
+    for (int op = 0; op < NUM_IR_OPS; op++) {
+        TraceKind sum = {0, 0, 0, 0};
+        for (int w = 0; w < MAX_WORKERS; w++) {
+            sum.count += tracer->workers[w].ops[op].count;
+            sum.total += tracer->workers[w].ops[op].total;
+            sum.self += tracer->workers[w].ops[op].self;
+        }
+        if (sum.count > 0) print_kind(output, ir_op_name(op), &sum);
+    }
+}
+
+// Helper function to write a JSON string; names are identifiers, but quote
+// anything that needs it
+static void write_json_string(FILE* output, const char* str) {
+    fputc('"', output);
+    for (const char* c = str; *c; c++) {
+        if (*c == '"' || *c == '\\') fprintf(output, "\\%c", *c);
+        else if ((unsigned char)*c < 0x20) fprintf(output, "\\u%04x", *c);
+        else fputc(*c, output);
+    }
+    fputc('"', output);
+}
+
+int trace_write(const Tracer* tracer, const char* path) {
+    FILE* output = fopen(path, "w");
+    if (!output) return -1;
+    fprintf(output, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+    int first = 1;
+    for (int w = 0; w < MAX_WORKERS; w++) {
+        const TraceBuffer* buffer = &tracer->workers[w];
+        if (buffer->num_events == 0) continue;
+        fprintf(output, "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, "
+                "\"args\": {\"name\": \"%s %d\"}}", first ? "" : ",\n", w, w == 0 ? "main" : "worker", w);
+        first = 0;
+        for (int e = 0; e < buffer->num_events; e++) {
+            const TraceEvent* event = &buffer->events[e];
+            fprintf(output, ",\n{\"name\": ");
+            write_json_string(output, event->name);
+            fprintf(output, ", \"cat\": \"%s\", \"ph\": \"X\", \"ts\": %.3f, \"dur\": %.3f, \"pid\": 1, "
+                    "\"tid\": %d, \"args\": {\"cpu_us\": %.3f, \"allocations\": %zu, \"bytes\": %zu}}",
+                    event->category, event->start, event->wall, w, event->cpu, event->allocations, event->bytes);
+        }
+    }
+    fprintf(output, "\n]}\n");
+    return fclose(output) == 0 ? 0 : -1;
+}
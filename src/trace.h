@@ -0,0 +1,92 @@
+// trace.h
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include "arena.h"
+#include "parser.h"
+#include "ir.h"
+#include "threadpool.h"
+
+// Compiler instrumentation: timed spans for phases, passes and functions,
+// plus counts and times per AST node kind lowered and per IR op selected.
+// Everything instrumented takes a Tracer* that is NULL when tracing is off,
+// which costs one test per span or node.
+
+// Start of a span: clocks in microseconds and the arena's counters
+typedef struct {
+    double wall;
+    double cpu;             // CPU time of the calling thread
+    size_t allocations;
+    size_t bytes;
+} TraceMark;
+
+// A finished span, also a Chrome trace "complete" event
+typedef struct {
+    const char* name;
+    const char* category;   // "phase", "pass" or "function"
+    double start;           // Microseconds since the tracer was created
+    double wall;
+    double cpu;
+    size_t allocations;
+    size_t bytes;
+} TraceEvent;
+
+// Calls of one node kind or op, with and without the time of nested calls.
+// A call inside another of the same kind only adds to 'self', so recursion
+// does not count twice.
+typedef struct {
+    long count;
+    double total;
+    double self;
+    int depth;              // Calls of the kind running
+} TraceKind;
+
+// Start of one call of a kind
+typedef struct {
+    double start;
+    double nested;
+} TraceKindMark;
+
+// Kept per worker, so threads never share one
+typedef struct {
+    TraceEvent* events;
+    int num_events;
+    int capacity;
+    TraceKind ops[NUM_IR_OPS];
+    double nested;          // Time of the kinds finished since the running one began
+    Arena names;            // Copies of the event names
+} TraceBuffer;
+
+typedef struct {
+    double origin;
+    TraceBuffer workers[MAX_WORKERS];   // Worker 0 is the main thread
+    TraceKind nodes[NUM_NODE_TYPES];
+} Tracer;
+
+void tracer_init(Tracer* tracer);
+void tracer_free(Tracer* tracer);
+// Forget the node and op counts, before a new compilation is reported
+void trace_reset_kinds(Tracer* tracer);
+// Forget the spans recorded so far, keeping their storage for the next ones
+void trace_clear_events(Tracer* tracer);
+
+double trace_now(void);
+// Time a span; both do nothing when 'tracer' is NULL. 'arena' may be NULL.
+void trace_begin(const Tracer* tracer, TraceMark* mark, const Arena* arena);
+void trace_end(Tracer* tracer, const TraceMark* mark, const char* name, const char* category,
+               int worker, const Arena* arena);
+// Time one call of a kind, which may run inside calls of others; only
+// called with tracing on
+void trace_kind_begin(Tracer* tracer, int worker, TraceKind* kind, TraceKindMark* mark);
+void trace_kind_end(Tracer* tracer, int worker, TraceKind* kind, const TraceKindMark* mark);
+
+// Phases and passes summed by name from event 'first_event' of each worker
+// on, then nodes and ops
+void trace_report(const Tracer* tracer, const int* first_event, FILE* output);
+// Every event as Chrome trace-event JSON; returns nonzero if the file
+// could not be written
+int trace_write(const Tracer* tracer, const char* path);
+
+#endif
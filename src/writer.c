@@ -0,0 +1,139 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <sys/uio.h>
+#include "writer.h"
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+// "00" to "99", so integers come out two digits per step
+static const char digit_pairs[] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+void text_init(TextBuffer* text, size_t capacity) {
+    text->data = NULL;
+    text->size = 0;
+    text->capacity = 0;
+    text_reserve(text, capacity);
+}
+
+void text_free(TextBuffer* text) {
+    free(text->data);
+    text->data = NULL;
+    text->size = 0;
+    text->capacity = 0;
+}
+
+void text_reserve(TextBuffer* text, size_t bytes) {
+    if (text->size + bytes <= text->capacity && text->data) return;
+    size_t capacity = text->capacity ? text->capacity : 4096;
+    while (capacity < text->size + bytes) capacity *= 2;
+    text->data = realloc(text->data, capacity);
+    if (!text->data) {
+        fprintf(stderr, "Error: Out of memory\n");
+        exit(1);
+    }
+    text->capacity = capacity;
+}
+
+void text_append(TextBuffer* text, const char* data, size_t length) {
+    text_reserve(text, length);
+    memcpy(text->data + text->size, data, length);
+    text->size += length;
+}
+
+void text_string(TextBuffer* text, const char* string) {
+    text_append(text, string, strlen(string));
+}
+
+void text_int(TextBuffer* text, long value) {
+    text_reserve(text, TEXT_INT_MAX);
+    text->size = text_put_int(text->data + text->size, value) - text->data;
+}
+
+char* text_put_int(char* p, long value) {
+    unsigned long magnitude = value < 0 ? 0 - (unsigned long)value : (unsigned long)value;
+    if (value < 0) *p++ = '-';
+    if (magnitude < 10) {
+        *p++ = (char)('0' + magnitude);
+        return p;
+    }
+
+    // Digits from the right end of a scratch buffer, two at a time
+    char digits[TEXT_INT_MAX];
+    char* start = digits + sizeof(digits);
+    while (magnitude >= 100) {
+        start -= 2;
+        memcpy(start, digit_pairs + 2 * (magnitude % 100), 2);
+        magnitude /= 100;
+    }
+    if (magnitude >= 10) {
+        start -= 2;
+        memcpy(start, digit_pairs + 2 * magnitude, 2);
+    } else {
+        *--start = (char)('0' + magnitude);
+    }
+    size_t length = digits + sizeof(digits) - start;
+    memcpy(p, start, length);
+    return p + length;
+}
+
+char* text_put_hex(char* p, unsigned int value) {
+    int shift = 28;
+    while (shift > 0 && !(value >> shift)) shift -= 4;
+    for (; shift >= 0; shift -= 4) *p++ = "0123456789ABCDEF"[value >> shift & 0xF];
+    return p;
+}
+
+// Helper function to write a batch of buffers, going on after short writes
+static int write_batch(int fd, struct iovec* vectors, int count) {
+    while (count > 0) {
+        ssize_t written = writev(fd, vectors, count);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return 1;
+        }
+        while (count > 0 && (size_t)written >= vectors->iov_len) {
+            written -= vectors->iov_len;
+            vectors++;
+            count--;
+        }
+        if (count > 0) {
+            vectors->iov_base = (char*)vectors->iov_base + written;
+            vectors->iov_len -= written;
+        }
+    }
+    return 0;
+}
+
+int text_write(FILE* output, const TextBuffer* buffers, int count) {
+    // Streams without a descriptor, such as memory streams, take the text through stdio
+    if (fflush(output) != 0) return 1;
+    int fd = fileno(output);
+    if (fd < 0) {
+        for (int i = 0; i < count; i++) {
+            if (fwrite(buffers[i].data, 1, buffers[i].size, output) != buffers[i].size) return 1;
+        }
+        return 0;
+    }
+
+    struct iovec vectors[IOV_MAX < 1024 ? IOV_MAX : 1024];
+    int batch = (int)(sizeof(vectors) / sizeof(vectors[0]));
+    for (int first = 0; first < count; first += batch) {
+        int used = 0;
+        for (int i = first; i < count && i < first + batch; i++) {
+            if (buffers[i].size == 0) continue;
+            vectors[used].iov_base = buffers[i].data;
+            vectors[used].iov_len = buffers[i].size;
+            used++;
+        }
+        if (write_batch(fd, vectors, used) != 0) return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,38 @@
+// writer.h
+#ifndef WRITER_H
+#define WRITER_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+// Longest text of a 64-bit integer, sign included
+#define TEXT_INT_MAX 20
+
+// Text built up in one growing buffer: pieces are copied in whole, with
+// no format strings, and the buffer only grows when a piece does not fit
+typedef struct {
+    char* data;
+    size_t size;
+    size_t capacity;
+} TextBuffer;
+
+void text_init(TextBuffer* text, size_t capacity);
+void text_free(TextBuffer* text);
+// Make room for 'bytes' more, so they can be written at data + size
+void text_reserve(TextBuffer* text, size_t bytes);
+void text_append(TextBuffer* text, const char* data, size_t length);
+void text_string(TextBuffer* text, const char* string);
+void text_int(TextBuffer* text, long value);
+
+// Write the decimal text of 'value' at 'p', at most TEXT_INT_MAX bytes, and
+// return the end
+char* text_put_int(char* p, long value);
+// Write 'value' in upper-case hexadecimal without a prefix and return the end
+char* text_put_hex(char* p, unsigned int value);
+
+// Write buffers to 'output' in order. A file with a descriptor gets them
+// straight from the buffers, with one writev() per batch of buffers, after
+// whatever the stream held. Returns nonzero if writing failed.
+int text_write(FILE* output, const TextBuffer* buffers, int count);
+
+#endif
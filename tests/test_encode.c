@@ -0,0 +1,316 @@
+// test_encode.c
+// Differential check of the built-in encoder: random programs covering every
+// opcode and operand form the code generator uses are printed as assembly
+// text, assembled with GNU as, and compared against the ELF object written
+// by the encoder, byte for byte in .text and relocation by relocation.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "insn.h"
+#include "object.h"
+
+#define NUM_PROGRAMS 150
+#define MAX_FUNCS 6
+#define MAX_LABELS 12
+#define MAX_FUNC_INSNS 400
+#define NUM_WORD_GLOBALS 4
+#define NUM_BYTE_GLOBALS 2
+
+static unsigned int seed = 2463534242u;
+static char work_dir[] = "/tmp/test_encode.XXXXXX";
+static const char* func_names[] = {"fn0", "fn1", "fn2", "fn3", "fn4", "fn5"};
+static const char* word_globals[] = {"gw0", "gw1", "gw2", "gw3"};
+static const char* byte_globals[] = {"gb0", "gb1"};
+static const int displacements[] = {0, 1, -1, 4, -4, 127, -128, 128, -129, 4096, -70000};
+
+// --- Random instructions ---
+
+static unsigned int random_word(void) {
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    return seed;
+}
+
+static int random_below(int n) {
+    return (int)(random_word() % (unsigned int)n);
+}
+
+// Immediates near the imm8 boundaries, plus any 32-bit value
+static int random_imm(void) {
+    switch (random_below(4)) {
+        case 0: return random_below(256) - 128;
+        case 1: return displacements[random_below(sizeof(displacements) / sizeof(int))];
+        case 2: return (int)random_word();
+        default: return random_below(8);
+    }
+}
+
+// Any of the eight registers, or one with a low byte
+static int random_reg(void) {
+    return random_below(8);
+}
+
+static int random_byte_reg(void) {
+    return random_below(4);
+}
+
+// General-purpose registers only, for instructions writing a register
+static Operand random_dst(void) {
+    return op_reg(random_below(NUM_REGS));
+}
+
+static Operand random_mem(int size) {
+    int displacement = displacements[random_below(sizeof(displacements) / sizeof(int))];
+    switch (random_below(5)) {
+        case 0: {
+            Operand operand = op_global(size, size == 1 ? byte_globals[random_below(NUM_BYTE_GLOBALS)]
+                                                        : word_globals[random_below(NUM_WORD_GLOBALS)]);
+            operand.value = random_below(3) * size;
+            return operand;
+        }
+        case 1:
+            return op_abs(size, random_below(2) ? 0x40000000u : (unsigned int)random_below(4096));
+        case 2: {
+            // Any index but esp, which has no encoding
+            int index = random_below(7);
+            if (index == REG_ESP) index = REG_EBP;
+            Operand operand = op_scaled(random_reg(), index, 1 << random_below(4));
+            operand.size = size;
+            operand.value = displacement;
+            return operand;
+        }
+        default:
+            return op_mem(size, random_reg(), displacement);
+    }
+}
+
+// Register or memory, for read-modify-write instructions
+static Operand random_rm(int size) {
+    if (random_below(2)) return random_mem(size);
+    return size == 1 ? op_reg8(random_byte_reg()) : random_dst();
+}
+
+// Two-operand forms of mov and the arithmetic group
+static void emit_binary(InsnList* code, Opcode op) {
+    int size = random_below(4) ? 4 : 1;
+    Operand reg = size == 1 ? op_reg8(random_byte_reg()) : random_dst();
+    switch (random_below(4)) {
+        case 0:
+            insn_emit(code, op, random_rm(size), op_imm(size == 1 ? random_below(256) - 128 : random_imm()));
+            break;
+        case 1: insn_emit(code, op, random_rm(size), reg); break;
+        case 2: insn_emit(code, op, reg, random_mem(size)); break;
+        default: insn_emit(code, op, reg, size == 1 ? op_reg8(random_byte_reg()) : op_reg(random_reg())); break;
+    }
+}
+
+static void emit_random_insn(InsnList* code, int first_label, int num_labels, int num_funcs) {
+    static const Opcode alu_ops[] = {OP_MOV, OP_ADD, OP_SUB, OP_AND, OP_XOR, OP_CMP};
+    static const Opcode unary_ops[] = {OP_NEG, OP_IMUL_WIDE, OP_IDIV, OP_INC, OP_DEC};
+    static const Opcode shift_ops[] = {OP_SHL, OP_SAR, OP_SHR};
+    switch (random_below(16)) {
+        case 0: case 1: case 2:
+            emit_binary(code, alu_ops[random_below(6)]);
+            break;
+        case 3:
+            if (random_below(2)) insn_emit(code, OP_TEST, random_rm(4), random_dst());
+            else insn_emit(code, OP_TEST, random_rm(4), op_imm(random_imm()));
+            break;
+        case 4: {
+            int kind = random_below(3);
+            Operand src = kind == 0 ? op_imm(random_imm()) : kind == 1 ? random_dst() : random_mem(4);
+            insn_emit(code, OP_IMUL, random_dst(), src);
+            break;
+        }
+        case 5:
+            insn_emit(code, unary_ops[random_below(5)], random_rm(random_below(4) ? 4 : 1), op_none());
+            break;
+        case 6:
+            insn_emit(code, shift_ops[random_below(3)], random_rm(4), op_imm(1 + random_below(31)));
+            break;
+        case 7:
+            insn_emit(code, OP_SETE + random_below(6), op_reg8(random_byte_reg()), op_none());
+            break;
+        case 8:
+            insn_emit(code, OP_LEA, random_dst(), random_mem(0));
+            break;
+        case 9:
+            insn_emit(code, OP_MOVZX, random_dst(), random_rm(1));
+            break;
+        case 10:
+            if (random_below(3)) {
+                int kind = random_below(3);
+                insn_emit(code, OP_PUSH, kind == 0 ? op_reg(random_reg()) : kind == 1 ? random_mem(4)
+                                                   : op_imm(random_imm()), op_none());
+            } else {
+                insn_emit(code, OP_POP, random_rm(4), op_none());
+            }
+            break;
+        case 11:
+            insn_emit(code, OP_CDQ, op_none(), op_none());
+            break;
+        case 12:
+            insn_emit(code, OP_CALL, op_name(func_names[random_below(num_funcs)]), op_none());
+            break;
+        case 13:
+            insn_emit(code, OP_RET, random_below(2) ? op_imm(4 * random_below(4)) : op_none(), op_none());
+            break;
+        case 14:
+            insn_emit(code, random_below(2) ? OP_JMP : OP_JE + random_below(6),
+                      op_label(first_label + random_below(num_labels)), op_none());
+            break;
+        default:
+            insn_emit(code, OP_INT, op_imm(128), op_none());
+            break;
+    }
+}
+
+// One function: its name, then instructions with numbered labels among them
+static void generate_function(InsnList* code, int f, int first_label, int num_funcs) {
+    int num_labels = 1 + random_below(MAX_LABELS);
+    int num_insns = 1 + random_below(random_below(4) ? 60 : MAX_FUNC_INSNS);
+    int next_label = 0;
+    insn_emit(code, OP_LABEL, op_name(func_names[f]), op_none());
+    for (int i = 0; i < num_insns; i++) {
+        while (next_label < num_labels && random_below(num_insns) < num_labels) {
+            insn_emit(code, OP_LABEL, op_label(first_label + next_label++), op_none());
+        }
+        emit_random_insn(code, first_label, num_labels, num_funcs);
+    }
+    while (next_label < num_labels) {
+        insn_emit(code, OP_LABEL, op_label(first_label + next_label++), op_none());
+    }
+}
+
+// --- Comparison ---
+
+// Print a function in GNU as syntax: NASM's size keywords need 'ptr'
+static void print_gas(FILE* output, const InsnList* code) {
+    char line[256];
+    FILE* text = tmpfile();
+    if (!text) {
+        perror("tmpfile");
+        exit(1);
+    }
+    insn_list_print(text, code);
+    rewind(text);
+    while (fgets(line, sizeof(line), text)) {
+        for (char* c = line; *c; c++) {
+            if (strncmp(c, "dword [", 7) == 0 || strncmp(c, "byte [", 6) == 0) {
+                char* bracket = strchr(c, '[');
+                fwrite(c, 1, bracket - c, output);
+                fputs("ptr ", output);
+                c = bracket;
+            }
+            fputc(*c, output);
+        }
+    }
+    fclose(text);
+}
+
+static void run(const char* command) {
+    if (system(command) != 0) {
+        fprintf(stderr, "FAIL: %s\n", command);
+        exit(1);
+    }
+}
+
+static int files_equal(const char* a, const char* b) {
+    FILE* fa = fopen(a, "rb");
+    FILE* fb = fopen(b, "rb");
+    if (!fa || !fb) {
+        fprintf(stderr, "Cannot open %s or %s\n", a, b);
+        exit(1);
+    }
+    int ca, cb;
+    do {
+        ca = fgetc(fa);
+        cb = fgetc(fb);
+    } while (ca == cb && ca != EOF);
+    fclose(fa);
+    fclose(fb);
+    return ca == cb;
+}
+
+// Assemble one random program both ways and compare; returns its instruction count
+static int check_program(int program) {
+    char path[256], command[1024];
+    snprintf(path, sizeof(path), "%s/test.s", work_dir);
+    FILE* source = fopen(path, "w");
+    snprintf(path, sizeof(path), "%s/test.o", work_dir);
+    FILE* object_output = fopen(path, "wb");
+    if (!source || !object_output) {
+        perror(path);
+        exit(1);
+    }
+
+    ObjectFile object;
+    object_init(&object);
+    InsnList code;
+    insn_list_init(&code);
+    int num_funcs = 1 + random_below(MAX_FUNCS);
+    int num_insns = 0;
+    fputs(".intel_syntax noprefix\n.text\n", source);
+    for (int f = 0; f < num_funcs; f++) {
+        code.count = 0;
+        generate_function(&code, f, f * MAX_LABELS, num_funcs);
+        print_gas(source, &code);
+        object_assemble(&object, &code);
+        num_insns += code.count;
+    }
+    fputs(".data\n", source);
+    for (int g = 0; g < NUM_WORD_GLOBALS; g++) {
+        fprintf(source, "%s: .long 0\n", word_globals[g]);
+        object_add_data(&object, word_globals[g], 4);
+    }
+    for (int g = 0; g < NUM_BYTE_GLOBALS; g++) {
+        fprintf(source, "%s: .byte 0\n", byte_globals[g]);
+        object_add_data(&object, byte_globals[g], 1);
+    }
+    fclose(source);
+    object_write(&object, FORMAT_ELF, object_output);
+    fclose(object_output);
+    object_free(&object);
+    insn_list_free(&code);
+
+    // Relocations compare by offset, type and symbol; symbol numbering may differ
+    snprintf(command, sizeof(command),
+             "cd %s && as --32 test.s -o as.o && "
+             "objcopy -O binary -j .text as.o as.text && objcopy -O binary -j .text test.o test.text && "
+             "readelf -rW as.o | awk '/R_386/ {print $1, $3, $5}' > as.rel && "
+             "readelf -rW test.o | awk '/R_386/ {print $1, $3, $5}' > test.rel", work_dir);
+    run(command);
+    const char* kinds[] = {"text", "rel"};
+    for (int k = 0; k < 2; k++) {
+        char ours[256], theirs[256];
+        snprintf(ours, sizeof(ours), "%s/test.%s", work_dir, kinds[k]);
+        snprintf(theirs, sizeof(theirs), "%s/as.%s", work_dir, kinds[k]);
+        if (!files_equal(ours, theirs)) {
+            fprintf(stderr, "FAIL: program %d: .%s differs from GNU as, see %s\n", program, kinds[k], work_dir);
+            exit(1);
+        }
+    }
+    return num_insns;
+}
+
+int main(void) {
+    if (system("as --version >/dev/null 2>&1") != 0 || system("objcopy --version >/dev/null 2>&1") != 0 ||
+        system("readelf --version >/dev/null 2>&1") != 0) {
+        printf("test_encode: skipped, GNU binutils not found\n");
+        return 0;
+    }
+    if (!mkdtemp(work_dir)) {
+        perror("mkdtemp");
+        return 1;
+    }
+
+    long insns = 0;
+    for (int p = 0; p < NUM_PROGRAMS; p++) insns += check_program(p);
+
+    char command[256];
+    snprintf(command, sizeof(command), "rm -rf %s", work_dir);
+    run(command);
+    printf("test_encode: %d programs, %ld instructions match GNU as\n", NUM_PROGRAMS, insns);
+    return 0;
+}
@@ -0,0 +1,91 @@
+// test_mmio.c
+// Device writes and reads, and the order of other side effects, must survive
+// optimization: each program below is run with hiasc --run under several
+// option sets, and every run must exit with the expected status after the
+// expected number of MMIO reads and writes.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define NUM_OPTION_SETS 4
+
+typedef struct {
+    const char* name;
+    const char* source;
+    int status;
+    int reads;
+    int writes;
+} Case;
+
+static const Case cases[] = {
+    // The peephole pass must not merge a load and a store back of a device
+    {"store back", "int m at 0x40000000;\n"
+                   "func int main() { m = 5; m = m; m += 0; return 0; }\n", 0, 2, 3},
+    // Folding 'x * 0', 'x & 0' and 'x % 1' to 0 must keep a device operand's read
+    {"fold reads", "int m at 0x40000000;\nint e at 0x40000004;\n"
+                   "func int main() { int a = m * 0; int b = m & 0; int c = e % 1; int d = 0 * m;\n"
+                   "    return a + b + c + d; }\n", 0, 4, 0},
+    // Operands are not reordered for registers when one calls a function
+    // that writes a global the other reads: f0() runs before g7 is read
+    {"call order", "int g2 = 3;\nint g6 = 4;\nint g7 = 1;\n"
+                   "func int f0() { g7 += 1; return 5; }\n"
+                   "func int main() { return (0 - (f0() + g6)) - ((g2 & g7) + (0 <= g2)); }\n", 244, 0, 0},
+};
+
+static const char* option_sets[NUM_OPTION_SETS] = {"-O0", "-O1", "-O1 --callconv=fastcall", "-O1 -j4"};
+static char work_dir[] = "/tmp/test_mmio.XXXXXX";
+
+static void fail(const char* message) {
+    fprintf(stderr, "FAIL: %s\n", message);
+    exit(1);
+}
+
+// Run one program and read the exit status and MMIO traffic off its report
+static void run_case(const char* hiasc, const Case* test, const char* options) {
+    char path[256], command[1024], line[256];
+    snprintf(path, sizeof(path), "%s/program.hiasm", work_dir);
+    FILE* source = fopen(path, "w");
+    if (!source) fail(path);
+    fputs(test->source, source);
+    fclose(source);
+
+    snprintf(command, sizeof(command), "%s %s --run %s", hiasc, options, path);
+    FILE* report = popen(command, "r");
+    if (!report) fail(command);
+    int status = -1, reads = -1, writes = -1;
+    while (fgets(line, sizeof(line), report)) {
+        sscanf(line, " exited with status %d", &status);
+        if (strstr(line, "MMIO reads")) sscanf(line, "%d", &reads);
+        if (strstr(line, "MMIO writes")) sscanf(line, "%d", &writes);
+    }
+    pclose(report);
+    if (status != test->status || reads != test->reads || writes != test->writes) {
+        fprintf(stderr, "FAIL: %s with %s: status %d after %d reads and %d writes, expected %d after %d and %d\n",
+                test->name, options, status, reads, writes, test->status, test->reads, test->writes);
+        exit(1);
+    }
+}
+
+int main(int argc, char** argv) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: test_mmio hiasc\n");
+        return 1;
+    }
+    if (!mkdtemp(work_dir)) fail("mkdtemp");
+
+    int checks = 0;
+    for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+        for (int o = 0; o < NUM_OPTION_SETS; o++) {
+            run_case(argv[1], &cases[c], option_sets[o]);
+            checks++;
+        }
+    }
+
+    char path[256];
+    snprintf(path, sizeof(path), "%s/program.hiasm", work_dir);
+    remove(path);
+    rmdir(work_dir);
+    printf("test_mmio: %d runs checked\n", checks);
+    return 0;
+}
@@ -0,0 +1,190 @@
+// test_muldiv.c
+// Randomized check of the multiply and divide by constant sequences: every
+// sequence is run on a small x86 register machine and compared against C
+// semantics (wrapping multiplication, division truncating toward zero) for
+// edge-case, byte-range and random operands, under every register assignment
+// the allocator may choose.
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include "insn.h"
+#include "muldiv.h"
+
+#define NUM_RANDOM_CONSTANTS 4000
+#define NUM_RANDOM_OPERANDS 200
+#define MAX_OPERANDS 1024
+
+static unsigned int seed = 2463534242u;
+static long checks = 0;
+static int failures = 0;
+
+// --- Register machine ---
+
+static unsigned int random_word(void) {
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    return seed;
+}
+
+static unsigned int value_of(const unsigned int* regs, const Operand* operand) {
+    if (operand->kind == OPND_IMM) return (unsigned int)operand->value;
+    if (operand->kind == OPND_REG) return regs[operand->reg];
+    fprintf(stderr, "Unexpected operand kind %d\n", operand->kind);
+    exit(1);
+}
+
+// Run a sequence; returns 0 on an instruction the machine does not know
+static int run(const InsnList* code, unsigned int* regs) {
+    for (int i = 0; i < code->count; i++) {
+        const Insn* insn = &code->insns[i];
+        unsigned int* dst = insn->dst.kind == OPND_REG ? &regs[insn->dst.reg] : NULL;
+        int has_value = insn->src.kind == OPND_REG || insn->src.kind == OPND_IMM;
+        unsigned int src = has_value ? value_of(regs, &insn->src) : 0;
+        switch (insn->op) {
+            case OP_MOV: *dst = src; break;
+            case OP_LEA:
+                *dst = regs[insn->src.reg] + regs[insn->src.index] * insn->src.scale +
+                       (unsigned int)insn->src.value;
+                break;
+            case OP_ADD: *dst += src; break;
+            case OP_SUB: *dst -= src; break;
+            case OP_IMUL: *dst *= src; break;
+            case OP_AND: *dst &= src; break;
+            case OP_XOR: *dst ^= src; break;
+            case OP_NEG: *dst = 0u - *dst; break;
+            case OP_SHL: *dst <<= src; break;
+            case OP_SHR: *dst >>= src; break;
+            case OP_SAR: *dst = (unsigned int)((int)*dst >> src); break;
+            case OP_CDQ: regs[REG_EDX] = (int)regs[REG_EAX] < 0 ? 0xFFFFFFFFu : 0; break;
+            case OP_IMUL_WIDE: {
+                long long product = (long long)(int)regs[REG_EAX] * (int)*dst;
+                regs[REG_EAX] = (unsigned int)product;
+                regs[REG_EDX] = (unsigned int)((unsigned long long)product >> 32);
+                break;
+            }
+            default:
+                return 0;
+        }
+    }
+    return 1;
+}
+
+// --- Checks ---
+
+static const char* op_text[] = {"*", "/", "%"};
+
+// Run the sequence for 'n op constant' with the operand in 'src' and the result
+// in 'dst'; registers other than dst and the clobbered ones must survive
+static void check(const InsnList* code, int op, int n, int constant, int src, int dst,
+                  unsigned int clobbers) {
+    unsigned int regs[NUM_REGS];
+    for (int r = 0; r < NUM_REGS; r++) regs[r] = 0xA5A50000u + r;
+    regs[src] = (unsigned int)n;
+    unsigned int before[NUM_REGS];
+    for (int r = 0; r < NUM_REGS; r++) before[r] = regs[r];
+
+    int expected;
+    if (op == 0) {
+        expected = (int)((unsigned int)n * (unsigned int)constant);
+    } else if (constant == -1) {
+        expected = op == 1 ? (int)(0u - (unsigned int)n) : 0;  // INT_MIN / -1 wraps
+    } else {
+        expected = op == 1 ? n / constant : n % constant;
+    }
+
+    checks++;
+    int ok = run(code, regs) && (int)regs[dst] == expected;
+    for (int r = 0; r < NUM_REGS && ok; r++) {
+        if (r != dst && !(clobbers & (1u << r)) && regs[r] != before[r]) ok = 0;
+    }
+    if (!ok && failures++ < 20) {
+        fprintf(stderr, "FAIL: %d %s %d (src r%d, dst r%d) gave %d, expected %d\n",
+                n, op_text[op], constant, src, dst, (int)regs[dst], expected);
+        insn_list_print(stderr, code);
+    }
+}
+
+// Helper function to add an operand unless the list is full
+static void add(int* operands, int* count, long long value) {
+    if (*count < MAX_OPERANDS) operands[(*count)++] = (int)(unsigned int)value;
+}
+
+// Operands near the interesting points of one constant
+static int gather_operands(int* operands, int constant) {
+    static const int edges[] = {0, 1, -1, 2, -2, 7, -7, 100, -100, INT_MAX, INT_MIN,
+                                INT_MAX - 1, INT_MIN + 1, 0x40000000, -0x40000000};
+    int count = 0;
+    for (int i = 0; i < (int)(sizeof(edges) / sizeof(edges[0])); i++) add(operands, &count, edges[i]);
+    for (int i = 0; i < 256; i++) add(operands, &count, i);  // Zero-extended bytes
+    for (int q = -3; q <= 3; q++) {
+        long long base = (long long)constant * q;
+        for (int r = -1; r <= 1; r++) {
+            long long value = base + r;
+            if (value >= INT_MIN && value <= INT_MAX) add(operands, &count, value);
+        }
+    }
+    for (int i = 0; i < NUM_RANDOM_OPERANDS; i++) {
+        unsigned int word = random_word();
+        add(operands, &count, (int)(i & 1 ? word : word >> (word & 31)));
+    }
+    return count;
+}
+
+// Check one constant for all three operators and every register pairing
+static void check_constant(int constant) {
+    static const int dividend_regs[] = {REG_EBX, REG_ECX, REG_ESI, REG_EDI};
+    int operands[MAX_OPERANDS];
+    int num_operands = gather_operands(operands, constant);
+    InsnList code;
+    insn_list_init(&code);
+
+    for (int op = 0; op < 3; op++) {
+        if (op > 0 && constant == 0) break;
+        int num_srcs = op == 0 ? NUM_REGS : 4;
+        unsigned int clobbers = op == 0 ? 0 : (1u << REG_EAX) | (1u << REG_EDX);
+        for (int s = 0; s < num_srcs; s++) {
+            int src = op == 0 ? s : dividend_regs[s];
+            for (int dst = 0; dst < NUM_REGS; dst++) {
+                code.count = 0;
+                if (op == 0) emit_mul_const(&code, dst, src, constant);
+                else emit_div_const(&code, dst, src, constant, op == 2);
+
+                // Every operand under one pairing, the edge cases under the rest
+                int limit = s == 0 && dst == 1 ? num_operands : 15;
+                for (int i = 0; i < limit; i++) {
+                    check(&code, op, operands[i], constant, src, dst, clobbers);
+                }
+            }
+        }
+    }
+    insn_list_free(&code);
+}
+
+int main(void) {
+    for (int c = -1100; c <= 1100; c++) check_constant(c);
+    for (int k = 11; k < 31; k++) {
+        int power = 1 << k;
+        check_constant(power);
+        check_constant(-power);
+        check_constant(power - 1);
+        check_constant(-(power - 1));
+        check_constant(power + 1);
+        check_constant(-(power + 1));
+    }
+    check_constant(INT_MIN);
+    check_constant(INT_MIN + 1);
+    check_constant(INT_MAX);
+    for (int i = 0; i < NUM_RANDOM_CONSTANTS; i++) {
+        unsigned int word = random_word();
+        check_constant((int)(word >> (word & 31)));
+        check_constant((int)word);
+    }
+
+    if (failures > 0) {
+        printf("test_muldiv: %d of %ld checks failed\n", failures, checks);
+        return 1;
+    }
+    printf("test_muldiv: %ld checks passed\n", checks);
+    return 0;
+}
@@ -0,0 +1,250 @@
+// test_server.c
+// Client for hiasc --server: compiles the examples with several option sets
+// over stdin and over a Unix socket, two connections at a time, and checks
+// every output against the same compilation run from the command line. Bad
+// sources and options must come back as errors without ending the session.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#define NUM_SOURCES 3
+#define NUM_OPTION_SETS 5
+
+static const char* sources[] = {"examples/expressions.hiasm", "examples/factorial.hiasm",
+                                "examples/led_blink.hiasm"};
+static const char* option_sets[] = {"", "-O0", "--format=elf", "--format=bin --callconv=fastcall",
+                                    "-j4  --format=elf -O1"};
+static const char* hiasc;
+static char work_dir[] = "/tmp/test_server.XXXXXX";
+static int checks = 0;
+
+typedef struct {
+    unsigned int status;
+    char* output;
+    unsigned int output_length;
+    char* diagnostics;
+    unsigned int diagnostics_length;
+} Response;
+
+static void fail(const char* message) {
+    fprintf(stderr, "FAIL: %s\n", message);
+    exit(1);
+}
+
+static char* read_file(const char* path, unsigned int* length) {
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        perror(path);
+        exit(1);
+    }
+    fseek(file, 0, SEEK_END);
+    *length = (unsigned int)ftell(file);
+    rewind(file);
+    char* data = malloc(*length + 1);
+    if (fread(data, 1, *length, file) != *length) fail("short read");
+    data[*length] = '\0';
+    fclose(file);
+    return data;
+}
+
+// --- Protocol ---
+
+static void write_full(int fd, const void* data, size_t length) {
+    const char* bytes = data;
+    while (length > 0) {
+        ssize_t n = write(fd, bytes, length);
+        if (n <= 0) fail("server closed the connection");
+        bytes += n;
+        length -= n;
+    }
+}
+
+static void read_full(int fd, void* data, size_t length) {
+    char* bytes = data;
+    while (length > 0) {
+        ssize_t n = read(fd, bytes, length);
+        if (n <= 0) fail("server closed the connection");
+        bytes += n;
+        length -= n;
+    }
+}
+
+static void write_string(int fd, const char* data, unsigned int length) {
+    unsigned char bytes[4] = {length & 0xFF, length >> 8 & 0xFF, length >> 16 & 0xFF, length >> 24};
+    write_full(fd, bytes, 4);
+    write_full(fd, data, length);
+}
+
+static unsigned int read_u32(int fd) {
+    unsigned char bytes[4];
+    read_full(fd, bytes, 4);
+    return bytes[0] | bytes[1] << 8 | bytes[2] << 16 | (unsigned int)bytes[3] << 24;
+}
+
+static char* read_string(int fd, unsigned int* length) {
+    *length = read_u32(fd);
+    char* data = malloc(*length + 1);
+    read_full(fd, data, *length);
+    data[*length] = '\0';
+    return data;
+}
+
+static Response request(int in, int out, const char* options, const char* source, unsigned int length) {
+    write_string(out, options, strlen(options));
+    write_string(out, source, length);
+    Response response;
+    response.status = read_u32(in);
+    response.output = read_string(in, &response.output_length);
+    response.diagnostics = read_string(in, &response.diagnostics_length);
+    return response;
+}
+
+static void free_response(Response* response) {
+    free(response->output);
+    free(response->diagnostics);
+}
+
+// --- Checks ---
+
+// Compile a source with hiasc itself and compare with the server's answer
+static void check_against_cli(int in, int out, int s, int o) {
+    char path[256], command[1024];
+    unsigned int source_length, expected_length;
+    char* source = read_file(sources[s], &source_length);
+    snprintf(path, sizeof(path), "%s/expected", work_dir);
+    snprintf(command, sizeof(command), "%s %s %s -o %s", hiasc, option_sets[o], sources[s], path);
+    if (system(command) != 0) fail(command);
+    char* expected = read_file(path, &expected_length);
+
+    Response response = request(in, out, option_sets[o], source, source_length);
+    if (response.status != 0 || response.output_length != expected_length ||
+        memcmp(response.output, expected, expected_length) != 0) {
+        fprintf(stderr, "FAIL: %s '%s': status %u, %u bytes, expected %u\n%s", sources[s], option_sets[o],
+                response.status, response.output_length, expected_length, response.diagnostics);
+        exit(1);
+    }
+    checks++;
+    free_response(&response);
+    free(expected);
+    free(source);
+}
+
+// Errors are reported and the session goes on
+static void check_error(int in, int out, const char* options, const char* source, const char* message) {
+    Response response = request(in, out, options, source, strlen(source));
+    if (response.status != 1 || response.output_length != 0 || !strstr(response.diagnostics, message)) {
+        fprintf(stderr, "FAIL: '%s' with '%s': status %u, diagnostics '%s', expected '%s'\n",
+                source, options, response.status, response.diagnostics, message);
+        exit(1);
+    }
+    checks++;
+    free_response(&response);
+}
+
+static void run_session(int in, int out) {
+    for (int s = 0; s < NUM_SOURCES; s++) {
+        for (int o = 0; o < NUM_OPTION_SETS; o++) check_against_cli(in, out, s, o);
+    }
+    check_error(in, out, "", "func int main() { return 1 +; }", "Expected expression");
+    check_error(in, out, "", "func int main() { asm(\"nop); }", "Unterminated string");
+    check_error(in, out, "", "func int main() { return missing; }", "Undeclared variable");
+    check_error(in, out, "--frobnicate", "func int main() { return 0; }", "Unknown option --frobnicate");
+    check_error(in, out, "--format=coff", "func int main() { return 0; }", "Unknown output format coff");
+    // Errors found while assembling come back too, and the session goes on
+    check_error(in, out, "--format=bin", "func int main() { asm(\"nop\"); return 0; }",
+                "Inline assembly needs --format=asm");
+    check_error(in, out, "--format=bin", "int m at 0x10;\nfunc int main() { m = 1; return 0; }",
+                "overlaps the image");
+    check_against_cli(in, out, 0, 0);
+}
+
+// --- Server processes ---
+
+static pid_t start_server(const char* argument, int* to_server, int* from_server) {
+    int request_pipe[2], response_pipe[2];
+    if (to_server && (pipe(request_pipe) != 0 || pipe(response_pipe) != 0)) fail("pipe");
+    pid_t pid = fork();
+    if (pid < 0) fail("fork");
+    if (pid == 0) {
+        if (to_server) {
+            dup2(request_pipe[0], STDIN_FILENO);
+            dup2(response_pipe[1], STDOUT_FILENO);
+            close(request_pipe[1]);
+            close(response_pipe[0]);
+        }
+        execl(hiasc, hiasc, argument, (char*)NULL);
+        perror(hiasc);
+        _exit(127);
+    }
+    if (to_server) {
+        close(request_pipe[0]);
+        close(response_pipe[1]);
+        *to_server = request_pipe[1];
+        *from_server = response_pipe[0];
+    }
+    return pid;
+}
+
+static int connect_to(const char* socket_path) {
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, socket_path);
+    for (int attempt = 0; attempt < 500; attempt++) {
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd >= 0 && connect(fd, (struct sockaddr*)&address, sizeof(address)) == 0) return fd;
+        if (fd >= 0) close(fd);
+        usleep(10000);
+    }
+    fail("cannot connect to the server socket");
+    return -1;
+}
+
+int main(int argc, char** argv) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: test_server <path to hiasc>\n");
+        return 1;
+    }
+    hiasc = argv[1];
+    signal(SIGPIPE, SIG_IGN);
+    if (!mkdtemp(work_dir)) {
+        perror("mkdtemp");
+        return 1;
+    }
+
+    // stdin and stdout; closing stdin ends the server
+    int to_server, from_server, status;
+    pid_t pid = start_server("--server", &to_server, &from_server);
+    run_session(from_server, to_server);
+    close(to_server);
+    if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        fail("server did not exit cleanly at the end of stdin");
+    }
+    close(from_server);
+
+    // A socket, with one connection left open while another is served
+    char socket_path[256], argument[300];
+    snprintf(socket_path, sizeof(socket_path), "%s/hiasc.sock", work_dir);
+    snprintf(argument, sizeof(argument), "--server=%s", socket_path);
+    pid = start_server(argument, NULL, NULL);
+    int first = connect_to(socket_path);
+    int second = connect_to(socket_path);
+    check_against_cli(first, first, 1, 1);
+    run_session(second, second);
+    close(second);
+    run_session(first, first);
+    close(first);
+    kill(pid, SIGTERM);
+    waitpid(pid, &status, 0);
+
+    char command[256];
+    snprintf(command, sizeof(command), "rm -rf %s", work_dir);
+    if (system(command) != 0) fail(command);
+    printf("test_server: %d requests checked\n", checks);
+    return 0;
+}
@@ -0,0 +1,458 @@
+// gen_hiasm.c
+// Seeded generator of valid HIASM programs for benchmarks: globals in memory,
+// registers and MMIO, then functions that only call earlier ones, then main.
+// The same seed, size and shape always give the same program.
+//
+// Usage: gen_hiasm [--seed=N] [--lines=N] [--shape=mixed|calls|expr|loops|decls]
+//                  [--depth=N] [--nest=N] > program.hiasm
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+
+#define MAX_PARAMS 4
+#define MAX_VARS 256
+
+// Relative weights of each statement kind, and the limits of a shape
+typedef struct {
+    const char* name;
+    int decl, assign, store, call, branch, loop;
+    int depth;              // Deepest expression
+    int nest;               // Deepest statement nesting
+    int min_body, max_body; // Statements at the top of a function
+} Shape;
+
+static const Shape shapes[] = {
+    {"mixed", 4, 6, 1, 2, 2, 2, 4, 3, 4, 16},
+    {"calls", 1, 2, 0, 8, 1, 1, 3, 2, 1, 4},
+    {"expr", 2, 8, 1, 1, 1, 1, 10, 2, 3, 10},
+    {"loops", 2, 4, 1, 1, 2, 6, 3, 6, 2, 8},
+    {"decls", 10, 3, 2, 1, 1, 1, 3, 2, 6, 24},
+};
+
+typedef enum { TYPE_INT, TYPE_BYTE, TYPE_PTR } VarType;
+
+typedef struct {
+    char name[16];
+    VarType type;
+    int writable;           // Loop counters are only read
+} Var;
+
+typedef struct {
+    int num_params;
+    int returns_int;
+} Func;
+
+typedef struct {
+    unsigned long long state;
+    const Shape* shape;
+    int depth;
+    int nest;
+    long lines;
+    int indent;
+    Var vars[MAX_VARS];     // Everything in scope: globals, then parameters and locals
+    int num_vars;
+    int num_globals;
+    Func* funcs;
+    int num_funcs;
+    int funcs_capacity;
+    int next_name;          // Locals are numbered across the program, so never clash
+    char* text;             // The expression being built
+    size_t text_length;
+    size_t text_capacity;
+} Gen;
+
+// Helper function to draw the next random number (splitmix64)
+static unsigned long long next_random(Gen* gen) {
+    unsigned long long z = (gen->state += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+static int random_below(Gen* gen, int n) {
+    return (int)(next_random(gen) % (unsigned long long)n);
+}
+
+static int chance(Gen* gen, int percent) {
+    return random_below(gen, 100) < percent;
+}
+
+// Helper function to write one line of the program at the current indent
+static void line(Gen* gen, const char* format, ...) {
+    printf("%*s", gen->indent * 4, "");
+    va_list args;
+    va_start(args, format);
+    vprintf(format, args);
+    va_end(args);
+    putchar('\n');
+    gen->lines++;
+}
+
+// --- Expressions ---
+
+static void text_add(Gen* gen, const char* format, ...) {
+    va_list args;
+    for (;;) {
+        va_start(args, format);
+        int n = vsnprintf(gen->text + gen->text_length, gen->text_capacity - gen->text_length, format, args);
+        va_end(args);
+        if (gen->text_length + n < gen->text_capacity) {
+            gen->text_length += n;
+            return;
+        }
+        gen->text_capacity = gen->text_capacity * 2 + n + 64;
+        gen->text = realloc(gen->text, gen->text_capacity);
+        if (!gen->text) {
+            fprintf(stderr, "Error: Out of memory\n");
+            exit(1);
+        }
+    }
+}
+
+// Helper function to pick a variable of a type in scope, -1 if there is none
+static int pick_var(Gen* gen, VarType type, int writable) {
+    int start = random_below(gen, gen->num_vars);
+    for (int i = 0; i < gen->num_vars; i++) {
+        int v = (start + i) % gen->num_vars;
+        if (gen->vars[v].type == TYPE_PTR ? type == TYPE_PTR : type != TYPE_PTR) {
+            if (!writable || gen->vars[v].writable) return v;
+        }
+    }
+    return -1;
+}
+
+// Helper function to pick an earlier function, -1 if there is none
+static int pick_callee(Gen* gen, int returns_int) {
+    if (gen->num_funcs == 0) return -1;
+    int start = random_below(gen, gen->num_funcs);
+    for (int i = 0; i < gen->num_funcs && i < 8; i++) {
+        int f = (start + gen->num_funcs - i) % gen->num_funcs;
+        if (!returns_int || gen->funcs[f].returns_int) return f;
+    }
+    return -1;
+}
+
+static void gen_expr(Gen* gen, int depth);
+
+static void gen_call(Gen* gen, int f, int depth) {
+    text_add(gen, "f%d(", f);
+    for (int a = 0; a < gen->funcs[f].num_params; a++) {
+        if (a > 0) text_add(gen, ", ");
+        gen_expr(gen, depth < 2 ? 0 : depth - 2);
+    }
+    text_add(gen, ")");
+}
+
+// Integer leaves: literals, variables, dereferences and the odd call
+static void gen_leaf(Gen* gen) {
+    int kind = random_below(gen, 10);
+    if (kind < 3) {
+        int value = random_below(gen, 4) == 0 ? random_below(gen, 65536) : random_below(gen, 100);
+        text_add(gen, value > 255 && chance(gen, 50) ? "0x%X" : "%d", value);
+        return;
+    }
+    if (kind == 3) {
+        int p = pick_var(gen, TYPE_PTR, 0);
+        if (p >= 0) {
+            text_add(gen, "*%s", gen->vars[p].name);
+            return;
+        }
+    }
+    int v = pick_var(gen, TYPE_INT, 0);
+    if (v >= 0) text_add(gen, "%s", gen->vars[v].name);
+    else text_add(gen, "%d", random_below(gen, 100));
+}
+
+// An int expression at most 'depth' operators deep; division and remainder
+// only by nonzero constants
+static void gen_expr(Gen* gen, int depth) {
+    if (depth <= 0 || chance(gen, 25)) {
+        gen_leaf(gen);
+        return;
+    }
+    int kind = random_below(gen, 20);
+    if (kind == 0) {
+        int f = pick_callee(gen, 1);
+        if (f >= 0) {
+            gen_call(gen, f, depth);
+            return;
+        }
+    }
+    if (kind == 1) {
+        text_add(gen, "-(");
+        gen_expr(gen, depth - 1);
+        text_add(gen, ")");
+        return;
+    }
+    static const char* ops[] = {"+", "-", "*", "&", "<", ">", "<=", ">=", "==", "!="};
+    if (kind <= 3) {
+        text_add(gen, "(");
+        gen_expr(gen, depth - 1);
+        text_add(gen, kind == 2 ? " / %d)" : " %% %d)", 1 + random_below(gen, 15));
+        return;
+    }
+    const char* op = ops[kind < 14 ? (kind - 4) % 4 : 4 + (kind - 14)];
+    text_add(gen, "(");
+    gen_expr(gen, depth - 1);
+    text_add(gen, " %s ", op);
+    gen_expr(gen, depth - 1);
+    text_add(gen, ")");
+}
+
+// Helper function to build an expression into the text buffer
+static const char* expr(Gen* gen, int depth) {
+    gen->text_length = 0;
+    text_add(gen, "");
+    gen_expr(gen, depth);
+    return gen->text;
+}
+
+// --- Statements ---
+
+static int add_var(Gen* gen, const char* prefix, VarType type, int writable) {
+    if (gen->num_vars == MAX_VARS) return -1;
+    Var* var = &gen->vars[gen->num_vars];
+    snprintf(var->name, sizeof(var->name), "%s%d", prefix, gen->next_name++);
+    var->type = type;
+    var->writable = writable;
+    return gen->num_vars++;
+}
+
+static void gen_block(Gen* gen, int statements, int nest);
+
+static void gen_decl(Gen* gen) {
+    int kind = random_below(gen, 4);
+    if (gen->num_vars == MAX_VARS) kind = -1;
+    if (kind == 0) {
+        int v = add_var(gen, "p", TYPE_PTR, 1);
+        line(gen, "ptr %s = alloc(%d);", gen->vars[v].name, 4 * (1 + random_below(gen, 64)));
+    } else if (kind >= 1) {
+        // The initializer cannot see the variable it declares
+        const char* init = expr(gen, gen->depth);
+        VarType type = kind == 2 ? TYPE_BYTE : TYPE_INT;
+        int v = add_var(gen, "v", type, 1);
+        line(gen, "%s%s %s = %s;", kind == 3 ? "reg " : "", type == TYPE_BYTE ? "byte" : "int",
+             gen->vars[v].name, init);
+    }
+}
+
+static void gen_assign(Gen* gen) {
+    int v = pick_var(gen, TYPE_INT, 1);
+    if (v < 0) return;
+    static const char* ops[] = {"=", "=", "+=", "-=", "*="};
+    const char* op = ops[random_below(gen, 5)];
+    line(gen, "%s %s %s;", gen->vars[v].name, op, expr(gen, gen->depth));
+}
+
+static void gen_store(Gen* gen) {
+    int p = pick_var(gen, TYPE_PTR, 0);
+    if (p < 0) {
+        gen_assign(gen);
+        return;
+    }
+    line(gen, "*%s = %s;", gen->vars[p].name, expr(gen, gen->depth));
+}
+
+static void gen_call_statement(Gen* gen) {
+    int f = pick_callee(gen, 0);
+    if (f < 0) {
+        gen_assign(gen);
+        return;
+    }
+    gen->text_length = 0;
+    text_add(gen, "");
+    gen_call(gen, f, gen->depth);
+    int v = gen->funcs[f].returns_int ? pick_var(gen, TYPE_INT, 1) : -1;
+    if (v >= 0) line(gen, "%s = %s;", gen->vars[v].name, gen->text);
+    else line(gen, "%s;", gen->text);
+}
+
+static void gen_branch(Gen* gen, int nest) {
+    line(gen, "if (%s) {", expr(gen, 2));
+    gen_block(gen, 1 + random_below(gen, 3), nest - 1);
+    if (chance(gen, 40)) {
+        line(gen, "} else {");
+        gen_block(gen, 1 + random_below(gen, 3), nest - 1);
+    }
+    line(gen, "}");
+}
+
+// Counted loops only, so every program terminates
+static void gen_loop(Gen* gen, int nest) {
+    int scope = gen->num_vars;
+    int counted = chance(gen, 60);
+    if (counted) {
+        int i = add_var(gen, "i", TYPE_INT, 0);
+        if (i < 0) return;
+        const char* name = gen->vars[i].name;
+        line(gen, "for (%sint %s = 0; %s < %d; %s += 1) {", chance(gen, 30) ? "reg " : "", name, name,
+             2 + random_below(gen, 30), name);
+    } else {
+        int w = add_var(gen, "w", TYPE_INT, 0);
+        if (w < 0) return;
+        const char* name = gen->vars[w].name;
+        line(gen, "int %s = %d;", name, 2 + random_below(gen, 30));
+        line(gen, "while (%s > 0) {", name);
+        gen->indent++;
+        line(gen, "%s -= 1;", name);
+        gen->indent--;
+    }
+    gen_block(gen, 1 + random_below(gen, 4), nest - 1);
+    line(gen, "}");
+    // The while counter stays declared after its loop, still read-only
+    if (counted) gen->num_vars = scope;
+}
+
+static void gen_statement(Gen* gen, int nest) {
+    const Shape* s = gen->shape;
+    int branch = nest > 0 ? s->branch : 0;
+    int loop = nest > 0 ? s->loop : 0;
+    int total = s->decl + s->assign + s->store + s->call + branch + loop;
+    int pick = random_below(gen, total);
+    if ((pick -= s->decl) < 0) gen_decl(gen);
+    else if ((pick -= s->assign) < 0) gen_assign(gen);
+    else if ((pick -= s->store) < 0) gen_store(gen);
+    else if ((pick -= s->call) < 0) gen_call_statement(gen);
+    else if ((pick -= branch) < 0) gen_branch(gen, nest);
+    else gen_loop(gen, nest);
+}
+
+// Statements in a nested scope; its declarations go out of scope after it
+static void gen_block(Gen* gen, int statements, int nest) {
+    int scope = gen->num_vars;
+    gen->indent++;
+    for (int i = 0; i < statements; i++) gen_statement(gen, nest);
+    gen->indent--;
+    gen->num_vars = scope;
+}
+
+// --- Program ---
+
+static void gen_globals(Gen* gen) {
+    line(gen, "// Generated by gen_hiasm --seed=%llu --shape=%s", gen->state, gen->shape->name);
+    for (int g = 0; g < 12; g++) {
+        int kind = g % 6;
+        if (kind == 5) {
+            // Devices are read and written like any global
+            int v = add_var(gen, "m", g % 12 == 5 ? TYPE_BYTE : TYPE_INT, 1);
+            line(gen, "%s %s at 0x%X;", gen->vars[v].type == TYPE_BYTE ? "byte" : "int", gen->vars[v].name,
+                 0x40000000 + 4 * g);
+            continue;
+        }
+        VarType type = kind == 1 ? TYPE_BYTE : TYPE_INT;
+        int v = add_var(gen, "g", type, 1);
+        line(gen, "%s%s %s = %d;", kind == 2 ? "reg " : "", type == TYPE_BYTE ? "byte" : "int",
+             gen->vars[v].name, random_below(gen, 256));
+    }
+    gen->num_globals = gen->num_vars;
+    line(gen, "");
+}
+
+static void gen_function(Gen* gen) {
+    if (gen->num_funcs == gen->funcs_capacity) {
+        gen->funcs_capacity = gen->funcs_capacity ? gen->funcs_capacity * 2 : 256;
+        gen->funcs = realloc(gen->funcs, gen->funcs_capacity * sizeof(Func));
+        if (!gen->funcs) {
+            fprintf(stderr, "Error: Out of memory\n");
+            exit(1);
+        }
+    }
+    Func func = {random_below(gen, MAX_PARAMS + 1), chance(gen, 80)};
+    char params[128] = "";
+    for (int p = 0; p < func.num_params; p++) {
+        int byte = chance(gen, 20);
+        int v = add_var(gen, "a", byte ? TYPE_BYTE : TYPE_INT, 1);
+        snprintf(params + strlen(params), sizeof(params) - strlen(params), "%s%s%s %s",
+                 p > 0 ? ", " : "", chance(gen, 10) ? "reg " : "", byte ? "byte" : "int", gen->vars[v].name);
+    }
+    static const char* conventions[] = {"", "", "", "cdecl ", "fastcall "};
+    line(gen, "func %s%s f%d(%s) {", conventions[random_below(gen, 5)], func.returns_int ? "int" : "void",
+         gen->num_funcs, params);
+
+    const Shape* s = gen->shape;
+    gen_block(gen, s->min_body + random_below(gen, s->max_body - s->min_body + 1), gen->nest);
+    gen->indent++;
+    if (func.returns_int) line(gen, "return %s;", expr(gen, gen->depth));
+    gen->indent--;
+    line(gen, "}");
+    line(gen, "");
+    gen->num_vars = gen->num_globals;
+    gen->funcs[gen->num_funcs++] = func;
+}
+
+static void gen_main(Gen* gen) {
+    line(gen, "func int main() {");
+    gen->indent++;
+    int v = add_var(gen, "v", TYPE_INT, 1);
+    line(gen, "int %s = 0;", gen->vars[v].name);
+    for (int i = 0; i < 8 && gen->num_funcs > 0; i++) {
+        int f = gen->num_funcs - 1 - random_below(gen, gen->num_funcs < 64 ? gen->num_funcs : 64);
+        gen->text_length = 0;
+        text_add(gen, "");
+        gen_call(gen, f, 2);
+        if (gen->funcs[f].returns_int) line(gen, "%s += %s;", gen->vars[v].name, gen->text);
+        else line(gen, "%s;", gen->text);
+    }
+    line(gen, "return %s & 0xFF;", gen->vars[v].name);
+    gen->indent--;
+    line(gen, "}");
+}
+
+// Helper function to read a numeric option; exits on a bad value
+static long long number_option(const char* arg, const char* value, long long min) {
+    char* end;
+    long long n = strtoll(value, &end, 10);
+    if (*value == '\0' || *end != '\0' || n < min) {
+        fprintf(stderr, "Error: Bad value in %s\n", arg);
+        exit(1);
+    }
+    return n;
+}
+
+int main(int argc, char** argv) {
+    Gen gen;
+    memset(&gen, 0, sizeof(gen));
+    gen.state = 1;
+    gen.shape = &shapes[0];
+    long long lines = 1000;
+    int depth = -1, nest = -1;
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        if (strncmp(arg, "--seed=", 7) == 0) {
+            gen.state = (unsigned long long)number_option(arg, arg + 7, 0);
+        } else if (strncmp(arg, "--lines=", 8) == 0) {
+            lines = number_option(arg, arg + 8, 1);
+        } else if (strncmp(arg, "--depth=", 8) == 0) {
+            depth = (int)number_option(arg, arg + 8, 0);
+        } else if (strncmp(arg, "--nest=", 7) == 0) {
+            nest = (int)number_option(arg, arg + 7, 0);
+        } else if (strncmp(arg, "--shape=", 8) == 0) {
+            gen.shape = NULL;
+            for (size_t s = 0; s < sizeof(shapes) / sizeof(shapes[0]); s++) {
+                if (strcmp(arg + 8, shapes[s].name) == 0) gen.shape = &shapes[s];
+            }
+            if (!gen.shape) {
+                fprintf(stderr, "Error: Unknown shape %s\n", arg + 8);
+                return 1;
+            }
+        } else {
+            fprintf(stderr, "Usage: gen_hiasm [--seed=N] [--lines=N] [--shape=mixed|calls|expr|loops|decls] "
+                            "[--depth=N] [--nest=N]\n");
+            return 1;
+        }
+    }
+    gen.depth = depth >= 0 ? depth : gen.shape->depth;
+    gen.nest = nest >= 0 ? nest : gen.shape->nest;
+
+    // Functions until the program is about as long as asked, then main
+    static char buffer[1 << 16];
+    setvbuf(stdout, buffer, _IOFBF, sizeof(buffer));
+    gen_globals(&gen);
+    while (gen.lines + 12 < lines) gen_function(&gen);
+    gen_main(&gen);
+
+    free(gen.funcs);
+    free(gen.text);
+    return fflush(stdout) == 0 ? 0 : 1;
+}
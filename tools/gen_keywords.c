@@ -0,0 +1,134 @@
+// gen_keywords.c
+// Build-time generator for the lexer tables: finds a collision-free hash over
+// the reserved words in src/keywords.def and emits it together with the
+// 256-entry character class table as a C header on stdout.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    const char* name;
+    const char* token;
+} KeywordDef;
+
+static const KeywordDef keywords[] = {
+#define KEYWORD(name, token) {#name, #token},
+#include "keywords.def"
+#undef KEYWORD
+};
+
+#define NUM_KEYWORDS ((int)(sizeof(keywords) / sizeof(keywords[0])))
+
+// Character classes, kept in sync with the CC_* names emitted below
+#define CC_SPACE        0x01
+#define CC_IDENT_START  0x02
+#define CC_IDENT_PART   0x04
+#define CC_DIGIT        0x08
+#define CC_HEX_DIGIT    0x10
+#define CC_NEWLINE      0x20
+
+// Helper function to hash a keyword with candidate multipliers
+static unsigned int hash(const char* name, int length, unsigned int mul1,
+                         unsigned int mul2, unsigned int mask) {
+    return ((unsigned char)name[0] * mul1 + (unsigned char)name[length - 1] * mul2 + length) & mask;
+}
+
+// Helper function to check whether a parameter set maps every keyword to its own slot
+static int is_perfect(unsigned int mul1, unsigned int mul2, unsigned int size) {
+    char used[256] = {0};
+    for (int i = 0; i < NUM_KEYWORDS; i++) {
+        unsigned int slot = hash(keywords[i].name, strlen(keywords[i].name), mul1, mul2, size - 1);
+        if (used[slot]) return 0;
+        used[slot] = 1;
+    }
+    return 1;
+}
+
+// Helper function to classify one byte
+static int classify(int c) {
+    int cls = 0;
+    if (c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f') cls |= CC_SPACE;
+    if (c == '\n') cls |= CC_NEWLINE;
+    if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_') cls |= CC_IDENT_START | CC_IDENT_PART;
+    if (c >= '0' && c <= '9') cls |= CC_DIGIT | CC_IDENT_PART | CC_HEX_DIGIT;
+    if ((c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F')) cls |= CC_HEX_DIGIT;
+    return cls;
+}
+
+int main(void) {
+    unsigned int size, mul1 = 0, mul2 = 0;
+    int found = 0;
+
+    // Smallest power-of-two table first, then the smallest multipliers
+    for (size = 16; size <= 256 && !found; size *= 2) {
+        for (mul1 = 1; mul1 < 256 && !found; mul1++) {
+            for (mul2 = 0; mul2 < 256 && !found; mul2++) {
+                if (is_perfect(mul1, mul2, size)) found = 1;
+            }
+        }
+    }
+    if (!found) {
+        fprintf(stderr, "gen_keywords: no perfect hash found\n");
+        return 1;
+    }
+    // The loops advanced once more after the hit
+    size /= 2;
+    mul1--;
+    mul2--;
+
+    int min_length = 255, max_length = 0;
+    for (int i = 0; i < NUM_KEYWORDS; i++) {
+        int length = strlen(keywords[i].name);
+        if (length < min_length) min_length = length;
+        if (length > max_length) max_length = length;
+    }
+
+    printf("// lexer_tables.h\n");
+    printf("// Generated by tools/gen_keywords.c from src/keywords.def, do not edit\n");
+    printf("#ifndef LEXER_TABLES_H\n#define LEXER_TABLES_H\n\n");
+    printf("// Included from lexer.c after lexer.h, which defines TokenType\n");
+    printf("#include <string.h>\n\n");
+
+    printf("#define CC_SPACE        0x%02x\n", CC_SPACE);
+    printf("#define CC_IDENT_START  0x%02x\n", CC_IDENT_START);
+    printf("#define CC_IDENT_PART   0x%02x\n", CC_IDENT_PART);
+    printf("#define CC_DIGIT        0x%02x\n", CC_DIGIT);
+    printf("#define CC_HEX_DIGIT    0x%02x\n", CC_HEX_DIGIT);
+    printf("#define CC_NEWLINE      0x%02x\n\n", CC_NEWLINE);
+
+    printf("static const unsigned char char_class[256] = {");
+    for (int c = 0; c < 256; c++) {
+        printf("%s0x%02x,", c % 16 ? " " : "\n    ", classify(c));
+    }
+    printf("\n};\n\n");
+
+    printf("typedef struct {\n    const char* name;\n    int length;\n    TokenType type;\n} Keyword;\n\n");
+    printf("static const Keyword keyword_table[%u] = {\n", size);
+    for (unsigned int slot = 0; slot < size; slot++) {
+        int match = -1;
+        for (int i = 0; i < NUM_KEYWORDS; i++) {
+            const char* name = keywords[i].name;
+            if (hash(name, strlen(name), mul1, mul2, size - 1) == slot) match = i;
+        }
+        if (match >= 0) {
+            printf("    {\"%s\", %d, %s},\n", keywords[match].name,
+                   (int)strlen(keywords[match].name), keywords[match].token);
+        } else {
+            printf("    {\"\", 0, TOKEN_IDENT},\n");
+        }
+    }
+    printf("};\n\n");
+
+    printf("// Map an identifier slice to its keyword token, or TOKEN_IDENT\n");
+    printf("static inline TokenType keyword_type(const char* start, int length) {\n");
+    printf("    if (length < %d || length > %d) return TOKEN_IDENT;\n", min_length, max_length);
+    printf("    unsigned int slot = ((unsigned char)start[0] * %uu + "
+           "(unsigned char)start[length - 1] * %uu + length) & %uu;\n", mul1, mul2, size - 1);
+    printf("    const Keyword* keyword = &keyword_table[slot];\n");
+    printf("    if (keyword->length == length && memcmp(keyword->name, start, length) == 0) {\n");
+    printf("        return keyword->type;\n    }\n");
+    printf("    return TOKEN_IDENT;\n}\n\n");
+
+    printf("#endif\n");
+    return 0;
+}